@@ -228,6 +228,13 @@ Device::discover()
                      getConfigRom().getVendorName().c_str(), getConfigRom().getModelName().c_str());
     }
 
+    // base value is the config.h value, can be overridden globally
+    // or in the device section
+    int32_t use_descriptor = BEBOB_DISCOVERY_USE_DESCRIPTOR;
+    c.getValueForSetting("bebob.discovery_use_descriptor", use_descriptor);
+    c.getValueForDeviceSetting(vendorId, modelId, "discovery_use_descriptor", use_descriptor);
+    setDescriptorDiscovery(use_descriptor != 0);
+
     if ( !Unit::discover() ) {
         debugError( "Could not discover unit\n" );
         return false;
@@ -21,6 +21,8 @@
  *
  */
 
+#include "config.h"
+
 #include "bebob/bebob_avplug.h"
 #include "bebob/bebob_avdevice.h"
 #include "libieee1394/configrom.h"
@@ -115,26 +117,43 @@ Plug::~Plug()
 bool
 Plug::discover()
 {
-    if ( !discoverPlugType() ) {
+    bool from_descriptor = false;
+    if ( m_unit->useDescriptorDiscovery()
+         && m_subunit && m_subunit->hasPlugDescriptors() ) {
+        from_descriptor = initFromDescriptor();
+        if ( !from_descriptor ) {
+            debugOutput( DEBUG_LEVEL_VERBOSE,
+                         "plug %d not in descriptor, using plug info commands\n",
+                         m_id );
+            // don't keep a partial result
+            m_name = "";
+            m_nrOfChannels = 0;
+            m_infoPlugType = eAPT_Unknown;
+            m_clusterInfos.clear();
+        }
+    }
+
+    if ( !from_descriptor && !discoverPlugType() ) {
         debugError( "discover: Could not discover plug type (%d,%d,%d,%d,%d)\n",
                     m_unit->getConfigRom().getNodeId(), getSubunitType(), getSubunitId(), m_direction, m_id );
         return false;
     }
 
-    if ( !discoverName() ) {
+    if ( m_name.empty() && !discoverName() ) {
         debugError( "Could not discover name (%d,%d,%d,%d,%d)\n",
                     m_unit->getConfigRom().getNodeId(), getSubunitType(), getSubunitId(), m_direction, m_id );
         return false;
     }
 
-    if ( !discoverNoOfChannels() ) {
+    if ( !from_descriptor && !discoverNoOfChannels() ) {
         debugError( "Could not discover number of channels "
                     "(%d,%d,%d,%d,%d)\n",
                     m_unit->getConfigRom().getNodeId(), getSubunitType(), getSubunitId(), m_direction, m_id );
         return false;
     }
 
-    if ( !discoverChannelPosition() ) {
+    if ( ( !from_descriptor || m_clusterInfos.empty() )
+         && !discoverChannelPosition() ) {
         debugError( "Could not discover channel positions "
                     "(%d,%d,%d,%d,%d)\n",
                     m_unit->getConfigRom().getNodeId(), getSubunitType(), getSubunitId(), m_direction, m_id );
@@ -401,6 +420,10 @@ Plug::discoverChannelName()
               ++pit )
         {
             ChannelInfo* channelInfo = &*pit;
+            if ( !channelInfo->m_name.empty() ) {
+                // already known from the descriptor
+                continue;
+            }
 
             ExtendedPlugInfoCmd extPlugInfoCmd = setPlugAddrToPlugInfoCmd();
             ExtendedPlugInfoInfoType extendedPlugInfoInfoType(
@@ -461,6 +484,10 @@ Plug::discoverClusterInfo()
           ++clit )
     {
         ClusterInfo* clusterInfo = &*clit;
+        if ( !clusterInfo->m_name.empty() ) {
+            // already known from the descriptor
+            continue;
+        }
 
         ExtendedPlugInfoCmd extPlugInfoCmd = setPlugAddrToPlugInfoCmd();
         ExtendedPlugInfoInfoType extendedPlugInfoInfoType(
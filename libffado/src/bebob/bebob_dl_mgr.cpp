@@ -21,6 +21,8 @@
  *
  */
 
+#include "config.h"
+
 #include "bebob_dl_mgr.h"
 #include "bebob_dl_codes.h"
 #include "bebob_dl_bcd.h"
@@ -37,6 +39,7 @@
 #include <cstring>
 #include <unistd.h>
 #include <memory>
+#include <errno.h>
 
 namespace BeBoB {
     enum {
@@ -68,11 +71,13 @@ namespace BeBoB {
         RegInfoDebuggerVersion =         0x64
     };
 
-    enum {
-        MaxRetries = 10,
-    };
-
     IMPL_DEBUG_MODULE( BootloaderManager, BootloaderManager, DEBUG_LEVEL_NORMAL );
+
+    // Serializes the transactions of all managers in the process with the
+    // commands that make a device reset the bus.  While a device switches
+    // between application and bootloader the node ids change, so no other
+    // device may be addressed until the reset happened.
+    static pthread_mutex_t s_busLock = PTHREAD_MUTEX_INITIALIZER;
 }
 
 BeBoB::BootloaderManager::BootloaderManager(Ieee1394Service& ieee1349service,
@@ -80,14 +85,23 @@ BeBoB::BootloaderManager::BootloaderManager(Ieee1394Service& ieee1349service,
     : m_ieee1394service( &ieee1349service )
     , m_protocolVersion( eBPV_Unknown )
     , m_isAppRunning( false )
+    , m_busResetSeen( false )
+    , m_generation( 0 )
+    , m_holdsBusLock( false )
     , m_forceEnabled( false )
     , m_bStartBootloader( true )
+    , m_progressOutput( true )
+    , m_state( eS_Idle )
+    , m_stateStart( 0 )
 {
     memset( &m_cachedInfoRegs, 0, sizeof( m_cachedInfoRegs ) );
+    memset( m_stateUsecs, 0, sizeof( m_stateUsecs ) );
+    memset( m_statePolls, 0, sizeof( m_statePolls ) );
 
     m_configRom = new ConfigRom( *m_ieee1394service, nodeId );
     // XXX throw exception if initialize fails!
     m_configRom->initialize();
+    m_generation = m_ieee1394service->getGeneration();
     if ( !cacheInfoRegisters() ) {
         debugError( "BootloaderManager: could not cache info registers\n" );
     }
@@ -124,17 +138,95 @@ BeBoB::BootloaderManager::~BootloaderManager()
     pthread_mutex_destroy( &m_mutex );
 }
 
+/**
+ * Looks up the node id of the device again when the bus was reset since
+ * it was last resolved, e.g. because another device was switched to or
+ * from its bootloader.
+ */
 bool
-BeBoB::BootloaderManager::cacheInfoRegisters()
+BeBoB::BootloaderManager::resolveNodeId()
 {
+    unsigned int generation = m_ieee1394service->getGeneration();
+    if ( generation == m_generation ) {
+        return true;
+    }
     if ( !m_configRom->updatedNodeId() ) {
-        debugError( "cacheInfoRegisters: did not find device anymore\n" );
+        debugError( "resolveNodeId: did not find device anymore\n" );
         return false;
     }
+    m_generation = generation;
+    return true;
+}
 
-    if ( !m_ieee1394service->read(
-             0xffc0 | m_configRom->getNodeId(),
-             AddrRegInfo,
+void
+BeBoB::BootloaderManager::lockBus()
+{
+    if ( !m_holdsBusLock ) {
+        pthread_mutex_lock( &s_busLock );
+    }
+}
+
+void
+BeBoB::BootloaderManager::unlockBus()
+{
+    if ( !m_holdsBusLock ) {
+        pthread_mutex_unlock( &s_busLock );
+    }
+}
+
+bool
+BeBoB::BootloaderManager::readNode( fb_nodeaddr_t addr, size_t length,
+                                    fb_quadlet_t* buffer )
+{
+    lockBus();
+    bool result = resolveNodeId()
+                  && m_ieee1394service->read( 0xffc0 | m_configRom->getNodeId(),
+                                              addr, length, buffer );
+    unlockBus();
+    return result;
+}
+
+bool
+BeBoB::BootloaderManager::writeNode( fb_nodeaddr_t addr, size_t length,
+                                     fb_quadlet_t* buffer )
+{
+    lockBus();
+    bool result = resolveNodeId()
+                  && m_ieee1394service->write( 0xffc0 | m_configRom->getNodeId(),
+                                               addr, length, buffer );
+    unlockBus();
+    return result;
+}
+
+bool
+BeBoB::BootloaderManager::waitForBusReset( unsigned int timeout_msecs )
+{
+    // pthread_cond_timedwait() uses CLOCK_REALTIME to evaluate its
+    // timeout argument.
+    struct timespec wake;
+    clock_gettime( CLOCK_REALTIME, &wake );
+    wake.tv_sec += timeout_msecs / 1000;
+    wake.tv_nsec += ( timeout_msecs % 1000 ) * 1000000L;
+    if ( wake.tv_nsec >= 1000000000L ) {
+        wake.tv_sec++;
+        wake.tv_nsec -= 1000000000L;
+    }
+    pthread_mutex_lock( &m_mutex );
+    while ( !m_busResetSeen ) {
+        if ( pthread_cond_timedwait( &m_cond, &m_mutex, &wake ) == ETIMEDOUT ) {
+            break;
+        }
+    }
+    bool seen = m_busResetSeen;
+    m_busResetSeen = false;
+    pthread_mutex_unlock( &m_mutex );
+    return seen;
+}
+
+bool
+BeBoB::BootloaderManager::cacheInfoRegisters()
+{
+    if ( !readNode( AddrRegInfo,
              sizeof( m_cachedInfoRegs )/4,
              reinterpret_cast<fb_quadlet_t*>( &m_cachedInfoRegs ) ) )
     {
@@ -153,19 +245,108 @@ BeBoB::BootloaderManager::cacheInfoRegisters()
     return true;
 }
 
+void
+BeBoB::BootloaderManager::setState( EState state )
+{
+    ffado_microsecs_t now = Util::SystemTimeSource::getCurrentTimeAsUsecs();
+    if ( m_state != eS_Idle ) {
+        m_stateUsecs[m_state] += now - m_stateStart;
+    }
+    debugOutput( DEBUG_LEVEL_VERBOSE, "state %s -> %s\n",
+                 getStateName( m_state ), getStateName( state ) );
+    m_state = state;
+    m_stateStart = now;
+}
+
+const char*
+BeBoB::BootloaderManager::getStateName( EState state )
+{
+    switch ( state ) {
+    case eS_Idle:                return "Idle";
+    case eS_StartingBootloader:  return "StartingBootloader";
+    case eS_Erasing:             return "Erasing";
+    case eS_Downloading:         return "Downloading";
+    case eS_Verifying:           return "Verifying";
+    case eS_ResettingConfig:     return "ResettingConfig";
+    case eS_ProgrammingGUID:     return "ProgrammingGUID";
+    case eS_StartingApplication: return "StartingApplication";
+    default:                     return "Unknown";
+    }
+}
+
+void
+BeBoB::BootloaderManager::printTimingReport()
+{
+    ffado_microsecs_t total = 0;
+
+    printf( "Timing report for node %d\n", m_configRom->getNodeId() );
+    for ( int i = eS_Idle + 1; i < eS_NbStates; ++i ) {
+        if ( m_stateUsecs[i] == 0 && m_statePolls[i] == 0 ) {
+            continue;
+        }
+        printf( "\t%-20s %8.3f s, %4u polls\n",
+                getStateName( ( EState )i ),
+                m_stateUsecs[i] / 1000000.0, m_statePolls[i] );
+        total += m_stateUsecs[i];
+    }
+    printf( "\t%-20s %8.3f s\n", "Total", total / 1000000.0 );
+}
+
+/**
+ * Polls until the check succeeds or the timeout expires. The interval
+ * between polls starts at BEBOB_DL_POLL_MIN_MSECS and doubles until
+ * BEBOB_DL_POLL_MAX_MSECS. A bus reset ends the current interval early.
+ */
 bool
-BeBoB::BootloaderManager::cacheInfoRegisters( int retries )
+BeBoB::BootloaderManager::waitUntilReady( ReadyCheck check, CommandCodes* cmd,
+                                          unsigned int timeout_msecs )
 {
-    for ( int i = 0; i < retries; ++i ) {
-        if ( cacheInfoRegisters() ) {
-            return true;
+    ffado_microsecs_t start = Util::SystemTimeSource::getCurrentTimeAsUsecs();
+    ffado_microsecs_t timeout = ( ffado_microsecs_t )timeout_msecs * 1000;
+    unsigned int interval_msecs = BEBOB_DL_POLL_MIN_MSECS;
+    bool progress = false;
+
+    while ( true ) {
+        m_statePolls[m_state]++;
+        bool ready = ( this->*check )( cmd );
+        if ( ready
+             || Util::SystemTimeSource::getCurrentTimeAsUsecs() - start > timeout )
+        {
+            if ( progress ) {
+                printf( "\n" );
+            }
+            if ( !ready && cmd ) {
+                // report what the device answered instead
+                readResponse( *cmd );
+            }
+            return ready;
+        }
+
+        waitForBusReset( interval_msecs );
+
+        if ( m_progressOutput ) {
+            printf( "." );
+            fflush( stdout );
+            progress = true;
+        }
+
+        interval_msecs *= 2;
+        if ( interval_msecs > BEBOB_DL_POLL_MAX_MSECS ) {
+            interval_msecs = BEBOB_DL_POLL_MAX_MSECS;
         }
-        sleep( 1 );
-        printf(".");
-        fflush(stdout);
     }
+}
 
-    return false;
+bool
+BeBoB::BootloaderManager::isBootloaderRunning( CommandCodes* cmd )
+{
+    return cacheInfoRegisters() && !m_isAppRunning;
+}
+
+bool
+BeBoB::BootloaderManager::isResponseReady( CommandCodes* cmd )
+{
+    return readResponse( *cmd, true );
 }
 
 std::string
@@ -267,6 +448,7 @@ BeBoB::BootloaderManager::downloadFirmware( std::string filename )
         printf( "prepare for download (start bootloader)\n" );
         if ( !startBootloaderCmd() ) {
             debugError( "downloadFirmware: Could not start bootloader\n" );
+            setState( eS_Idle );
             return false;
         }
     }
@@ -274,27 +456,32 @@ BeBoB::BootloaderManager::downloadFirmware( std::string filename )
     printf( "start downloading protocol for application image\n" );
     if ( !downloadObject( *bcd, eOT_Application ) ) {
         debugError( "downloadFirmware: Firmware download failed\n" );
+        setState( eS_Idle );
         return false;
     }
 
     printf( "start downloading protocol for CnE\n" );
     if ( !downloadObject( *bcd, eOT_CnE ) ) {
         debugError( "downloadFirmware: CnE download failed\n" );
+        setState( eS_Idle );
         return false;
     }
 
     printf( "setting CnE to factory default settings\n" );
     if ( !initializeConfigToFactorySettingCmd() ) {
         debugError( "downloadFirmware: Could not reinitalize CnE\n" );
+        setState( eS_Idle );
         return false;
     }
 
     printf( "start application\n" );
     if ( !startApplicationCmd() ) {
         debugError( "downloadFirmware: Could not restart application\n" );
+        setState( eS_Idle );
         return false;
     }
 
+    setState( eS_Idle );
     return true;
 }
 
@@ -330,6 +517,7 @@ BeBoB::BootloaderManager::downloadCnE( std::string filename )
         printf( "prepare for download (start bootloader)\n" );
         if ( !startBootloaderCmd() ) {
             debugError( "downloadCnE: Could not start bootloader\n" );
+            setState( eS_Idle );
             return false;
         }
     }
@@ -337,21 +525,25 @@ BeBoB::BootloaderManager::downloadCnE( std::string filename )
     printf( "start downloading protocol for CnE\n" );
     if ( !downloadObject( *bcd, eOT_CnE ) ) {
         debugError( "downloadCnE: CnE download failed\n" );
+        setState( eS_Idle );
         return false;
     }
 
     printf( "setting CnE to factory default settings\n" );
     if ( !initializeConfigToFactorySettingCmd() ) {
         debugError( "downloadFirmware: Could not reinitalize CnE\n" );
+        setState( eS_Idle );
         return false;
     }
 
     printf( "start application\n" );
     if ( !startApplicationCmd() ) {
         debugError( "downloadCnE: Could not restart application\n" );
+        setState( eS_Idle );
         return false;
     }
 
+    setState( eS_Idle );
     return true;
 }
 
@@ -400,18 +592,13 @@ BeBoB::BootloaderManager::downloadObject( BCD& bcd, EObjectType eObject )
         return false;
     }
 
-    // bootloader erases the flash, have to wait until is ready
-    // to answer our next request
+    // bootloader erases the flash, it answers our request
+    // once it is done
     printf( "wait until flash erasing has terminated\n" );
-    int cnt = 30;
-    while(cnt--) {
-        sleep( 1 );
-        printf(".");
-        fflush(stdout);
-    }
-    printf("\n");
-
-    if ( !readResponse( ccDStart ) ) {
+    setState( eS_Erasing );
+    if ( !waitUntilReady( &BootloaderManager::isResponseReady, &ccDStart,
+                          BEBOB_DL_ERASE_TIMEOUT_MSECS ) )
+    {
         debugError( "downloadObject: (start) command read request failed\n" );
         return false;
     }
@@ -428,6 +615,7 @@ BeBoB::BootloaderManager::downloadObject( BCD& bcd, EObjectType eObject )
     bool result = true;
     int totalBytes = imageLength;
     int downloadedBytes = 0;
+    setState( eS_Downloading );
     while ( imageLength > 0 ) {
         unsigned int blockSize = imageLength > maxBlockSize ?
                         maxBlockSize  : imageLength;
@@ -438,11 +626,9 @@ BeBoB::BootloaderManager::downloadObject( BCD& bcd, EObjectType eObject )
             break;
         }
 
-        if ( !get1394Serivce()->write(
-                 0xffc0 | getConfigRom()->getNodeId(),
-                 AddrRegReqBuf,
-                 ( blockSize + 3 ) / 4,
-                 reinterpret_cast<fb_quadlet_t*>( block ) ) )
+        if ( !writeNode( AddrRegReqBuf,
+                         ( blockSize + 3 ) / 4,
+                         reinterpret_cast<fb_quadlet_t*>( block ) ) )
         {
             debugError( "downloadObject: Could not write to node %d\n",
                         getConfigRom()->getNodeId() );
@@ -482,7 +668,7 @@ BeBoB::BootloaderManager::downloadObject( BCD& bcd, EObjectType eObject )
         }
 
         downloadedBytes += blockSize;
-        if ( ( i % 100 ) == 0 ) {
+        if ( m_progressOutput && ( i % 100 ) == 0 ) {
            printf( "%10d/%d bytes downloaded\r",
                    downloadedBytes, totalBytes );
            fflush(stdout);
@@ -509,15 +695,10 @@ BeBoB::BootloaderManager::downloadObject( BCD& bcd, EObjectType eObject )
     }
 
     printf( "wait for transaction completion\n" );
-    cnt = 10;
-    while(cnt--) {
-        sleep( 1 );
-        printf(".");
-        fflush(stdout);
-    }
-    printf("\n");
-
-    if ( !readResponse( ccEnd ) ) {
+    setState( eS_Verifying );
+    if ( !waitUntilReady( &BootloaderManager::isResponseReady, &ccEnd,
+                          BEBOB_DL_COMMAND_TIMEOUT_MSECS ) )
+    {
         debugError( "downloadObject: (end) command read failed\n" );
     }
 
@@ -547,43 +728,34 @@ BeBoB::BootloaderManager::programGUID( fb_octlet_t guid )
     if ( m_bStartBootloader ) {
         if ( !startBootloaderCmd() ) {
             debugError( "programGUID: Could not start bootloader\n" );
+            setState( eS_Idle );
             return false;
         }
     }
 
     if ( !programGUIDCmd( guid ) ) {
         debugError( "programGUID: Could not program guid\n" );
+        setState( eS_Idle );
         return false;
     }
 
     if ( !startApplicationCmd() ) {
         debugError( "Could not restart application\n");
+        setState( eS_Idle );
         return false;
     }
 
+    setState( eS_Idle );
     return true;
 }
 
 void
 BeBoB::BootloaderManager::busresetHandler()
 {
+    pthread_mutex_lock( &m_mutex );
+    m_busResetSeen = true;
     pthread_cond_signal( &m_cond );
-}
-
-void
-BeBoB::BootloaderManager::waitForBusReset()
-{
-    struct timespec timeout;
-    int retcode;
-    // pthread_cond_timedwait() uses CLOCK_REALTIME to evaluate its
-    // timeout argument.
-    clock_gettime(CLOCK_REALTIME, &timeout);
-    do {
-        printf(".");
-        fflush(stdout);
-        timeout.tv_sec = timeout.tv_sec + 1;
-        retcode = pthread_cond_timedwait( &m_cond, &m_mutex, &timeout );
-    } while (retcode == ETIMEDOUT);
+    pthread_mutex_unlock( &m_mutex );
 }
 
 bool
@@ -599,11 +771,9 @@ BeBoB::BootloaderManager::writeRequest( CommandCodes& cmd )
         return false;
     }
 
-    if ( !get1394Serivce()->write(
-             0xffc0 | getConfigRom()->getNodeId(),
-             AddrRegReq,
-             sizeof( buf )/4,
-             reinterpret_cast<fb_quadlet_t*>( buf ) ) )
+    if ( !writeNode( AddrRegReq,
+                     sizeof( buf )/4,
+                     reinterpret_cast<fb_quadlet_t*>( buf ) ) )
     {
         debugError( "writeRequest: Could not ARM write to node %d\n",
                     getConfigRom()->getNodeId() );
@@ -614,15 +784,13 @@ BeBoB::BootloaderManager::writeRequest( CommandCodes& cmd )
 }
 
 bool
-BeBoB::BootloaderManager::readResponse( CommandCodes& writeRequestCmd )
+BeBoB::BootloaderManager::readResponse( CommandCodes& writeRequestCmd, bool quiet )
 {
     const size_t buf_length = 0x40;
     unsigned char raw[buf_length];
-    if ( !get1394Serivce()->read(
-             0xffc0 | getConfigRom()->getNodeId(),
-             AddrRegResp,
-             writeRequestCmd.getRespSizeInQuadlets(),
-             reinterpret_cast<fb_quadlet_t*>( raw ) ) )
+    if ( !readNode( AddrRegResp,
+                    writeRequestCmd.getRespSizeInQuadlets(),
+                    reinterpret_cast<fb_quadlet_t*>( raw ) ) )
     {
         return false;
     }
@@ -642,8 +810,10 @@ BeBoB::BootloaderManager::readResponse( CommandCodes& writeRequestCmd )
     result &=
         writeRequestCmd.getCommandCode()
         == writeRequestCmd.getRespCommandCode();
+    // while polling, a mismatch only means the response of the previous
+    // command is still there, i.e. the device didn't complete this one yet
     #ifdef DEBUG
-       if ( !result ) {
+       if ( !result && !quiet ) {
            debugError( "readResponse: protocol version: %d expected, "
                        " %d reported\n",
                        writeRequestCmd.getProtocolVersion(),
@@ -666,27 +836,31 @@ BeBoB::BootloaderManager::startBootloaderCmd()
 {
     CommandCodesReset cmd( m_protocolVersion,
                            CommandCodesReset::eSM_Bootloader ) ;
-    if ( !writeRequest( cmd ) ) {
+    setState( eS_StartingBootloader );
+
+    // the device resets the bus when it switches to the bootloader,
+    // after which the info registers report the bootloader version.
+    // The other devices are not addressed until then.
+    pthread_mutex_lock( &s_busLock );
+    m_holdsBusLock = true;
+    bool result = writeRequest( cmd );
+    if ( !result ) {
         debugError( "startBootloaderCmd: writeRequest failed\n" );
-        return false;
-    }
-
-    waitForBusReset();
-    if ( !cacheInfoRegisters( MaxRetries ) ) {
+    } else if ( !waitUntilReady( &BootloaderManager::isBootloaderRunning, NULL,
+                                 BEBOB_DL_BOOTLOADER_TIMEOUT_MSECS ) )
+    {
         debugError( "startBootloaderCmd: Could not read info registers\n" );
+        result = false;
+    }
+    m_holdsBusLock = false;
+    pthread_mutex_unlock( &s_busLock );
+    if ( !result ) {
         return false;
     }
 
     // wait for bootloader finish startup sequence
     // there is no way to find out when it has finished
-    sleep( 10 );
-    int cnt = 10;
-    while(cnt--) {
-        sleep( 1 );
-        printf(".");
-        fflush(stdout);
-    }
-    printf("\n");
+    Util::SystemTimeSource::SleepUsecRelative( BEBOB_DL_BOOTLOADER_SETTLE_MSECS * 1000 );
 
     return true;
 }
@@ -696,24 +870,42 @@ BeBoB::BootloaderManager::startApplicationCmd()
 {
     CommandCodesGo cmd( m_protocolVersion,
                            CommandCodesGo::eSM_Application ) ;
-    if ( !writeRequest( cmd ) ) {
+    setState( eS_StartingApplication );
+
+    // the device resets the bus when it leaves the bootloader, the
+    // other devices are not addressed until that happened
+    pthread_mutex_lock( &s_busLock );
+    m_holdsBusLock = true;
+    pthread_mutex_lock( &m_mutex );
+    m_busResetSeen = false;
+    pthread_mutex_unlock( &m_mutex );
+    bool result = writeRequest( cmd );
+    if ( !result ) {
         debugError( "startApplicationCmd: writeRequest failed\n" );
-        return false;
+    } else if ( !waitForBusReset( BEBOB_DL_BOOTLOADER_TIMEOUT_MSECS ) ) {
+        debugWarning( "startApplicationCmd: no bus reset seen\n" );
     }
+    m_holdsBusLock = false;
+    pthread_mutex_unlock( &s_busLock );
 
-    return true;
+    return result;
 }
 
 bool
 BeBoB::BootloaderManager::programGUIDCmd( fb_octlet_t guid )
 {
     CommandCodesProgramGUID cmd( m_protocolVersion, guid );
+    setState( eS_ProgrammingGUID );
     if ( !writeRequest( cmd ) ) {
         debugError( "programGUIDCmd: writeRequest failed\n" );
         return false;
     }
 
-    sleep( 1 );
+    if ( !waitUntilReady( &BootloaderManager::isResponseReady, &cmd,
+                          BEBOB_DL_COMMAND_TIMEOUT_MSECS ) )
+    {
+        debugWarning( "programGUIDCmd: no response from device\n" );
+    }
 
     return true;
 }
@@ -727,7 +919,11 @@ BeBoB::BootloaderManager::initializePersParamCmd()
         return false;
     }
 
-    sleep( 1 );
+    if ( !waitUntilReady( &BootloaderManager::isResponseReady, &cmd,
+                          BEBOB_DL_COMMAND_TIMEOUT_MSECS ) )
+    {
+        debugWarning( "initializePersParamCmd: no response from device\n" );
+    }
 
     return true;
 }
@@ -736,19 +932,17 @@ bool
 BeBoB::BootloaderManager::initializeConfigToFactorySettingCmd()
 {
     CommandCodesInitializeConfigToFactorySetting cmd( m_protocolVersion );
+    setState( eS_ResettingConfig );
     if ( !writeRequest( cmd ) ) {
         debugError( "initializeConfigToFactorySettingCmd: writeRequest failed\n" );
         return false;
     }
 
-    sleep( 5 );
-    int cnt = 5;
-    while(cnt--) {
-        sleep( 1 );
-        printf(".");
-        fflush(stdout);
+    if ( !waitUntilReady( &BootloaderManager::isResponseReady, &cmd,
+                          BEBOB_DL_COMMAND_TIMEOUT_MSECS ) )
+    {
+        debugWarning( "initializeConfigToFactorySettingCmd: no response from device\n" );
     }
-    printf("\n");
 
     return true;
 }
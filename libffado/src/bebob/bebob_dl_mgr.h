@@ -28,6 +28,7 @@
 
 #include "fbtypes.h"
 #include "libutil/Functors.h"
+#include "libutil/SystemTimeSource.h"
 
 #include "debugmodule/debugmodule.h"
 
@@ -67,19 +68,53 @@ namespace BeBoB {
         bool setStartBootloader( bool bStartBootloader )
             { m_bStartBootloader = bStartBootloader; return true; }
 
+        bool setProgressOutput( bool enabled )
+            { m_progressOutput = enabled; return true; }
+
         int getSoftwareVersion() {return m_cachedInfoRegs.m_softwareVersion;};
         std::string getSoftwareDate();
         std::string getSoftwareTime();
 
+        void printTimingReport();
+
         protected:
         enum EObjectType {
             eOT_Application,
             eOT_CnE
         };
 
-        void waitForBusReset();
+        // the states of a download, the time spent in
+        // each of them is reported by printTimingReport()
+        enum EState {
+            eS_Idle = 0,
+            eS_StartingBootloader,
+            eS_Erasing,
+            eS_Downloading,
+            eS_Verifying,
+            eS_ResettingConfig,
+            eS_ProgrammingGUID,
+            eS_StartingApplication,
+            eS_NbStates
+        };
+
+        void setState( EState state );
+        static const char* getStateName( EState state );
+
+        typedef bool ( BootloaderManager::*ReadyCheck )( CommandCodes* cmd );
+        bool waitUntilReady( ReadyCheck check, CommandCodes* cmd,
+                             unsigned int timeout_msecs );
+        bool isBootloaderRunning( CommandCodes* cmd );
+        bool isResponseReady( CommandCodes* cmd );
+
+        bool resolveNodeId();
+        bool readNode( fb_nodeaddr_t addr, size_t length, fb_quadlet_t* buffer );
+        bool writeNode( fb_nodeaddr_t addr, size_t length, fb_quadlet_t* buffer );
+        void lockBus();
+        void unlockBus();
+        bool waitForBusReset( unsigned int timeout_msecs );
+
         bool writeRequest( CommandCodes& cmd );
-        bool readResponse( CommandCodes& writeRequestCmd );
+        bool readResponse( CommandCodes& writeRequestCmd, bool quiet = false );
         bool downloadObject( BCD& bcd, EObjectType eObject );
 
         bool programGUIDCmd( octlet_t guid );
@@ -91,7 +126,6 @@ namespace BeBoB {
 
     private:
         bool cacheInfoRegisters();
-        bool cacheInfoRegisters( int retries );
 
         struct info_register_t {
             fb_octlet_t  m_manId;
@@ -123,11 +157,22 @@ namespace BeBoB {
 
         pthread_mutex_t m_mutex;
         pthread_cond_t  m_cond;
+        bool            m_busResetSeen;
+        // the bus generation for which the node id was resolved
+        unsigned int    m_generation;
+        // this manager resets the bus, see lockBus()
+        bool            m_holdsBusLock;
 
         Functor*        m_functor;
 
             bool            m_forceEnabled;
         bool            m_bStartBootloader;
+        bool            m_progressOutput;
+
+        EState            m_state;
+        ffado_microsecs_t m_stateStart;
+        ffado_microsecs_t m_stateUsecs[eS_NbStates];
+        unsigned int      m_statePolls[eS_NbStates];
 
         DECLARE_DEBUG_MODULE;
     };
@@ -33,6 +33,11 @@ FocusriteDevice::FocusriteDevice( DeviceManager& d, std::auto_ptr<ConfigRom>( co
     : BeBoB::Device( d, configRom)
     , m_cmd_time_interval( 0 )
     , m_earliest_next_cmd_time( 0 )
+    , m_batch_depth( 0 )
+    , m_snapshot_hits( 0 )
+    , m_snapshot_misses( 0 )
+    , m_nb_transactions( 0 )
+    , m_snapshot_lock( "FRSNAP" )
 {
     debugOutput( DEBUG_LEVEL_VERBOSE, "Created BeBoB::Focusrite::FocusriteDevice (NodeID %d)\n",
                  getConfigRom().getNodeId() );
@@ -43,6 +48,8 @@ void
 FocusriteDevice::showDevice()
 {
     debugOutput(DEBUG_LEVEL_NORMAL, "This is a BeBoB::Focusrite::FocusriteDevice\n");
+    debugOutput(DEBUG_LEVEL_NORMAL, " Parameter snapshot: %zd values, %u hits, %u misses, %u transactions\n",
+                m_snapshot.size(), m_snapshot_hits, m_snapshot_misses, m_nb_transactions);
     BeBoB::Device::showDevice();
 }
 
@@ -51,19 +58,23 @@ FocusriteDevice::setVerboseLevel(int l)
 {
     debugOutput( DEBUG_LEVEL_VERBOSE, "Setting verbose level to %d...\n", l );
 
+    m_snapshot_lock.setVerboseLevel(l);
     BeBoB::Device::setVerboseLevel(l);
 }
 
 bool
-FocusriteDevice::setSpecificValue(uint32_t id, uint32_t v)
+FocusriteDevice::useAvcForParameters()
 {
-    debugOutput(DEBUG_LEVEL_VERBOSE, "Writing parameter address space id 0x%08X (%u), data: 0x%08X\n",
-        id, id, v);
     bool use_avc = false;
     if(!getOption("useAvcForParameters", use_avc)) {
         debugWarning("Could not retrieve useAvcForParameters parameter, defaulting to false\n");
     }
+    return use_avc;
+}
 
+void
+FocusriteDevice::waitForCommandSlot()
+{
     // rate control
     ffado_microsecs_t now = Util::SystemTimeSource::getCurrentTimeAsUsecs();
     if(m_cmd_time_interval && (m_earliest_next_cmd_time > now)) {
@@ -72,39 +83,247 @@ FocusriteDevice::setSpecificValue(uint32_t id, uint32_t v)
         Util::SystemTimeSource::SleepUsecRelative(wait);
     }
     m_earliest_next_cmd_time = now + m_cmd_time_interval;
+    m_nb_transactions++;
+}
 
-    if (use_avc) {
-        return setSpecificValueAvc(id, v);
+bool
+FocusriteDevice::setSpecificValue(uint32_t id, uint32_t v)
+{
+    debugOutput(DEBUG_LEVEL_VERBOSE, "Writing parameter address space id 0x%08X (%u), data: 0x%08X\n",
+        id, id, v);
+
+    {
+        Util::MutexLockHelper lock(m_snapshot_lock);
+        if (m_batch_depth > 0) {
+            debugOutput(DEBUG_LEVEL_VERY_VERBOSE, "Queueing write of id %u\n", id);
+            m_pending_writes[id] = v;
+            if (!isVolatileParameter(id)) {
+                m_snapshot[id] = v;
+            }
+            return true;
+        }
+    }
+
+    bool retval;
+    waitForCommandSlot();
+    if (useAvcForParameters()) {
+        retval = setSpecificValueAvc(id, v);
     } else {
-        return setSpecificValueARM(id, v);
+        retval = setSpecificValueARM(id, v);
     }
+
+    if (retval) {
+        storeInSnapshot(id, 1, &v);
+    } else {
+        removeFromSnapshot(id, 1);
+    }
+    return retval;
 }
 
 bool
 FocusriteDevice::getSpecificValue(uint32_t id, uint32_t *v)
 {
     bool retval;
-    bool use_avc = false;
-    if(!getOption("useAvcForParameters", use_avc)) {
-        debugWarning("Could not retrieve useAvcForParameters parameter, defaulting to false\n");
-    }
-
-    // rate control
-    ffado_microsecs_t now = Util::SystemTimeSource::getCurrentTimeAsUsecs();
-    if(m_cmd_time_interval && (m_earliest_next_cmd_time > now)) {
-        ffado_microsecs_t wait = m_earliest_next_cmd_time - now;
-        debugOutput( DEBUG_LEVEL_VERBOSE, "Rate control... %"PRIu64"\n", wait );
-        Util::SystemTimeSource::SleepUsecRelative(wait);
-    }
-    m_earliest_next_cmd_time = now + m_cmd_time_interval;
+    waitForCommandSlot();
 
     // execute
-    if (use_avc) {
+    if (useAvcForParameters()) {
         retval = getSpecificValueAvc(id, v);
     } else {
         retval = getSpecificValueARM(id, v);
     }
     debugOutput(DEBUG_LEVEL_VERBOSE,"Read parameter address space id 0x%08X (%u): %08X\n", id, id, *v);
+
+    if (retval) {
+        storeInSnapshot(id, 1, v);
+    }
+    return retval;
+}
+
+bool
+FocusriteDevice::setSpecificValues(uint32_t first_id, unsigned int count, const uint32_t *v)
+{
+    debugOutput(DEBUG_LEVEL_VERBOSE, "Writing %u parameters from id 0x%08X (%u)\n",
+        count, first_id, first_id);
+    bool retval = true;
+
+    if (useAvcForParameters()) {
+        // there is no AV/C command that carries more than one parameter
+        for (unsigned int i = 0; i < count; i++) {
+            waitForCommandSlot();
+            if (!setSpecificValueAvc(first_id + i, v[i])) {
+                removeFromSnapshot(first_id + i, count - i);
+                return false;
+            }
+            storeInSnapshot(first_id + i, 1, v + i);
+        }
+        return true;
+    }
+
+    waitForCommandSlot();
+    retval = setSpecificValuesARM(first_id, count, v);
+    if (retval) {
+        storeInSnapshot(first_id, count, v);
+        return true;
+    }
+    if (count == 1) {
+        removeFromSnapshot(first_id, count);
+        return false;
+    }
+
+    // not every device (or every part of the parameter space) accepts
+    // block writes, retry them one parameter at a time
+    debugWarning("Block write of %u parameters from id %u failed, writing them separately\n",
+                 count, first_id);
+    retval = true;
+    for (unsigned int i = 0; i < count; i++) {
+        waitForCommandSlot();
+        if (setSpecificValueARM(first_id + i, v[i])) {
+            storeInSnapshot(first_id + i, 1, v + i);
+        } else {
+            removeFromSnapshot(first_id + i, 1);
+            retval = false;
+        }
+    }
+    return retval;
+}
+
+bool
+FocusriteDevice::getSpecificValues(uint32_t first_id, unsigned int count, uint32_t *v)
+{
+    debugOutput(DEBUG_LEVEL_VERBOSE, "Reading %u parameters from id 0x%08X (%u)\n",
+        count, first_id, first_id);
+
+    if (useAvcForParameters()) {
+        for (unsigned int i = 0; i < count; i++) {
+            waitForCommandSlot();
+            if (!getSpecificValueAvc(first_id + i, v + i)) {
+                return false;
+            }
+        }
+    } else {
+        waitForCommandSlot();
+        if (!getSpecificValuesARM(first_id, count, v)) {
+            return false;
+        }
+    }
+    storeInSnapshot(first_id, count, v);
+    return true;
+}
+
+// the snapshot
+void
+FocusriteDevice::storeInSnapshot(uint32_t first_id, unsigned int count, const uint32_t *v)
+{
+    Util::MutexLockHelper lock(m_snapshot_lock);
+    for (unsigned int i = 0; i < count; i++) {
+        if (!isVolatileParameter(first_id + i)) {
+            m_snapshot[first_id + i] = v[i];
+        }
+    }
+}
+
+void
+FocusriteDevice::removeFromSnapshot(uint32_t first_id, unsigned int count)
+{
+    Util::MutexLockHelper lock(m_snapshot_lock);
+    m_snapshot.erase(m_snapshot.lower_bound(first_id),
+                     m_snapshot.lower_bound(first_id + count));
+}
+
+bool
+FocusriteDevice::getCachedValue(uint32_t id, uint32_t *v)
+{
+    if (isVolatileParameter(id)) {
+        return getSpecificValue(id, v);
+    }
+
+    {
+        Util::MutexLockHelper lock(m_snapshot_lock);
+        ParameterMap::iterator it = m_snapshot.find(id);
+        if (it != m_snapshot.end()) {
+            m_snapshot_hits++;
+            *v = it->second;
+            return true;
+        }
+        m_snapshot_misses++;
+    }
+
+    // fetch the whole block the parameter is in, the elements of a
+    // panel tend to be read in order. AV/C can only do one at a time.
+    if (!useAvcForParameters()) {
+        uint32_t block[FR_PARAM_SNAPSHOT_BLOCK];
+        uint32_t first_id = id - (id % FR_PARAM_SNAPSHOT_BLOCK);
+        if (getSpecificValues(first_id, FR_PARAM_SNAPSHOT_BLOCK, block)) {
+            *v = block[id - first_id];
+            return true;
+        }
+        // the block might extend beyond the parameter space
+        debugOutput(DEBUG_LEVEL_VERBOSE,
+                    "Block read for id %u failed, reading it separately\n", id);
+    }
+    return getSpecificValue(id, v);
+}
+
+bool
+FocusriteDevice::updateSnapshot(uint32_t first_id, unsigned int count)
+{
+    std::vector<uint32_t> values(count);
+    return getSpecificValues(first_id, count, &values[0]);
+}
+
+void
+FocusriteDevice::invalidateSnapshot()
+{
+    debugOutput(DEBUG_LEVEL_VERBOSE, "Invalidating parameter snapshot\n");
+    Util::MutexLockHelper lock(m_snapshot_lock);
+    m_snapshot.clear();
+}
+
+// write batches
+void
+FocusriteDevice::beginWriteBatch()
+{
+    Util::MutexLockHelper lock(m_snapshot_lock);
+    m_batch_depth++;
+}
+
+bool
+FocusriteDevice::endWriteBatch()
+{
+    ParameterMap writes;
+    {
+        Util::MutexLockHelper lock(m_snapshot_lock);
+        if (m_batch_depth == 0) {
+            debugWarning("endWriteBatch without beginWriteBatch\n");
+            return false;
+        }
+        if (--m_batch_depth > 0) {
+            return true;
+        }
+        writes.swap(m_pending_writes);
+    }
+
+    debugOutput(DEBUG_LEVEL_VERBOSE, "Flushing %zd queued writes\n", writes.size());
+
+    // send the runs of consecutive parameters as one transaction each
+    bool retval = true;
+    std::vector<uint32_t> values;
+    ParameterMap::iterator it = writes.begin();
+    while (it != writes.end()) {
+        uint32_t first_id = it->first;
+        values.clear();
+        do {
+            values.push_back(it->second);
+            ++it;
+        } while (it != writes.end() && it->first == first_id + values.size());
+
+        if (!setSpecificValues(first_id, values.size(), &values[0])) {
+            debugError("Could not write %zd parameters from id %u\n",
+                       values.size(), first_id);
+            retval = false;
+        }
+    }
     return retval;
 }
 
@@ -195,6 +414,42 @@ FocusriteDevice::getSpecificValueARM(uint32_t id, uint32_t *v)
     return true;
 }
 
+bool
+FocusriteDevice::setSpecificValuesARM(uint32_t first_id, unsigned int count, const uint32_t *v)
+{
+    std::vector<fb_quadlet_t> data(count);
+    for (unsigned int i = 0; i < count; i++) {
+        data[i] = CondSwapToBus32(v[i]);
+    }
+
+    fb_nodeaddr_t addr = FR_PARAM_SPACE_START + (first_id * 4);
+    fb_nodeid_t nodeId = getNodeId() | 0xFFC0;
+
+    if(!get1394Service().write( nodeId, addr, count, &data[0] ) ) {
+        debugOutput(DEBUG_LEVEL_VERBOSE, "Could not write %u quadlets to node 0x%04X addr 0x%012"PRIX64"\n",
+                    count, nodeId, addr);
+        return false;
+    }
+    return true;
+}
+
+bool
+FocusriteDevice::getSpecificValuesARM(uint32_t first_id, unsigned int count, uint32_t *v)
+{
+    fb_nodeaddr_t addr = FR_PARAM_SPACE_START + (first_id * 4);
+    fb_nodeid_t nodeId = getNodeId() | 0xFFC0;
+
+    if(!get1394Service().read( nodeId, addr, count, v ) ) {
+        debugOutput(DEBUG_LEVEL_VERBOSE, "Could not read %u quadlets from node 0x%04X addr 0x%012"PRIX64"\n",
+                    count, nodeId, addr);
+        return false;
+    }
+    for (unsigned int i = 0; i < count; i++) {
+        v[i] = CondSwapFromBus32(v[i]);
+    }
+    return true;
+}
+
 int
 FocusriteDevice::convertDefToSr( uint32_t def ) {
     switch(def) {
@@ -251,8 +506,8 @@ BinaryControl::setValue(int v)
     uint32_t reg;
     uint32_t old_reg;
 
-    if ( !m_Parent.getSpecificValue(m_cmd_id, &reg) ) {
-        debugError( "getSpecificValue failed\n" );
+    if ( !m_Parent.getCachedValue(m_cmd_id, &reg) ) {
+        debugError( "getCachedValue failed\n" );
         return 0;
     }
     
@@ -276,8 +531,8 @@ BinaryControl::getValue()
 {
     uint32_t reg;
 
-    if ( !m_Parent.getSpecificValue(m_cmd_id, &reg) ) {
-        debugError( "getSpecificValue failed\n" );
+    if ( !m_Parent.getCachedValue(m_cmd_id, &reg) ) {
+        debugError( "getCachedValue failed\n" );
         return 0;
     } else {
         bool val= (reg & (1<<m_cmd_bit)) != 0;
@@ -325,8 +580,8 @@ VolumeControl::getValue()
 {
     uint32_t val=0;
 
-    if ( !m_Parent.getSpecificValue(m_cmd_id, &val) ) {
-        debugError( "getSpecificValue failed\n" );
+    if ( !m_Parent.getCachedValue(m_cmd_id, &val) ) {
+        debugError( "getCachedValue failed\n" );
         return 0;
     } else {
         debugOutput(DEBUG_LEVEL_VERBOSE, "getValue for %d = %d\n", 
@@ -436,8 +691,8 @@ VolumeControlLowRes::setValue(int v)
     if (v>0xFF) v=0xFF;
     else if (v<0) v=0;
 
-    if ( !m_Parent.getSpecificValue(m_cmd_id, &reg) ) {
-        debugError( "getSpecificValue failed\n" );
+    if ( !m_Parent.getCachedValue(m_cmd_id, &reg) ) {
+        debugError( "getCachedValue failed\n" );
         return 0;
     }
     
@@ -459,8 +714,8 @@ VolumeControlLowRes::getValue()
 {
     uint32_t val, reg;
 
-    if ( !m_Parent.getSpecificValue(m_cmd_id, &reg) ) {
-        debugError( "getSpecificValue failed\n" );
+    if ( !m_Parent.getCachedValue(m_cmd_id, &reg) ) {
+        debugError( "getCachedValue failed\n" );
         return 0;
     } else {
         val = (reg & 0xFF)>>m_bit_shift;
@@ -592,8 +847,8 @@ double FocusriteMatrixMixer::getValue( const int row, const int col )
     struct sCellInfo c=m_CellInfo.at(row).at(col);
     uint32_t val=0;
 
-    if ( !m_Parent.getSpecificValue(c.address, &val) ) {
-        debugError( "getSpecificValue failed\n" );
+    if ( !m_Parent.getCachedValue(c.address, &val) ) {
+        debugError( "getCachedValue failed\n" );
         return 0;
     } else {
         debugOutput(DEBUG_LEVEL_VERBOSE, "getValue for id %d row %d col %d = %u\n", 
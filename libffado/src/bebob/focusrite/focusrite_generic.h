@@ -32,9 +32,15 @@
 #include "libcontrol/MatrixMixer.h"
 
 #include "libutil/SystemTimeSource.h"
+#include "libutil/PosixMutex.h"
+
+#include <map>
 
 #define FR_PARAM_SPACE_START 0x000100000000LL
 
+// the number of parameters fetched at once when the snapshot misses
+#define FR_PARAM_SNAPSHOT_BLOCK 32
+
 namespace BeBoB {
 namespace Focusrite {
 
@@ -104,6 +110,8 @@ public:
 
     virtual int getMinimum() {return 0;};
     virtual int getMaximum() {return 0x07FFF;};
+
+    virtual bool isLive() {return true;};
 private:
     FocusriteDevice&        m_Parent;
     unsigned int            m_cmd_id;
@@ -164,6 +172,8 @@ public:
 
     virtual int getMinimum() {return 0;};
     virtual int getMaximum() {return 0x07FFF;};
+
+    virtual bool isLive() {return true;};
 private:
     FocusriteDevice&        m_Parent;
     unsigned int            m_cmd_id;
@@ -236,20 +246,76 @@ public:
     bool setSpecificValue(uint32_t id, uint32_t v);
     bool getSpecificValue(uint32_t id, uint32_t *v);
 
+    /**
+     * @brief read/write a range of consecutive parameters
+     *
+     * Done in one transaction when the parameter space is accessed
+     * directly, one command per parameter when AV/C is used.
+     */
+    bool setSpecificValues(uint32_t first_id, unsigned int count, const uint32_t *v);
+    bool getSpecificValues(uint32_t first_id, unsigned int count, uint32_t *v);
+
+    /**
+     * @brief read a parameter from the snapshot of the device state
+     *
+     * The snapshot is filled a block of FR_PARAM_SNAPSHOT_BLOCK parameters
+     * at a time, and kept up to date by the writes that go through this
+     * device. Volatile parameters are always read from the device.
+     */
+    bool getCachedValue(uint32_t id, uint32_t *v);
+    /// re-read a range of parameters into the snapshot
+    bool updateSnapshot(uint32_t first_id, unsigned int count);
+    /// to be called when the device state might have changed behind our back
+    void invalidateSnapshot();
+    unsigned int getSnapshotHits() {return m_snapshot_hits;};
+    unsigned int getSnapshotMisses() {return m_snapshot_misses;};
+
+    /**
+     * @brief group the writes that follow into as few transactions as possible
+     *
+     * Until the matching endWriteBatch() the writes only update the
+     * snapshot. They are then sent in ranges of consecutive parameters.
+     * Batches can be nested, the writes are sent by the outermost one.
+     */
+    void beginWriteBatch();
+    bool endWriteBatch();
+
 protected:
     int convertDefToSr( uint32_t def );
     uint32_t convertSrToDef( int sr );
 
+    /// parameters that the device changes by itself, these are never cached
+    virtual bool isVolatileParameter(uint32_t id) {return false;};
+
 private:
+    void waitForCommandSlot();
+    bool useAvcForParameters();
+
+    void storeInSnapshot(uint32_t first_id, unsigned int count, const uint32_t *v);
+    void removeFromSnapshot(uint32_t first_id, unsigned int count);
+
     bool setSpecificValueAvc(uint32_t id, uint32_t v);
     bool getSpecificValueAvc(uint32_t id, uint32_t *v);
 
     bool setSpecificValueARM(uint32_t id, uint32_t v);
     bool getSpecificValueARM(uint32_t id, uint32_t *v);
 
+    bool setSpecificValuesARM(uint32_t first_id, unsigned int count, const uint32_t *v);
+    bool getSpecificValuesARM(uint32_t first_id, unsigned int count, uint32_t *v);
+
 protected:
     ffado_microsecs_t m_cmd_time_interval;
     ffado_microsecs_t m_earliest_next_cmd_time;
+
+private:
+    typedef std::map<uint32_t, uint32_t> ParameterMap;
+    ParameterMap        m_snapshot;
+    ParameterMap        m_pending_writes;
+    int                 m_batch_depth;
+    unsigned int        m_snapshot_hits;
+    unsigned int        m_snapshot_misses;
+    unsigned int        m_nb_transactions;
+    Util::PosixMutex    m_snapshot_lock;
 };
 
 } // namespace Focusrite
@@ -406,6 +406,21 @@ SaffireDevice::getSupportedSamplingFrequencies()
     return frequencies;
 }
 
+bool
+SaffireDevice::isVolatileParameter(uint32_t id)
+{
+    if(m_isSaffireLE) {
+        return (id >= FR_SAFFIRELE_CMD_ID_METERING_IN1
+                && id <= FR_SAFFIRELE_CMD_ID_AUDIO_ON);
+    } else {
+        return id == FR_SAFFIRE_CMD_ID_MONITOR_DIAL
+               || (id >= FR_SAFFIRE_CMD_ID_METERING_IN1
+                   && id <= FR_SAFFIRE_CMD_ID_METERING_PC10)
+               || id == FR_SAFFIRE_CMD_ID_EXTERNAL_LOCK
+               || id == FR_SAFFIRE_CMD_ID_AUDIO_ON_STATUS;
+    }
+}
+
 void
 SaffireDevice::showDevice()
 {
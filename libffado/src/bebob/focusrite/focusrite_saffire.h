@@ -279,6 +279,9 @@ public:
     virtual bool destroyMixer();
     virtual std::vector<int> getSupportedSamplingFrequencies();
 
+protected:
+    virtual bool isVolatileParameter(uint32_t id);
+
 private:
     Control::Container *m_MixerContainer;
     bool m_isSaffireLE;
@@ -568,6 +568,25 @@ SaffireProDevice::getConfigurationId()
     return id;
 }
 
+bool
+SaffireProDevice::isVolatileParameter(uint32_t id)
+{
+    switch(id) {
+        // the front panel and the status the device reports
+        case FR_SAFFIREPRO_CMD_ID_MONITOR_DIAL:
+        case FR_SAFFIREPRO_CMD_ID_DIM_INDICATOR:
+        case FR_SAFFIREPRO_CMD_ID_MUTE_INDICATOR:
+        case FR_SAFFIREPRO_CMD_ID_EXT_CLOCK_LOCK:
+        case FR_SAFFIREPRO_CMD_ID_AUDIO_ON:
+        case FR_SAFFIREPRO_CMD_ID_USING_HIGHVOLTAGE_RAIL:
+        case FR_SAFFIREPRO_CMD_ID_SYNC_CONFIG:
+        case FR_SAFFIREPRO_CMD_ID_PLAYBACK_COUNT:
+            return true;
+        default:
+            return false;
+    }
+}
+
 bool
 SaffireProDevice::setNickname( std::string name)
 {
@@ -794,6 +813,8 @@ SaffireProDevice::rebootDevice() {
                            FR_SAFFIREPRO_CMD_REBOOT_CODE ) ) {
         debugError( "setSpecificValue failed\n" );
     }
+    // the state of the device is reloaded from its flash
+    invalidateSnapshot();
 }
 
 void
@@ -993,14 +1014,17 @@ SaffireProDevice::setDeviceName(std::string n) {
         name[i] = n.at(i);
     }
 
+    // the name is sent in one transaction
+    beginWriteBatch();
     for (i=0; i<4; i++) {
         char *ptr = (char *) &name[i*4];
         tmp = *((uint32_t *)ptr);
         tmp = CondSwapToBus32(tmp);
-        if ( !setSpecificValue(FR_SAFFIREPRO_CMD_ID_DEVICE_NAME_1 + i, tmp ) ) {
-            debugError( "setSpecificValue failed\n" );
-            return false;
-        }
+        setSpecificValue(FR_SAFFIREPRO_CMD_ID_DEVICE_NAME_1 + i, tmp );
+    }
+    if ( !endWriteBatch() ) {
+        debugError( "setSpecificValue failed\n" );
+        return false;
     }
     return true;
 }
@@ -1008,14 +1032,15 @@ SaffireProDevice::setDeviceName(std::string n) {
 std::string
 SaffireProDevice::getDeviceName() {
     std::string retval="";
+    uint32_t name[4];
     uint32_t tmp;
     unsigned int i;
+    if ( !getSpecificValues(FR_SAFFIREPRO_CMD_ID_DEVICE_NAME_1, 4, name ) ) {
+        debugError( "getSpecificValues failed\n" );
+        return "";
+    }
     for (i=0; i<4; i++) {
-        if ( !getSpecificValue(FR_SAFFIREPRO_CMD_ID_DEVICE_NAME_1 + i, &tmp ) ) {
-            debugError( "getSpecificValue failed\n" );
-            return "";
-        }
-        tmp = CondSwapFromBus32(tmp);
+        tmp = CondSwapFromBus32(name[i]);
         unsigned int j;
         char *ptr = (char *) &tmp;
         for (j=0; j<4; j++) {
@@ -415,6 +415,8 @@ protected:
     virtual uint16_t getConfigurationIdSyncMode();
     virtual uint64_t getConfigurationId();
 
+    virtual bool isVolatileParameter(uint32_t id);
+
 private:
     virtual bool setSamplingFrequencyDo( uint32_t );
     virtual bool setSamplingFrequencyDoNoReboot( uint32_t );
@@ -39,6 +39,9 @@
 #include "debugmodule/debugmodule.h"
 
 #include "libutil/PosixMutex.h"
+#include "libutil/PosixThread.h"
+#include "libutil/SystemTimeSource.h"
+#include "libutil/StartupTrace.h"
 
 #ifdef ENABLE_BEBOB
 #include "bebob/bebob_avdevice.h"
@@ -80,12 +83,22 @@
 #include <iostream>
 #include <sstream>
 
+#include <unistd.h>
+
 #include <algorithm>
 
 using namespace std;
 
 IMPL_DEBUG_MODULE( DeviceManager, DeviceManager, DEBUG_LEVEL_NORMAL );
 
+// discover a device, accounting the time it takes in the startup trace
+static bool
+discoverDevice(FFADODevice *avDevice)
+{
+    Util::TraceSpan span("FFADODevice::discover", avDevice->getConfigRom().getGuidString());
+    return avDevice->discover();
+}
+
 DeviceManager::DeviceManager()
     : Control::Container(NULL, "devicemanager") // this is the control root node
     , m_DeviceListLock( new Util::PosixMutex("DEVLST") )
@@ -94,6 +107,10 @@ DeviceManager::DeviceManager()
     , m_deviceStringParser( new DeviceStringParser() )
     , m_configuration ( new Util::Configuration() )
     , m_used_cache_last_time( false )
+    , m_process_function( NULL )
+    , m_process_arg( NULL )
+    , m_process_task( NULL )
+    , m_process_thread( NULL )
     , m_thread_realtime( false )
     , m_thread_priority( 0 )
 {
@@ -107,6 +124,13 @@ DeviceManager::~DeviceManager()
     if(!m_configuration->save()) {
         debugWarning("could not save configuration\n");
     }
+    // also covers the restarts since the streaming was started
+    Util::StartupTrace::instance()->write();
+
+    // the period thread uses the devices
+    stopProcessThread();
+    delete m_process_thread;
+    delete m_process_task;
 
     m_BusResetLock->Lock(); // make sure we are not handling a busreset.
     m_DeviceListLock->Lock(); // make sure nobody is using this
@@ -178,6 +202,17 @@ DeviceManager::initialize()
     m_configuration->openFile( USER_CONFIG_FILE, Util::Configuration::eFM_ReadWrite );
     m_configuration->openFile( SYSTEM_CONFIG_FILE, Util::Configuration::eFM_ReadOnly );
 
+    int32_t startup_trace = STARTUPTRACE_ENABLE;
+    m_configuration->getValueForSetting("startup_trace.enable", startup_trace);
+    if(startup_trace) {
+        char filename[256];
+        snprintf(filename, sizeof(filename), "%s/ffado-startup-%d.json",
+                 STARTUPTRACE_DUMP_DIR, (int)getpid());
+        Util::StartupTrace::instance()->setFile(filename);
+    }
+    // the settings decide whether the trace is on
+    Util::TraceSpan span("DeviceManager::initialize");
+
     int nb_detected_ports = Ieee1394Service::detectNbPorts();
     if (nb_detected_ports < 0) {
         debugFatal("Failed to detect the number of 1394 adapters. Is the IEEE1394 stack loaded (raw1394)?\n");
@@ -248,8 +283,22 @@ DeviceManager::busresetHandler(Ieee1394Service &service)
     // serialize bus reset handling since it can be that a new one occurs while we're
     // doing stuff.
     debugOutput( DEBUG_LEVEL_NORMAL, "Bus reset detected on service %p...\n", &service );
+
+    // the streams lose some cycles during the reset, which should
+    // not be seen as an xrun before we know whether the streams survived
+    service.getIsoHandlerManager().notifyBusReset();
+
     Util::MutexLockHelper lock(*m_BusResetLock);
     debugOutput( DEBUG_LEVEL_NORMAL, " handling busreset...\n" );
+    ffado_microsecs_t reset_time = service.getLastBusResetTime();
+
+    // The IRM forgets all iso allocations on a bus reset. They have to be
+    // reclaimed within one second (IEC 61883-1), hence this goes first.
+    bool resync_only = service.useBusResetFastPath();
+    if(resync_only && !service.restoreIsoChannels()) {
+        debugOutput(DEBUG_LEVEL_NORMAL, "Iso resources changed by bus reset\n");
+        resync_only = false;
+    }
 
     // FIXME: what if the devices are gone? (device should detect this!)
     // propagate the bus reset to all avDevices
@@ -262,7 +311,16 @@ DeviceManager::busresetHandler(Ieee1394Service &service)
             debugOutput(DEBUG_LEVEL_NORMAL,
                         "issue busreset on device GUID %s\n",
                         (*it)->getConfigRom().getGuidString().c_str());
+            int old_node_id = (*it)->getNodeId();
             (*it)->handleBusReset();
+            // the connections of a device that moved can't be trusted
+            if((*it)->getNodeId() != old_node_id) {
+                debugOutput(DEBUG_LEVEL_NORMAL,
+                            "device GUID %s changed node id from %d to %d\n",
+                            (*it)->getConfigRom().getGuidString().c_str(),
+                            old_node_id, (*it)->getNodeId());
+                resync_only = false;
+            }
         } else {
             debugOutput(DEBUG_LEVEL_NORMAL,
                         "skipping device GUID %s since not on service %p\n",
@@ -271,10 +329,20 @@ DeviceManager::busresetHandler(Ieee1394Service &service)
     }
     m_DeviceListLock->Unlock();
 
+    // cycles lost before the reset was noticed might have caused an xrun,
+    // in that case the streams are restarted anyway
+    if(resync_only && service.getIsoHandlerManager().xrunOccurred()) {
+        debugOutput(DEBUG_LEVEL_NORMAL, "Streams already in xrun\n");
+        resync_only = false;
+    }
+
     // now that the devices have been updates, we can request to update the iso streams
-    if(!service.getIsoHandlerManager().handleBusReset()) {
+    if(!service.getIsoHandlerManager().handleBusReset(resync_only)) {
         debugError("IsoHandlerManager failed to handle busreset\n");
     }
+    debugOutput(DEBUG_LEVEL_NORMAL, "Bus reset %s %"PRIu64" usecs after reset\n",
+                (resync_only ? "ridden out, streams resynchronized" : "handled, streams stopped"),
+                Util::SystemTimeSource::getCurrentTimeAsUsecs() - reset_time);
 
     // notify the streamprocessormanager of the busreset
 //     if(m_processorManager) {
@@ -351,6 +419,7 @@ DeviceManager::unregisterNotification(notif_vec_t& list, Util::Functor *handler)
 bool
 DeviceManager::discover( bool useCache, bool rediscover )
 {
+    Util::TraceSpan span("DeviceManager::discover");
     debugOutput( DEBUG_LEVEL_NORMAL, "Starting discovery...\n" );
     useCache = useCache && ENABLE_DISCOVERY_CACHE;
     m_used_cache_last_time = useCache;
@@ -492,7 +561,7 @@ DeviceManager::discover( bool useCache, bool rediscover )
                     isFromCache = true;
                     // restore the debug level for everything that was loaded
                     avDevice->setVerboseLevel( getDebugLevel() );
-                } else if ( avDevice->discover() ) {
+                } else if ( discoverDevice(avDevice) ) {
                     debugOutput( DEBUG_LEVEL_VERBOSE, "discovery successful\n" );
                 } else {
                     debugError( "could not discover device\n" );
@@ -622,7 +691,7 @@ DeviceManager::discover( bool useCache, bool rediscover )
                         isFromCache = true;
                         // restore the debug level for everything that was loaded
                         avDevice->setVerboseLevel( getDebugLevel() );
-                    } else if ( avDevice->discover() ) {
+                    } else if ( discoverDevice(avDevice) ) {
                         debugOutput( DEBUG_LEVEL_VERBOSE, "discovery successful\n" );
                     } else {
                         debugError( "could not discover device\n" );
@@ -747,7 +816,7 @@ DeviceManager::discover( bool useCache, bool rediscover )
 
             avDevice->setVerboseLevel( getDebugLevel() );
 
-            if ( !avDevice->discover() ) {
+            if ( !discoverDevice(avDevice) ) {
                 debugError( "could not discover device\n" );
                 delete avDevice;
                 return false;
@@ -772,6 +841,7 @@ DeviceManager::discover( bool useCache, bool rediscover )
 bool
 DeviceManager::initStreaming()
 {
+    Util::TraceSpan span("DeviceManager::initStreaming");
     // iterate over the found devices
     // add the stream processors of the devices to the managers
     for ( FFADODeviceVectorIterator it = m_avDevices.begin();
@@ -804,6 +874,7 @@ DeviceManager::initStreaming()
             }
         }
         // prepare the device
+        Util::TraceSpan prepare_span("FFADODevice::prepare", device->getConfigRom().getGuidString());
         device->prepare();
     }
 
@@ -819,6 +890,7 @@ DeviceManager::initStreaming()
 bool
 DeviceManager::prepareStreaming()
 {
+    Util::TraceSpan span("DeviceManager::prepareStreaming");
     if (!m_processorManager->prepare()) {
         debugFatal("Could not prepare streaming...\n");
         return false;
@@ -859,6 +931,9 @@ DeviceManager::startStreamingOnDevice(FFADODevice *device)
     for(j=0; j < device->getStreamCount(); j++) {
         debugOutput(DEBUG_LEVEL_VERBOSE,"Starting stream %d of device %p\n", j, device);
         // start the stream
+        std::ostringstream detail;
+        detail << device->getConfigRom().getGuidString() << " stream " << j;
+        Util::TraceSpan span("FFADODevice::startStreamByIndex", detail.str());
         if (!device->startStreamByIndex(j)) {
             debugWarning("Could not start stream %d of device %p\n", j, device);
             all_streams_started = false;
@@ -887,6 +962,7 @@ DeviceManager::startStreamingOnDevice(FFADODevice *device)
 
 bool
 DeviceManager::startStreaming() {
+    Util::TraceSpan span("DeviceManager::startStreaming");
     bool device_start_failed = false;
     FFADODeviceVectorIterator it;
 
@@ -920,6 +996,11 @@ DeviceManager::startStreaming() {
 
     // start the stream processor manager to tune in to the channels
     if(m_processorManager->start()) {
+        if(m_process_function && !startProcessThread()) {
+            debugError("Could not start the period thread\n");
+            stopStreaming();
+            return false;
+        }
         return true;
     } else {
         debugWarning("Failed to start SPM!\n");
@@ -968,6 +1049,10 @@ bool
 DeviceManager::stopStreaming()
 {
     bool result = true;
+    // the period thread has to be gone before the SP's stop
+    if(!stopProcessThread()) {
+        return false;
+    }
     m_processorManager->stop();
 
     // create the connections for all devices
@@ -1003,14 +1088,88 @@ DeviceManager::waitForPeriod() {
     }
 }
 
+bool
+DeviceManager::setProcessFunction(ProcessFunction f, void *arg)
+{
+    if(m_process_thread) {
+        debugError("Cannot change the process function while streaming\n");
+        return false;
+    }
+    m_process_function = f;
+    m_process_arg = arg;
+    return true;
+}
+
+bool
+DeviceManager::startProcessThread()
+{
+    assert(m_process_thread == NULL);
+    if(m_process_task == NULL) {
+        m_process_task = new ProcessTask(*this);
+        m_process_task->setVerboseLevel(getDebugLevel());
+    }
+    // reset the statistics
+    m_process_task->Init();
+
+    // the period thread takes the place of the client thread, hence it
+    // runs at the base priority
+    m_process_thread = new Util::PosixThread(m_process_task, "PROCESS", m_thread_realtime,
+                                             m_thread_priority, PTHREAD_CANCEL_DEFERRED);
+    m_process_thread->setVerboseLevel(getDebugLevel());
+    if(m_process_thread->Start() != 0) {
+        debugError("Could not start the period thread\n");
+        delete m_process_thread;
+        m_process_thread = NULL;
+        return false;
+    }
+    return true;
+}
+
+bool
+DeviceManager::stopProcessThread()
+{
+    if(m_process_thread == NULL) return true;
+    if(pthread_equal(pthread_self(), m_process_thread->GetThreadID())) {
+        debugError("Streaming cannot be stopped from within the process function\n");
+        return false;
+    }
+    m_process_thread->Stop();
+    delete m_process_thread;
+    m_process_thread = NULL;
+    if(getDebugLevel() >= DEBUG_LEVEL_VERBOSE) {
+        m_process_task->show();
+    }
+    return true;
+}
+
+bool
+DeviceManager::getProcessStatistics(struct ProcessStatistics &stats)
+{
+    if(m_process_task == NULL) return false;
+    // read while the thread is running, so the values are not necessarily
+    // consistent with each other
+    ProcessTask &t = *m_process_task;
+    unsigned int periods = t.m_periods;
+    stats.periods = periods;
+    stats.xruns = t.m_xruns;
+    stats.latency_min_usecs = (periods ? t.m_latency_min : 0);
+    stats.latency_max_usecs = t.m_latency_max;
+    stats.latency_avg_usecs = (periods ? t.m_latency_sum / periods : 0);
+    stats.duration_max_usecs = t.m_duration_max;
+    stats.duration_avg_usecs = (periods ? t.m_duration_sum / periods : 0);
+    return true;
+}
+
 bool
 DeviceManager::setPeriodSize(unsigned int period) {
     // Useful for cases where only the period size needs adjusting
     if (!m_processorManager->streamingParamsOk(period, -1, -1)) {
         return false;
     }
-    m_processorManager->setPeriodSize(period);
-    return true;
+    if (!m_processorManager->setPeriodSize(period)) {
+        return false;
+    }
+    return retuneIsoHandlers();
 }
 
 bool
@@ -1018,10 +1177,31 @@ DeviceManager::setStreamingParams(unsigned int period, unsigned int rate, unsign
     if (!m_processorManager->streamingParamsOk(period, rate, nb_buffers)) {
         return false;
     }
-    m_processorManager->setPeriodSize(period);
+    if (!m_processorManager->setPeriodSize(period)) {
+        return false;
+    }
     m_processorManager->setNominalRate(rate);
     m_processorManager->setNbBuffers(nb_buffers);
-    return true;
+    return retuneIsoHandlers();
+}
+
+/**
+ * The ISO buffer parameters of the handlers depend on the number of
+ * packets in a period, hence they are re-derived when it changes.
+ */
+bool
+DeviceManager::retuneIsoHandlers() {
+    bool retval = true;
+    for ( Ieee1394ServiceVectorIterator it = m_1394Services.begin();
+          it != m_1394Services.end();
+          ++it )
+    {
+        if (!(*it)->getIsoHandlerManager().periodSizeChanged()) {
+            debugWarning("Could not retune the ISO handlers on port %d\n", (*it)->getPort());
+            retval = false;
+        }
+    }
+    return retval;
 }
 
 FFADODevice*
@@ -1292,4 +1472,94 @@ DeviceManager::showDeviceInfo() {
 void
 DeviceManager::showStreamingInfo() {
     m_processorManager->dumpInfo();
+    if(m_process_task) {
+        m_process_task->show();
+    }
+}
+
+// -- ProcessTask -- //
+IMPL_DEBUG_MODULE( ProcessTask, ProcessTask, DEBUG_LEVEL_NORMAL );
+
+ProcessTask::ProcessTask(DeviceManager &parent)
+    : m_parent( parent )
+{
+    Init();
+}
+
+bool
+ProcessTask::Init()
+{
+    m_periods = 0;
+    m_xruns = 0;
+    m_latency_min = 0xFFFFFFFFFFFFFFFFULL;
+    m_latency_max = 0;
+    m_latency_sum = 0;
+    m_duration_max = 0;
+    m_duration_sum = 0;
+    return true;
+}
+
+bool
+ProcessTask::Execute()
+{
+    enum DeviceManager::eWaitResult result = m_parent.waitForPeriod();
+    if(result != DeviceManager::eWR_OK) {
+        // let the client know, the buffers are not transferred
+        if(result == DeviceManager::eWR_Xrun) {
+            m_xruns++;
+        }
+        int retval = m_parent.m_process_function(result, m_parent.m_process_arg);
+        if(result != DeviceManager::eWR_Xrun) {
+            debugOutput(DEBUG_LEVEL_VERBOSE, "Period thread exits (wait result %d)\n", (int)result);
+            return false;
+        }
+        return (retval == 0);
+    }
+
+    Streaming::StreamProcessorManager &spm = m_parent.getStreamProcessorManager();
+    if(!spm.transfer(Streaming::StreamProcessor::ePT_Receive)) {
+        debugWarning("Could not transfer capture buffers\n");
+    }
+
+    uint64_t time_in = Util::SystemTimeSource::getCurrentTimeAsUsecs();
+    int retval = m_parent.m_process_function(result, m_parent.m_process_arg);
+    uint64_t time_out = Util::SystemTimeSource::getCurrentTimeAsUsecs();
+
+    if(!spm.transfer(Streaming::StreamProcessor::ePT_Transmit)) {
+        debugWarning("Could not transfer playback buffers\n");
+    }
+
+    // the wait can return slightly before the scheduled time
+    uint64_t period_at = spm.getSystemTimeAtPeriod();
+    uint64_t latency = (time_in > period_at ? time_in - period_at : 0);
+    uint64_t duration = time_out - time_in;
+    if(latency < m_latency_min) m_latency_min = latency;
+    if(latency > m_latency_max) m_latency_max = latency;
+    if(duration > m_duration_max) m_duration_max = duration;
+    m_latency_sum += latency;
+    m_duration_sum += duration;
+    m_periods++;
+
+    debugOutputExtreme(DEBUG_LEVEL_VERY_VERBOSE,
+                       "period %u: latency %"PRIu64"us, process %"PRIu64"us\n",
+                       m_periods, latency, duration);
+
+    if(retval != 0) {
+        debugOutput(DEBUG_LEVEL_VERBOSE, "Process function requests stop (%d)\n", retval);
+        return false;
+    }
+    return true;
+}
+
+void
+ProcessTask::show()
+{
+    struct DeviceManager::ProcessStatistics stats;
+    if(!m_parent.getProcessStatistics(stats)) return;
+    debugOutputShort(DEBUG_LEVEL_NORMAL, "Period thread: %u periods, %u xruns\n",
+                     stats.periods, stats.xruns);
+    debugOutputShort(DEBUG_LEVEL_NORMAL, " wait-to-callback latency: min %"PRIu64", avg %"PRIu64", max %"PRIu64" usecs\n",
+                     stats.latency_min_usecs, stats.latency_avg_usecs, stats.latency_max_usecs);
+    debugOutputShort(DEBUG_LEVEL_NORMAL, " process function:         avg %"PRIu64", max %"PRIu64" usecs\n",
+                     stats.duration_avg_usecs, stats.duration_max_usecs);
 }
@@ -37,6 +37,7 @@
 
 #include "libutil/Functors.h"
 #include "libutil/Mutex.h"
+#include "libutil/Thread.h"
 #include "libutil/Configuration.h"
 
 #include <vector>
@@ -45,6 +46,7 @@
 class Ieee1394Service;
 class FFADODevice;
 class DeviceStringParser;
+class DeviceManager;
 
 namespace Streaming {
     class StreamProcessor;
@@ -62,6 +64,45 @@ typedef std::vector< Util::Functor* >::iterator FunctorVectorIterator;
 typedef std::vector< ConfigRom* > ConfigRomVector;
 typedef std::vector< ConfigRom* >::iterator ConfigRomVectorIterator;
 
+/**
+ * @brief Runs the client's process function at every period boundary
+ *
+ * This is just another thread that calls waitForPeriod(), transfers the
+ * capture buffers, calls the process function and transfers the playback
+ * buffers, i.e. the loop a client would otherwise run itself. The period
+ * is still handed from the packetizer threads to this thread, the client
+ * only doesn't have to write and schedule the loop.
+ */
+class ProcessTask : public Util::RunnableInterface
+{
+public:
+    ProcessTask(DeviceManager &parent);
+    virtual ~ProcessTask() {};
+
+    bool Init();
+    bool Execute();
+
+    void show();
+    void setVerboseLevel(int l) {setDebugLevel(l);};
+
+private:
+    DeviceManager &m_parent;
+
+    // statistics, all times in usecs
+    unsigned int m_periods;
+    unsigned int m_xruns;
+    uint64_t m_latency_min;
+    uint64_t m_latency_max;
+    uint64_t m_latency_sum;
+    uint64_t m_duration_max;
+    uint64_t m_duration_sum;
+
+    friend class DeviceManager;
+
+protected:
+    DECLARE_DEBUG_MODULE;
+};
+
 class DeviceManager
     : public Util::OptionContainer,
       public Control::Container
@@ -95,6 +136,39 @@ public:
     bool stopStreaming();
     bool resetStreaming();
     enum eWaitResult waitForPeriod();
+
+    /**
+     * @brief the process function called by the library's period thread
+     * @param result the outcome of the wait for the period. The buffers
+     *               are only transferred for eWR_OK.
+     * @param arg the argument passed to setProcessFunction()
+     * @return 0 to continue, anything else stops the period thread
+     */
+    typedef int (*ProcessFunction)(enum eWaitResult result, void *arg);
+    /**
+     * @brief let the library drive the period loop
+     *
+     * When a process function is set, startStreaming() starts a thread
+     * that waits for the periods and calls the function, stopStreaming()
+     * stops it again. Has to be set while streaming is stopped, NULL
+     * disables it.
+     */
+    bool setProcessFunction(ProcessFunction f, void *arg);
+
+    struct ProcessStatistics {
+        unsigned int periods;
+        unsigned int xruns;
+        // time from the scheduled period boundary until the process
+        // function is entered, this includes the capture decoding
+        uint64_t latency_min_usecs;
+        uint64_t latency_max_usecs;
+        uint64_t latency_avg_usecs;
+        // time spent in the process function
+        uint64_t duration_max_usecs;
+        uint64_t duration_avg_usecs;
+    };
+    /// the statistics of the period thread since streaming was started
+    bool getProcessStatistics(struct ProcessStatistics &stats);
     bool setPeriodSize(unsigned int period);
     bool setStreamingParams(unsigned int period, unsigned int rate, unsigned int nb_buffers);
 
@@ -151,6 +225,7 @@ protected:
     FFADODevice* getSlaveDriver( std::auto_ptr<ConfigRom>( configRom ) );
 
     void busresetHandler(Ieee1394Service &);
+    bool retuneIsoHandlers();
 
 protected:
     // we have one service for each port
@@ -178,6 +253,15 @@ private:
     notif_vec_t                           m_preUpdateNotifiers;
     notif_vec_t                           m_postUpdateNotifiers;
 
+    // the library driven period loop
+    ProcessFunction                       m_process_function;
+    void*                                 m_process_arg;
+    ProcessTask*                          m_process_task;
+    Util::Thread*                         m_process_thread;
+    bool startProcessThread();
+    bool stopProcessThread();
+    friend class ProcessTask;
+
     bool registerNotification(notif_vec_t&, Util::Functor *);
     bool unregisterNotification(notif_vec_t&, Util::Functor *);
     void signalNotifiers(notif_vec_t& list);
@@ -25,6 +25,7 @@
 
 #include "dice/dice_avdevice.h"
 #include "dice/dice_defines.h"
+#include "dice/dice_eap.h"
 
 #include "libieee1394/configrom.h"
 #include "libieee1394/ieee1394service.h"
@@ -1829,14 +1830,20 @@ Device::writeRegBlock(fb_nodeaddr_t offset, fb_quadlet_t *data, size_t length) {
         return false;
     }
 
-    fb_quadlet_t data_out[length/4];
+    if(length == 0) {
+        return true;
+    }
+
+    // round to next full quadlet, the partial one is padded with zeros
+    int length_quads = (length+3)/4;
+    fb_quadlet_t data_out[length_quads];
+    data_out[length_quads - 1] = 0;
     memcpy(data_out, data, length);
-    byteSwapToBus(data_out, length/4);
+    byteSwapToBus(data_out, length_quads);
 
     fb_nodeaddr_t addr = DICE_REGISTER_BASE + offset;
     fb_nodeid_t nodeId = getNodeId() | 0xFFC0;
     int quads_done = 0;
-    int length_quads = (length+3)/4;
     while(quads_done < length_quads) {
         fb_nodeaddr_t curr_addr = addr + quads_done*4;
         fb_quadlet_t *curr_data = data_out + quads_done;
@@ -1851,7 +1858,7 @@ Device::writeRegBlock(fb_nodeaddr_t offset, fb_quadlet_t *data, size_t length) {
         }
         #endif
 
-        if(!get1394Service().write( nodeId, addr, quads_todo, curr_data ) ) {
+        if(!get1394Service().write( nodeId, curr_addr, quads_todo, curr_data ) ) {
             debugError("Could not write %d quadlets to node 0x%04X addr 0x%012"PRIX64"\n", quads_todo, nodeId, curr_addr);
             return false;
         }
@@ -2065,4 +2072,34 @@ Device::Notifier::~Notifier()
 
 }
 
+bool
+Device::Notifier::handleWrite(struct raw1394_arm_request *arm_req)
+{
+    if(arm_req->buffer_length < 4) {
+        debugWarning("Short notification: %u bytes\n", arm_req->buffer_length);
+        return false;
+    }
+    fb_quadlet_t notification = CondSwapFromBus32(*((fb_quadlet_t *)arm_req->buffer));
+    debugOutput(DEBUG_LEVEL_VERBOSE, "Notification: 0x%08X\n", notification);
+
+    // anything but the streaming related bits means that the device
+    // (possibly its front panel or standalone logic) changed its state,
+    // the mixer image can no longer be trusted
+    const fb_quadlet_t streaming_bits = DICE_NOTIFY_RX_CFG_CHG_BIT | DICE_NOTIFY_TX_CFG_CHG_BIT
+                                      | DICE_NOTIFY_DUP_ISOC_BIT | DICE_NOTIFY_BW_ERR_BIT
+                                      | DICE_NOTIFY_LOCK_CHG_BIT | DICE_NOTIFY_CLOCK_ACCEPTED;
+    if((notification & ~streaming_bits) && m_device.m_eap) {
+        if(m_device.m_eap->getMixer()) {
+            debugOutput(DEBUG_LEVEL_VERBOSE, "Invalidating mixer coefficient cache\n");
+            m_device.m_eap->getMixer()->invalidateCoefficients();
+        }
+        // we don't know which of the controls changed
+        m_device.m_eap->notifyValueChanged();
+    }
+    if(notification & (DICE_NOTIFY_LOCK_CHG_BIT | DICE_NOTIFY_CLOCK_ACCEPTED)) {
+        m_device.notifyClockStateChanged();
+    }
+    return true;
+}
+
 }
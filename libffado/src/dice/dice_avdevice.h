@@ -90,6 +90,11 @@ public:
     virtual DICE_FL_INFO_PARAM* showFlashInfoFL(bool v = true);
     virtual bool showAppInfoFL();
 
+private: // firmware loader helpers
+    bool executeFL(fb_quadlet_t opcode, unsigned int timeout_msecs);
+    friend class FLOpcodeStatus;
+public:
+
     virtual bool onSamplerateChange( int oldSamplingFrequency );
     virtual bool setSamplingFrequency( int samplingFrequency );
     virtual int getSamplingFrequency( );
@@ -251,6 +256,8 @@ public:
         Notifier(Device &, nodeaddr_t start);
         virtual ~Notifier();
 
+        virtual bool handleWrite(struct raw1394_arm_request *);
+
     private:
         Device &m_device;
     };
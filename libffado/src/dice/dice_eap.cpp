@@ -28,6 +28,7 @@
 
 #include "libutil/SystemTimeSource.h"
 #include "libutil/ByteSwap.h"
+#include "libutil/PosixMutex.h"
 
 #include <cstdio>
 
@@ -1159,6 +1160,10 @@ EAP::Mixer::Mixer(EAP &p)
 : Control::MatrixMixer(&p.m_device, "MatrixMixer")
 , m_eap(p)
 , m_coeff(NULL)
+, m_coeff_valid(false)
+, m_dirty_first(-1)
+, m_dirty_last(-1)
+, m_lock(new Util::PosixMutex("DICEMIX"))
 , m_debugModule(p.m_debugModule)
 {
 }
@@ -1169,6 +1174,7 @@ EAP::Mixer::~Mixer()
         free(m_coeff);
         m_coeff = NULL;
     }
+    delete m_lock;
 }
 
 bool
@@ -1190,6 +1196,7 @@ EAP::Mixer::init()
     int nb_outputs = m_eap.m_mixer_nb_rx;
 
     m_coeff = (fb_quadlet_t *)calloc(nb_outputs * nb_inputs, sizeof(fb_quadlet_t));
+    m_dirty_first = m_dirty_last = -1;
 
     // load initial values
     if(!loadCoefficients()) {
@@ -1202,6 +1209,13 @@ EAP::Mixer::init()
 
 bool
 EAP::Mixer::loadCoefficients()
+{
+    Util::MutexLockHelper lock(*m_lock);
+    return loadCoefficientsNoLock();
+}
+
+bool
+EAP::Mixer::loadCoefficientsNoLock()
 {
     if(m_coeff == NULL) {
         debugError("Coefficient cache not initialized\n");
@@ -1209,15 +1223,28 @@ EAP::Mixer::loadCoefficients()
     }
     int nb_inputs = m_eap.m_mixer_nb_tx;
     int nb_outputs = m_eap.m_mixer_nb_rx;
+    // set before reading, such that a notification that arrives
+    // during the read marks the image stale again
+    m_coeff_valid = true;
     if(!m_eap.readRegBlock(eRT_Mixer, 4, m_coeff, nb_inputs * nb_outputs * 4)) {
         debugError("Failed to read coefficients\n");
+        m_coeff_valid = false;
         return false;
     }
+    // the device image replaces anything not written yet
+    m_dirty_first = m_dirty_last = -1;
     return true;
 }
 
 bool
 EAP::Mixer::storeCoefficients()
+{
+    Util::MutexLockHelper lock(*m_lock);
+    return storeCoefficientsNoLock();
+}
+
+bool
+EAP::Mixer::storeCoefficientsNoLock()
 {
     if(m_coeff == NULL) {
         debugError("Coefficient cache not initialized\n");
@@ -1227,15 +1254,36 @@ EAP::Mixer::storeCoefficients()
         debugWarning("Mixer is read-only\n");
         return false;
     }
-    int nb_inputs = m_eap.m_mixer_nb_tx;
-    int nb_outputs = m_eap.m_mixer_nb_rx;
-    if(!m_eap.writeRegBlock(eRT_Mixer, 4, m_coeff, nb_inputs * nb_outputs * 4)) {
-        debugError("Failed to read coefficients\n");
+    if(m_dirty_first < 0) {
+        // nothing changed
+        return true;
+    }
+    // write the modified range as one block
+    int nb_quads = m_dirty_last - m_dirty_first + 1;
+    debugOutput(DEBUG_LEVEL_VERBOSE, "Storing coefficients %d to %d\n", m_dirty_first, m_dirty_last);
+    if(!m_eap.writeRegBlock(eRT_Mixer, 4 + m_dirty_first * 4, m_coeff + m_dirty_first, nb_quads * 4)) {
+        debugError("Failed to write coefficients\n");
         return false;
     }
+    m_dirty_first = m_dirty_last = -1;
     return true;
 }
 
+bool
+EAP::Mixer::updateCoefficientsNoLock()
+{
+    if(m_coeff_valid) {
+        return true;
+    }
+    // the device changed something, write out what we have
+    // pending first such that it isn't lost
+    if(m_dirty_first >= 0 && !storeCoefficientsNoLock()) {
+        debugWarning("Could not store pending coefficients\n");
+    }
+    debugOutput(DEBUG_LEVEL_VERBOSE, "Reloading stale coefficient cache\n");
+    return loadCoefficientsNoLock();
+}
+
 void
 EAP::Mixer::updateNameCache()
 {
@@ -1331,6 +1379,10 @@ EAP::Mixer::show()
 
     updateNameCache();
 
+    m_lock->Lock();
+    updateCoefficientsNoLock();
+    m_lock->Unlock();
+
     const size_t bufflen = 4096;
     char tmp[bufflen];
     int cnt;
@@ -1381,10 +1433,21 @@ EAP::Mixer::setValue( const int row, const int col, const double val)
         debugWarning("Mixer is read-only\n");
         return false;
     }
+    if(!canWrite(row, col)) {
+        debugWarning("Coefficient (%d, %d) out of range\n", row, col);
+        return 0;
+    }
+    Util::MutexLockHelper lock(*m_lock);
     int nb_outputs = m_eap.m_mixer_nb_tx;
-    int addr = ((nb_outputs * col) + row) * 4;
+    int idx = (nb_outputs * col) + row;
     quadlet_t tmp = (quadlet_t) val;
-    if(!m_eap.writeRegBlock(eRT_Mixer, 4+addr, &tmp, 4)) {
+    m_coeff[idx] = tmp;
+
+    // merge with whatever is still pending
+    if(m_dirty_first < 0 || idx < m_dirty_first) m_dirty_first = idx;
+    if(idx > m_dirty_last) m_dirty_last = idx;
+
+    if(!storeCoefficientsNoLock()) {
         debugError("Failed to write coefficient\n");
         return 0;
     }
@@ -1394,14 +1457,17 @@ EAP::Mixer::setValue( const int row, const int col, const double val)
 double
 EAP::Mixer::getValue( const int row, const int col)
 {
-    int nb_outputs = m_eap.m_mixer_nb_tx;
-    int addr = ((nb_outputs * col) + row) * 4;
-    quadlet_t tmp;
-    if(!m_eap.readRegBlock(eRT_Mixer, 4+addr, &tmp, 4)) {
-        debugError("Failed to read coefficient\n");
+    if(row < 0 || row >= m_eap.m_mixer_nb_tx || col < 0 || col >= m_eap.m_mixer_nb_rx) {
+        debugWarning("Coefficient (%d, %d) out of range\n", row, col);
         return 0;
     }
-    return (double)(tmp);
+    Util::MutexLockHelper lock(*m_lock);
+    if(!updateCoefficientsNoLock()) {
+        debugError("Failed to read coefficients\n");
+        return 0;
+    }
+    int nb_outputs = m_eap.m_mixer_nb_tx;
+    return (double)(m_coeff[(nb_outputs * col) + row]);
 }
 
 int
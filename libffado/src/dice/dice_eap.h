@@ -411,10 +411,15 @@ public:
          */
         bool loadCoefficients();
         /**
-         * Stores the coefficients from the cache to the device
+         * Stores the modified coefficients from the cache to the device
          * @return 
          */
         bool storeCoefficients();
+        /**
+         * Marks the local cache as stale, it is reloaded from the device
+         * on the next access. Safe to call from the notifier.
+         */
+        void invalidateCoefficients() {m_coeff_valid = false;};
 
         virtual int getRowCount( );
         virtual int getColCount( );
@@ -436,8 +441,20 @@ public:
         virtual bool storeCoefficientMap(int &);
 
     private:
+        // the caller should hold m_lock
+        bool loadCoefficientsNoLock();
+        bool storeCoefficientsNoLock();
+        bool updateCoefficientsNoLock();
+
         EAP &         m_eap;
+        // the coefficient image, reads are served from here
         fb_quadlet_t *m_coeff;
+        volatile bool m_coeff_valid;
+        // range of coefficients that still have to be written
+        // to the device (-1 if none)
+        int           m_dirty_first;
+        int           m_dirty_last;
+        Util::Mutex  *m_lock;
 
         //std::map<int, RouterConfig::Route> m_input_route_map;
         //std::map<int, RouterConfig::RouteVector> m_output_route_map;
@@ -36,6 +36,7 @@
 #include "debugmodule/debugmodule.h"
 
 #include "libutil/ByteSwap.h"
+#include "libutil/FlashTransfer.h"
 #include <libraw1394/csr.h>
 
 #include <stdint.h>
@@ -60,19 +61,53 @@ namespace Dice {
 
 fb_quadlet_t tmp_quadlet;
 
+// the completion of a firmware loader operation, as seen by Util::FlashTransfer
+class FLOpcodeStatus : public Util::FlashStatusSource
+{
+public:
+	FLOpcodeStatus(Device &dev) : m_dev(dev) {};
+	virtual eFlashStatus getFlashStatus() {
+		fb_quadlet_t opcode;
+		// reads can fail while the device is busy (e.g. while it calculates
+		// the upload checksum), that is not an error
+		if (!m_dev.readReg(DICE_FL_OFFSET + DICE_FL_OPCODE, &opcode)) {
+			return eFS_Busy;
+		}
+		return (opcode & (1UL<<31)) ? eFS_Busy : eFS_Ready;
+	};
+private:
+	Device &m_dev;
+};
+
+/*
+ * Executes a firmware loader operation and waits for its completion.
+ * The parameters should be written before. On return tmp_quadlet holds
+ * the return status of the operation.
+ */
 bool
-Device::showDiceInfoFL() {
+Device::executeFL(fb_quadlet_t opcode, unsigned int timeout_msecs) {
+	FLOpcodeStatus status(*this);
 
-	DICE_FL_GET_VENDOR_IMAGE_DESC_RETURN image_desc;
+	if (!writeReg(DICE_FL_OFFSET + DICE_FL_OPCODE, (1UL<<31) | opcode)) {
+		printMessage("Could not start operation 0x%X\n", opcode);
+		tmp_quadlet = 0xFFFFFFFF;
+		return false;
+	}
+
+	if (!Util::FlashTransfer::waitForCompletion(status, timeout_msecs)) {
+		printMessage("Timeout waiting for operation 0x%X to complete\n", opcode);
+		tmp_quadlet = 0xFFFFFFFF;
+		return false;
+	}
+	return readReg(DICE_FL_OFFSET + DICE_FL_RETURN_STATUS, &tmp_quadlet);
+}
 
-	writeReg(DICE_FL_OFFSET + DICE_FL_OPCODE, (1UL<<31) | DICE_FL_OP_GET_RUNNING_IMAGE_VINFO);
+bool
+Device::showDiceInfoFL() {
 
-	do {
-		usleep(10000);
-		readReg(DICE_FL_OFFSET + DICE_FL_OPCODE, &tmp_quadlet);
-	} while (tmp_quadlet & (1UL<<31));
+	DICE_FL_GET_VENDOR_IMAGE_DESC_RETURN image_desc;
 
-	readReg(DICE_FL_OFFSET + DICE_FL_RETURN_STATUS, &tmp_quadlet);
+	executeFL(DICE_FL_OP_GET_RUNNING_IMAGE_VINFO, DICE_FL_TIMEOUT_MSECS);
 
 	if (tmp_quadlet == DICE_FL_RETURN_NO_ERROR) {
 		readRegBlock(DICE_FL_OFFSET + DICE_FL_PARAMETER, (fb_quadlet_t*) &image_desc, sizeof(image_desc));
@@ -113,14 +148,7 @@ Device::dumpFirmwareFL(const char* filename) {
 
 				writeRegBlock(DICE_FL_OFFSET + DICE_FL_PARAMETER, (fb_quadlet_t*) &memory, sizeof(memory));
 
-				writeReg(DICE_FL_OFFSET + DICE_FL_OPCODE, (1UL<<31) | DICE_FL_OP_READ_MEMORY);
-
-				do {
-					usleep(4000);
-					readReg(DICE_FL_OFFSET + DICE_FL_OPCODE, &tmp_quadlet);
-				} while (tmp_quadlet & (1UL<<31));
-
-				readReg(DICE_FL_OFFSET + DICE_FL_RETURN_STATUS, &tmp_quadlet);
+				executeFL(DICE_FL_OP_READ_MEMORY, DICE_FL_TIMEOUT_MSECS);
 
 				if (tmp_quadlet == DICE_FL_RETURN_NO_ERROR) {
 					readRegBlock(DICE_FL_OFFSET + DICE_FL_PARAMETER, (fb_quadlet_t*) &memory, sizeof(memory));
@@ -147,14 +175,7 @@ Device::showFlashInfoFL(bool v) {
 	DICE_FL_INFO_PARAM flash_info;
 	DICE_FL_INFO_PARAM* pflash_info = new DICE_FL_INFO_PARAM;
 
-	writeReg(DICE_FL_OFFSET + DICE_FL_OPCODE, (1UL<<31) | DICE_FL_OP_GET_FLASH_INFO);
-
-	do {
-		usleep(10000);
-		readReg(DICE_FL_OFFSET + DICE_FL_OPCODE, &tmp_quadlet);
-	} while (tmp_quadlet & (1UL<<31));
-
-	readReg(DICE_FL_OFFSET + DICE_FL_RETURN_STATUS, &tmp_quadlet);
+	executeFL(DICE_FL_OP_GET_FLASH_INFO, DICE_FL_TIMEOUT_MSECS);
 
 	if (tmp_quadlet == DICE_FL_RETURN_NO_ERROR) {
 		readRegBlock(DICE_FL_OFFSET + DICE_FL_PARAMETER, (fb_quadlet_t*) &flash_info, sizeof(flash_info));
@@ -182,13 +203,7 @@ Device::showImgInfoFL() {
 	do {
 		writeReg(DICE_FL_OFFSET + DICE_FL_PARAMETER, imageID);
 
-		writeReg(DICE_FL_OFFSET + DICE_FL_OPCODE, (1UL<<31) | DICE_FL_OP_GET_IMAGE_DESC);
-		do {
-			usleep(100);
-			readReg(DICE_FL_OFFSET + DICE_FL_OPCODE, &tmp_quadlet);
-		} while (tmp_quadlet & (1UL<<31));
-
-		readReg(DICE_FL_OFFSET + DICE_FL_RETURN_STATUS, &tmp_quadlet);
+		executeFL(DICE_FL_OP_GET_IMAGE_DESC, DICE_FL_TIMEOUT_MSECS);
 
 		if (tmp_quadlet == DICE_FL_RETURN_NO_ERROR) {
 			readRegBlock(DICE_FL_OFFSET + DICE_FL_PARAMETER, (fb_quadlet_t*) &img_desc, sizeof(img_desc));
@@ -223,14 +238,7 @@ Device::showAppInfoFL() {
 
 	DICE_FL_GET_APP_INFO_RETURN app_info;
 
-	writeReg(DICE_FL_OFFSET + DICE_FL_OPCODE, (1UL<<31) | DICE_FL_OP_GET_APP_INFO);
-
-	do {
-		usleep(10000);
-		readReg(DICE_FL_OFFSET + DICE_FL_OPCODE, &tmp_quadlet);
-	} while (tmp_quadlet & (1UL<<31));
-
-	readReg(DICE_FL_OFFSET + DICE_FL_RETURN_STATUS, &tmp_quadlet);
+	executeFL(DICE_FL_OP_GET_APP_INFO, DICE_FL_TIMEOUT_MSECS);
 
 	if (tmp_quadlet == DICE_FL_RETURN_NO_ERROR) {
 		readRegBlock(DICE_FL_OFFSET + DICE_FL_PARAMETER, (fb_quadlet_t*) &app_info, sizeof(app_info));
@@ -281,14 +289,7 @@ Device::testDiceFL(int action) {
 
 			writeRegBlock(DICE_FL_OFFSET + DICE_FL_PARAMETER, (fb_quadlet_t*) &testParam, sizeof(testParam));
 
-			writeReg(DICE_FL_OFFSET + DICE_FL_OPCODE, (1UL<<31) | DICE_FL_OP_TEST_ACTION);
-
-			do {
-				usleep(10000);
-				readReg(DICE_FL_OFFSET + DICE_FL_OPCODE, &tmp_quadlet);
-			} while (tmp_quadlet & (1UL<<31));
-
-			readReg(DICE_FL_OFFSET + DICE_FL_RETURN_STATUS, &tmp_quadlet);
+			executeFL(DICE_FL_OP_TEST_ACTION, DICE_FL_TIMEOUT_MSECS);
 
 			if (tmp_quadlet == DICE_FL_RETURN_NO_ERROR) {
 				printMessage("Quadlet written successfully\n");
@@ -310,14 +311,7 @@ Device::testDiceFL(int action) {
 
 			writeRegBlock(DICE_FL_OFFSET + DICE_FL_PARAMETER, (fb_quadlet_t*) &testParam, sizeof(testParam));
 
-			writeReg(DICE_FL_OFFSET + DICE_FL_OPCODE, (1UL<<31) | DICE_FL_OP_TEST_ACTION);
-
-			do {
-				usleep(10000);
-				readReg(DICE_FL_OFFSET + DICE_FL_OPCODE, &tmp_quadlet);
-			} while (tmp_quadlet & (1UL<<31));
-
-			readReg(DICE_FL_OFFSET + DICE_FL_RETURN_STATUS, &tmp_quadlet);
+			executeFL(DICE_FL_OP_TEST_ACTION, DICE_FL_TIMEOUT_MSECS);
 
 			if (tmp_quadlet == DICE_FL_RETURN_NO_ERROR) {
 				readRegBlock(DICE_FL_OFFSET + DICE_FL_PARAMETER, (fb_quadlet_t*) &testReturn, sizeof(testReturn));
@@ -349,14 +343,7 @@ Device::deleteImgFL(const char* image, bool v) {
 
 	writeRegBlock(DICE_FL_OFFSET + DICE_FL_PARAMETER, (fb_quadlet_t*) &imageDelete, sizeof(imageDelete));
 
-	writeReg(DICE_FL_OFFSET + DICE_FL_OPCODE, (1UL<<31) | DICE_FL_OP_DELETE_IMAGE);
-
-	do {
-		usleep(300000);
-		readReg(DICE_FL_OFFSET + DICE_FL_OPCODE, &tmp_quadlet);
-	} while (tmp_quadlet & (1UL<<31));
-
-	readReg(DICE_FL_OFFSET + DICE_FL_RETURN_STATUS, &tmp_quadlet);
+	executeFL(DICE_FL_OP_DELETE_IMAGE, DICE_FL_FLASH_TIMEOUT_MSECS);
 
 	if (tmp_quadlet == DICE_FL_RETURN_NO_ERROR) {
 		printMessage("Deletion successfully finished\n");
@@ -423,16 +410,10 @@ Device::flashDiceFL(const char* filename, const char* image) {
 				}
 
 				writeRegBlock(DICE_FL_OFFSET + DICE_FL_PARAMETER, (fb_quadlet_t*) &upload_header, sizeof(upload_header));
-				writeRegBlock(DICE_FL_OFFSET + DICE_FL_BUFFER, (fb_quadlet_t*) &upload_data, sizeof(upload_data));
-
-				writeReg(DICE_FL_OFFSET + DICE_FL_OPCODE, (1UL<<31) | DICE_FL_OP_UPLOAD);
+				// only the part of the buffer that is in use
+				writeRegBlock(DICE_FL_OFFSET + DICE_FL_BUFFER, (fb_quadlet_t*) &upload_data, (upload_header.length + 3) & ~3);
 
-				do {
-					usleep(100);
-					readReg(DICE_FL_OFFSET + DICE_FL_OPCODE, &tmp_quadlet);
-				} while (tmp_quadlet & (1UL<<31));
-
-				readReg(DICE_FL_OFFSET + DICE_FL_RETURN_STATUS, &tmp_quadlet);
+				executeFL(DICE_FL_OP_UPLOAD, DICE_FL_TIMEOUT_MSECS);
 
 				if (tmp_quadlet == DICE_FL_RETURN_NO_ERROR) {
 					//printMessage("Upload operation successful");
@@ -459,14 +440,7 @@ Device::flashDiceFL(const char* filename, const char* image) {
 
 	writeReg(DICE_FL_OFFSET + DICE_FL_PARAMETER, imageSize);
 
-	writeReg(DICE_FL_OFFSET + DICE_FL_OPCODE, (1UL<<31) | DICE_FL_OP_UPLOAD_STAT);
-
-	do {
-		usleep(1000000); //take care on polling, depends on dice-image size (to low values lead to a read error)
-		readReg(DICE_FL_OFFSET + DICE_FL_OPCODE, &tmp_quadlet);
-	} while (tmp_quadlet & (1UL<<31));
-
-	readReg(DICE_FL_OFFSET + DICE_FL_RETURN_STATUS, &tmp_quadlet);
+	executeFL(DICE_FL_OP_UPLOAD_STAT, DICE_FL_FLASH_TIMEOUT_MSECS);
 
 	if (tmp_quadlet == DICE_FL_RETURN_NO_ERROR) {
 		readReg(DICE_FL_OFFSET + DICE_FL_PARAMETER, &tmp_quadlet);
@@ -513,14 +487,7 @@ Device::flashDiceFL(const char* filename, const char* image) {
 
 			writeRegBlock(DICE_FL_OFFSET + DICE_FL_PARAMETER, (fb_quadlet_t*) &imageCreate, sizeof(imageCreate));
 
-			writeReg(DICE_FL_OFFSET + DICE_FL_OPCODE, (1UL<<31) | DICE_FL_OP_CREATE_IMAGE);
-
-			do {
-				usleep(300000);
-				readReg(DICE_FL_OFFSET + DICE_FL_OPCODE, &tmp_quadlet);
-			} while (tmp_quadlet & (1UL<<31));
-
-			readReg(DICE_FL_OFFSET + DICE_FL_RETURN_STATUS, &tmp_quadlet);
+			executeFL(DICE_FL_OP_CREATE_IMAGE, DICE_FL_FLASH_TIMEOUT_MSECS);
 
 			if (tmp_quadlet == DICE_FL_RETURN_NO_ERROR) {
 				printMessage("Flashing successfully finished\n");
@@ -47,6 +47,10 @@
 
 #define DICE_FL_BUFFER			0x34 //offset for Upload buffer
 
+/* time to wait for an operation to complete (msecs) */
+#define DICE_FL_TIMEOUT_MSECS			5000
+#define DICE_FL_FLASH_TIMEOUT_MSECS		120000 //operations that erase or program the flash
+
 /* Opcode IDs for implemented functions (firmware dependent) */
 #define	DICE_FL_OP_GET_IMAGE_DESC			0x0		// parameters: imageId  return: imageDesc
 #define	DICE_FL_OP_DELETE_IMAGE				0x1		// parameters: name  return: none
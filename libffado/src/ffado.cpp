@@ -37,6 +37,8 @@
 #include "devicemanager.h"
 #include "ffadodevice.h"
 
+#include "libutil/StartupTrace.h"
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -81,6 +83,9 @@ struct _ffado_device
 
     ffado_options_t options;
     ffado_device_info_t device_info;
+
+    ffado_process_callback_t process_callback;
+    void *process_arg;
 };
 
 ffado_device_t *ffado_streaming_init (ffado_device_info_t device_info, ffado_options_t options) {
@@ -103,6 +108,8 @@ ffado_device_t *ffado_streaming_init (ffado_device_info_t device_info, ffado_opt
     }
 
     memcpy((void *)&dev->options, (void *)&options, sizeof(dev->options));
+    dev->process_callback = NULL;
+    dev->process_arg = NULL;
 
     dev->m_deviceManager = new DeviceManager();
     if ( !dev->m_deviceManager ) {
@@ -218,8 +225,10 @@ int ffado_streaming_start(ffado_device_t *dev) {
     debugOutput(DEBUG_LEVEL_VERBOSE,"------------- Start -------------\n");
     if(!dev->m_deviceManager->startStreaming()) {
         debugFatal("Could not start the streaming system\n");
+        Util::StartupTrace::instance()->write();
         return -1;
     }
+    Util::StartupTrace::instance()->write();
     return 0;
 }
 
@@ -276,6 +285,52 @@ ffado_streaming_wait(ffado_device_t *dev) {
     }
 }
 
+static int ffado_streaming_process(enum DeviceManager::eWaitResult result, void *arg) {
+    ffado_device_t *dev = (ffado_device_t *)arg;
+    ffado_wait_response response;
+    switch(result) {
+        case DeviceManager::eWR_OK:
+            response = ffado_wait_ok;
+            break;
+        case DeviceManager::eWR_Xrun:
+            response = ffado_wait_xrun;
+            break;
+        case DeviceManager::eWR_Shutdown:
+            response = ffado_wait_shutdown;
+            break;
+        default:
+            response = ffado_wait_error;
+            break;
+    }
+    return dev->process_callback(dev, response, dev->process_arg);
+}
+
+int ffado_streaming_set_process_callback(ffado_device_t *dev, ffado_process_callback_t callback, void *arg) {
+    if(!dev->m_deviceManager->setProcessFunction(callback ? ffado_streaming_process : NULL, dev)) {
+        debugError("Could not set process callback\n");
+        return -1;
+    }
+    dev->process_callback = callback;
+    dev->process_arg = arg;
+    return 0;
+}
+
+int ffado_streaming_get_process_stats(ffado_device_t *dev, ffado_process_stats_t *stats) {
+    struct DeviceManager::ProcessStatistics s;
+    if(!dev->m_deviceManager->getProcessStatistics(s)) {
+        return -1;
+    }
+    memset(stats, 0, sizeof(*stats));
+    stats->periods = s.periods;
+    stats->xruns = s.xruns;
+    stats->latency_min = s.latency_min_usecs;
+    stats->latency_max = s.latency_max_usecs;
+    stats->latency_avg = s.latency_avg_usecs;
+    stats->process_max = s.duration_max_usecs;
+    stats->process_avg = s.duration_avg_usecs;
+    return 0;
+}
+
 int ffado_streaming_transfer_capture_buffers(ffado_device_t *dev) {
     return dev->m_deviceManager->getStreamProcessorManager().transfer(Streaming::StreamProcessor::ePT_Receive);
 }
@@ -377,6 +432,27 @@ int ffado_streaming_set_audio_datatype(ffado_device_t *dev,
                 return -1;
             }
             break;
+        case ffado_audio_datatype_int16:
+            if(!dev->m_deviceManager->getStreamProcessorManager().setAudioDataType(
+               Streaming::StreamProcessorManager::eADT_Int16)) {
+                debugError("Could not set datatype\n");
+                return -1;
+            }
+            break;
+        case ffado_audio_datatype_int32:
+            if(!dev->m_deviceManager->getStreamProcessorManager().setAudioDataType(
+               Streaming::StreamProcessorManager::eADT_Int32)) {
+                debugError("Could not set datatype\n");
+                return -1;
+            }
+            break;
+        case ffado_audio_datatype_float64:
+            if(!dev->m_deviceManager->getStreamProcessorManager().setAudioDataType(
+               Streaming::StreamProcessorManager::eADT_Float64)) {
+                debugError("Could not set datatype\n");
+                return -1;
+            }
+            break;
         default:
             debugError("Invalid audio datatype\n");
             return -1;
@@ -390,6 +466,12 @@ ffado_streaming_audio_datatype ffado_streaming_get_audio_datatype(ffado_device_t
             return ffado_audio_datatype_int24;
         case Streaming::StreamProcessorManager::eADT_Float:
             return ffado_audio_datatype_float;
+        case Streaming::StreamProcessorManager::eADT_Int16:
+            return ffado_audio_datatype_int16;
+        case Streaming::StreamProcessorManager::eADT_Int32:
+            return ffado_audio_datatype_int32;
+        case Streaming::StreamProcessorManager::eADT_Float64:
+            return ffado_audio_datatype_float64;
         default:
             debugError("Invalid audio datatype\n");
             return ffado_audio_datatype_error;
@@ -426,6 +508,7 @@ int ffado_streaming_set_capture_stream_buffer(ffado_device_t *dev, int i, char *
     // it should already have failed before, if not correct
     assert(p);
     p->setBufferAddress((void *)buff);
+    p->setBufferStride(1);
     return 0;
 }
 
@@ -435,5 +518,34 @@ int ffado_streaming_set_playback_stream_buffer(ffado_device_t *dev, int i, char
     // it should already have failed before, if not correct
     assert(p);
     p->setBufferAddress((void *)buff);
+    p->setBufferStride(1);
     return 0;
 }
+
+static int ffado_streaming_set_interleaved_buffer(ffado_device_t *dev, char *buff,
+    unsigned int nb_channels, enum Streaming::Port::E_Direction direction) {
+    Streaming::StreamProcessorManager &spm = dev->m_deviceManager->getStreamProcessorManager();
+    if(nb_channels == 0) {
+        debugError("Invalid number of channels\n");
+        return -1;
+    }
+    unsigned int sample_size = Streaming::StreamProcessorManager::getAudioSampleSize(spm.getAudioDataType());
+    unsigned int channel = 0;
+    int nb_ports = spm.getPortCount(direction);
+    for(int i = 0; i < nb_ports && channel < nb_channels; i++) {
+        Streaming::Port *p = spm.getPortByIndex(i, direction);
+        if(!p || p->getPortType() != Streaming::Port::E_Audio) continue;
+        p->setBufferAddress((void *)(buff + channel * sample_size));
+        p->setBufferStride(nb_channels);
+        channel++;
+    }
+    return 0;
+}
+
+int ffado_streaming_set_capture_interleaved_buffer(ffado_device_t *dev, char *buff, unsigned int nb_channels) {
+    return ffado_streaming_set_interleaved_buffer(dev, buff, nb_channels, Streaming::Port::E_Capture);
+}
+
+int ffado_streaming_set_playback_interleaved_buffer(ffado_device_t *dev, char *buff, unsigned int nb_channels) {
+    return ffado_streaming_set_interleaved_buffer(dev, buff, nb_channels, Streaming::Port::E_Playback);
+}
@@ -166,6 +166,14 @@ FFADODevice::getStreamingState()
     return eSS_Idle;
 }
 
+void
+FFADODevice::notifyClockStateChanged()
+{
+    if(m_genericContainer) {
+        m_genericContainer->notifyValueChanged();
+    }
+}
+
 bool
 FFADODevice::setNickname( std::string name)
 {
@@ -289,6 +289,12 @@ public:
      */
     virtual enum eStreamingState getStreamingState();
 
+    /**
+     * @brief notify the control clients that the clock source, sample rate
+     *        or lock state changed behind our back (e.g. on a device notification)
+     */
+    void notifyClockStateChanged();
+
     /**
      * @brief Outputs the device configuration to stderr/stdout [debug helper]
      *
@@ -33,12 +33,12 @@
 #include "libieee1394/ieee1394service.h"
 
 #include "fireworks/fireworks_control.h"
+#include "fireworks/fireworks_firmware.h"
 
 #include "libutil/PosixMutex.h"
 
 #include "IntelFlashMap.h"
 
-#define ECHO_FLASH_ERASE_TIMEOUT_MILLISECS 2000
 #define FIREWORKS_MIN_FIRMWARE_VERSION 0x04080000
 
 #include <sstream>
@@ -948,31 +948,12 @@ Device::eraseFlashBlocks(uint32_t start_address, unsigned int nb_quads)
 bool
 Device::waitForFlash(unsigned int msecs)
 {
-    bool ready;
-
-    EfcFlashGetStatusCmd statusCmd;
-    const unsigned int time_to_sleep_usecs = 10000;
-    int wait_cycles = msecs * 1000 / time_to_sleep_usecs;
-
-    do {
-        if (!doEfcOverAVC(statusCmd)) {
-            debugError("Could not read flash status\n");
-            return false;
-        }
-        if (statusCmd.m_header.retval == EfcCmd::eERV_FlashBusy) {
-            ready = false;
-        } else {
-            ready = statusCmd.m_ready;
-        }
-        usleep(time_to_sleep_usecs);
-    } while (!ready && wait_cycles--);
-
-    if(wait_cycles == 0) {
+    DeviceFlash flash(*this);
+    if (!Util::FlashTransfer::waitForCompletion(flash, msecs)) {
         debugError("Timeout while waiting for flash\n");
         return false;
     }
-
-    return ready;
+    return true;
 }
 
 uint32_t
@@ -66,6 +66,7 @@ namespace FireWorks {
 
 IMPL_DEBUG_MODULE( Firmware, Firmware, DEBUG_LEVEL_NORMAL );
 IMPL_DEBUG_MODULE( FirmwareUtil, FirmwareUtil, DEBUG_LEVEL_NORMAL );
+IMPL_DEBUG_MODULE( DeviceFlash, DeviceFlash, DEBUG_LEVEL_NORMAL );
 
 // the firmware class
 
@@ -521,10 +522,17 @@ FirmwareUtil::writeFirmwareToDevice(Firmware f)
         debugError("Could not prepare data for writing to the device\n");
         return false;
     }
-    if(!m_Parent.writeFlash(start_addr, writelen, buff)) {
+    DeviceFlash flash(m_Parent);
+    flash.setVerboseLevel(getDebugLevel());
+    Util::FlashTransfer transfer(flash);
+    transfer.setVerboseLevel(getDebugLevel());
+    if(!transfer.write(start_addr, buff, writelen)) {
         debugError("Writing to flash failed.\n");
         return false;
     }
+    if(getDebugLevel() >= DEBUG_LEVEL_VERBOSE) {
+        transfer.showStatistics();
+    }
     return true;
 }
 
@@ -540,4 +548,53 @@ FirmwareUtil::show()
     debugOutput(DEBUG_LEVEL_NORMAL, "FirmwareUtil\n");
 }
 
+DeviceFlash::DeviceFlash(FireWorks::Device& p)
+: m_Parent(p)
+{
+}
+
+unsigned int
+DeviceFlash::getEraseBlockQuads(uint64_t addr)
+{
+    // the erase block size is fixed by the HW, and depends
+    // on the flash section we're in
+    if (addr < MAINBLOCKS_BASE_OFFSET_BYTES) {
+        return PROGRAMBLOCK_SIZE_BYTES / 4;
+    } else {
+        return MAINBLOCK_SIZE_BYTES / 4;
+    }
+}
+
+bool
+DeviceFlash::readFlashBlock(uint64_t addr, uint32_t *buffer, unsigned int nb_quads)
+{
+    return m_Parent.readFlash(addr, nb_quads, buffer);
+}
+
+bool
+DeviceFlash::writeFlashBlock(uint64_t addr, uint32_t *buffer, unsigned int nb_quads)
+{
+    return m_Parent.writeFlash(addr, nb_quads, buffer);
+}
+
+bool
+DeviceFlash::eraseFlashBlock(uint64_t addr)
+{
+    return m_Parent.eraseFlash(addr);
+}
+
+Util::FlashStatusSource::eFlashStatus
+DeviceFlash::getFlashStatus()
+{
+    EfcFlashGetStatusCmd statusCmd;
+    if (!m_Parent.doEfcOverAVC(statusCmd)) {
+        debugError("Could not read flash status\n");
+        return eFS_Error;
+    }
+    if (statusCmd.m_header.retval == EfcCmd::eERV_FlashBusy) {
+        return eFS_Busy;
+    }
+    return (statusCmd.m_ready ? eFS_Ready : eFS_Busy);
+}
+
 } // FireWorks
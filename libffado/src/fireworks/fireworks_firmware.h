@@ -32,6 +32,8 @@
 
 #include "IntelFlashMap.h"
 
+#include "libutil/FlashTransfer.h"
+
 #include <string>
 
 class ConfigRom;
@@ -53,6 +55,8 @@ namespace FireWorks {
 
 #define ECHO_FIRMWARE_NUM_BOXTYPES  4
 
+#define ECHO_FLASH_ERASE_TIMEOUT_MILLISECS 2000
+
 class Firmware
 {
 public:
@@ -161,6 +165,10 @@ public:
 
     /**
      * @brief writes a firmware to the device
+     *
+     * Only the flash blocks that differ from the firmware are erased
+     * and written, every written block is verified.
+     *
      * @param f firmware to write
      * @return true if successful
      */
@@ -200,6 +208,43 @@ private:
     DECLARE_DEBUG_MODULE;
 };
 
+/**
+ * @brief The flash memory of a device, as seen by Util::FlashTransfer
+ */
+class DeviceFlash : public Util::FlashTarget
+{
+public:
+    DeviceFlash(FireWorks::Device& parent);
+    virtual ~DeviceFlash() {};
+
+    virtual void setVerboseLevel(int l)
+        {setDebugLevel(l);};
+
+    virtual unsigned int getMaxReadQuads()
+        {return EFC_FLASH_SIZE_QUADS;};
+    virtual unsigned int getMaxWriteQuads()
+        {return EFC_FLASH_SIZE_QUADS;};
+    virtual unsigned int getEraseBlockQuads(uint64_t addr);
+
+    virtual bool readFlashBlock(uint64_t addr, uint32_t *buffer, unsigned int nb_quads);
+    virtual bool writeFlashBlock(uint64_t addr, uint32_t *buffer, unsigned int nb_quads);
+    virtual bool eraseFlashBlock(uint64_t addr);
+
+    // the EFC write command returns when the data is written
+    virtual bool pollAfterWrite()
+        {return false;};
+    virtual unsigned int getEraseTimeoutMsecs()
+        {return ECHO_FLASH_ERASE_TIMEOUT_MILLISECS;};
+
+    virtual eFlashStatus getFlashStatus();
+
+protected:
+    FireWorks::Device&          m_Parent;
+
+private:
+    DECLARE_DEBUG_MODULE;
+};
+
 } // namespace FireWorks
 
 #endif
@@ -22,6 +22,8 @@
  *
  */
 
+#include "config.h"
+
 #include "devicemanager.h"
 #include "genericavc/avc_avdevice.h"
 
@@ -143,6 +145,14 @@ Device::discover()
         debugWarning("Using generic AV/C support for unsupported device '%s %s'\n",
                      getConfigRom().getVendorName().c_str(), getConfigRom().getModelName().c_str());
     }
+
+    // base value is the config.h value, can be overridden globally
+    // or in the device section
+    int32_t use_descriptor = GENERICAVC_DISCOVERY_USE_DESCRIPTOR;
+    c.getValueForSetting("genericavc.discovery_use_descriptor", use_descriptor);
+    c.getValueForDeviceSetting(vendorId, modelId, "discovery_use_descriptor", use_descriptor);
+    setDescriptorDiscovery(use_descriptor != 0);
+
     return discoverGeneric();
 }
 
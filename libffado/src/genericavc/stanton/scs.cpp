@@ -306,6 +306,8 @@ ScsDevice::HSS1394Handler::handleWrite(struct raw1394_arm_request *arm_req) {
                 debugOutput(DEBUG_LEVEL_VERBOSE, "Calling functor %p\n", func);
                 ( *func )(arm_req->buffer + 1, payload_len);
             }
+            // the user data reflects the state of the deck controls
+            m_device.notifyValueChanged();
             break;
         case eMT_DebugData:
         case eMT_UserTagBase:
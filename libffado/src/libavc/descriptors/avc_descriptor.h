@@ -131,6 +131,8 @@ public:
 
     bool load();
     bool reload();
+    bool isLoaded() const
+        {return m_loaded;};
 
     virtual void show();
 
@@ -30,6 +30,7 @@
 #include "libutil/Time.h"
 
 #include "libutil/ByteSwap.h"
+#include "libutil/Atomic.h"
 
 #include <cstring>
 #include <cstdlib>
@@ -42,6 +43,8 @@ namespace AVC {
 IMPL_DEBUG_MODULE( AVCCommand, AVCCommand, DEBUG_LEVEL_NORMAL );
 IMPL_DEBUG_MODULE( IBusData, IBusData, DEBUG_LEVEL_VERBOSE );
 
+volatile int32_t AVCCommand::m_nbCommandsFired = 0;
+
 AVCCommand::AVCCommand( Ieee1394Service& ieee1394service,
                         opcode_t opcode )
     : m_p1394Service( &ieee1394service )
@@ -210,6 +213,8 @@ AVCCommand::fire()
         }
     }
 
+    INC_ATOMIC( &m_nbCommandsFired );
+
     bool result = false;
     unsigned int resp_len;
     quadlet_t* resp = m_p1394Service->transactionBlock( m_nodeId,
@@ -260,11 +265,11 @@ AVCCommand::fire()
 
         }
         debugOutputShort( DEBUG_LEVEL_VERY_VERBOSE, "\n" );
-        m_p1394Service->transactionBlockClose();
+        m_p1394Service->transactionBlockClose( m_nodeId );
     } else {
         debugOutput( DEBUG_LEVEL_VERBOSE, "no response\n" );
         result = false;
-        m_p1394Service->transactionBlockClose();
+        m_p1394Service->transactionBlockClose( m_nodeId );
     }
 
     return result;
@@ -109,6 +109,10 @@ public:
 
     virtual const char* getCmdName() const = 0;
 
+    /// the number of commands fired so far, by all instances
+    static unsigned int getNbCommandsFired()
+        { return m_nbCommandsFired; }
+
 protected:
     void showFcpFrame( const unsigned char* buf,
                unsigned short frameSize ) const;
@@ -131,6 +135,8 @@ private:
     EResponse    m_eResponse;
     ECommandType m_commandType;
 
+    static volatile int32_t m_nbCommandsFired;
+
 protected:
     DECLARE_DEBUG_MODULE;
 };
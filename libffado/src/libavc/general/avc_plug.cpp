@@ -176,7 +176,8 @@ bool
 Plug::discover()
 {
 
-    if ( !initFromDescriptor() ) {
+    // the fields found in the descriptor are not queried below
+    if ( m_unit->useDescriptorDiscovery() && !initFromDescriptor() ) {
         debugOutput(DEBUG_LEVEL_NORMAL,
                     "discover: Could not init plug from descriptor (%d,%d,%d,%d,%d)\n",
                     m_unit->getConfigRom().getNodeId(), getSubunitType(), getSubunitId(), m_direction, m_id );
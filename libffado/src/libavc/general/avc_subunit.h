@@ -70,6 +70,9 @@ class Subunit {
 
     bool addPlug( Plug& plug );
     virtual bool initPlugFromDescriptor( Plug& plug );
+    /// true if initPlugFromDescriptor() can be used for the plugs of this subunit
+    virtual bool hasPlugDescriptors()
+        { return false; }
 
     PlugVector& getPlugs()
 	{ return m_plugs; }
@@ -47,6 +47,13 @@ IMPL_DEBUG_MODULE( Unit, Unit, DEBUG_LEVEL_NORMAL );
 
 Unit::Unit( )
     : m_pPlugManager( new PlugManager( ) )
+    , m_discoveryStart( 0 )
+    , m_discoveryStepStart( 0 )
+    , m_discoveryStartCommands( 0 )
+    , m_discoveryStepCommands( 0 )
+    , m_discoveryUsecs( 0 )
+    , m_discoveryCommands( 0 )
+    , m_descriptorDiscovery( true )
 {
     debugOutput( DEBUG_LEVEL_VERBOSE, "Created Unit\n" );
     m_pPlugManager->setVerboseLevel( getDebugLevel() );
@@ -173,34 +180,68 @@ Unit::discover()
         return false;
     }
 
+    m_discoveryStart = Util::SystemTimeSource::getCurrentTimeAsUsecs();
+    m_discoveryStepStart = m_discoveryStart;
+    m_discoveryStartCommands = AVCCommand::getNbCommandsFired();
+    m_discoveryStepCommands = m_discoveryStartCommands;
+
     if ( !enumerateSubUnits() ) {
         debugError( "Could not enumarate sub units\n" );
         return false;
     }
+    reportDiscoveryStep( "subunits" );
 
     if ( !discoverPlugs() ) {
         debugError( "Detecting plugs failed\n" );
         return false;
     }
+    reportDiscoveryStep( "plugs" );
 
     if ( !rediscoverConnections() ) {
         debugError( "Detecting connections failed\n" );
         return false;
     }
+    reportDiscoveryStep( "connections" );
 
     if ( !discoverSyncModes() ) {
         debugError( "Detecting sync modes failed\n" );
         return false;
     }
+    reportDiscoveryStep( "sync modes" );
 
     if ( !propagatePlugInfo() ) {
         debugError( "Failed to propagate plug info\n" );
         return false;
     }
 
+    m_discoveryUsecs = Util::SystemTimeSource::getCurrentTimeAsUsecs() - m_discoveryStart;
+    m_discoveryCommands = AVCCommand::getNbCommandsFired() - m_discoveryStartCommands;
+    debugOutput( DEBUG_LEVEL_NORMAL,
+                 "Discovery of %s (node %d) took %"PRIu64" ms and %u AV/C commands\n",
+                 getConfigRom().getModelName().c_str(),
+                 getConfigRom().getNodeId(),
+                 m_discoveryUsecs / 1000,
+                 m_discoveryCommands );
+
     return true;
 }
 
+void
+Unit::reportDiscoveryStep( const char* step )
+{
+    ffado_microsecs_t now = Util::SystemTimeSource::getCurrentTimeAsUsecs();
+    unsigned int commands = AVCCommand::getNbCommandsFired();
+
+    debugOutput( DEBUG_LEVEL_VERBOSE,
+                 " discovery step '%s': %"PRIu64" ms, %u AV/C commands\n",
+                 step,
+                 (now - m_discoveryStepStart) / 1000,
+                 commands - m_discoveryStepCommands );
+
+    m_discoveryStepStart = now;
+    m_discoveryStepCommands = commands;
+}
+
 bool
 Unit::rediscoverConnections() {
     debugOutput( DEBUG_LEVEL_VERBOSE, "Re-discovering plug connections...\n");
@@ -873,6 +914,8 @@ bool Unit::setActiveSync(const SyncInfo& syncInfo)
 void
 Unit::show()
 {
+    debugOutput( DEBUG_LEVEL_NORMAL, "Last discovery: %"PRIu64" ms, %u AV/C commands\n",
+                 m_discoveryUsecs / 1000, m_discoveryCommands );
     if (getDebugLevel() >= DEBUG_LEVEL_VERY_VERBOSE) {
         m_pPlugManager->showPlugs();
     }
@@ -37,6 +37,7 @@
 #include "../audiosubunit/avc_audiosubunit.h"
 
 #include "libutil/serialize.h"
+#include "libutil/SystemTimeSource.h"
 
 #include <sstream>
 #include <vector>
@@ -63,9 +64,22 @@ public:
     /// Discovers the unit's internals
     virtual bool discover();
 
+    /// the number of AV/C commands used by the last discovery
+    unsigned int getDiscoveryCommandCount() const
+        { return m_discoveryCommands; }
+    /// the duration of the last discovery
+    ffado_microsecs_t getDiscoveryTime() const
+        { return m_discoveryUsecs; }
+
     PlugManager& getPlugManager()
         { return *m_pPlugManager; }
 
+    /// initialize the subunit plugs from the subunit descriptors, if any
+    void setDescriptorDiscovery( bool enable )
+        { m_descriptorDiscovery = enable; }
+    bool useDescriptorDiscovery() const
+        { return m_descriptorDiscovery; }
+
     struct SyncInfo {
         SyncInfo( Plug& source,
                   Plug& destination,
@@ -151,6 +165,8 @@ protected:
 
     void showPlugs( PlugVector& plugs ) const;
 
+    void reportDiscoveryStep( const char* step );
+
 
     bool serializeSyncInfoVector( std::string basePath,
                                   Util::IOSerialize& ser,
@@ -166,6 +182,15 @@ protected:
     PlugManager*              m_pPlugManager;
     SyncInfoVector            m_syncInfos;
 
+    // discovery cost accounting
+    ffado_microsecs_t         m_discoveryStart;
+    ffado_microsecs_t         m_discoveryStepStart;
+    unsigned int              m_discoveryStartCommands;
+    unsigned int              m_discoveryStepCommands;
+    ffado_microsecs_t         m_discoveryUsecs;
+    unsigned int              m_discoveryCommands;
+    bool                      m_descriptorDiscovery;
+
 private:
     DECLARE_DEBUG_MODULE;
 
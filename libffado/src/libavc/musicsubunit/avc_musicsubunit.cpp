@@ -44,6 +44,7 @@ namespace AVC {
 SubunitMusic::SubunitMusic( Unit& unit, subunit_t id )
     : Subunit( unit, eST_Music, id )
     , m_status_descriptor ( new AVCMusicStatusDescriptor( &unit, this ) )
+    , m_status_descriptor_failed ( false )
 {
 
 }
@@ -51,6 +52,7 @@ SubunitMusic::SubunitMusic( Unit& unit, subunit_t id )
 SubunitMusic::SubunitMusic()
     : Subunit()
     , m_status_descriptor ( NULL )
+    , m_status_descriptor_failed ( false )
 {
 }
 
@@ -81,15 +83,17 @@ SubunitMusic::initPlugFromDescriptor( Plug& plug )
     bool result=true;
 
     // load the descriptor (if not already loaded)
-    if (m_status_descriptor != NULL) {
-        result &= m_status_descriptor->load();
+    if (!hasPlugDescriptors()) {
+        debugOutput(DEBUG_LEVEL_VERBOSE, "No status descriptor available\n");
+        return false;
     }
 
     AVCMusicSubunitPlugInfoBlock *info;
     info = m_status_descriptor->getSubunitPlugInfoBlock(plug.getDirection(), plug.getPlugId());
 
     if (info == NULL) {
-        debugError("Could not find plug info block\n");
+        // not an error, the caller falls back to the plug info commands
+        debugOutput(DEBUG_LEVEL_VERBOSE, "Could not find plug info block\n");
         return false;
     }
 
@@ -156,7 +160,7 @@ SubunitMusic::initPlugFromDescriptor( Plug& plug )
 
             if (mplug==NULL) {
                 debugWarning("No music plug found for this signal\n");
-                sinfo.m_name = "unknown";
+                // leave the name empty such that it is queried separately
             } else {
                 sinfo.m_name = mplug->getName();
 
@@ -215,12 +219,30 @@ SubunitMusic::initPlugFromDescriptor( Plug& plug )
 
 }
 
+bool
+SubunitMusic::hasPlugDescriptors()
+{
+    if (m_status_descriptor == NULL || m_status_descriptor_failed) {
+        return false;
+    }
+    if (!m_status_descriptor->isLoaded()) {
+        debugOutput(DEBUG_LEVEL_VERBOSE, "Loading the status descriptor...\n");
+        if (!m_status_descriptor->load()) {
+            debugOutput(DEBUG_LEVEL_VERBOSE, "Could not load the status descriptor\n");
+            m_status_descriptor_failed = true;
+            return false;
+        }
+    }
+    return true;
+}
+
 bool
 SubunitMusic::loadDescriptors()
 {
     bool result=true;
     if (m_status_descriptor != NULL) {
         result &= m_status_descriptor->load();
+        m_status_descriptor_failed = !result;
     } else {
         debugError("BUG: m_status_descriptor == NULL\n");
         return false;
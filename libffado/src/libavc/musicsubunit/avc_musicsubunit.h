@@ -45,6 +45,7 @@ class SubunitMusic: public Subunit {
     
     virtual bool discover();
     virtual bool initPlugFromDescriptor( Plug& plug );
+    virtual bool hasPlugDescriptors();
 
     virtual bool loadDescriptors();
     
@@ -62,6 +63,8 @@ protected:
                                          Util::IODeserialize& deser );
 
     class AVCMusicStatusDescriptor*  m_status_descriptor;
+    // the device has no status descriptor, don't ask again for every plug
+    bool m_status_descriptor_failed;
 };
 
 }
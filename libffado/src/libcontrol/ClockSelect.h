@@ -58,6 +58,7 @@ public:
     virtual std::string getAttributeName(int attridx);
 
     virtual bool canChangeValue();
+    virtual bool isLive() {return true;};
 
     virtual void show();
 
@@ -107,6 +108,7 @@ public:
     virtual std::string getEnumLabel(int idx);
 
     virtual bool canChangeValue();
+    virtual bool isLive() {return true;};
 
     virtual void show();
 
@@ -0,0 +1,579 @@
+/*
+ * Copyright (C) 2005-2008 by Pieter Palmers
+ *
+ * This file is part of FFADO
+ * FFADO = Free Firewire (pro-)audio drivers for linux
+ *
+ * FFADO is based upon FreeBoB.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) version 3 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "config.h"
+
+#include "ControlState.h"
+#include "Element.h"
+#include "BasicElements.h"
+#include "MatrixMixer.h"
+
+#include "libutil/PosixSharedMemory.h"
+#include "libutil/PosixMutex.h"
+#include "libutil/PosixThread.h"
+#include "libutil/SystemTimeSource.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+namespace Control {
+
+IMPL_DEBUG_MODULE( StatePublisher, StatePublisher, DEBUG_LEVEL_NORMAL );
+
+StatePublisher::StatePublisher(Container &root, std::string name)
+: m_root( root )
+, m_name( name )
+, m_shm( NULL )
+, m_segment( NULL )
+, m_local_segment( NULL )
+, m_valid( false )
+, m_lock( new Util::PosixMutex("CTLSTATE") )
+, m_serializer( NULL )
+, m_reader_heartbeat( 0 )
+, m_reader_seen( 0 )
+, m_task( NULL )
+, m_thread( NULL )
+{
+    memset((void *)m_changed, 0, sizeof(m_changed));
+}
+
+StatePublisher::~StatePublisher()
+{
+    stop();
+    removeChangeHandlers();
+    if(m_shm) {
+        m_shm->LockInMemory(false);
+        delete m_shm;
+    }
+    if(m_local_segment) {
+        delete m_local_segment;
+    }
+    delete m_lock;
+}
+
+bool
+StatePublisher::init()
+{
+    if(m_segment) {
+        debugOutput(DEBUG_LEVEL_VERBOSE, "(%p) already initialized\n", this);
+        return true;
+    }
+
+    m_shm = new Util::PosixSharedMemory(m_name, sizeof(ControlStateSegment));
+    if(m_shm == NULL) {
+        debugError("Could not allocate shared memory object\n");
+        return false;
+    }
+    m_shm->setVerboseLevel(getDebugLevel());
+    if(m_shm->Create(Util::PosixSharedMemory::eD_ReadWrite, true)) {
+        m_segment = (ControlStateSegment *)m_shm->requestBlock(0, sizeof(ControlStateSegment));
+    }
+    if(m_segment == NULL) {
+        debugWarning("Could not create control state segment '%s', using private memory\n",
+                     m_name.c_str());
+        delete m_shm;
+        m_shm = NULL;
+        m_local_segment = new ControlStateSegment;
+        m_segment = m_local_segment;
+    } else if(!m_shm->LockInMemory(true)) {
+        debugWarning("Could not memlock control state segment\n");
+    }
+
+    memset((void *)m_segment, 0, sizeof(ControlStateSegment));
+    m_segment->version = CONTROLSTATE_VERSION;
+    m_segment->max_entries = CONTROLSTATE_MAX_ENTRIES;
+    m_segment->entry_size = sizeof(ControlStateEntry);
+    m_segment->pid = getpid();
+    // the magic is written last, readers use it to detect a valid segment
+    __sync_synchronize();
+    m_segment->magic = CONTROLSTATE_MAGIC;
+
+    debugOutput(DEBUG_LEVEL_VERBOSE, "(%p) control state segment '%s' (%u bytes, %s)\n",
+                this, m_name.c_str(), (unsigned int)sizeof(ControlStateSegment),
+                (m_shm ? "shared" : "private"));
+
+    return rebuild();
+}
+
+bool
+StatePublisher::rebuild()
+{
+    if(m_segment == NULL) {
+        debugError("(%p) not initialized\n", this);
+        return false;
+    }
+    Util::MutexLockHelper lock(*m_lock);
+
+    // might already be odd after an invalidate()
+    if((m_segment->layout_seq & 1) == 0) {
+        m_segment->layout_seq++;
+    }
+    __sync_synchronize();
+    m_segment->nb_entries = 0;
+    removeChangeHandlers();
+    m_entries.clear();
+    memset((void *)m_changed, 0, sizeof(m_changed));
+
+    // make sure the tree doesn't change while we walk it
+    m_root.lockControl();
+    const ElementVector &children = m_root.getElementVector();
+    for ( ConstElementVectorIterator it = children.begin();
+          it != children.end();
+          ++it )
+    {
+        addElements(**it, **it, (*it)->getName());
+    }
+    m_root.unlockControl();
+
+    // the values are read by the refresh thread, once there is a
+    // reader for them
+    m_valid = true;
+
+    __sync_synchronize();
+    m_segment->nb_entries = m_entries.size();
+    __sync_synchronize();
+    m_segment->layout_seq++;
+
+    debugOutput(DEBUG_LEVEL_VERBOSE, "(%p) published %u control entries\n",
+                this, (unsigned int)m_entries.size());
+    return true;
+}
+
+void
+StatePublisher::invalidate()
+{
+    Util::MutexLockHelper lock(*m_lock);
+    debugOutput(DEBUG_LEVEL_VERBOSE, "(%p) invalidating control entries\n", this);
+    m_valid = false;
+    removeChangeHandlers();
+    if(m_segment) {
+        // readers see an odd layout sequence until the next rebuild
+        if((m_segment->layout_seq & 1) == 0) {
+            m_segment->layout_seq++;
+        }
+        __sync_synchronize();
+    }
+}
+
+void
+StatePublisher::addElements(Element &e, Element &device, std::string path)
+{
+    // the entries below an element are contiguous
+    unsigned int first = m_entries.size();
+
+    // a container has no value of its own
+    Container *c = dynamic_cast<Container *>(&e);
+    if(c) {
+        const ElementVector &children = c->getElementVector();
+        for ( ConstElementVectorIterator it = children.begin();
+              it != children.end();
+              ++it )
+        {
+            addElements(**it, device, path + "/" + (*it)->getName());
+        }
+        addChangeHandler(e, first, m_entries.size());
+        return;
+    }
+
+    if(dynamic_cast<Continuous *>(&e)) {
+        addEntry(e, device, path, eCST_Continuous, 0, 0);
+    } else if(dynamic_cast<Discrete *>(&e)) {
+        addEntry(e, device, path, eCST_Discrete, 0, 0);
+    } else if(dynamic_cast<AttributeEnum *>(&e)) {
+        addEntry(e, device, path, eCST_AttributeEnum, 0, 0);
+    } else if(dynamic_cast<Enum *>(&e)) {
+        addEntry(e, device, path, eCST_Enum, 0, 0);
+    } else if(dynamic_cast<Boolean *>(&e)) {
+        addEntry(e, device, path, eCST_Boolean, 0, 0);
+    } else if(dynamic_cast<Text *>(&e)) {
+        addEntry(e, device, path, eCST_Text, 0, 0);
+    } else if(dynamic_cast<MatrixMixer *>(&e)) {
+        MatrixMixer *m = dynamic_cast<MatrixMixer *>(&e);
+        int rows = m->getRowCount();
+        int cols = m->getColCount();
+        for(int r = 0; r < rows; r++) {
+            for(int col = 0; col < cols; col++) {
+                char cell[32];
+                snprintf(cell, sizeof(cell), "/%d,%d", r, col);
+                if(!addEntry(e, device, path + cell, eCST_MatrixCell, r, col)) return;
+            }
+        }
+    } else {
+        // registers and other elements without a single value are not published
+        debugOutput(DEBUG_LEVEL_VERY_VERBOSE, "skipping %s\n", path.c_str());
+    }
+    addChangeHandler(e, first, m_entries.size());
+}
+
+void
+StatePublisher::addChangeHandler(Element &e, unsigned int first, unsigned int last)
+{
+    if(first == last) return;
+    ChangeHandler *h = new ChangeHandler(*this, e, first, last);
+    if(!e.addSignalHandler(h)) {
+        debugWarning("Could not add change handler to %s\n", e.getName().c_str());
+        delete h;
+        return;
+    }
+    m_handlers.push_back(h);
+}
+
+/**
+ * Unregisters from the elements, which have to be still there.
+ * Called with m_lock held, or from the destructor.
+ */
+void
+StatePublisher::removeChangeHandlers()
+{
+    for ( ChangeHandlerVectorIterator it = m_handlers.begin();
+          it != m_handlers.end();
+          ++it )
+    {
+        (*it)->getElement().remSignalHandler(*it);
+        delete *it;
+    }
+    m_handlers.clear();
+}
+
+void
+StatePublisher::markChanged(unsigned int first, unsigned int last)
+{
+    for(unsigned int i = first; i < last && i < CONTROLSTATE_MAX_ENTRIES; i++) {
+        m_changed[i] = true;
+    }
+}
+
+bool
+StatePublisher::addEntry(Element &e, Element &device, std::string path,
+                         enum eControlStateType type, int row, int col)
+{
+    unsigned int idx = m_entries.size();
+    if(idx >= CONTROLSTATE_MAX_ENTRIES) {
+        debugWarning("No space left for control entry %s\n", path.c_str());
+        return false;
+    }
+    if(path.size() >= CONTROLSTATE_PATH_LEN) {
+        debugWarning("Control path too long: %s\n", path.c_str());
+        return true;
+    }
+
+    struct entry_info info;
+    info.element = &e;
+    info.device = &device;
+    info.type = type;
+    info.row = row;
+    info.col = col;
+    info.locked_attr = -1;
+    if(type == eCST_AttributeEnum) {
+        AttributeEnum *a = dynamic_cast<AttributeEnum *>(&e);
+        for(int i = 0; i < a->attributeCount(); i++) {
+            if(a->getAttributeName(i) == "locked") {
+                info.locked_attr = i;
+                break;
+            }
+        }
+    }
+    m_entries.push_back(info);
+
+    ControlStateEntry *entry = &m_segment->entries[idx];
+    memset((void *)entry, 0, sizeof(ControlStateEntry));
+    strncpy(entry->path, path.c_str(), CONTROLSTATE_PATH_LEN - 1);
+    entry->type = type;
+    entry->row = row;
+    entry->col = col;
+    entry->status = -1;
+    if(e.isLive()) entry->flags |= CONTROLSTATE_FLAG_LIVE;
+
+    if(type == eCST_Continuous) {
+        Continuous *c = dynamic_cast<Continuous *>(&e);
+        entry->minimum = c->getMinimum();
+        entry->maximum = c->getMaximum();
+    } else if(type == eCST_Discrete) {
+        Discrete *d = dynamic_cast<Discrete *>(&e);
+        entry->minimum = d->getMinimum();
+        entry->maximum = d->getMaximum();
+    } else if(type == eCST_Enum || type == eCST_AttributeEnum) {
+        Enum *en = dynamic_cast<Enum *>(&e);
+        entry->maximum = en->count() - 1;
+    } else if(type == eCST_Boolean) {
+        entry->maximum = 1;
+    }
+    // make sure the first refresh writes the entry
+    entry->value = -1e300;
+    return true;
+}
+
+void
+StatePublisher::writeEntry(ControlStateEntry *e, double value, int32_t status, const char *text)
+{
+    if(e->value == value && e->status == status
+       && strncmp(e->text, text, CONTROLSTATE_TEXT_LEN - 1) == 0) {
+        return;
+    }
+    e->seq++;
+    __sync_synchronize();
+    e->value = value;
+    e->status = status;
+    strncpy(e->text, text, CONTROLSTATE_TEXT_LEN - 1);
+    e->changes++;
+    e->timestamp = Util::SystemTimeSource::getCurrentTimeAsUsecs();
+    __sync_synchronize();
+    e->seq++;
+}
+
+void
+StatePublisher::refreshEntry(unsigned int idx)
+{
+    struct entry_info &info = m_entries.at(idx);
+    ControlStateEntry *entry = &m_segment->entries[idx];
+    Element *e = info.element;
+
+    double value = 0.0;
+    int32_t status = -1;
+    std::string text;
+
+    switch(info.type) {
+        case eCST_Continuous:
+            value = dynamic_cast<Continuous *>(e)->getValue();
+            break;
+        case eCST_Discrete:
+            value = dynamic_cast<Discrete *>(e)->getValue();
+            break;
+        case eCST_AttributeEnum:
+            if(info.locked_attr >= 0) {
+                AttributeEnum *a = dynamic_cast<AttributeEnum *>(e);
+                status = atoi(a->getAttributeValue(info.locked_attr).c_str());
+            }
+            // fall through
+        case eCST_Enum: {
+                Enum *en = dynamic_cast<Enum *>(e);
+                int sel = en->selected();
+                value = sel;
+                if(sel >= 0) text = en->getEnumLabel(sel);
+            }
+            break;
+        case eCST_Boolean: {
+                Boolean *b = dynamic_cast<Boolean *>(e);
+                bool sel = b->selected();
+                value = (sel ? 1 : 0);
+                text = b->getBooleanLabel(sel);
+            }
+            break;
+        case eCST_Text:
+            text = dynamic_cast<Text *>(e)->getValue();
+            break;
+        case eCST_MatrixCell:
+            value = dynamic_cast<MatrixMixer *>(e)->getValue(info.row, info.col);
+            break;
+    }
+    writeEntry(entry, value, status, text.c_str());
+}
+
+bool
+StatePublisher::hasReader()
+{
+    ffado_microsecs_t now = Util::SystemTimeSource::getCurrentTimeAsUsecs();
+    uint32_t heartbeat = m_segment->reader_heartbeat;
+    if(heartbeat != m_reader_heartbeat) {
+        m_reader_heartbeat = heartbeat;
+        m_reader_seen = now;
+    }
+    return m_reader_seen && now - m_reader_seen < CONTROLSTATE_READER_TIMEOUT_USECS;
+}
+
+/**
+ * Reserves the device of an entry with the serializer, unless it is
+ * already reserved in acquired. The entries of a device are contiguous,
+ * hence a device is reserved once for all its entries.
+ * Called with m_lock held.
+ * @return false if the device is busy
+ */
+bool
+StatePublisher::acquireDevice(unsigned int idx, Element *&acquired)
+{
+    if(m_serializer == NULL) return true;
+    Element *device = m_entries.at(idx).device;
+    if(device == acquired) return true;
+    releaseDevice(acquired);
+    if(!m_serializer->tryAcquire(device)) {
+        debugOutputExtreme(DEBUG_LEVEL_VERY_VERBOSE, "device %s busy\n",
+                           device->getName().c_str());
+        return false;
+    }
+    acquired = device;
+    return true;
+}
+
+void
+StatePublisher::releaseDevice(Element *&acquired)
+{
+    if(acquired) {
+        m_serializer->release(acquired);
+        acquired = NULL;
+    }
+}
+
+void
+StatePublisher::refresh()
+{
+    Util::MutexLockHelper lock(*m_lock);
+    if(!m_valid) return;
+    bool reader = hasReader();
+    Element *acquired = NULL;
+    for(unsigned int i = 0; i < m_entries.size(); i++) {
+        ControlStateEntry *entry = &m_segment->entries[i];
+        if(!m_changed[i] && !(reader && (entry->changes == 0
+                                         || (entry->flags & CONTROLSTATE_FLAG_LIVE)))) {
+            continue;
+        }
+        // a busy device is read at the next refresh
+        if(!acquireDevice(i, acquired)) continue;
+        m_changed[i] = false;
+        refreshEntry(i);
+    }
+    releaseDevice(acquired);
+    m_segment->refreshes++;
+}
+
+void
+StatePublisher::updateElement(Element *e)
+{
+    Util::MutexLockHelper lock(*m_lock);
+    if(!m_valid) return;
+    Element *acquired = NULL;
+    for(unsigned int i = 0; i < m_entries.size(); i++) {
+        if(m_entries.at(i).element == e) {
+            if(!acquireDevice(i, acquired)) {
+                // read at the next refresh
+                m_changed[i] = true;
+                continue;
+            }
+            refreshEntry(i);
+        }
+    }
+    releaseDevice(acquired);
+}
+
+void
+StatePublisher::setAccessSerializer(AccessSerializer *s)
+{
+    Util::MutexLockHelper lock(*m_lock);
+    m_serializer = s;
+}
+
+bool
+StatePublisher::start()
+{
+    if(m_thread) {
+        debugOutput(DEBUG_LEVEL_VERBOSE, "(%p) already running\n", this);
+        return true;
+    }
+    m_task = new RefreshTask(*this);
+    m_thread = new Util::PosixThread(m_task, "CTLSTATE", false,
+                                     0, PTHREAD_CANCEL_DEFERRED);
+    if(m_thread->Start() != 0) {
+        debugError("Could not start control state refresh thread\n");
+        delete m_thread;
+        m_thread = NULL;
+        delete m_task;
+        m_task = NULL;
+        return false;
+    }
+    return true;
+}
+
+bool
+StatePublisher::stop()
+{
+    if(m_thread) {
+        m_thread->Stop();
+        delete m_thread;
+        m_thread = NULL;
+    }
+    if(m_task) {
+        delete m_task;
+        m_task = NULL;
+    }
+    return true;
+}
+
+void
+StatePublisher::show()
+{
+    if(m_segment == NULL) {
+        debugOutput(DEBUG_LEVEL_NORMAL, "StatePublisher %p not initialized\n", this);
+        return;
+    }
+    debugOutput(DEBUG_LEVEL_NORMAL, "StatePublisher %p: '%s' (%s), %u entries, %u refreshes\n",
+                this, m_name.c_str(), (m_shm ? "shared" : "private"),
+                m_segment->nb_entries, m_segment->refreshes);
+}
+
+void
+StatePublisher::setVerboseLevel(int l)
+{
+    setDebugLevel(l);
+    if(m_shm) m_shm->setVerboseLevel(l);
+}
+
+// --- refresh task
+
+StatePublisher::RefreshTask::RefreshTask(StatePublisher &parent)
+: m_parent( parent )
+{
+}
+
+bool
+StatePublisher::RefreshTask::Execute()
+{
+    Util::SystemTimeSource::SleepUsecRelative(CONTROLSTATE_REFRESH_INTERVAL_USECS);
+    m_parent.refresh();
+    return true;
+}
+
+// --- change handler
+
+StatePublisher::ChangeHandler::ChangeHandler(StatePublisher &parent, Element &e,
+                                             unsigned int first, unsigned int last)
+: SignalFunctor( Element::eS_ValueChanged )
+, m_parent( parent )
+, m_element( e )
+, m_first( first )
+, m_last( last )
+{
+}
+
+void
+StatePublisher::ChangeHandler::operator() ()
+{
+    m_parent.markChanged(m_first, m_last);
+}
+
+void
+StatePublisher::ChangeHandler::operator() (int)
+{
+    m_parent.markChanged(m_first, m_last);
+}
+
+} // namespace Control
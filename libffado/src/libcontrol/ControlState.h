@@ -0,0 +1,294 @@
+/*
+ * Copyright (C) 2005-2008 by Pieter Palmers
+ *
+ * This file is part of FFADO
+ * FFADO = Free Firewire (pro-)audio drivers for linux
+ *
+ * FFADO is based upon FreeBoB.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) version 3 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef CONTROL_STATE_H
+#define CONTROL_STATE_H
+
+#include "debugmodule/debugmodule.h"
+
+#include "libutil/Thread.h"
+#include "libutil/SystemTimeSource.h"
+#include "Element.h"
+
+#include <vector>
+#include <string>
+#include <string.h>
+#include <stdint.h>
+
+#define CONTROLSTATE_MAGIC              0x46464353 // 'FFCS'
+#define CONTROLSTATE_VERSION            2
+#define CONTROLSTATE_MAX_ENTRIES        1024
+#define CONTROLSTATE_PATH_LEN           128
+#define CONTROLSTATE_TEXT_LEN           64
+
+// the value changes by itself (meters, lock status), refreshed at every
+// interval while a reader is attached
+#define CONTROLSTATE_FLAG_LIVE          0x01
+
+namespace Util {
+    class PosixSharedMemory;
+    class Mutex;
+}
+
+namespace Control {
+
+class Element;
+class Container;
+
+/**
+ * @brief Serializes the accesses to a device
+ *
+ * Implemented by the owner of the control tree when it accesses the
+ * devices from several threads (e.g. the call pool of ffado-dbus-server).
+ * The key of a device is its element, i.e. the child of the root.
+ */
+class AccessSerializer
+{
+public:
+    virtual ~AccessSerializer() {};
+    /// returns false if the device is busy, otherwise it is reserved until release()
+    virtual bool tryAcquire(void *key) = 0;
+    virtual void release(void *key) = 0;
+};
+
+enum eControlStateType {
+    eCST_Continuous = 1,
+    eCST_Discrete = 2,
+    eCST_Enum = 3,
+    eCST_AttributeEnum = 4,
+    eCST_Boolean = 5,
+    eCST_Text = 6,
+    eCST_MatrixCell = 7
+};
+
+/**
+ * @brief The published state of one control element
+ *
+ * value holds the numeric value for all types: the value of continuous,
+ * discrete and matrix elements, the selected index of enums and 0/1 for
+ * booleans. text holds the value of text elements and the label of the
+ * selected enum entry. status is the 'locked' attribute of an attribute
+ * enum (e.g. the clock source), -1 otherwise.
+ *
+ * Every entry is protected by its own sequence lock: seq is odd while the
+ * entry is being written. A reader copies the entry and retries if seq
+ * was odd or changed during the copy (see StatePublisher::readEntry()).
+ * An entry with changes == 0 was not read from the device yet.
+ */
+struct ControlStateEntry {
+    char path[CONTROLSTATE_PATH_LEN];
+    uint32_t type;
+    uint32_t flags;
+    int32_t row, col;               // of a matrix cell
+    volatile uint32_t seq;
+    volatile uint32_t changes;      // the number of times the value changed
+    volatile uint64_t timestamp;    // usecs of the last change
+    volatile double value;
+    volatile double minimum;
+    volatile double maximum;
+    volatile int32_t status;
+    uint32_t reserved;
+    char text[CONTROLSTATE_TEXT_LEN];
+};
+
+/**
+ * @brief The layout of the control state shared memory segment
+ *
+ * layout_seq is a sequence lock on the entry list: it is odd while the
+ * entries are reassigned (e.g. after a bus reset changed the device set).
+ * Readers that cache entry indexes should check it.
+ *
+ * A reader increments reader_heartbeat at least once every
+ * CONTROLSTATE_READER_TIMEOUT_USECS while it is interested in the live
+ * values, the owner only polls the device while it sees it change.
+ */
+struct ControlStateSegment {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t max_entries;
+    uint32_t entry_size;
+    uint32_t pid;
+    volatile uint32_t layout_seq;
+    volatile uint32_t nb_entries;
+    volatile uint32_t refreshes;
+    volatile uint32_t reader_heartbeat;
+    uint32_t reserved;
+
+    ControlStateEntry entries[CONTROLSTATE_MAX_ENTRIES];
+};
+
+/**
+ * @brief Publishes the state of a control tree through POSIX shared memory
+ *
+ * The owner of the control tree (e.g. ffado-dbus-server) creates the
+ * publisher on the root of the tree. Every element with a value gets an
+ * entry, identified by the path of element names from the root.
+ *
+ * The publisher listens to the eS_ValueChanged signal of the elements and
+ * their containers, the refresh thread re-reads the elements that changed.
+ * Other values are only read while a reader is attached: the ones that were
+ * never read, and the live elements (meters, clock/lock status) at every
+ * refresh interval. Without a reader, the device is not polled. An entry is
+ * only written when its value changed. updateElement() publishes the value
+ * of an element immediately.
+ *
+ * The values are read from the devices by the refresh thread. When an
+ * AccessSerializer is set, a device is only read while it is not otherwise
+ * busy, a value of a busy device is read at a later refresh.
+ *
+ * Readers map the segment read-write, since they signal their presence
+ * through reader_heartbeat, but never involve the owner, the bus or any
+ * syscall to read a value. The segment is created with mode 0700, hence
+ * only processes of the same user can attach.
+ *
+ * When the control tree is about to change, invalidate() has to be called,
+ * and rebuild() once the new tree is in place.
+ */
+class StatePublisher
+{
+public:
+    StatePublisher(Container &root, std::string name);
+    virtual ~StatePublisher();
+
+    bool init();
+    bool isShared() {return m_shm != NULL;};
+    ControlStateSegment *getSegment() {return m_segment;};
+
+    /// (re)assign the entries to the elements of the tree
+    bool rebuild();
+    /// stop using the elements, to be called before the tree changes
+    void invalidate();
+
+    /// re-read the changed elements, and the live ones if a reader is attached
+    void refresh();
+    /// true if a reader showed a sign of life recently
+    bool hasReader();
+    /// re-read the entries of one element
+    void updateElement(Element *e);
+    /// serialize the device reads with the other users of the devices
+    void setAccessSerializer(AccessSerializer *s);
+
+    bool start();
+    bool stop();
+
+    /**
+     * @brief copy an entry consistently (reader side, lock-free)
+     * @param e the entry in the segment
+     * @param copy where to copy it to
+     * @return false if no consistent copy could be made
+     */
+    static inline bool readEntry(const ControlStateEntry *e, ControlStateEntry *copy) {
+        for(int tries = 0; tries < 100; tries++) {
+            uint32_t seq = e->seq;
+            if(seq & 1) continue;
+            __sync_synchronize();
+            memcpy((void *)copy, (const void *)e, sizeof(ControlStateEntry));
+            __sync_synchronize();
+            if(e->seq == seq) return true;
+        }
+        return false;
+    };
+
+    void show();
+    void setVerboseLevel(int l);
+
+private:
+    class RefreshTask : public Util::RunnableInterface
+    {
+    public:
+        RefreshTask(StatePublisher &parent);
+        virtual ~RefreshTask() {};
+        bool Init() {return true;};
+        bool Execute();
+    private:
+        StatePublisher &m_parent;
+    };
+
+    // marks the entries of an element (or of all elements below a
+    // container) when it signals a value change
+    class ChangeHandler : public SignalFunctor
+    {
+    public:
+        ChangeHandler(StatePublisher &parent, Element &e,
+                      unsigned int first, unsigned int last);
+        virtual ~ChangeHandler() {};
+        virtual void operator() ();
+        virtual void operator() (int);
+        Element &getElement() {return m_element;};
+    private:
+        StatePublisher &m_parent;
+        Element &m_element;
+        unsigned int m_first;
+        unsigned int m_last;
+    };
+    typedef std::vector<ChangeHandler *> ChangeHandlerVector;
+    typedef std::vector<ChangeHandler *>::iterator ChangeHandlerVectorIterator;
+
+    struct entry_info {
+        Element *       element;
+        Element *       device;     // the serialization key
+        enum eControlStateType type;
+        int             row;
+        int             col;
+        int             locked_attr;
+    };
+
+    void addElements(Element &e, Element &device, std::string path);
+    void addChangeHandler(Element &e, unsigned int first, unsigned int last);
+    void removeChangeHandlers();
+    void markChanged(unsigned int first, unsigned int last);
+    bool addEntry(Element &e, Element &device, std::string path,
+                  enum eControlStateType type, int row, int col);
+    bool acquireDevice(unsigned int idx, Element *&acquired);
+    void releaseDevice(Element *&acquired);
+    void refreshEntry(unsigned int idx);
+    void writeEntry(ControlStateEntry *e, double value, int32_t status, const char *text);
+
+    Container &             m_root;
+    std::string             m_name;
+    Util::PosixSharedMemory* m_shm;
+    ControlStateSegment*    m_segment;
+    ControlStateSegment*    m_local_segment;
+    std::vector<struct entry_info> m_entries;
+    bool                    m_valid;
+    Util::Mutex*            m_lock;
+    AccessSerializer*       m_serializer;
+
+    // written by the change handlers, possibly from a device's notification
+    // thread, hence not protected by m_lock
+    volatile bool           m_changed[CONTROLSTATE_MAX_ENTRIES];
+    ChangeHandlerVector     m_handlers;
+
+    uint32_t                m_reader_heartbeat;
+    ffado_microsecs_t       m_reader_seen;
+
+    RefreshTask*            m_task;
+    Util::Thread*           m_thread;
+
+protected:
+    DECLARE_DEBUG_MODULE;
+};
+
+}; // namespace Control
+
+#endif // CONTROL_STATE_H
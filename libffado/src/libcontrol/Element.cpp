@@ -51,6 +51,7 @@ Element::Element(Element *parent)
     if(parent == NULL) {
         m_element_lock = new Util::PosixMutex("CTLEL");
     }
+    initSignalLock();
 }
 
 Element::Element(Element *parent, std::string n)
@@ -66,11 +67,23 @@ Element::Element(Element *parent, std::string n)
     if(parent == NULL) {
         m_element_lock = new Util::PosixMutex("CTLEL");
     }
+    initSignalLock();
 }
 
 Element::~Element()
 {
     if(m_element_lock) delete m_element_lock;
+    pthread_mutex_destroy(&m_signal_lock);
+}
+
+void
+Element::initSignalLock()
+{
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&m_signal_lock, &attr);
+    pthread_mutexattr_destroy(&attr);
 }
 
 void
@@ -133,7 +146,9 @@ bool
 Element::addSignalHandler( SignalFunctor* functor )
 {
     debugOutput(DEBUG_LEVEL_VERBOSE, "Adding signal handler (%p)\n", functor);
+    pthread_mutex_lock(&m_signal_lock);
     m_signalHandlers.push_back( functor );
+    pthread_mutex_unlock(&m_signal_lock);
     return true;
 }
 
@@ -142,6 +157,8 @@ Element::remSignalHandler( SignalFunctor* functor )
 {
     debugOutput(DEBUG_LEVEL_VERBOSE, "Removing signal handler (%p)\n", functor);
 
+    // waits for a signal that is being emitted on another thread
+    pthread_mutex_lock(&m_signal_lock);
     for ( std::vector< SignalFunctor* >::iterator it = m_signalHandlers.begin();
           it != m_signalHandlers.end();
           ++it )
@@ -149,36 +166,39 @@ Element::remSignalHandler( SignalFunctor* functor )
         if ( *it == functor ) {
             debugOutput(DEBUG_LEVEL_VERBOSE, " found\n");
             m_signalHandlers.erase( it );
+            pthread_mutex_unlock(&m_signal_lock);
             return true;
         }
     }
+    pthread_mutex_unlock(&m_signal_lock);
     debugOutput(DEBUG_LEVEL_VERBOSE, " not found\n");
     return false;
 }
 
+// the handlers can change the handler vector, hence it is indexed
 bool
 Element::emitSignal(int id, int value)
 {
-    for ( std::vector< SignalFunctor* >::iterator it = m_signalHandlers.begin();
-          it != m_signalHandlers.end();
-          ++it )
+    pthread_mutex_lock(&m_signal_lock);
+    for ( unsigned int i = 0; i < m_signalHandlers.size(); i++ )
     {
-        SignalFunctor *f = *it;
+        SignalFunctor *f = m_signalHandlers.at(i);
         if(f && f->m_id == id) (*f)(value);
     }
+    pthread_mutex_unlock(&m_signal_lock);
     return true;
 }
 
 bool
 Element::emitSignal(int id)
 {
-    for ( std::vector< SignalFunctor* >::iterator it = m_signalHandlers.begin();
-          it != m_signalHandlers.end();
-          ++it )
+    pthread_mutex_lock(&m_signal_lock);
+    for ( unsigned int i = 0; i < m_signalHandlers.size(); i++ )
     {
-        SignalFunctor *f = *it;
+        SignalFunctor *f = m_signalHandlers.at(i);
         if(f && f->m_id == id) (*f)();
     }
+    pthread_mutex_unlock(&m_signal_lock);
     return true;
 }
 
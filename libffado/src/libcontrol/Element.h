@@ -33,6 +33,8 @@
 #include "libutil/Mutex.h"
 #include "libutil/Functors.h"
 
+#include <pthread.h>
+
 namespace Control {
 
 class Element;
@@ -85,6 +87,8 @@ public:
 
     // can the value of this element change?
     virtual bool canChangeValue();
+    // does the value change by itself (e.g. meters, lock status)?
+    virtual bool isLive() {return false;};
 
     // these allow to prevent external access to the control elements
     // e.g. when the config tree is rebuilt
@@ -93,11 +97,28 @@ public:
     virtual bool isControlLocked();
 
     /**
-     * Update signal handler
+     * Update signal handler. The signals can be emitted from any thread
+     * (e.g. a device's notification handler). Once remSignalHandler()
+     * returned, the functor is not called anymore and can be deleted.
      */
     bool addSignalHandler( SignalFunctor* functor );
     bool remSignalHandler( SignalFunctor* functor );
 
+    // kept clear of the signal id's of the derived classes
+    enum eElementSignals {
+        eS_ValueChanged = 0x100,
+    };
+
+    /**
+     * Notify the signal handlers that the value of this element changed.
+     * To be called by whoever changed it, i.e. the writer of a new value or
+     * a device notification handler. For a container this means that some
+     * value below it changed.
+     * @param idx the index of the value that changed, -1 if unknown
+     */
+    void notifyValueChanged(int idx = -1)
+        {emitSignal(eS_ValueChanged, idx);};
+
     virtual void show();
 
     /**
@@ -120,6 +141,10 @@ private:
 
     uint64_t m_id;
     std::vector< SignalFunctor* > m_signalHandlers;
+    // held while the handlers are called, recursive such that a handler
+    // can (un)register handlers of this element
+    pthread_mutex_t m_signal_lock;
+    void initSignalLock();
 
 protected:
     DECLARE_DEBUG_MODULE;
@@ -29,6 +29,7 @@
 #include "libutil/PosixMutex.h"
 #include "libutil/Atomic.h"
 #include "libutil/Watchdog.h"
+#include "libutil/Configuration.h"
 
 #define DLL_PI        (3.141592653589793238)
 #define DLL_2PI       (2 * DLL_PI)
@@ -48,6 +49,7 @@ CycleTimerHelper::CycleTimerHelper(Ieee1394Service &parent, unsigned int update_
     , m_next_time_ticks ( 0 )
     , m_first_run ( true )
     , m_sleep_until ( 0 )
+    , m_sleep_until_lo ( 0 )
     , m_cycle_timer_prev ( 0 )
     , m_cycle_timer_ticks_prev ( 0 )
     , m_current_shadow_idx ( 0 )
@@ -55,8 +57,12 @@ CycleTimerHelper::CycleTimerHelper(Ieee1394Service &parent, unsigned int update_
     , m_realtime ( false )
     , m_priority ( 0 )
     , m_update_lock( new Util::PosixMutex("CTRUPD") )
+    , m_deadline ( NULL )
     , m_busreset_functor ( NULL)
     , m_unhandled_busreset ( false )
+    , m_feed_enabled ( false )
+    , m_nb_fed_updates ( 0 )
+    , m_nb_fed_rejects ( 0 )
 {
     debugOutput( DEBUG_LEVEL_VERBOSE, "Create %p...\n", this);
 
@@ -78,6 +84,7 @@ CycleTimerHelper::CycleTimerHelper(Ieee1394Service &parent, unsigned int update_
     , m_next_time_ticks ( 0 )
     , m_first_run ( true )
     , m_sleep_until ( 0 )
+    , m_sleep_until_lo ( 0 )
     , m_cycle_timer_prev ( 0 )
     , m_cycle_timer_ticks_prev ( 0 )
     , m_current_shadow_idx ( 0 )
@@ -85,8 +92,12 @@ CycleTimerHelper::CycleTimerHelper(Ieee1394Service &parent, unsigned int update_
     , m_realtime ( rt )
     , m_priority ( prio )
     , m_update_lock( new Util::PosixMutex("CTRUPD") )
+    , m_deadline ( NULL )
     , m_busreset_functor ( NULL)
     , m_unhandled_busreset ( false )
+    , m_feed_enabled ( false )
+    , m_nb_fed_updates ( 0 )
+    , m_nb_fed_rejects ( 0 )
 {
     debugOutput( DEBUG_LEVEL_VERBOSE, "Create %p...\n", this);
 
@@ -97,10 +108,18 @@ CycleTimerHelper::CycleTimerHelper(Ieee1394Service &parent, unsigned int update_
 
 CycleTimerHelper::~CycleTimerHelper()
 {
+    if (m_feed_enabled) {
+        debugOutput( DEBUG_LEVEL_VERBOSE, "(%p) DLL updates fed from ISO: %u, rejected: %u\n",
+                     this, m_nb_fed_updates, m_nb_fed_rejects);
+    }
     if (m_Thread) {
         m_Thread->Stop();
         delete m_Thread;
     }
+    if (m_deadline) {
+        Util::Watchdog *watchdog = m_Parent.getWatchdog();
+        if (watchdog) watchdog->unregisterThread(m_deadline);
+    }
 
     // unregister the bus reset handler
     if(m_busreset_functor) {
@@ -120,7 +139,18 @@ CycleTimerHelper::Start()
         return false;
     }
 
-    m_Thread = new Util::PosixThread(this, "CTRHLP", m_realtime, m_priority, 
+#if IEEE1394SERVICE_USE_CYCLETIMER_DLL
+    int feed = IEEE1394SERVICE_CYCLETIMER_FEED_FROM_ISO;
+    Util::Configuration *feed_config = m_Parent.getConfiguration();
+    if(feed_config) {
+        feed_config->getValueForSetting("ieee1394.cycletimer.feed_from_iso", feed);
+    }
+    m_feed_enabled = (feed != 0);
+    debugOutput( DEBUG_LEVEL_VERBOSE, "(%p) DLL fed from ISO: %d\n", this, m_feed_enabled);
+#endif
+
+    // when fed, the RT ISO threads keep the DLL up to date while streaming
+    m_Thread = new Util::PosixThread(this, "CTRHLP", m_realtime && !m_feed_enabled, m_priority, 
                                      PTHREAD_CANCEL_DEFERRED);
     if(!m_Thread) {
         debugFatal("No thread\n");
@@ -129,7 +159,16 @@ CycleTimerHelper::Start()
     // register the thread with the RT watchdog
     Util::Watchdog *watchdog = m_Parent.getWatchdog();
     if(watchdog) {
-        if(!watchdog->registerThread(m_Thread)) {
+        int policy = WATCHDOG_POLICY_CYCLETIMER;
+        Util::Configuration *config = m_Parent.getConfiguration();
+        if(config) {
+            config->getValueForSetting("ieee1394.cycletimer.watchdog_policy", policy);
+        }
+        char name[32];
+        snprintf(name, sizeof(name), "CTRHLP port %d", m_Parent.getPort());
+        m_deadline = watchdog->registerThread(name, m_Thread, m_usecs_per_update,
+                                              (enum Util::ThreadDeadline::eDemotionPolicy)policy);
+        if(!m_deadline) {
             debugWarning("could not register update thread with watchdog\n");
         }
     } else {
@@ -235,7 +274,7 @@ CycleTimerHelper::setThreadParameters(bool rt, int priority) {
 
 #if IEEE1394SERVICE_USE_CYCLETIMER_DLL
     if (m_Thread) {
-        if (m_realtime) {
+        if (m_realtime && !m_feed_enabled) {
             m_Thread->AcquireRealTime(m_priority);
         } else {
             m_Thread->DropRealTime();
@@ -300,7 +339,7 @@ CycleTimerHelper::initDLL() {
                        (unsigned int)TICKS_TO_CYCLES( (uint64_t)cycle_timer_ticks ),
                        (unsigned int)TICKS_TO_OFFSET( (uint64_t)cycle_timer_ticks ) );
 
-    m_sleep_until = local_time + m_usecs_per_update;
+    setSleepUntil(local_time + m_usecs_per_update);
     m_dll_e2 = m_ticks_per_update;
     m_current_time_usecs = local_time;
     m_next_time_usecs = m_current_time_usecs + m_usecs_per_update;
@@ -345,17 +384,37 @@ CycleTimerHelper::Execute()
     m_last_loop_entry = now;
     #endif
 
+    // the previous update is done, whatever path it returned by
+    if (m_deadline) m_deadline->end();
+
+    // the update that is due, the ISO threads can move it on concurrently
+    m_update_lock->Lock();
+    ffado_microsecs_t due = m_sleep_until;
+    m_update_lock->Unlock();
+
     if (!m_first_run) {
         // wait for the next update period
         //#if DEBUG_EXTREME_ENABLE
         #ifdef DEBUG
         ffado_microsecs_t now = Util::SystemTimeSource::getCurrentTimeAsUsecs();
-        int sleep_time = m_sleep_until - now;
+        int sleep_time = due - now;
         debugOutput( DEBUG_LEVEL_ULTRA_VERBOSE, "(%p) Sleep until %"PRId64"/%f (now: %"PRId64", diff=%d) ...\n",
-                    this, m_sleep_until, m_next_time_usecs, now, sleep_time);
+                    this, due, m_next_time_usecs, now, sleep_time);
         #endif
-        Util::SystemTimeSource::SleepUsecAbsolute(m_sleep_until);
+        ffado_microsecs_t wake_time = due;
+        if (m_feed_enabled) {
+            // the ISO threads do the update when streaming, only
+            // take over when they didn't for a whole period
+            wake_time += m_usecs_per_update;
+        }
+        Util::SystemTimeSource::SleepUsecAbsolute(wake_time);
         debugOutput( DEBUG_LEVEL_ULTRA_VERBOSE, " (%p) back...\n", this);
+        if (m_deadline) m_deadline->begin(wake_time);
+        if (m_feed_enabled
+            && !isUpdateDue(Util::SystemTimeSource::getCurrentTimeAsUsecs() - m_usecs_per_update)) {
+            // fed in the meantime
+            return true;
+        }
     } else {
         // Since getCycleTimerTicks() is called below,
         // m_shadow_vars[m_current_shadow_idx] must contain valid data.  On
@@ -372,7 +431,6 @@ CycleTimerHelper::Execute()
 
     uint32_t cycle_timer;
     uint64_t local_time;
-    int64_t usecs_late;
     int ntries=10;
     uint64_t cycle_timer_ticks;
     int64_t err_ticks;
@@ -388,7 +446,6 @@ CycleTimerHelper::Execute()
             debugError("Could not read cycle timer register\n");
             return false;
         }
-        usecs_late = local_time - m_sleep_until;
         cycle_timer_ticks = CYCLE_TIMER_TO_TICKS(cycle_timer);
 
         // calculate the CTR_TICKS we expect to read at "local_time"
@@ -416,9 +473,6 @@ CycleTimerHelper::Execute()
     // wakeup and read is as small as possible
     Util::MutexLockHelper lock(*m_update_lock);
 
-    // the difference between the measured and the expected time
-    int64_t diff_ticks = diffTicks(cycle_timer_ticks, (int64_t)m_next_time_ticks);
-
     // // simulate a random scheduling delay between (0-10ms)
     // ffado_microsecs_t tmp = Util::SystemTimeSource::SleepUsecRandom(10000);
     // debugOutput( DEBUG_LEVEL_VERBOSE, " (%p) random sleep of %u usecs...\n", this, tmp);
@@ -426,7 +480,7 @@ CycleTimerHelper::Execute()
     if(m_unhandled_busreset) {
         debugOutput(DEBUG_LEVEL_VERBOSE,
                     "(%p) Skipping DLL update due to unhandled busreset\n", this);
-        m_sleep_until += m_usecs_per_update;
+        setSleepUntil(m_sleep_until + m_usecs_per_update);
         // keep the thread running
         return true;
     }
@@ -440,6 +494,64 @@ CycleTimerHelper::Execute()
                        (unsigned int)TICKS_TO_CYCLES( (uint64_t)cycle_timer_ticks ),
                        (unsigned int)TICKS_TO_OFFSET( (uint64_t)cycle_timer_ticks ) );
 
+    // the ISO threads updated the DLL since the due time was read, possibly
+    // after the register was read
+    if (m_feed_enabled && !m_first_run
+        && (m_sleep_until != due || local_time < m_sleep_until)) {
+        return true;
+    }
+
+    if(!updateDLL(cycle_timer, local_time)) {
+        return false;
+    }
+
+#ifdef DEBUG
+    // do some verification
+    // we re-read a valid ctr timestamp
+    // then we use the attached system time to calculate
+    // the DLL generated timestamp and we check what the
+    // difference is
+
+    if(!readCycleTimerWithRetry(&cycle_timer, &local_time, 10)) {
+        debugError("Could not read cycle timer register (verify)\n");
+        return true; // true since this is a check only
+    }
+    cycle_timer_ticks = CYCLE_TIMER_TO_TICKS(cycle_timer);
+
+    // only check when successful
+    struct compute_vars new_vars = m_shadow_vars[m_current_shadow_idx];
+    int64_t time_diff = local_time - new_vars.usecs;
+    double y_step_in_ticks = ((double)time_diff) * new_vars.rate;
+    int64_t y_step_in_ticks_int = (int64_t)y_step_in_ticks;
+    uint64_t offset_in_ticks_int = new_vars.ticks;
+    uint32_t dll_time;
+    if (y_step_in_ticks_int > 0) {
+        dll_time = addTicks(offset_in_ticks_int, y_step_in_ticks_int);
+    } else {
+        dll_time = substractTicks(offset_in_ticks_int, -y_step_in_ticks_int);
+    }
+    int32_t ctr_diff = cycle_timer_ticks-dll_time;
+    debugOutput(DEBUG_LEVEL_ULTRA_VERBOSE, "(%p) CTR DIFF: HW %010"PRIu64" - DLL %010u = %010d (%s)\n", 
+                this, cycle_timer_ticks, dll_time, ctr_diff, (ctr_diff>0?"lag":"lead"));
+#endif
+
+    return true;
+}
+
+/*
+ * update the DLL with a cycle timer sample, taken at or after the time
+ * the update was due (m_sleep_until).
+ * call with lock held
+ */
+bool
+CycleTimerHelper::updateDLL(uint32_t cycle_timer, uint64_t local_time)
+{
+    uint64_t cycle_timer_ticks = CYCLE_TIMER_TO_TICKS(cycle_timer);
+    int64_t usecs_late = local_time - m_sleep_until;
+
+    // the difference between the measured and the expected time
+    int64_t diff_ticks = diffTicks(cycle_timer_ticks, (int64_t)m_next_time_ticks);
+
     if (m_first_run) {
         if(!initDLL()) {
             debugError("(%p) Could not init DLL\n", this);
@@ -456,7 +568,7 @@ CycleTimerHelper::Execute()
         }
     } else {
         // calculate next sleep time
-        m_sleep_until += m_usecs_per_update;
+        setSleepUntil(m_sleep_until + m_usecs_per_update);
 
         // correct for the latency between the wakeup and the actual CTR
         // read. The only time we can trust is the time returned by the
@@ -484,7 +596,7 @@ CycleTimerHelper::Execute()
 
         #ifdef DEBUG
         // makes no sense if not running realtime
-        if(m_realtime && usecs_late > 1000) {
+        if(m_realtime && !m_feed_enabled && usecs_late > 1000) {
             debugOutput(DEBUG_LEVEL_VERBOSE, "Rather late wakeup: %"PRId64" usecs\n", usecs_late);
         }
         #endif
@@ -573,39 +685,79 @@ CycleTimerHelper::Execute()
     // update the next index position
     m_shadow_vars[next_idx] = new_vars;
 
-    // then we can update the current index
+    // then we can update the current index, the updates can come
+    // from different threads hence the barrier
+    __sync_synchronize();
     m_current_shadow_idx = next_idx;
+    return true;
+}
 
-#ifdef DEBUG
-    // do some verification
-    // we re-read a valid ctr timestamp
-    // then we use the attached system time to calculate
-    // the DLL generated timestamp and we check what the
-    // difference is
+/*
+ * a cycle timer sample read by an ISO thread. There is no retry on a bogus
+ * read, the next poll return provides a new sample. Never blocks: when the
+ * update thread holds the lock the sample is dropped.
+ */
+void
+CycleTimerHelper::feed(uint32_t cycle_timer, uint64_t local_time)
+{
+    if (m_update_lock->TryLock() == false) {
+        return;
+    }
+    if (m_first_run || m_unhandled_busreset || local_time < m_sleep_until) {
+        // not due or not ready for it
+        m_update_lock->Unlock();
+        return;
+    }
 
-    if(!readCycleTimerWithRetry(&cycle_timer, &local_time, 10)) {
-        debugError("Could not read cycle timer register (verify)\n");
-        return true; // true since this is a check only
+    uint64_t cycle_timer_ticks = CYCLE_TIMER_TO_TICKS(cycle_timer);
+    int64_t err_ticks = diffTicks(cycle_timer_ticks, (int64_t)getCycleTimerTicks(local_time));
+    // the same checks as readCycleTimerWithRetry() and Execute() apply
+    if (cycle_timer == 0
+        || diffTicks(cycle_timer_ticks, m_cycle_timer_ticks_prev) < 0
+        || -err_ticks > 1*TICKS_PER_CYCLE || err_ticks > 1*TICKS_PER_CYCLE) {
+        debugOutputExtreme(DEBUG_LEVEL_VERBOSE,
+                           "(%p) rejected fed CTR: %08X, err: %"PRId64"\n",
+                           this, cycle_timer, err_ticks);
+        m_nb_fed_rejects++;
+        m_update_lock->Unlock();
+        return;
     }
-    cycle_timer_ticks = CYCLE_TIMER_TO_TICKS(cycle_timer);
+    m_cycle_timer_prev = cycle_timer;
+    m_cycle_timer_ticks_prev = cycle_timer_ticks;
 
-    // only check when successful
-    int64_t time_diff = local_time - new_vars.usecs;
-    double y_step_in_ticks = ((double)time_diff) * new_vars.rate;
-    int64_t y_step_in_ticks_int = (int64_t)y_step_in_ticks;
-    uint64_t offset_in_ticks_int = new_vars.ticks;
-    uint32_t dll_time;
-    if (y_step_in_ticks_int > 0) {
-        dll_time = addTicks(offset_in_ticks_int, y_step_in_ticks_int);
-    } else {
-        dll_time = substractTicks(offset_in_ticks_int, -y_step_in_ticks_int);
+    if(!updateDLL(cycle_timer, local_time)) {
+        debugError("(%p) Could not update DLL\n", this);
     }
-    int32_t ctr_diff = cycle_timer_ticks-dll_time;
-    debugOutput(DEBUG_LEVEL_ULTRA_VERBOSE, "(%p) CTR DIFF: HW %010"PRIu64" - DLL %010u = %010d (%s)\n", 
-                this, cycle_timer_ticks, dll_time, ctr_diff, (ctr_diff>0?"lag":"lead"));
-#endif
+    m_nb_fed_updates++;
+    m_update_lock->Unlock();
+}
 
-    return true;
+void
+CycleTimerHelper::setSleepUntil(ffado_microsecs_t t)
+{
+    m_sleep_until = t;
+    m_sleep_until_lo = (uint32_t)t;
+}
+
+bool
+CycleTimerHelper::isUpdateDue(uint64_t now)
+{
+    // wraps every ~71 minutes, the update interval is way shorter
+    return (int32_t)((uint32_t)now - m_sleep_until_lo) >= 0;
+}
+
+uint32_t
+CycleTimerHelper::getCycleTimerAndUpdate()
+{
+    uint64_t now = m_Parent.getCurrentTimeAsUsecs();
+    if (m_feed_enabled && isUpdateDue(now)) {
+        uint32_t cycle_timer;
+        uint64_t local_time;
+        if (m_Parent.readCycleTimerReg(&cycle_timer, &local_time)) {
+            feed(cycle_timer, local_time);
+        }
+    }
+    return getCycleTimer(now);
 }
 
 uint32_t
@@ -756,6 +908,12 @@ CycleTimerHelper::getCycleTimer()
     return cycle_timer;
 }
 
+uint32_t
+CycleTimerHelper::getCycleTimerAndUpdate()
+{
+    return getCycleTimer();
+}
+
 uint32_t
 CycleTimerHelper::getCycleTimer(uint64_t now)
 {
@@ -59,6 +59,9 @@
 #include "debugmodule/debugmodule.h"
 
 class Ieee1394Service;
+namespace Util {
+    class ThreadDeadline;
+}
 
 class CycleTimerHelper : public Util::RunnableInterface
 {
@@ -97,6 +100,17 @@ public:
      */
     uint32_t getCycleTimer(uint64_t now);
 
+    /**
+     * @brief get the current cycle timer value (in CTR format), and update
+     *        the DLL with a register read when an update is due
+     *
+     * Used by the ISO threads at every poll return. When the DLL is fed
+     * this way, the update thread only takes over when the ISO threads
+     * stop (e.g. when not streaming).
+     * @note thread safe, doesn't block
+     */
+    uint32_t getCycleTimerAndUpdate();
+
     /**
      * @brief get the system time for a specific cycle timer value (in ticks)
      * @note thread safe
@@ -125,6 +139,12 @@ private:
 
 #if IEEE1394SERVICE_USE_CYCLETIMER_DLL
     bool initDLL();
+    bool updateDLL(uint32_t cycle_timer, uint64_t local_time);
+    void feed(uint32_t cycle_timer, uint64_t local_time);
+    // call with lock held
+    void setSleepUntil(ffado_microsecs_t t);
+    // lock free, can be called from any thread
+    bool isUpdateDue(uint64_t now);
 #endif
 
     Ieee1394Service &m_Parent;
@@ -143,6 +163,9 @@ private:
     double m_next_time_ticks;
     bool m_first_run;
     ffado_microsecs_t m_sleep_until;
+    // the low 32 bits of m_sleep_until, for the lock free readers since
+    // a 64 bit read isn't atomic on all platforms
+    volatile uint32_t m_sleep_until_lo;
 
     uint32_t m_cycle_timer_prev;
     uint64_t m_cycle_timer_ticks_prev;
@@ -166,11 +189,18 @@ private:
     bool            m_realtime;
     unsigned int    m_priority;
     Util::Mutex*    m_update_lock;
+    // an update has to be done before the next one is due
+    Util::ThreadDeadline* m_deadline;
 
     // busreset handling
     Util::Functor* m_busreset_functor;
     bool            m_unhandled_busreset;
 
+    // DLL updates fed by the ISO threads
+    bool            m_feed_enabled;
+    unsigned int    m_nb_fed_updates;
+    unsigned int    m_nb_fed_rejects;
+
 #ifdef DEBUG
     uint64_t m_last_loop_entry;
     int m_successive_short_loops;
@@ -49,6 +49,7 @@ using namespace Streaming;
 IsoHandlerManager::IsoTask::IsoTask(IsoHandlerManager& manager, enum IsoHandler::EHandlerType t)
     : m_manager( manager )
     , m_SyncIsoHandler ( NULL )
+    , m_deadline ( NULL )
     , m_handlerType( t )
     , m_running( false )
     , m_in_busreset( false )
@@ -141,6 +142,7 @@ IsoHandlerManager::IsoTask::updateShadowMapHelper()
     unsigned int i, cnt, max;
     max = m_manager.m_IsoHandlers.size();
     m_SyncIsoHandler = NULL;
+    int min_irq_interval = 0;
     for (i = 0, cnt = 0; i < max; i++) {
 
         // FIXME: This is a very crude guard against some other thread
@@ -175,6 +177,9 @@ IsoHandlerManager::IsoTask::updateShadowMapHelper()
             m_poll_fds_shadow[cnt].revents = 0;
             m_poll_fds_shadow[cnt].events = POLLIN;
             cnt++;
+            if(min_irq_interval == 0 || h->getIrqInterval() < min_irq_interval) {
+                min_irq_interval = h->getIrqInterval();
+            }
             // FIXME: need a more generic approach here
             if(   m_SyncIsoHandler == NULL
                && h->getType() == IsoHandler::eHT_Transmit) {
@@ -201,6 +206,9 @@ IsoHandlerManager::IsoTask::updateShadowMapHelper()
         m_SyncIsoHandler = m_IsoHandler_map_shadow[0];
     }
     m_poll_nfds_shadow = cnt;
+    if(m_deadline && min_irq_interval > 0) {
+        m_deadline->setBudget(min_irq_interval * USECS_PER_CYCLE);
+    }
     debugOutput( DEBUG_LEVEL_VERBOSE, "(%p) updated shadow vars...\n", this);
 }
 
@@ -305,7 +313,9 @@ IsoHandlerManager::IsoTask::Execute()
     // Use a shadow map of the fd's such that we don't have to update
     // the fd map everytime we run poll().
     err = poll (m_poll_fds_shadow, m_poll_nfds_shadow, m_poll_timeout);
-    uint32_t ctr_at_poll_return = m_manager.get1394Service().getCycleTimer();
+    // also keeps the cycle timer DLL up to date while streaming
+    uint32_t ctr_at_poll_return = m_manager.get1394Service().getCycleTimerAndUpdate();
+    if(m_deadline && err > 0) m_deadline->begin();
 
     if (err < 0) {
         if (errno == EINTR) {
@@ -358,6 +368,7 @@ IsoHandlerManager::IsoTask::Execute()
     }
 
     if(handler_died) {
+        if(m_deadline) m_deadline->cancel();
         m_running = false;
         // One or more handlers have died, however it can be restarted again,
         // so keep looping. The xrun handling code will eventually time out if
@@ -394,6 +405,7 @@ IsoHandlerManager::IsoTask::Execute()
             }
         }
     }
+    if(m_deadline) m_deadline->end();
     return true;
 }
 
@@ -482,6 +494,7 @@ IsoHandlerManager::IsoHandlerManager(Ieee1394Service& service)
    , m_IsoTaskTransmit ( NULL )
    , m_IsoThreadReceive ( NULL )
    , m_IsoTaskReceive ( NULL )
+   , m_FlightRecorder ( NULL )
 {
 }
 
@@ -494,6 +507,7 @@ IsoHandlerManager::IsoHandlerManager(Ieee1394Service& service, bool run_rt, int
    , m_IsoThreadReceive ( NULL )
    , m_IsoTaskReceive ( NULL )
    , m_MissedCyclesOK ( false )
+   , m_FlightRecorder ( NULL )
 {
 }
 
@@ -512,17 +526,64 @@ IsoHandlerManager::~IsoHandlerManager()
         m_IsoThreadReceive->Stop();
         delete m_IsoThreadReceive;
     }
+    // the threads are stopped, so the deadlines are no longer used
+    Util::Watchdog *watchdog = m_service.getWatchdog();
     if (m_IsoTaskTransmit) {
+        if (watchdog) watchdog->unregisterThread(m_IsoTaskTransmit->m_deadline);
         delete m_IsoTaskTransmit;
     }
     if (m_IsoTaskReceive) {
+        if (watchdog) watchdog->unregisterThread(m_IsoTaskReceive->m_deadline);
         delete m_IsoTaskReceive;
     }
+    if (m_FlightRecorder) {
+        delete m_FlightRecorder;
+    }
+}
+
+void
+IsoHandlerManager::notifyBusReset()
+{
+    for ( IsoHandlerVectorIterator it = m_IsoHandlers.begin();
+          it != m_IsoHandlers.end();
+          ++it )
+    {
+        (*it)->notifyBusReset();
+    }
 }
 
 bool
-IsoHandlerManager::handleBusReset()
+IsoHandlerManager::xrunOccurred()
 {
+    for ( StreamProcessorVectorIterator it = m_StreamProcessors.begin();
+          it != m_StreamProcessors.end();
+          ++it )
+    {
+        if ((*it)->xrunOccurred()) return true;
+    }
+    return false;
+}
+
+bool
+IsoHandlerManager::handleBusReset(bool resync_only)
+{
+    if (resync_only) {
+        debugOutput( DEBUG_LEVEL_NORMAL, "bus reset, resynchronizing streams...\n");
+        // the handlers are not stopped, hence the iso tasks can keep
+        // iterating them
+        bool retval = true;
+        for ( IsoHandlerVectorIterator it = m_IsoHandlers.begin();
+              it != m_IsoHandlers.end();
+              ++it )
+        {
+            if (!(*it)->handleBusReset(true)) {
+                debugWarning("Failed to resync %p after busreset\n", *it);
+                retval = false;
+            }
+        }
+        return retval;
+    }
+
     debugOutput( DEBUG_LEVEL_NORMAL, "bus reset...\n");
     // A few things can happen on bus reset:
     // 1) no devices added/removed => streams are still valid, but might have to be restarted
@@ -608,11 +669,31 @@ bool IsoHandlerManager::init()
     int ihm_iso_prio_increase_xmit = ISOHANDLERMANAGER_ISO_PRIO_INCREASE_XMIT;
     int ihm_iso_prio_increase_recv = ISOHANDLERMANAGER_ISO_PRIO_INCREASE_RECV;
     int64_t isotask_activity_timeout_usecs = ISOHANDLERMANAGER_ISO_TASK_WAIT_TIMEOUT_USECS;
+    int flightrecorder_enable = ISOHANDLERMANAGER_FLIGHTRECORDER_ENABLE;
+    int flightrecorder_records = ISOHANDLERMANAGER_FLIGHTRECORDER_RECORDS;
+    int watchdog_policy = WATCHDOG_POLICY_ISO_TASK;
     if(config) {
         config->getValueForSetting("ieee1394.isomanager.prio_increase", ihm_iso_prio_increase);
         config->getValueForSetting("ieee1394.isomanager.prio_increase_xmit", ihm_iso_prio_increase_xmit);
         config->getValueForSetting("ieee1394.isomanager.prio_increase_recv", ihm_iso_prio_increase_recv);
         config->getValueForSetting("ieee1394.isomanager.isotask_activity_timeout_usecs", isotask_activity_timeout_usecs);
+        config->getValueForSetting("ieee1394.isomanager.flightrecorder", flightrecorder_enable);
+        config->getValueForSetting("ieee1394.isomanager.flightrecorder_records", flightrecorder_records);
+        config->getValueForSetting("ieee1394.isomanager.watchdog_policy", watchdog_policy);
+    }
+
+    // the flight recorder has to exist before the threads start
+    if(flightrecorder_enable && flightrecorder_records > 0) {
+        char name[16];
+        snprintf(name, sizeof(name), "port%d", m_service.getPort());
+        m_FlightRecorder = new Util::FlightRecorder(name, flightrecorder_records);
+        if(!m_FlightRecorder || !m_FlightRecorder->init()) {
+            debugWarning("Could not create flight recorder, continuing without\n");
+            delete m_FlightRecorder;
+            m_FlightRecorder = NULL;
+        } else {
+            m_FlightRecorder->setVerboseLevel(getDebugLevel());
+        }
     }
 
     // create threads to iterate our ISO handlers
@@ -652,13 +733,21 @@ bool IsoHandlerManager::init()
         return false;
     }
     m_IsoThreadReceive->setVerboseLevel(getDebugLevel());
-    // register the thread with the RT watchdog
+    // register the threads with the RT watchdog. The budget is set
+    // once the handlers are known, until then only stalls are detected.
     Util::Watchdog *watchdog = m_service.getWatchdog();
     if(watchdog) {
-        if(!watchdog->registerThread(m_IsoThreadTransmit)) {
+        char name[32];
+        enum Util::ThreadDeadline::eDemotionPolicy policy =
+            (enum Util::ThreadDeadline::eDemotionPolicy)watchdog_policy;
+        snprintf(name, sizeof(name), "ISOXMT port %d", m_service.getPort());
+        m_IsoTaskTransmit->m_deadline = watchdog->registerThread(name, m_IsoThreadTransmit, 0, policy);
+        if(!m_IsoTaskTransmit->m_deadline) {
             debugWarning("could not register iso transmit thread with watchdog\n");
         }
-        if(!watchdog->registerThread(m_IsoThreadReceive)) {
+        snprintf(name, sizeof(name), "ISORCV port %d", m_service.getPort());
+        m_IsoTaskReceive->m_deadline = watchdog->registerThread(name, m_IsoThreadReceive, 0, policy);
+        if(!m_IsoTaskReceive->m_deadline) {
             debugWarning("could not register iso receive thread with watchdog\n");
         }
     } else {
@@ -678,6 +767,13 @@ bool IsoHandlerManager::init()
     return true;
 }
 
+void
+IsoHandlerManager::dumpFlightRecorder(const char *reason)
+{
+    if(m_FlightRecorder == NULL) return;
+    m_FlightRecorder->dump(reason);
+}
+
 void
 IsoHandlerManager::signalActivityTransmit()
 {
@@ -735,28 +831,20 @@ bool IsoHandlerManager::unregisterHandler(IsoHandler *handler)
  *        between streams and handlers, this is not ok for
  *        multichannel receive
  */
-bool IsoHandlerManager::registerStream(StreamProcessor *stream)
+/**
+ * @brief derive the raw1394 ISO buffer parameters for the handler of a stream
+ *
+ * The interrupt interval follows from the number of packets in a period,
+ * hence these have to be re-derived when the period size changes.
+ *
+ * @param stream the stream
+ * @param p the parameters
+ * @return false if the stream can't be handled
+ */
+bool
+IsoHandlerManager::getHandlerParameters(StreamProcessor *stream, struct HandlerParameters &p)
 {
-    debugOutput( DEBUG_LEVEL_VERBOSE, "Registering %s stream %p\n", stream->getTypeString(), stream);
-    assert(stream);
-
-    IsoHandler* h = NULL;
-
-    // make sure the stream isn't already attached to a handler
-    for ( IsoHandlerVectorIterator it = m_IsoHandlers.begin();
-      it != m_IsoHandlers.end();
-      ++it )
-    {
-        if((*it)->isStreamRegistered(stream)) {
-            debugError( "stream already registered!\n");
-            return false;
-        }
-    }
-
-    // clean up all handlers that aren't used
-    pruneHandlers();
-
-    // allocate a handler for this stream
+    p.receive_mode = RAW1394_DMA_PACKET_PER_BUFFER;
     if (stream->getType()==StreamProcessor::ePT_Receive) {
         // grab the options from the parent
         Util::Configuration *config = m_service.getConfiguration();
@@ -834,17 +922,10 @@ bool IsoHandlerManager::registerStream(StreamProcessor *stream)
             irq_interval = buffers/2;
         }
 
-        // create the actual handler
-        debugOutput( DEBUG_LEVEL_VERBOSE, " creating IsoRecvHandler\n");
-        h = new IsoHandler(*this, IsoHandler::eHT_Receive,
-                           buffers, max_packet_size, irq_interval);
-
-        if(!h) {
-            debugFatal("Could not create IsoRecvHandler\n");
-            return false;
-        }
-
-        h->setReceiveMode(receive_mode);
+        p.buf_packets = buffers;
+        p.max_packet_size = max_packet_size;
+        p.irq_interval = irq_interval;
+        p.receive_mode = receive_mode;
 
     } else if (stream->getType()==StreamProcessor::ePT_Transmit) {
         // grab the options from the parent
@@ -885,11 +966,63 @@ bool IsoHandlerManager::registerStream(StreamProcessor *stream)
             irq_interval = buffers/2;
         }
 
+        p.buf_packets = buffers;
+        p.max_packet_size = max_packet_size;
+        p.irq_interval = irq_interval;
+
+    } else {
+        debugFatal("Bad stream type\n");
+        return false;
+    }
+    return true;
+}
+
+bool IsoHandlerManager::registerStream(StreamProcessor *stream)
+{
+    debugOutput( DEBUG_LEVEL_VERBOSE, "Registering %s stream %p\n", stream->getTypeString(), stream);
+    assert(stream);
+
+    IsoHandler* h = NULL;
+
+    // make sure the stream isn't already attached to a handler
+    for ( IsoHandlerVectorIterator it = m_IsoHandlers.begin();
+      it != m_IsoHandlers.end();
+      ++it )
+    {
+        if((*it)->isStreamRegistered(stream)) {
+            debugError( "stream already registered!\n");
+            return false;
+        }
+    }
+
+    // clean up all handlers that aren't used
+    pruneHandlers();
+
+    // allocate a handler for this stream
+    struct HandlerParameters params;
+    if(!getHandlerParameters(stream, params)) {
+        debugFatal("Could not determine the handler parameters\n");
+        return false;
+    }
+    if (stream->getType()==StreamProcessor::ePT_Receive) {
+        // create the actual handler
+        debugOutput( DEBUG_LEVEL_VERBOSE, " creating IsoRecvHandler\n");
+        h = new IsoHandler(*this, IsoHandler::eHT_Receive,
+                           params.buf_packets, params.max_packet_size, params.irq_interval);
+
+        if(!h) {
+            debugFatal("Could not create IsoRecvHandler\n");
+            return false;
+        }
+
+        h->setReceiveMode(params.receive_mode);
+
+    } else if (stream->getType()==StreamProcessor::ePT_Transmit) {
         debugOutput( DEBUG_LEVEL_VERBOSE, " creating IsoXmitHandler\n");
 
         // create the actual handler
         h = new IsoHandler(*this, IsoHandler::eHT_Transmit,
-                           buffers, max_packet_size, irq_interval);
+                           params.buf_packets, params.max_packet_size, params.irq_interval);
 
         if(!h) {
             debugFatal("Could not create IsoXmitHandler\n");
@@ -922,6 +1055,44 @@ bool IsoHandlerManager::registerStream(StreamProcessor *stream)
     return true;
 }
 
+bool
+IsoHandlerManager::periodSizeChanged()
+{
+    debugOutput( DEBUG_LEVEL_VERBOSE, "(%p) period size changed, retuning handlers...\n", this);
+    bool retval = true;
+    for ( IsoHandlerVectorIterator it = m_IsoHandlers.begin();
+          it != m_IsoHandlers.end();
+          ++it )
+    {
+        IsoHandler *h = *it;
+        // find the stream of the handler
+        StreamProcessor *stream = NULL;
+        for ( StreamProcessorVectorIterator it2 = m_StreamProcessors.begin();
+              it2 != m_StreamProcessors.end();
+              ++it2 )
+        {
+            if(h->isStreamRegistered(*it2)) {
+                stream = *it2;
+                break;
+            }
+        }
+        if(stream == NULL) continue;
+
+        struct HandlerParameters params;
+        if(!getHandlerParameters(stream, params)) {
+            debugError("Could not determine the parameters for handler %p\n", h);
+            retval = false;
+            continue;
+        }
+        if(!h->setBufferParameters(params.buf_packets, params.irq_interval, params.receive_mode)) {
+            debugError("Could not retune handler %p\n", h);
+            retval = false;
+            continue;
+        }
+    }
+    return retval;
+}
+
 bool IsoHandlerManager::unregisterStream(StreamProcessor *stream)
 {
     debugOutput( DEBUG_LEVEL_VERBOSE, "Unregistering %s stream %p\n", stream->getTypeString(), stream);
@@ -1390,6 +1561,16 @@ IsoHandlerManager::IsoHandler::iterate(uint32_t cycle_timer_now) {
     if(m_State == eHS_Running) {
         assert(m_handle);
 
+        Util::FlightRecord *r = (m_manager.getFlightRecorder() ? m_manager.getFlightRecorder()->getRecord() : NULL);
+        if(r) {
+            fillFlightRecord(r, Util::FlightRecorder::eRT_Iterate, -1);
+            r->pkt_ctr = 0xFFFFFFFF;
+            r->dropped = 0;
+            r->skipped = 0;
+            r->length = 0;
+            r->result = 0;
+        }
+
         #if ISOHANDLER_FLUSH_BEFORE_ITERATE
         // this flushes all packets received since the poll() returned
         // from kernel to userspace such that they are processed by this
@@ -1421,9 +1602,27 @@ IsoHandlerManager::IsoHandler::iterate(uint32_t cycle_timer_now) {
  * @return ?
  */
 
+void
+IsoHandlerManager::IsoHandler::notifyBusReset()
+{
+    if (m_Client) {
+        m_Client->notifyBusReset();
+    }
+}
+
 bool
-IsoHandlerManager::IsoHandler::handleBusReset()
+IsoHandlerManager::IsoHandler::handleBusReset(bool resync_only)
 {
+    if (m_Client == NULL) {
+        // not streaming, nothing to resynchronize
+        return true;
+    }
+    if (resync_only) {
+        // the handle is being iterated by the iso task, leave it alone
+        debugOutput( DEBUG_LEVEL_VERBOSE, "bus reset, resync only...\n");
+        return m_Client->handleBusReset(true);
+    }
+
     debugOutput( DEBUG_LEVEL_NORMAL, "bus reset...\n");
     m_last_packet_handled_at = 0xFFFFFFFF;
 
@@ -1435,7 +1634,7 @@ IsoHandlerManager::IsoHandler::handleBusReset()
     raw1394_read(m_handle, raw1394_get_local_id(m_handle),
                  CSR_REGISTER_BASE | CSR_CYCLE_TIME, 4, &buf);
 
-    return m_Client->handleBusReset();
+    return m_Client->handleBusReset(false);
 }
 
 /**
@@ -1517,6 +1716,31 @@ bool IsoHandlerManager::IsoHandler::unregisterStream(StreamProcessor *stream)
     return true;
 }
 
+/**
+ * fills the fields of a flight record that are common to
+ * all record types
+ */
+void
+IsoHandlerManager::IsoHandler::fillFlightRecord(Util::FlightRecord *r, int type, int cycle)
+{
+    r->type = type;
+    r->now = m_last_now;
+    r->cycle = cycle;
+    r->handler = (m_type == eHT_Transmit ? 0x80 : 0x00);
+    if(m_Client) {
+        int channel = m_Client->getChannel();
+        r->handler |= (channel < 0 ? 0x40 : (channel & 0x3F));
+        r->sp_state = m_Client->getStateId();
+        r->flags = (m_Client->xrunOccurred() ? Util::FlightRecorder::eRF_ClientXrun : 0);
+        r->buffer_fill = m_Client->getBufferFill();
+    } else {
+        r->handler |= 0x40;
+        r->sp_state = 0;
+        r->flags = 0;
+        r->buffer_fill = -1;
+    }
+}
+
 // ISO packet interface
 enum raw1394_iso_disposition IsoHandlerManager::IsoHandler::putPacket(
                     unsigned char *data, unsigned int length,
@@ -1603,6 +1827,17 @@ enum raw1394_iso_disposition IsoHandlerManager::IsoHandler::putPacket(
     #endif
     m_last_packet_handled_at = pkt_ctr;
 
+    // telemetry: how late did we handle this packet
+    Util::TelemetryStreamSlot *telemetry = (m_Client ? m_Client->getTelemetrySlot() : NULL);
+    if(telemetry) {
+        int64_t latency = diffTicks(CYCLE_TIMER_TO_TICKS(m_last_now), pkt_ctr_ticks);
+        Util::StreamTelemetry::mark(&telemetry->packet_latency, (latency > 0 ? latency : 0));
+        if(dropped_cycles > 0) {
+            telemetry->dropped_cycles += dropped_cycles;
+            Util::StreamTelemetry::mark(&telemetry->dropped, dropped_cycles);
+        }
+    }
+
     // leave the offset field (for now?)
 
     debugOutputExtreme(DEBUG_LEVEL_ULTRA_VERBOSE,
@@ -1620,10 +1855,20 @@ enum raw1394_iso_disposition IsoHandlerManager::IsoHandler::putPacket(
     #endif
 
     // iterate the client if required
+    enum raw1394_iso_disposition retval = RAW1394_ISO_OK;
     if(m_Client)
-        return m_Client->putPacket(data, length, channel, tag, sy, pkt_ctr, dropped_cycles);
+        retval = m_Client->putPacket(data, length, channel, tag, sy, pkt_ctr, dropped_cycles);
 
-    return RAW1394_ISO_OK;
+    Util::FlightRecord *r = (m_manager.getFlightRecorder() ? m_manager.getFlightRecorder()->getRecord() : NULL);
+    if(r) {
+        fillFlightRecord(r, Util::FlightRecorder::eRT_PutPacket, cycle);
+        r->pkt_ctr = pkt_ctr;
+        r->dropped = dropped_cycles;
+        r->skipped = 0;
+        r->length = length;
+        r->result = retval;
+    }
+    return retval;
 }
 
 enum raw1394_iso_disposition
@@ -1657,6 +1902,13 @@ IsoHandlerManager::IsoHandler::getPacket(unsigned char *data, unsigned int *leng
         uint64_t pkt_ctr_ticks = wrapAtMinMaxTicks(tmp);
         pkt_ctr = TICKS_TO_CYCLE_TIMER(pkt_ctr_ticks);
 
+        // telemetry: how far ahead of transmission is this packet generated
+        if(m_Client && m_Client->getTelemetrySlot()) {
+            int64_t ahead = diffTicks(pkt_ctr_ticks, CYCLE_TIMER_TO_TICKS(m_last_now));
+            Util::StreamTelemetry::mark(&m_Client->getTelemetrySlot()->packet_latency,
+                                        (ahead > 0 ? ahead : 0));
+        }
+
 //debugOutput(DEBUG_LEVEL_VERBOSE, "cy=%d, now_cy=%d, diff_cy=%lld, tmp=%lld, pkt_ctr_ticks=%lld, pkt_ctr=%d\n",
 //  cycle, now_cycles, diff_cycles, tmp, pkt_ctr_ticks, pkt_ctr);
         #if ISOHANDLER_CHECK_CTR_RECONSTRUCTION
@@ -1721,6 +1973,18 @@ IsoHandlerManager::IsoHandler::getPacket(unsigned char *data, unsigned int *leng
         else
             dropped_cycles -= m_deferred_cycles;
 
+        Util::TelemetryStreamSlot *telemetry = (m_Client ? m_Client->getTelemetrySlot() : NULL);
+        if(telemetry) {
+            if(skipped) {
+                telemetry->skipped_cycles += skipped;
+                Util::StreamTelemetry::mark(&telemetry->skipped, skipped);
+            }
+            if(dropped_cycles > 0) {
+                telemetry->dropped_cycles += dropped_cycles;
+                Util::StreamTelemetry::mark(&telemetry->dropped, dropped_cycles);
+            }
+        }
+
         #ifdef DEBUG
         if(skipped) {
             debugOutput(DEBUG_LEVEL_VERY_VERBOSE,
@@ -1769,6 +2033,16 @@ IsoHandlerManager::IsoHandler::getPacket(unsigned char *data, unsigned int *leng
             } else
                 m_deferred_cycles++;
         }
+
+        Util::FlightRecord *r = (m_manager.getFlightRecorder() ? m_manager.getFlightRecorder()->getRecord() : NULL);
+        if(r) {
+            fillFlightRecord(r, Util::FlightRecorder::eRT_GetPacket, cycle);
+            r->pkt_ctr = pkt_ctr;
+            r->dropped = (dropped_cycles > 0 ? dropped_cycles : 0);
+            r->skipped = skipped;
+            r->length = *length;
+            r->result = retval;
+        }
         return retval;
     }
 
@@ -1939,6 +2213,27 @@ IsoHandlerManager::IsoHandler::disable()
     return true;
 }
 
+bool
+IsoHandlerManager::IsoHandler::setBufferParameters(unsigned int buf_packets, int irq_interval,
+                                                   enum raw1394_iso_dma_recv_mode receive_mode)
+{
+    if(buf_packets == m_buf_packets && irq_interval == m_irq_interval
+       && (m_type == eHT_Transmit || receive_mode == m_receive_mode)) {
+        return true;
+    }
+    debugOutput( DEBUG_LEVEL_VERBOSE, "(%p, %s) buffers %u => %u, irq interval %d => %d\n",
+                 this, getTypeString(), m_buf_packets, buf_packets, m_irq_interval, irq_interval);
+    if(m_State != eHS_Stopped || m_NextState != eHS_Stopped) {
+        debugError("(%p, %s) Can't change the buffer parameters of a running handler\n",
+                   this, getTypeString());
+        return false;
+    }
+    m_buf_packets = buf_packets;
+    m_irq_interval = irq_interval;
+    m_receive_mode = receive_mode;
+    return true;
+}
+
 // functions to request enable or disable at the next opportunity
 bool
 IsoHandlerManager::IsoHandler::requestEnable(int cycle)
@@ -29,6 +29,7 @@
 #include "debugmodule/debugmodule.h"
 
 #include "libutil/Thread.h"
+#include "libutil/FlightRecorder.h"
 
 #include <sys/poll.h>
 #include <errno.h>
@@ -36,6 +37,9 @@
 #include <semaphore.h>
 
 class Ieee1394Service;
+namespace Util {
+    class ThreadDeadline;
+}
 //class IsoHandler;
 //enum IsoHandler::EHandlerType;
 
@@ -106,6 +110,8 @@ class IsoHandlerManager
                                   unsigned char *tag, unsigned char *sy,
                                   int cycle, unsigned int dropped, unsigned int skipped);
 
+                void fillFlightRecord(Util::FlightRecord *r, int type, int cycle);
+
         public:
 
     /**
@@ -154,11 +160,20 @@ class IsoHandlerManager
             bool isEnabled()
             {return m_State == eHS_Running;};
 
-    // no setter functions, because those would require a re-init
             unsigned int getMaxPacketSize() { return m_max_packet_size;};
             unsigned int getNbBuffers() { return m_buf_packets;};
             int getIrqInterval() { return m_irq_interval;};
 
+    /**
+             * @brief change the ISO buffer parameters
+             *
+             * The parameters are used on the next enable(). They can only
+             * be changed while the handler is stopped.
+             * @return true if successful, false if the handler is running
+     */
+            bool setBufferParameters(unsigned int buf_packets, int irq_interval,
+                                     enum raw1394_iso_dma_recv_mode receive_mode);
+
             void dumpInfo();
 
             bool inUse() {return (m_Client != 0) ;};
@@ -196,7 +211,12 @@ class IsoHandlerManager
             {m_receive_mode = m;}
 
             void notifyOfDeath();
-            bool handleBusReset();
+            void notifyBusReset();
+            /**
+             * @param resync_only keep running, only let the client
+             *                    resynchronize to the stream
+             */
+            bool handleBusReset(bool resync_only = false);
 
         private:
             IsoHandlerManager& m_manager;
@@ -301,6 +321,10 @@ class IsoHandlerManager
         // updates the streams map
             void updateShadowMapHelper();
 
+        // the deadline of an iteration, the budget is the shortest
+        // interrupt interval of the handlers
+            Util::ThreadDeadline * m_deadline;
+
 #ifdef DEBUG
             uint64_t m_last_loop_entry;
             int m_successive_short_loops;
@@ -375,16 +399,53 @@ class IsoHandlerManager
          */
         void setMissedCyclesOK(bool ok) { m_MissedCyclesOK = ok; };
 
+        /**
+         * @brief re-derives the ISO buffer parameters of all handlers
+         *
+         * To be called when the period size has changed, since the
+         * interrupt interval of a handler depends on it. The handlers
+         * have to be stopped, a running handler is not retuned.
+         * @return true if successful
+         */
+        bool periodSizeChanged();
+
     private:
         IsoHandler * getHandlerForStream(Streaming::StreamProcessor *stream);
         void requestShadowMapUpdate();
+
+        // the raw1394 ISO buffer parameters for the handler of a stream
+        struct HandlerParameters {
+            unsigned int buf_packets;
+            unsigned int max_packet_size;
+            int irq_interval;
+            enum raw1394_iso_dma_recv_mode receive_mode;
+        };
+        bool getHandlerParameters(Streaming::StreamProcessor *stream, struct HandlerParameters &p);
     public:
         Ieee1394Service& get1394Service() {return m_service;};
 
+        /**
+         * returns the flight recorder for this manager, NULL if disabled
+         */
+        Util::FlightRecorder *getFlightRecorder() {return m_FlightRecorder;};
+        ///> has the flight recorder contents written to disk, doesn't block on the I/O
+        void dumpFlightRecorder(const char *reason);
+
+        /**
+         * This should be called as soon as a busreset has been detected,
+         * such that the cycles lost during the reset are not considered
+         * an xrun until the reset is handled.
+         */
+        void notifyBusReset();
+        ///> true if one of the registered streams has flagged an xrun
+        bool xrunOccurred();
         /**
          * This should be called when a busreset has happened.
+         * @param resync_only true if the iso resources of the streams
+         *                    survived the reset. The handlers keep running
+         *                    and the stream processors only resynchronize.
          */
-        bool handleBusReset();
+        bool handleBusReset(bool resync_only = false);
 
     // the state machine
     private:
@@ -427,6 +488,8 @@ class IsoHandlerManager
 
         bool            m_MissedCyclesOK;
 
+        Util::FlightRecorder *m_FlightRecorder;
+
         // debug stuff
         DECLARE_DEBUG_MODULE;
 
@@ -39,6 +39,7 @@
 #include "libutil/PosixMutex.h"
 #include "libutil/PosixThread.h"
 #include "libutil/Configuration.h"
+#include "libutil/StartupTrace.h"
 
 #include <errno.h>
 #include "libutil/ByteSwap.h"
@@ -81,6 +82,7 @@ Ieee1394Service::Ieee1394Service()
     , m_have_new_ctr_read ( false )
     , m_filterFCPResponse ( false )
     , m_pWatchdog ( new Util::Watchdog() )
+    , m_last_busreset_time ( 0 )
 {
     for (unsigned int i=0; i<64; i++) {
         m_channels[i].channel=-1;
@@ -111,6 +113,7 @@ Ieee1394Service::Ieee1394Service(bool rt, int prio)
     , m_have_new_ctr_read ( false )
     , m_filterFCPResponse ( false )
     , m_pWatchdog ( new Util::Watchdog() )
+    , m_last_busreset_time ( 0 )
 {
     for (unsigned int i=0; i<64; i++) {
         m_channels[i].channel=-1;
@@ -149,6 +152,12 @@ Ieee1394Service::~Ieee1394Service()
     }
 
     delete m_pWatchdog;
+    for ( async_handle_vec_t::iterator it = m_async_handles.begin();
+          it != m_async_handles.end();
+          ++it )
+    {
+        delete *it;
+    }
     if ( m_handle ) {
         raw1394_destroy_handle( m_handle );
     }
@@ -397,6 +406,25 @@ Ieee1394Service::initialize( int port )
     raw1394_set_userdata( m_handle, this );
     raw1394_set_userdata( m_util_handle, this );
 
+    // the async transaction handle pool
+    int nb_async_handles = IEEE1394SERVICE_ASYNC_HANDLE_POOL_SIZE;
+    if(m_configuration) {
+        m_configuration->getValueForSetting("ieee1394.async_handle_pool_size", nb_async_handles);
+    }
+    if(nb_async_handles < 1) {
+        nb_async_handles = 1;
+    }
+    for (int i = 0; i < nb_async_handles; i++) {
+        AsyncHandle *h = new AsyncHandle(*this, i);
+        if(!h->init(port)) {
+            debugFatal("Could not initialize async transaction handle %d\n", i);
+            delete h;
+            return false;
+        }
+        m_async_handles.push_back(h);
+    }
+    debugOutput(DEBUG_LEVEL_VERBOSE, "Using %d async transaction handles\n", nb_async_handles);
+
     // increase the split-transaction timeout if required (e.g. for bebob's)
     int split_timeout = IEEE1394SERVICE_MIN_SPLIT_TIMEOUT_USECS;
     if(m_configuration) {
@@ -526,6 +554,11 @@ Ieee1394Service::getCycleTimer(uint64_t t) {
     return m_pCTRHelper->getCycleTimer(t);
 }
 
+uint32_t
+Ieee1394Service::getCycleTimerAndUpdate() {
+    return m_pCTRHelper->getCycleTimerAndUpdate();
+}
+
 uint64_t
 Ieee1394Service::getSystemTimeForCycleTimerTicks(uint32_t ticks) {
     return m_pCTRHelper->getSystemTimeForCycleTimerTicks(ticks);
@@ -579,18 +612,29 @@ Ieee1394Service::getCurrentTimeAsUsecs() {
     return Util::SystemTimeSource::getCurrentTimeAsUsecs();
 }
 
+Ieee1394Service::AsyncHandle &
+Ieee1394Service::getAsyncHandle( fb_nodeid_t nodeId )
+{
+    // fixed affinity on the node number (the bus number is ignored)
+    return *m_async_handles.at((nodeId & 0x3F) % m_async_handles.size());
+}
+
 bool
 Ieee1394Service::read( fb_nodeid_t nodeId,
                        fb_nodeaddr_t addr,
                        size_t length,
                        fb_quadlet_t* buffer )
 {
-    Util::MutexLockHelper lock(*m_handle_lock);
-    return readNoLock(nodeId, addr, length, buffer);
+    AsyncHandle &h = getAsyncHandle(nodeId);
+    h.lock();
+    bool retval = readNoLock(h.get1394Handle(), nodeId, addr, length, buffer);
+    h.unlock();
+    return retval;
 }
 
 bool
-Ieee1394Service::readNoLock( fb_nodeid_t nodeId,
+Ieee1394Service::readNoLock( raw1394handle_t handle,
+                             fb_nodeid_t nodeId,
                              fb_nodeaddr_t addr,
                              size_t length,
                              fb_quadlet_t* buffer )
@@ -599,7 +643,7 @@ Ieee1394Service::readNoLock( fb_nodeid_t nodeId,
         debugWarning("operation on invalid node\n");
         return false;
     }
-    if ( raw1394_read( m_handle, nodeId, addr, length*4, buffer ) == 0 ) {
+    if ( raw1394_read( handle, nodeId, addr, length*4, buffer ) == 0 ) {
 
         #ifdef DEBUG
         debugOutput(DEBUG_LEVEL_VERY_VERBOSE,
@@ -642,12 +686,16 @@ Ieee1394Service::write( fb_nodeid_t nodeId,
                         size_t length,
                         fb_quadlet_t* data )
 {
-    Util::MutexLockHelper lock(*m_handle_lock);
-    return writeNoLock(nodeId, addr, length, data);
+    AsyncHandle &h = getAsyncHandle(nodeId);
+    h.lock();
+    bool retval = writeNoLock(h.get1394Handle(), nodeId, addr, length, data);
+    h.unlock();
+    return retval;
 }
 
 bool
-Ieee1394Service::writeNoLock( fb_nodeid_t nodeId,
+Ieee1394Service::writeNoLock( raw1394handle_t handle,
+                              fb_nodeid_t nodeId,
                               fb_nodeaddr_t addr,
                               size_t length,
                               fb_quadlet_t* data )
@@ -663,7 +711,7 @@ Ieee1394Service::writeNoLock( fb_nodeid_t nodeId,
     printBuffer( DEBUG_LEVEL_VERY_VERBOSE, length, data );
     #endif
 
-    return raw1394_write( m_handle, nodeId, addr, length*4, data ) == 0;
+    return raw1394_write( handle, nodeId, addr, length*4, data ) == 0;
 }
 
 bool
@@ -713,11 +761,12 @@ Ieee1394Service::lockCompareSwap64( fb_nodeid_t nodeId,
 
     // do separate locking here (no MutexLockHelper) since 
     // we use read_octlet in the DEBUG code in this function
-    m_handle_lock->Lock();
-    int retval=raw1394_lock64(m_handle, nodeId, addr,
+    AsyncHandle &h = getAsyncHandle(nodeId);
+    h.lock();
+    int retval=raw1394_lock64(h.get1394Handle(), nodeId, addr,
                               RAW1394_EXTCODE_COMPARE_SWAP,
                               swap_value, compare_value, result);
-    m_handle_lock->Unlock();
+    h.unlock();
 
     if(retval) {
         debugError("raw1394_lock64 failed: %s\n", strerror(errno));
@@ -748,26 +797,27 @@ Ieee1394Service::transactionBlock( fb_nodeid_t nodeId,
         return NULL;
     }
     // NOTE: this expects a call to transactionBlockClose to unlock
-    m_handle_lock->Lock();
+    AsyncHandle &h = getAsyncHandle(nodeId);
+    h.lock();
 
     // clear the request & response memory
-    memset(&m_fcp_block, 0, sizeof(m_fcp_block));
+    memset(&h.fcp_block, 0, sizeof(h.fcp_block));
 
     // make a local copy of the request
     if(len < MAX_FCP_BLOCK_SIZE_QUADS) {
-        memcpy(m_fcp_block.request, buf, len*sizeof(quadlet_t));
-        m_fcp_block.request_length = len;
+        memcpy(h.fcp_block.request, buf, len*sizeof(quadlet_t));
+        h.fcp_block.request_length = len;
     } else {
         debugWarning("Truncating FCP request\n");
-        memcpy(m_fcp_block.request, buf, MAX_FCP_BLOCK_SIZE_BYTES);
-        m_fcp_block.request_length = MAX_FCP_BLOCK_SIZE_QUADS;
+        memcpy(h.fcp_block.request, buf, MAX_FCP_BLOCK_SIZE_BYTES);
+        h.fcp_block.request_length = MAX_FCP_BLOCK_SIZE_QUADS;
     }
-    m_fcp_block.target_nodeid = 0xffc0 | nodeId;
+    h.fcp_block.target_nodeid = 0xffc0 | nodeId;
 
-    bool success = doFcpTransaction();
+    bool success = doFcpTransaction(h);
     if(success) {
-        *resp_len = m_fcp_block.response_length;
-        return m_fcp_block.response;
+        *resp_len = h.fcp_block.response_length;
+        return h.fcp_block.response;
     } else {
         debugWarning("FCP transaction failed\n");
         *resp_len = 0;
@@ -776,18 +826,18 @@ Ieee1394Service::transactionBlock( fb_nodeid_t nodeId,
 }
 
 bool
-Ieee1394Service::transactionBlockClose()
+Ieee1394Service::transactionBlockClose( fb_nodeid_t nodeId )
 {
-    m_handle_lock->Unlock();
+    getAsyncHandle(nodeId).unlock();
     return true;
 }
 
 // FCP code
 bool
-Ieee1394Service::doFcpTransaction()
+Ieee1394Service::doFcpTransaction(AsyncHandle &h)
 {
     for(int i=0; i < IEEE1394SERVICE_FCP_MAX_TRIES; i++) {
-        if(doFcpTransactionTry()) {
+        if(doFcpTransactionTry(h)) {
             return true;
         } else {
             debugOutput(DEBUG_LEVEL_VERBOSE, "FCP transaction try %d failed\n", i);
@@ -825,36 +875,37 @@ Ieee1394Service::doFcpTransaction()
 #define FCP_MASK_RESPONSE_OPERAND(x, n) ((x) & (0xFF000000 >> (((n)%4)*8)))
 
 bool
-Ieee1394Service::doFcpTransactionTry()
+Ieee1394Service::doFcpTransactionTry(AsyncHandle &h)
 {
-    // NOTE that access to this is protected by the m_handle lock
+    // NOTE that access to this is protected by the lock of h
+    raw1394handle_t handle = h.get1394Handle();
     int err;
     bool retval = true;
     uint64_t timeout;
 
     // prepare an fcp response handler
-    raw1394_set_fcp_handler(m_handle, _avc_fcp_handler);
+    raw1394_set_fcp_handler(handle, _avc_fcp_handler);
 
     // start listening for FCP requests
     // this fails if some other program is listening for a FCP response
-    err = raw1394_start_fcp_listen(m_handle);
+    err = raw1394_start_fcp_listen(handle);
     if(err) {
         debugOutput(DEBUG_LEVEL_VERBOSE, "could not start FCP listen (err=%d, errno=%d)\n", err, errno);
         retval = false;
         goto out;
     }
 
-    m_fcp_block.status = eFS_Waiting;
+    h.fcp_block.status = eFS_Waiting;
 
     #ifdef DEBUG
     debugOutput(DEBUG_LEVEL_VERY_VERBOSE,"fcp request: node 0x%hX, length = %d bytes\n",
-                m_fcp_block.target_nodeid, m_fcp_block.request_length*4);
-    printBuffer(DEBUG_LEVEL_VERY_VERBOSE, m_fcp_block.request_length, m_fcp_block.request );
+                h.fcp_block.target_nodeid, h.fcp_block.request_length*4);
+    printBuffer(DEBUG_LEVEL_VERY_VERBOSE, h.fcp_block.request_length, h.fcp_block.request );
     #endif
 
     // write the FCP request
-    if(!writeNoLock( m_fcp_block.target_nodeid, FCP_COMMAND_ADDR,
-                     m_fcp_block.request_length, m_fcp_block.request)) {
+    if(!writeNoLock( handle, h.fcp_block.target_nodeid, FCP_COMMAND_ADDR,
+                     h.fcp_block.request_length, h.fcp_block.request)) {
         debugOutput(DEBUG_LEVEL_VERBOSE, "write of FCP request failed\n");
         retval = false;
         goto out;
@@ -862,28 +913,28 @@ Ieee1394Service::doFcpTransactionTry()
 
     // wait for the response to arrive
     struct pollfd raw1394_poll;
-    raw1394_poll.fd = raw1394_get_fd(m_handle);
+    raw1394_poll.fd = raw1394_get_fd(handle);
     raw1394_poll.events = POLLIN;
 
     timeout = Util::SystemTimeSource::getCurrentTimeAsUsecs() +
               IEEE1394SERVICE_FCP_RESPONSE_TIMEOUT_USEC;
 
-    while(m_fcp_block.status == eFS_Waiting 
+    while(h.fcp_block.status == eFS_Waiting 
           && Util::SystemTimeSource::getCurrentTimeAsUsecs() < timeout) {
         if(poll( &raw1394_poll, 1, IEEE1394SERVICE_FCP_POLL_TIMEOUT_MSEC) > 0) {
             if (raw1394_poll.revents & POLLIN) {
-                raw1394_loop_iterate(m_handle);
+                raw1394_loop_iterate(handle);
             }
         }
     }
 
     // check the request and figure out what happened
-    if(m_fcp_block.status == eFS_Waiting) {
+    if(h.fcp_block.status == eFS_Waiting) {
         debugOutput(DEBUG_LEVEL_VERBOSE, "FCP response timed out\n");
         retval = false;
         goto out;
     }
-    if(m_fcp_block.status == eFS_Error) {
+    if(h.fcp_block.status == eFS_Error) {
         debugError("FCP request/response error\n");
         retval = false;
         goto out;
@@ -891,13 +942,13 @@ Ieee1394Service::doFcpTransactionTry()
 
 out:
     // stop listening for FCP responses
-    err = raw1394_stop_fcp_listen(m_handle);
+    err = raw1394_stop_fcp_listen(handle);
     if(err) {
         debugOutput(DEBUG_LEVEL_VERBOSE, "could not stop FCP listen (err=%d, errno=%d)\n", err, errno);
         retval = false;
     }
 
-    m_fcp_block.status = eFS_Empty;
+    h.fcp_block.status = eFS_Empty;
     return retval;
 }
 
@@ -906,19 +957,17 @@ Ieee1394Service::_avc_fcp_handler(raw1394handle_t handle, nodeid_t nodeid,
                                   int response, size_t length,
                                   unsigned char *data)
 {
-    Ieee1394Service *service = static_cast<Ieee1394Service *>(raw1394_get_userdata(handle));
-    if(service) {
-        return service->handleFcpResponse(nodeid, response, length, data);
+    AsyncHandle *h = static_cast<AsyncHandle *>(raw1394_get_userdata(handle));
+    if(h) {
+        return h->get1394Service().handleFcpResponse(*h, nodeid, response, length, data);
     } else return -1;
 }
 
 int
-Ieee1394Service::handleFcpResponse(nodeid_t nodeid,
+Ieee1394Service::handleFcpResponse(AsyncHandle &h, nodeid_t nodeid,
                                    int response, size_t length,
                                    unsigned char *data)
 {
-    static struct sFcpBlock fcp_block_last;
-
     fb_quadlet_t *data_quads = (fb_quadlet_t *)data;
     #ifdef DEBUG
     debugOutput(DEBUG_LEVEL_VERY_VERBOSE,"fcp response: node 0x%hX, response = %d, length = %zd bytes\n",
@@ -938,9 +987,9 @@ Ieee1394Service::handleFcpResponse(nodeid_t nodeid,
             debugOutput(DEBUG_LEVEL_VERBOSE, "INTERIM\n");
         } else {
             // it's an actual response, check if it matches our request
-            if(nodeid != m_fcp_block.target_nodeid) {
+            if(nodeid != h.fcp_block.target_nodeid) {
                 debugOutput(DEBUG_LEVEL_VERBOSE, "FCP response node id's don't match! (%x, %x)\n",
-                                                 m_fcp_block.target_nodeid, nodeid);
+                                                 h.fcp_block.target_nodeid, nodeid);
             } else if (first_quadlet == 0) {
                 debugWarning("Bogus FCP response\n");
                 printBuffer(DEBUG_LEVEL_WARNING, (length+3)/4, data_quads );
@@ -950,11 +999,11 @@ Ieee1394Service::handleFcpResponse(nodeid_t nodeid,
                 printBuffer(DEBUG_LEVEL_WARNING, (length+3)/4, data_quads );
 #endif
             } else if(FCP_MASK_SUBUNIT_AND_OPCODE(first_quadlet) 
-                      != FCP_MASK_SUBUNIT_AND_OPCODE(CondSwapFromBus32(m_fcp_block.request[0]))) {
+                      != FCP_MASK_SUBUNIT_AND_OPCODE(CondSwapFromBus32(h.fcp_block.request[0]))) {
                 debugOutput(DEBUG_LEVEL_VERBOSE, "FCP response not for this request: %08X != %08X\n",
                              FCP_MASK_SUBUNIT_AND_OPCODE(first_quadlet),
-                             FCP_MASK_SUBUNIT_AND_OPCODE(CondSwapFromBus32(m_fcp_block.request[0])));
-            } else if(m_filterFCPResponse && (memcmp(fcp_block_last.response, data, length) == 0)) {
+                             FCP_MASK_SUBUNIT_AND_OPCODE(CondSwapFromBus32(h.fcp_block.request[0])));
+            } else if(m_filterFCPResponse && (memcmp(h.fcp_block_last.response, data, length) == 0)) {
                 // This is workaround for the Edirol FA-101. The device tends to send more than
                 // one responde to one request. This seems to happen when discovering 
                 // function blocks and looks very likely there is a race condition in the 
@@ -964,12 +1013,12 @@ Ieee1394Service::handleFcpResponse(nodeid_t nodeid,
                 // the same FCP twice.
                 debugWarning("Received duplicate FCP response. Ignore it\n");
             } else {
-                m_fcp_block.response_length = (length + sizeof(quadlet_t) - 1) / sizeof(quadlet_t);
-                memcpy(m_fcp_block.response, data, length);
+                h.fcp_block.response_length = (length + sizeof(quadlet_t) - 1) / sizeof(quadlet_t);
+                memcpy(h.fcp_block.response, data, length);
                 if (m_filterFCPResponse) {
-                    memcpy(fcp_block_last.response, data, length);
+                    memcpy(h.fcp_block_last.response, data, length);
                 }
-                m_fcp_block.status = eFS_Responded;
+                h.fcp_block.status = eFS_Responded;
             }
        }
     }
@@ -979,7 +1028,8 @@ Ieee1394Service::handleFcpResponse(nodeid_t nodeid,
 bool
 Ieee1394Service::setSplitTimeoutUsecs(fb_nodeid_t nodeId, unsigned int timeout)
 {
-    Util::MutexLockHelper lock(*m_handle_lock);
+    AsyncHandle &h = getAsyncHandle(nodeId);
+    h.lock();
     debugOutput(DEBUG_LEVEL_VERBOSE, "setting SPLIT_TIMEOUT on node 0x%X to %uusecs...\n", nodeId, timeout);
     unsigned int secs = timeout / 1000000;
     unsigned int usecs = timeout % 1000000;
@@ -988,23 +1038,27 @@ Ieee1394Service::setSplitTimeoutUsecs(fb_nodeid_t nodeId, unsigned int timeout)
     quadlet_t split_timeout_low = CondSwapToBus32(((usecs / 125) & 0x1FFF) << 19);
 
     // write the CSR registers
-    if(!writeNoLock( 0xffc0 | nodeId, CSR_REGISTER_BASE + CSR_SPLIT_TIMEOUT_HI, 1,
+    if(!writeNoLock( h.get1394Handle(), 0xffc0 | nodeId, CSR_REGISTER_BASE + CSR_SPLIT_TIMEOUT_HI, 1,
                   &split_timeout_hi)) {
         debugOutput(DEBUG_LEVEL_VERBOSE, "write of CSR_SPLIT_TIMEOUT_HI failed\n");
+        h.unlock();
         return false;
     }
-    if(!writeNoLock( 0xffc0 | nodeId, CSR_REGISTER_BASE + CSR_SPLIT_TIMEOUT_LO, 1,
+    if(!writeNoLock( h.get1394Handle(), 0xffc0 | nodeId, CSR_REGISTER_BASE + CSR_SPLIT_TIMEOUT_LO, 1,
                   &split_timeout_low)) {
         debugOutput(DEBUG_LEVEL_VERBOSE, "write of CSR_SPLIT_TIMEOUT_LO failed\n");
+        h.unlock();
         return false;
     }
+    h.unlock();
     return true;
 }
 
 int
 Ieee1394Service::getSplitTimeoutUsecs(fb_nodeid_t nodeId)
 {
-    Util::MutexLockHelper lock(*m_handle_lock);
+    AsyncHandle &h = getAsyncHandle(nodeId);
+    h.lock();
 
     // Keep Valgrind quiet by including explicit assignment
     quadlet_t split_timeout_hi = 0;
@@ -1012,20 +1066,24 @@ Ieee1394Service::getSplitTimeoutUsecs(fb_nodeid_t nodeId)
 
     debugOutput(DEBUG_LEVEL_VERBOSE, "reading SPLIT_TIMEOUT on node 0x%X...\n", nodeId);
 
-    if(!readNoLock( 0xffc0 | nodeId, CSR_REGISTER_BASE + CSR_SPLIT_TIMEOUT_HI, 1,
+    if(!readNoLock( h.get1394Handle(), 0xffc0 | nodeId, CSR_REGISTER_BASE + CSR_SPLIT_TIMEOUT_HI, 1,
                   &split_timeout_hi)) {
         debugOutput(DEBUG_LEVEL_VERBOSE, "read of CSR_SPLIT_TIMEOUT_HI failed\n");
+        h.unlock();
         return 0;
     }
     debugOutput(DEBUG_LEVEL_VERBOSE, " READ HI: 0x%08X\n", split_timeout_hi);
 
-    if(!readNoLock( 0xffc0 | nodeId, CSR_REGISTER_BASE + CSR_SPLIT_TIMEOUT_LO, 1,
+    if(!readNoLock( h.get1394Handle(), 0xffc0 | nodeId, CSR_REGISTER_BASE + CSR_SPLIT_TIMEOUT_LO, 1,
                   &split_timeout_low)) {
         debugOutput(DEBUG_LEVEL_VERBOSE, "read of CSR_SPLIT_TIMEOUT_LO failed\n");
+        h.unlock();
         return 0;
     }
     debugOutput(DEBUG_LEVEL_VERBOSE, " READ LO: 0x%08X\n", split_timeout_low);
 
+    h.unlock();
+
     split_timeout_hi = CondSwapFromBus32(split_timeout_hi);
     split_timeout_low = CondSwapFromBus32(split_timeout_low);
 
@@ -1038,6 +1096,29 @@ Ieee1394Service::setFCPResponseFiltering(bool enable)
     m_filterFCPResponse = enable;
 }
 
+bool
+Ieee1394Service::getAsyncHandleStatistics(unsigned int idx, struct sAsyncHandleStatistics &stats)
+{
+    if(idx >= m_async_handles.size()) {
+        return false;
+    }
+    stats = m_async_handles.at(idx)->stats;
+    return true;
+}
+
+void
+Ieee1394Service::resetAsyncHandleStatistics()
+{
+    for ( async_handle_vec_t::iterator it = m_async_handles.begin();
+          it != m_async_handles.end();
+          ++it )
+    {
+        (*it)->lock();
+        memset(&(*it)->stats, 0, sizeof((*it)->stats));
+        (*it)->unlock();
+    }
+}
+
 int
 Ieee1394Service::getVerboseLevel()
 {
@@ -1098,10 +1179,21 @@ Ieee1394Service::resetHandler( unsigned int generation )
 {
     quadlet_t buf=0;
 
+    m_last_busreset_time = Util::SystemTimeSource::getCurrentTimeAsUsecs();
+
     m_handle_lock->Lock();
     raw1394_update_generation(m_handle, generation);
     m_handle_lock->Unlock();
 
+    for ( async_handle_vec_t::iterator it = m_async_handles.begin();
+          it != m_async_handles.end();
+          ++it )
+    {
+        (*it)->lock();
+        raw1394_update_generation((*it)->get1394Handle(), generation);
+        (*it)->unlock();
+    }
+
     // do a simple read on ourself in order to update the internal structures
     // this avoids failures after a bus reset
     read_quadlet( getLocalNodeId() | 0xFFC0,
@@ -1590,6 +1682,143 @@ bool Ieee1394Service::unregisterIsoChannel(unsigned int c) {
     return true;
 }
 
+bool
+Ieee1394Service::useBusResetFastPath()
+{
+    int fast_path = IEEE1394SERVICE_BUSRESET_FAST_PATH;
+    if(m_configuration) {
+        m_configuration->getValueForSetting("ieee1394.busreset_fast_path", fast_path);
+    }
+    return fast_path != 0;
+}
+
+/**
+ * Checks whether a plug still carries the connection on a channel
+ * @param node node id of the plug (without bus part)
+ * @param plug plug number
+ * @param output true for an oPCR, false for an iPCR
+ * @param channel the channel the connection should be on
+ * @return true if the plug is online and connected on the channel
+ */
+bool
+Ieee1394Service::verifyPlug(nodeid_t node, int plug, bool output, int channel)
+{
+    int result;
+    bool online;
+    int nb_connections;
+    int plug_channel;
+    if (output) {
+        struct iec61883_oPCR pcr;
+        result = iec61883_get_oPCRX(m_handle, node | 0xffc0, &pcr, plug);
+        online = pcr.online;
+        nb_connections = pcr.n_p2p_connections + pcr.bcast_connection;
+        plug_channel = pcr.channel;
+    } else {
+        struct iec61883_iPCR pcr;
+        result = iec61883_get_iPCRX(m_handle, node | 0xffc0, &pcr, plug);
+        online = pcr.online;
+        nb_connections = pcr.n_p2p_connections + pcr.bcast_connection;
+        plug_channel = pcr.channel;
+    }
+    if (result < 0) {
+        debugOutput(DEBUG_LEVEL_VERBOSE, "Could not read %sPCR[%d] of node %d\n",
+                    (output ? "o" : "i"), plug, node);
+        return false;
+    }
+    debugOutput(DEBUG_LEVEL_VERBOSE, "%sPCR[%d] of node %d: online=%d, connections=%d, channel=%d\n",
+                (output ? "o" : "i"), plug, node, online, nb_connections, plug_channel);
+    return online && nb_connections > 0 && plug_channel == channel;
+}
+
+/**
+ * Allocates the channel and bandwidth of a channel we manage at the IRM again.
+ * The caller should hold m_handle_lock.
+ */
+bool
+Ieee1394Service::reclaimIsoChannel(struct ChannelInfo &cinfo)
+{
+    if (raw1394_channel_modify(m_handle, cinfo.channel, RAW1394_MODIFY_ALLOC) != 0) {
+        debugOutput(DEBUG_LEVEL_VERBOSE, "Could not reclaim channel %d\n", cinfo.channel);
+        return false;
+    }
+    if (cinfo.bandwidth > 0
+        && raw1394_bandwidth_modify(m_handle, cinfo.bandwidth, RAW1394_MODIFY_ALLOC) != 0) {
+        debugOutput(DEBUG_LEVEL_VERBOSE, "Could not reclaim %d bandwidth units for channel %d\n",
+                    cinfo.bandwidth, cinfo.channel);
+        raw1394_channel_modify(m_handle, cinfo.channel, RAW1394_MODIFY_FREE);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Re-establishes a CMP connection we made after a bus reset, on the same
+ * channel. The caller should hold m_handle_lock.
+ */
+bool
+Ieee1394Service::reconnectIsoChannel(struct ChannelInfo &cinfo)
+{
+    int xmit_plug = cinfo.xmit_plug;
+    int recv_plug = cinfo.recv_plug;
+    int bandwidth = cinfo.bandwidth;
+    if (iec61883_cmp_reconnect(m_handle,
+                               cinfo.xmit_node | 0xffc0, &xmit_plug,
+                               cinfo.recv_node | 0xffc0, &recv_plug,
+                               &bandwidth, cinfo.channel) < 0) {
+        debugOutput(DEBUG_LEVEL_VERBOSE, "Could not reconnect %04X:%02d to %04X:%02d on channel %d\n",
+                    cinfo.xmit_node, cinfo.xmit_plug, cinfo.recv_node, cinfo.recv_plug,
+                    cinfo.channel);
+        return false;
+    }
+    return true;
+}
+
+bool
+Ieee1394Service::restoreIsoChannels()
+{
+    nodeid_t local_node = getLocalNodeId();
+
+    Util::MutexLockHelper lock(*m_handle_lock);
+    bool retval = true;
+    for (unsigned int c = 0; c < 64; c++) {
+        struct ChannelInfo &cinfo = m_channels[c];
+        switch (cinfo.alloctype) {
+            case AllocFree:
+                continue;
+            case AllocCMP:
+                // the plugs drop their p2p connections unless the
+                // connection owner re-establishes them within a second
+                // after the reset, which also reclaims channel and
+                // bandwidth at the IRM
+                if (!reconnectIsoChannel(cinfo)) {
+                    debugOutput(DEBUG_LEVEL_NORMAL, "Could not re-establish the connection on channel %d\n", c);
+                    retval = false;
+                    continue;
+                }
+                // we don't implement plug registers ourselves
+                if (cinfo.xmit_node != local_node
+                    && !verifyPlug(cinfo.xmit_node, cinfo.xmit_plug, true, cinfo.channel)) {
+                    debugOutput(DEBUG_LEVEL_NORMAL, "Connection on channel %d lost at the transmitter\n", c);
+                    retval = false;
+                    continue;
+                }
+                if (cinfo.recv_node != local_node
+                    && !verifyPlug(cinfo.recv_node, cinfo.recv_plug, false, cinfo.channel)) {
+                    debugOutput(DEBUG_LEVEL_NORMAL, "Connection on channel %d lost at the receiver\n", c);
+                    retval = false;
+                }
+                break;
+            case AllocGeneric:
+                if (!reclaimIsoChannel(cinfo)) {
+                    debugOutput(DEBUG_LEVEL_NORMAL, "Channel %d is no longer available\n", c);
+                    retval = false;
+                }
+                break;
+        }
+    }
+    return retval;
+}
+
 /**
  * Returns the current value of the `bandwidth available' register on
  * the IRM, or -1 on error.
@@ -1641,6 +1870,19 @@ Ieee1394Service::show()
     debugOutputShort( DEBUG_LEVEL_NORMAL, "Iso handler info:\n");
     #endif
     if (m_pIsoManager) m_pIsoManager->dumpInfo();
+    if (m_pWatchdog) m_pWatchdog->show();
+
+    debugOutputShort( DEBUG_LEVEL_NORMAL, "Async transaction handles:\n");
+    for ( async_handle_vec_t::iterator it = m_async_handles.begin();
+          it != m_async_handles.end();
+          ++it )
+    {
+        struct sAsyncHandleStatistics &stats = (*it)->stats;
+        debugOutputShort( DEBUG_LEVEL_NORMAL,
+                          " Handle %u: %u transactions, %u contended, waited %"PRIu64" usecs (max %"PRIu64")\n",
+                          (*it)->getId(), stats.nb_transactions, stats.nb_contended,
+                          stats.wait_usecs, stats.max_wait_usecs);
+    }
 }
 
 // the helper thread class
@@ -1738,3 +1980,57 @@ Ieee1394Service::HelperThread::Stop()
     // stop the thread
     return m_thread.Stop() == 0;
 }
+
+// the async transaction handle class
+Ieee1394Service::AsyncHandle::AsyncHandle(Ieee1394Service &parent, unsigned int id)
+: m_parent( parent )
+, m_id( id )
+, m_handle( NULL )
+, m_lock( new Util::PosixMutex("SRVCASH") )
+, m_debugModule(parent.m_debugModule)
+{
+    memset(&fcp_block, 0, sizeof(fcp_block));
+    memset(&fcp_block_last, 0, sizeof(fcp_block_last));
+    memset(&stats, 0, sizeof(stats));
+}
+
+Ieee1394Service::AsyncHandle::~AsyncHandle()
+{
+    if(m_handle) {
+        raw1394_destroy_handle(m_handle);
+    }
+    delete m_lock;
+}
+
+bool
+Ieee1394Service::AsyncHandle::init(int port)
+{
+    m_handle = raw1394_new_handle_on_port( port );
+    if(!m_handle) {
+        debugError("Could not allocate handle: %s\n", strerror(errno));
+        return false;
+    }
+    raw1394_set_userdata( m_handle, this );
+    return true;
+}
+
+void
+Ieee1394Service::AsyncHandle::lock()
+{
+    Util::StartupTrace::countAsyncTransaction();
+    if(m_lock->TryLock()) {
+        stats.nb_transactions++;
+        return;
+    }
+    // someone else is using this handle, account for the wait
+    ffado_microsecs_t start = Util::SystemTimeSource::getCurrentTimeAsUsecs();
+    m_lock->Lock();
+    uint64_t waited = Util::SystemTimeSource::getCurrentTimeAsUsecs() - start;
+
+    stats.nb_transactions++;
+    stats.nb_contended++;
+    stats.wait_usecs += waited;
+    if(waited > stats.max_wait_usecs) {
+        stats.max_wait_usecs = waited;
+    }
+}
@@ -29,6 +29,7 @@
 #include "libutil/Functors.h"
 #include "libutil/Mutex.h"
 #include "libutil/Thread.h"
+#include "libutil/SystemTimeSource.h"
 
 #include "debugmodule/debugmodule.h"
 
@@ -143,6 +144,14 @@ public:
      */
     uint32_t getCycleTimer(uint64_t t);
 
+    /**
+     * @brief get the most recent cycle timer value (in CTR format)
+     *
+     * @note Same as getCycleTimer(), but also updates the DLL from a
+     *       register read when an update is due. For the ISO threads.
+     */
+    uint32_t getCycleTimerAndUpdate();
+
     /**
      * @brief get the system time for a specific cycle timer value (in ticks)
      * @note thread safe
@@ -256,13 +265,10 @@ public:
 
     /**
      * close AV/C transaction.
-     * @param nodeId 
-     * @param buf 
-     * @param len 
-     * @param resp_len 
+     * @param nodeId the node passed to transactionBlock()
      * @return 
      */
-    bool transactionBlockClose();
+    bool transactionBlockClose( fb_nodeid_t nodeId );
 
     int getVerboseLevel();
 
@@ -355,6 +361,29 @@ public:
      */
     void setFCPResponseFiltering(bool enable);
 
+    /**
+     * @brief usage statistics of an async transaction handle
+     */
+    struct sAsyncHandleStatistics {
+        unsigned int nb_transactions;   ///< number of times the handle was used
+        unsigned int nb_contended;      ///< number of times the handle was in use
+        uint64_t     wait_usecs;        ///< total time spent waiting for the handle
+        uint64_t     max_wait_usecs;    ///< longest wait for the handle
+    };
+
+    /**
+     * @brief get the number of handles in the async transaction pool
+     */
+    unsigned int getNbAsyncHandles() {return m_async_handles.size();};
+    /**
+     * @brief get the usage statistics of a handle in the async transaction pool
+     * @param idx index of the handle
+     * @param stats will be filled with the statistics
+     * @return false if idx is out of range
+     */
+    bool getAsyncHandleStatistics(unsigned int idx, struct sAsyncHandleStatistics &stats);
+    void resetAsyncHandleStatistics();
+
 // ISO channel stuff
 public:
     signed int getAvailableBandwidth();
@@ -364,6 +393,22 @@ public:
     signed int allocateIsoChannelCMP(nodeid_t xmit_node, int xmit_plug,
                                      nodeid_t recv_node, int recv_plug);
     bool freeIsoChannel(signed int channel);
+    /**
+     * @brief restore the iso channels after a bus reset
+     *
+     * Re-establishes the CMP connections and checks that the plugs
+     * carry them on the same channel, and reclaims the other channels
+     * and their bandwidth at the IRM, since the IRM forgets all
+     * allocations on a bus reset.
+     *
+     * @return true if all channels we manage are still valid
+     */
+    bool restoreIsoChannels();
+
+    /// true if bus resets should be handled without stopping the streams
+    bool useBusResetFastPath();
+    /// the time (in usecs) at which the last bus reset was seen
+    ffado_microsecs_t getLastBusResetTime() {return m_last_busreset_time;};
 
     IsoHandlerManager& getIsoHandlerManager() {return *m_pIsoManager;};
 private:
@@ -388,6 +433,9 @@ private:
 
     bool unregisterIsoChannel(unsigned int c);
     bool registerIsoChannel(unsigned int c, struct ChannelInfo cinfo);
+    bool verifyPlug(nodeid_t node, int plug, bool output, int channel);
+    bool reclaimIsoChannel(struct ChannelInfo &cinfo);
+    bool reconnectIsoChannel(struct ChannelInfo &cinfo);
 
 public:
 // FIXME: should be private, but is used to do the PCR control in GenericAVC::AvDevice
@@ -431,6 +479,13 @@ private:
     HelperThread *m_armHelperNormal;
     HelperThread *m_armHelperRealtime;
 
+    class AsyncHandle;
+    typedef std::vector< AsyncHandle * > async_handle_vec_t;
+    async_handle_vec_t m_async_handles;
+
+    /// the pool handle used for all async transactions to nodeId
+    AsyncHandle &getAsyncHandle( fb_nodeid_t nodeId );
+
 private: // unsorted
     bool configurationUpdated();
 
@@ -467,6 +522,8 @@ private: // unsorted
     // the RT watchdog
     Util::Watchdog*     m_pWatchdog;
 
+    volatile ffado_microsecs_t m_last_busreset_time;
+
     typedef std::vector< Util::Functor* > reset_handler_vec_t;
     reset_handler_vec_t m_busResetHandlers;
 
@@ -476,12 +533,14 @@ private: // unsorted
     typedef std::vector< ARMHandler * > arm_handler_vec_t;
     arm_handler_vec_t m_armHandlers;
 
-    // unprotected variants
-    bool writeNoLock( fb_nodeid_t nodeId,
+    // unprotected variants, the caller should hold the lock of the handle
+    bool writeNoLock( raw1394handle_t handle,
+        fb_nodeid_t nodeId,
         fb_nodeaddr_t addr,
         size_t length,
         fb_quadlet_t* data );
-    bool readNoLock( fb_nodeid_t nodeId,
+    bool readNoLock( raw1394handle_t handle,
+           fb_nodeid_t nodeId,
            fb_nodeaddr_t addr,
            size_t length,
            fb_quadlet_t* buffer );
@@ -490,7 +549,7 @@ private: // unsorted
     static int _avc_fcp_handler(raw1394handle_t handle, nodeid_t nodeid, 
                                 int response, size_t length,
                                 unsigned char *data);
-    int handleFcpResponse(nodeid_t nodeid,
+    int handleFcpResponse(AsyncHandle &h, nodeid_t nodeid,
                           int response, size_t length,
                           unsigned char *data);
 
@@ -509,10 +568,50 @@ private: // unsorted
         unsigned int response_length;
         quadlet_t response[MAX_FCP_BLOCK_SIZE_QUADS];
     };
-    struct sFcpBlock m_fcp_block;
 
-    bool doFcpTransaction();
-    bool doFcpTransactionTry();
+    bool doFcpTransaction(AsyncHandle &h);
+    bool doFcpTransactionTry(AsyncHandle &h);
+
+    /**
+     * @brief a raw1394 handle of the async transaction pool
+     *
+     * Every transaction locks the handle for its whole duration. Nodes
+     * have a fixed affinity to a handle, so that e.g. the FCP
+     * transactions to a node stay serialized while transactions to
+     * nodes on different handles run in parallel.
+     */
+    class AsyncHandle
+    {
+    public:
+        AsyncHandle(Ieee1394Service &, unsigned int id);
+        ~AsyncHandle();
+
+        bool init(int port);
+
+        raw1394handle_t get1394Handle() {return m_handle;};
+        Ieee1394Service &get1394Service() {return m_parent;};
+        unsigned int getId() {return m_id;};
+
+        /// lock the handle, accounting for the time spent waiting
+        void lock();
+        void unlock() {m_lock->Unlock();};
+
+        // the FCP state of the transaction in progress,
+        // protected by the handle lock
+        struct sFcpBlock fcp_block;
+        // the last response, used for duplicate filtering
+        struct sFcpBlock fcp_block_last;
+
+        struct sAsyncHandleStatistics stats;
+
+    private:
+        Ieee1394Service &m_parent;
+        unsigned int     m_id;
+        raw1394handle_t  m_handle;
+        Util::Mutex*     m_lock;
+
+        DECLARE_DEBUG_MODULE_REFERENCE;
+    };
 
 public:
     void setVerboseLevel(int l);
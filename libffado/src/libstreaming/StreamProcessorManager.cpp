@@ -26,15 +26,26 @@
 #include "StreamProcessorManager.h"
 #include "generic/StreamProcessor.h"
 #include "generic/Port.h"
+#include "util/Resampler.h"
 #include "libieee1394/cycletimer.h"
+#include "libieee1394/configrom.h"
+#include "libieee1394/ieee1394service.h"
+#include "libieee1394/IsoHandlerManager.h"
 
 #include "devicemanager.h"
 
 #include "libutil/Time.h"
+#include "libutil/PosixThread.h"
+#include "libutil/Atomic.h"
+#include "libutil/Watchdog.h"
+#include "libutil/StartupTrace.h"
+#include "libutil/PosixSharedMemory.h"
 
 #include <errno.h>
+#include <unistd.h>
 #include <assert.h>
 #include <math.h>
+#include <algorithm>
 
 namespace Streaming {
 
@@ -45,10 +56,20 @@ StreamProcessorManager::StreamProcessorManager(DeviceManager &p)
     #ifdef DEBUG
     , m_time_of_transfer2 ( 0 )
     #endif
+    , m_system_time_at_period ( 0 )
+    , m_telemetry( NULL )
+    , m_deadline_watchdog( NULL )
+    , m_deadline( NULL )
+    , m_transfer_next( 0 )
+    , m_transfer_failed( 0 )
+    , m_transfer_type( StreamProcessor::ePT_Receive )
+    , m_transfer_ticks_per_frame( 0.0 )
+    , m_transfer_workers_exit( false )
     , m_is_slave( false )
     , m_SyncSource(NULL)
     , m_parent( p )
     , m_xrun_happened( false )
+    , m_handling_xrun( false )
     , m_activity_wait_timeout_nsec( 0 ) // dynamically set
     , m_nb_buffers( 0 )
     , m_period( 0 )
@@ -63,6 +84,8 @@ StreamProcessorManager::StreamProcessorManager(DeviceManager &p)
 {
     addOption(Util::OptionContainer::Option("slaveMode",false));
     sem_init(&m_activity_semaphore, 0, 0);
+    sem_init(&m_transfer_start, 0, 0);
+    sem_init(&m_transfer_done, 0, 0);
 }
 
 StreamProcessorManager::StreamProcessorManager(DeviceManager &p, unsigned int period,
@@ -71,10 +94,20 @@ StreamProcessorManager::StreamProcessorManager(DeviceManager &p, unsigned int pe
     #ifdef DEBUG
     , m_time_of_transfer2 ( 0 )
     #endif
+    , m_system_time_at_period ( 0 )
+    , m_telemetry( NULL )
+    , m_deadline_watchdog( NULL )
+    , m_deadline( NULL )
+    , m_transfer_next( 0 )
+    , m_transfer_failed( 0 )
+    , m_transfer_type( StreamProcessor::ePT_Receive )
+    , m_transfer_ticks_per_frame( 0.0 )
+    , m_transfer_workers_exit( false )
     , m_is_slave( false )
     , m_SyncSource(NULL)
     , m_parent( p )
     , m_xrun_happened( false )
+    , m_handling_xrun( false )
     , m_activity_wait_timeout_nsec( 0 ) // dynamically set
     , m_nb_buffers(nb_buffers)
     , m_period(period)
@@ -89,12 +122,21 @@ StreamProcessorManager::StreamProcessorManager(DeviceManager &p, unsigned int pe
 {
     addOption(Util::OptionContainer::Option("slaveMode",false));
     sem_init(&m_activity_semaphore, 0, 0);
+    sem_init(&m_transfer_start, 0, 0);
+    sem_init(&m_transfer_done, 0, 0);
 }
 
 StreamProcessorManager::~StreamProcessorManager() {
+    clearTransferWorkers();
+    sem_destroy(&m_transfer_start);
+    sem_destroy(&m_transfer_done);
     sem_post(&m_activity_semaphore);
     sem_destroy(&m_activity_semaphore);
     delete m_WaitLock;
+    clearDeadline();
+    detachTelemetry();
+    if(m_telemetry) delete m_telemetry;
+    clearClockDomains();
 }
 
 // void
@@ -259,6 +301,9 @@ bool StreamProcessorManager::unregisterProcessor(StreamProcessor *processor)
     debugOutput( DEBUG_LEVEL_VERBOSE, "Unregistering processor (%p)\n",processor);
     assert(processor);
 
+    // the clock domains refer to the SP's, prepare() sets them up again
+    clearClockDomains();
+
     if (processor->getType()==StreamProcessor::ePT_Receive) {
 
         for ( StreamProcessorVectorIterator it = m_ReceiveProcessors.begin();
@@ -266,6 +311,10 @@ bool StreamProcessorManager::unregisterProcessor(StreamProcessor *processor)
               ++it )
         {
             if ( *it == processor ) {
+                if (m_telemetry) {
+                    m_telemetry->releaseSlot(processor->getTelemetrySlot());
+                    processor->setTelemetrySlot(NULL);
+                }
                 if (*it == m_SyncSource) {
                     debugOutput(DEBUG_LEVEL_VERBOSE, "unregistering sync source\n");
                     m_SyncSource = NULL;
@@ -289,6 +338,10 @@ bool StreamProcessorManager::unregisterProcessor(StreamProcessor *processor)
               ++it )
         {
             if ( *it == processor ) {
+                if (m_telemetry) {
+                    m_telemetry->releaseSlot(processor->getTelemetrySlot());
+                    processor->setTelemetrySlot(NULL);
+                }
                 if (*it == m_SyncSource) {
                     debugOutput(DEBUG_LEVEL_VERBOSE, "unregistering sync source\n");
                     m_SyncSource = NULL;
@@ -357,7 +410,7 @@ bool StreamProcessorManager::streamingParamsOk(signed int period, signed int rat
     return true;
 }
 
-void StreamProcessorManager::setPeriodSize(unsigned int period) {
+bool StreamProcessorManager::setPeriodSize(unsigned int period) {
     // This method is called early in the initialisation sequence to set the
     // initial period size.  However, at that point in time the stream
     // processors haven't been registered so they won't have their buffers
@@ -369,7 +422,28 @@ void StreamProcessorManager::setPeriodSize(unsigned int period) {
     // as happens via jack's setbufsize facility for example.
 
     if (period == m_period)
-        return;
+        return true;
+
+    // The SP buffers and the resamplers of the clock domains are in use
+    // by the streaming threads, they can only be resized when stopped.
+    for ( StreamProcessorVectorIterator it = m_ReceiveProcessors.begin();
+          it != m_ReceiveProcessors.end();
+          ++it )
+    {
+        if (!(*it)->isStopped() && !(*it)->isCreated()) {
+            debugWarning("Can't change the period size while streaming\n");
+            return false;
+        }
+    }
+    for ( StreamProcessorVectorIterator it = m_TransmitProcessors.begin();
+          it != m_TransmitProcessors.end();
+          ++it )
+    {
+        if (!(*it)->isStopped() && !(*it)->isCreated()) {
+            debugWarning("Can't change the period size while streaming\n");
+            return false;
+        }
+    }
 
     debugOutput( DEBUG_LEVEL_VERBOSE, "Setting period size to %d (was %d)\n", period, m_period);
     m_period = period;
@@ -389,6 +463,11 @@ void StreamProcessorManager::setPeriodSize(unsigned int period) {
             debugWarning("transmit stream processor %p couldn't set period size\n", *it);
     }
 
+    // the resamplers are sized for one period
+    if (!m_clock_domains.empty() && !setupClockDomains()) {
+        debugWarning("Could not set up the clock domains for the new period size\n");
+    }
+
     // Keep the activity timeout in sync with the new period size.  See
     // also comments about this in prepare().
     if (m_nominal_framerate > 0) {
@@ -396,6 +475,7 @@ void StreamProcessorManager::setPeriodSize(unsigned int period) {
         debugOutput(DEBUG_LEVEL_VERBOSE, "setting activity timeout to %d\n", timeout_usec);
         setActivityWaitTimeoutUsec(timeout_usec);
     }
+    return true;
 }
 
 bool StreamProcessorManager::setSyncSource(StreamProcessor *s) {
@@ -405,6 +485,7 @@ bool StreamProcessorManager::setSyncSource(StreamProcessor *s) {
 }
 
 bool StreamProcessorManager::prepare() {
+    Util::TraceSpan span("StreamProcessorManager::prepare");
 
     debugOutput( DEBUG_LEVEL_VERBOSE, "Preparing...\n");
     m_is_slave=false;
@@ -483,12 +564,330 @@ bool StreamProcessorManager::prepare() {
 
     updateShadowLists();
 
+    if(!setupClockDomains()) {
+        debugFatal("Could not set up clock domains\n");
+        return false;
+    }
+
+    if(!setupTransferWorkers()) {
+        debugWarning("Could not set up the transfer workers, transferring serially\n");
+    }
+
+    if(!setupTelemetry()) {
+        debugWarning("Could not set up streaming telemetry\n");
+    }
+
+    if(!setupDeadline()) {
+        debugWarning("Could not register the period deadline with the watchdog\n");
+    }
+
     return true;
 }
 
+/**
+ * @brief Sets up the telemetry segment and assigns a slot to every SP
+ *
+ * The telemetry is optional, failure to set it up is not fatal.
+ *
+ * @return true if successful (or disabled)
+ */
+bool
+StreamProcessorManager::setupTelemetry()
+{
+    int32_t enable = STREAMTELEMETRY_ENABLE;
+    Util::Configuration &config = m_parent.getConfiguration();
+    config.getValueForSetting("streaming.telemetry.enable", enable);
+    if(!enable) {
+        debugOutput(DEBUG_LEVEL_VERBOSE, "Streaming telemetry disabled\n");
+        return true;
+    }
+
+    if(m_telemetry == NULL) {
+        // the segments of processes that crashed are left behind
+        Util::PosixSharedMemory::removeStaleSegments(STREAMTELEMETRY_SHM_NAME);
+
+        // one segment per process, a second client must not take over ours
+        m_telemetry = new Util::StreamTelemetry(
+            Util::PosixSharedMemory::getProcessName(STREAMTELEMETRY_SHM_NAME, getpid()));
+        if(m_telemetry == NULL) {
+            debugError("Could not allocate telemetry\n");
+            return false;
+        }
+        m_telemetry->setVerboseLevel(getDebugLevel());
+        if(!m_telemetry->init()) {
+            debugError("Could not init telemetry\n");
+            delete m_telemetry;
+            m_telemetry = NULL;
+            return false;
+        }
+    }
+
+    unsigned int idx = 0;
+    for ( StreamProcessorVectorIterator it = m_ReceiveProcessors.begin();
+        it != m_ReceiveProcessors.end();
+        ++it ) {
+        allocateTelemetrySlot(*it, idx++);
+    }
+    idx = 0;
+    for ( StreamProcessorVectorIterator it = m_TransmitProcessors.begin();
+        it != m_TransmitProcessors.end();
+        ++it ) {
+        allocateTelemetrySlot(*it, idx++);
+    }
+
+    // the watchdogs of the busses publish the deadlines of their threads
+    for (int i = 0; i < 2; i++) {
+        StreamProcessorVector &v = (i == 0 ? m_ReceiveProcessors : m_TransmitProcessors);
+        for ( StreamProcessorVectorIterator it = v.begin();
+            it != v.end();
+            ++it ) {
+            Util::Watchdog *watchdog = (*it)->getParent().get1394Service().getWatchdog();
+            if(watchdog == NULL
+               || std::find(m_telemetry_watchdogs.begin(), m_telemetry_watchdogs.end(), watchdog)
+                  != m_telemetry_watchdogs.end()) {
+                continue;
+            }
+            watchdog->setTelemetry(m_telemetry);
+            m_telemetry_watchdogs.push_back(watchdog);
+        }
+    }
+    return true;
+}
+
+void
+StreamProcessorManager::detachTelemetry()
+{
+    for ( std::vector<Util::Watchdog *>::iterator it = m_telemetry_watchdogs.begin();
+        it != m_telemetry_watchdogs.end();
+        ++it ) {
+        (*it)->setTelemetry(NULL);
+    }
+    m_telemetry_watchdogs.clear();
+}
+
+/**
+ * @brief Registers the client's period processing with the watchdog
+ *
+ * The budget is one period. The client thread is not ours, so it is
+ * never demoted by default, but the statistics show how much of the
+ * period the client uses.
+ *
+ * @return true if successful
+ */
+bool
+StreamProcessorManager::setupDeadline()
+{
+    unsigned int budget = (unsigned int)(1000000ULL * m_period / m_nominal_framerate);
+    if(m_deadline) {
+        m_deadline->setBudget(budget);
+        return true;
+    }
+    if(m_SyncSource == NULL) {
+        debugError("No sync source\n");
+        return false;
+    }
+    m_deadline_watchdog = m_SyncSource->getParent().get1394Service().getWatchdog();
+    if(m_deadline_watchdog == NULL) {
+        return false;
+    }
+    int policy = WATCHDOG_POLICY_CLIENT;
+    m_parent.getConfiguration().getValueForSetting("streaming.watchdog_policy", policy);
+    m_deadline = m_deadline_watchdog->registerThread("period", NULL, budget,
+                                                     (enum Util::ThreadDeadline::eDemotionPolicy)policy);
+    return m_deadline != NULL;
+}
+
+void
+StreamProcessorManager::clearDeadline()
+{
+    if(m_deadline) {
+        m_deadline_watchdog->unregisterThread(m_deadline);
+        m_deadline = NULL;
+        m_deadline_watchdog = NULL;
+    }
+}
+
+/**
+ * @brief Puts the SP's of every device that is not the sync source's in a clock domain
+ *
+ * Normally all devices are assumed to be word-clocked to the sync source.
+ * When streaming.aggregate_clock_domains is set, every other device is
+ * assumed to run from its own clock, and its SP's are resampled to the
+ * rate of the sync source. The rate of a device is tracked through its
+ * first receive SP, hence a device without one is left alone.
+ *
+ * @return true if successful (or disabled)
+ */
+bool
+StreamProcessorManager::setupClockDomains()
+{
+    clearClockDomains();
+
+    int32_t enable = STREAMPROCESSORMANAGER_AGGREGATE_CLOCK_DOMAINS;
+    Util::Configuration &config = m_parent.getConfiguration();
+    config.getValueForSetting("streaming.aggregate_clock_domains", enable);
+    if(!enable || m_SyncSource == NULL) {
+        return true;
+    }
+
+    FFADODevice *master = &m_SyncSource->getParent();
+    for ( StreamProcessorVectorIterator it = m_ReceiveProcessors.begin();
+        it != m_ReceiveProcessors.end();
+        ++it ) {
+        FFADODevice &device = (*it)->getParent();
+        if(&device == master || findClockDomain(device)) {
+            continue;
+        }
+        ClockDomain *domain = new ClockDomain(*m_SyncSource, **it);
+        domain->setVerboseLevel(getDebugLevel());
+        m_clock_domains.push_back(domain);
+        debugOutput(DEBUG_LEVEL_VERBOSE, "Device %p gets its own clock domain, reference SP %p\n",
+                    &device, *it);
+    }
+
+    for ( StreamProcessorVectorIterator it = m_TransmitProcessors.begin();
+        it != m_TransmitProcessors.end();
+        ++it ) {
+        FFADODevice &device = (*it)->getParent();
+        if(&device != master && findClockDomain(device) == NULL) {
+            debugWarning("Device %p has no receive stream to track its clock, not resampling SP %p\n",
+                         &device, *it);
+        }
+    }
+
+    for ( ClockDomainVectorIterator it = m_clock_domains.begin();
+        it != m_clock_domains.end();
+        ++it ) {
+        FFADODevice &device = (*it)->getReference().getParent();
+        for (int i = 0; i < 2; i++) {
+            StreamProcessorVector &v = (i == 0 ? m_ReceiveProcessors : m_TransmitProcessors);
+            for ( StreamProcessorVectorIterator it2 = v.begin();
+                it2 != v.end();
+                ++it2 ) {
+                if(&(*it2)->getParent() != &device) continue;
+                Resampler *r = new Resampler(**it2, (*it2)->getType() == StreamProcessor::ePT_Receive, **it);
+                r->setVerboseLevel(getDebugLevel());
+                if(!r->init(m_period, m_audio_datatype)) {
+                    debugError("Could not init resampler for SP %p\n", *it2);
+                    delete r;
+                    return false;
+                }
+                (*it2)->setResampler(r);
+            }
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief returns the clock domain of a device, NULL if it has none
+ */
+ClockDomain *
+StreamProcessorManager::findClockDomain(FFADODevice &device)
+{
+    for ( ClockDomainVectorIterator it = m_clock_domains.begin();
+        it != m_clock_domains.end();
+        ++it ) {
+        if(&(*it)->getReference().getParent() == &device) {
+            return *it;
+        }
+    }
+    return NULL;
+}
+
+void
+StreamProcessorManager::clearClockDomains()
+{
+    for ( StreamProcessorVectorIterator it = m_ReceiveProcessors.begin();
+        it != m_ReceiveProcessors.end();
+        ++it ) {
+        (*it)->setResampler(NULL);
+    }
+    for ( StreamProcessorVectorIterator it = m_TransmitProcessors.begin();
+        it != m_TransmitProcessors.end();
+        ++it ) {
+        (*it)->setResampler(NULL);
+    }
+    for ( ClockDomainVectorIterator it = m_clock_domains.begin();
+        it != m_clock_domains.end();
+        ++it ) {
+        delete *it;
+    }
+    m_clock_domains.clear();
+}
+
+void
+StreamProcessorManager::resetClockDomains()
+{
+    for ( ClockDomainVectorIterator it = m_clock_domains.begin();
+        it != m_clock_domains.end();
+        ++it ) {
+        (*it)->reset();
+    }
+    for (int i = 0; i < 2; i++) {
+        StreamProcessorVector &v = (i == 0 ? m_ReceiveProcessors : m_TransmitProcessors);
+        for ( StreamProcessorVectorIterator it = v.begin();
+            it != v.end();
+            ++it ) {
+            if((*it)->getResampler()) {
+                (*it)->getResampler()->reset();
+            }
+        }
+    }
+}
+
+void
+StreamProcessorManager::allocateTelemetrySlot(StreamProcessor *sp, unsigned int idx)
+{
+    if(sp->getTelemetrySlot()) return; // already has one
+    char name[STREAMTELEMETRY_NAME_LEN];
+    snprintf(name, STREAMTELEMETRY_NAME_LEN, "%s %u (%s)",
+             sp->getTypeString(), idx,
+             sp->getParent().getConfigRom().getModelName().c_str());
+    Util::TelemetryStreamSlot *slot =
+        m_telemetry->allocateSlot(name, (sp->getType() == StreamProcessor::ePT_Receive ? 0 : 1));
+    sp->setTelemetrySlot(slot);
+}
+
+/**
+ * @brief Updates the per-period telemetry
+ *
+ * Called from waitForPeriod(), hence RT context. Only does
+ * single-writer stores into the telemetry segment.
+ */
+void
+StreamProcessorManager::updateTelemetry(bool xrun_occurred)
+{
+    Util::TelemetrySegment *seg = m_telemetry->getSegment();
+    seg->periods++;
+    if(xrun_occurred) seg->xruns++;
+    Util::StreamTelemetry::mark(&seg->wake_latency,
+                                (m_delayed_usecs > 0 ? m_delayed_usecs : 0));
+
+    for ( StreamProcessorVectorIterator it = m_ReceiveProcessors.begin();
+        it != m_ReceiveProcessors.end();
+        ++it ) {
+        Util::TelemetryStreamSlot *slot = (*it)->getTelemetrySlot();
+        if(slot == NULL) continue;
+        slot->channel = (*it)->getChannel();
+        if((*it)->xrunOccurred()) slot->xruns++;
+        Util::StreamTelemetry::mark(&slot->buffer_fill, (*it)->getBufferFill());
+    }
+    for ( StreamProcessorVectorIterator it = m_TransmitProcessors.begin();
+        it != m_TransmitProcessors.end();
+        ++it ) {
+        Util::TelemetryStreamSlot *slot = (*it)->getTelemetrySlot();
+        if(slot == NULL) continue;
+        slot->channel = (*it)->getChannel();
+        if((*it)->xrunOccurred()) slot->xruns++;
+        Util::StreamTelemetry::mark(&slot->buffer_fill, (*it)->getBufferFill());
+    }
+}
+
 bool
 StreamProcessorManager::startDryRunning()
 {
+    Util::TraceSpan span("StreamProcessorManager::startDryRunning", !m_handling_xrun);
     debugOutput( DEBUG_LEVEL_VERBOSE, "Putting StreamProcessor streams into dry-running state...\n");
     for ( StreamProcessorVectorIterator it = m_TransmitProcessors.begin();
             it != m_TransmitProcessors.end();
@@ -564,6 +963,7 @@ StreamProcessorManager::startDryRunning()
 }
 
 bool StreamProcessorManager::syncStartAll() {
+    Util::TraceSpan span("StreamProcessorManager::syncStartAll", !m_handling_xrun);
     if(m_SyncSource == NULL) return false;
 
     // get the options
@@ -863,7 +1263,13 @@ bool StreamProcessorManager::syncStartAll() {
     for ( StreamProcessorVectorIterator it = m_TransmitProcessors.begin();
         it != m_TransmitProcessors.end();
         ++it ) {
-        (*it)->setTicksPerFrame(rate);
+        // a resampled SP runs at the rate of its own device
+        Resampler *r = (*it)->getResampler();
+        if(r) {
+            (*it)->setTicksPerFrame(r->getDomain().getReference().getTicksPerFrame());
+        } else {
+            (*it)->setTicksPerFrame(rate);
+        }
         (*it)->setBufferTailTimestamp(transmit_tail_timestamp);
         ffado_timestamp_t ts;
         signed int fc;
@@ -878,6 +1284,8 @@ bool StreamProcessorManager::syncStartAll() {
         return false;
     }
 
+    resetClockDomains();
+
     debugOutput( DEBUG_LEVEL_VERBOSE, " StreamProcessor streams running...\n");
     return true;
 }
@@ -885,6 +1293,7 @@ bool StreamProcessorManager::syncStartAll() {
 bool
 StreamProcessorManager::alignReceivedStreams()
 {
+    Util::TraceSpan span("StreamProcessorManager::alignReceivedStreams");
     debugOutput( DEBUG_LEVEL_VERBOSE, "Aligning received streams...\n");
     unsigned int nb_sync_runs;
     unsigned int nb_rcv_sp = m_ReceiveProcessors.size();
@@ -998,6 +1407,7 @@ StreamProcessorManager::alignReceivedStreams()
 }
 
 bool StreamProcessorManager::start() {
+    Util::TraceSpan span("StreamProcessorManager::start");
     debugOutput( DEBUG_LEVEL_VERBOSE, "Starting Processors...\n");
 
     // start all SP's synchonized
@@ -1160,6 +1570,7 @@ bool StreamProcessorManager::handleXrun() {
     debugOutput( DEBUG_LEVEL_VERBOSE, "Handling Xrun ...\n");
 
     dumpInfo();
+    dumpFlightRecorders("xrun");
 
     /*
      * Reset means:
@@ -1172,11 +1583,13 @@ bool StreamProcessorManager::handleXrun() {
      */
 
     debugOutput( DEBUG_LEVEL_VERBOSE, "Restarting StreamProcessors...\n");
+    m_handling_xrun = true;
     // start all SP's synchonized
     bool start_result = false;
     for (int ntries=0; ntries < STREAMPROCESSORMANAGER_SYNCSTART_TRIES; ntries++) {
         if(m_shutdown_needed) {
             debugOutput(DEBUG_LEVEL_VERBOSE, "Shutdown requested...\n");
+            m_handling_xrun = false;
             return true;
         }
         // put all SP's into dry-running state
@@ -1194,6 +1607,7 @@ bool StreamProcessorManager::handleXrun() {
             debugOutput(DEBUG_LEVEL_VERBOSE, "Sync start try %d failed...\n", ntries);
         }
     }
+    m_handling_xrun = false;
     if (!start_result) {
         debugFatal("Could not syncStartAll...\n");
         return false;
@@ -1203,6 +1617,36 @@ bool StreamProcessorManager::handleXrun() {
     return true;
 }
 
+/**
+ * @brief Writes the flight recorders of all ISO managers involved to disk
+ *
+ * @param reason the reason for the dump
+ */
+void StreamProcessorManager::dumpFlightRecorders(const char *reason) {
+    std::vector<IsoHandlerManager *> managers;
+    for ( StreamProcessorVectorIterator it = m_ReceiveProcessors.begin();
+          it != m_ReceiveProcessors.end();
+          ++it ) {
+        IsoHandlerManager *m = &((*it)->getParent().get1394Service().getIsoHandlerManager());
+        if(std::find(managers.begin(), managers.end(), m) == managers.end()) {
+            managers.push_back(m);
+        }
+    }
+    for ( StreamProcessorVectorIterator it = m_TransmitProcessors.begin();
+          it != m_TransmitProcessors.end();
+          ++it ) {
+        IsoHandlerManager *m = &((*it)->getParent().get1394Service().getIsoHandlerManager());
+        if(std::find(managers.begin(), managers.end(), m) == managers.end()) {
+            managers.push_back(m);
+        }
+    }
+    for ( std::vector<IsoHandlerManager *>::iterator it = managers.begin();
+          it != managers.end();
+          ++it ) {
+        (*it)->dumpFlightRecorder(reason);
+    }
+}
+
 /**
  * @brief Waits until the next period of samples is ready
  *
@@ -1212,6 +1656,8 @@ bool StreamProcessorManager::handleXrun() {
  * @return true if the period is ready, false if not
  */
 bool StreamProcessorManager::waitForPeriod() {
+    // the client is done with the previous period
+    if(m_deadline) m_deadline->end();
     if(m_SyncSource == NULL) return false;
     if(m_shutdown_needed) return false;
     bool xrun_occurred = false;
@@ -1234,6 +1680,7 @@ bool StreamProcessorManager::waitForPeriod() {
     #endif
 
     // wait until it's time to transfer
+    m_system_time_at_period = pred_system_time_at_xfer;
     Util::SystemTimeSource::SleepUsecAbsolute(pred_system_time_at_xfer);
 
     #if DEBUG_EXTREME_ENABLE
@@ -1436,6 +1883,14 @@ bool StreamProcessorManager::waitForPeriod() {
                         "delayed for %d usecs...\n",
                         m_delayed_usecs);
 
+    if(m_telemetry) {
+        updateTelemetry(xrun_occurred);
+    }
+    // the period is due one period after it became available
+    if(m_deadline && !xrun_occurred) {
+        m_deadline->begin(pred_system_time_at_xfer);
+    }
+
     // now we can signal the client that we are (should be) ready
     return !xrun_occurred;
 }
@@ -1473,43 +1928,203 @@ bool StreamProcessorManager::transfer(enum StreamProcessor::eProcessorType t) {
         (unsigned int)TICKS_TO_OFFSET(m_time_of_transfer));
 
     bool retval = true;
-    // a static cast could make sure that there is no performance
-    // penalty for the virtual functions (to be checked)
     if (t==StreamProcessor::ePT_Receive) {
-        for ( StreamProcessorVectorIterator it = m_ReceiveProcessors.begin();
-                it != m_ReceiveProcessors.end();
+        retval &= transferProcessors(t);
+        // the reference SP's have been read, track the device clocks
+        for ( ClockDomainVectorIterator it = m_clock_domains.begin();
+                it != m_clock_domains.end();
                 ++it ) {
-            if(!(*it)->getFrames(m_period, m_time_of_transfer)) {
-                    debugWarning("could not getFrames(%u, %11"PRIu64") from stream processor (%p)\n",
-                            m_period, m_time_of_transfer,*it);
-                retval &= false; // buffer underrun
-            }
+            (*it)->update(m_period);
         }
     } else {
         // FIXME: in the SPM it would be nice to have system time instead of
         //        1394 time
-        float rate = m_SyncSource->getTicksPerFrame();
+        m_transfer_ticks_per_frame = m_SyncSource->getTicksPerFrame();
+        retval &= transferProcessors(t);
+    }
+    return retval;
+}
 
-        for ( StreamProcessorVectorIterator it = m_TransmitProcessors.begin();
-                it != m_TransmitProcessors.end();
+/**
+ * @brief Transfer one period of frames for one StreamProcessor
+ *
+ * Can be called from the client thread and the transfer workers
+ * concurrently, as long as each SP is handled by one of them.
+ *
+ * @param sp the StreamProcessor
+ * @param t the type of the StreamProcessor
+ * @return true if successful, false otherwise (indicates xrun).
+ */
+bool StreamProcessorManager::transferProcessor(StreamProcessor *sp,
+                                               enum StreamProcessor::eProcessorType t) {
+    // a static cast could make sure that there is no performance
+    // penalty for the virtual functions (to be checked)
+    if (t==StreamProcessor::ePT_Receive) {
+        if(!sp->getFrames(m_period, m_time_of_transfer)) {
+                debugWarning("could not getFrames(%u, %11"PRIu64") from stream processor (%p)\n",
+                        m_period, m_time_of_transfer, sp);
+            return false; // buffer underrun
+        }
+    } else {
+        // this is the delay in frames between the point where a frame is received and
+        // when it is transmitted again
+        unsigned int one_ringbuffer_in_frames = m_nb_buffers * m_period + sp->getExtraBufferFrames();
+        int64_t one_ringbuffer_in_ticks = (int64_t)(((float)one_ringbuffer_in_frames) * m_transfer_ticks_per_frame);
+
+        // the data we are putting into the buffer is intended to be transmitted
+        // one ringbuffer size after it has been received
+        int64_t transmit_timestamp = addTicks(m_time_of_transfer, one_ringbuffer_in_ticks);
+
+        if(!sp->putFrames(m_period, transmit_timestamp)) {
+            debugWarning("could not putFrames(%u,%"PRIu64") to stream processor (%p)\n",
+                    m_period, transmit_timestamp, sp);
+            return false; // buffer underrun
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Transfer one period of frames for all StreamProcessors of a type
+ *
+ * When there are transfer workers, they are woken up to take part, and
+ * this returns once all SP's have been transferred.
+ *
+ * @param t The processor type to tranfer for (receive or transmit)
+ * @return true if successful, false otherwise (indicates xrun).
+ */
+bool StreamProcessorManager::transferProcessors(enum StreamProcessor::eProcessorType t) {
+    StreamProcessorVector &processors = (t==StreamProcessor::ePT_Receive
+                                         ? m_ReceiveProcessors : m_TransmitProcessors);
+    unsigned int nb_helpers = m_transfer_workers.size();
+    if (nb_helpers > processors.size() - 1) {
+        nb_helpers = processors.size() - 1;
+    }
+
+    if (processors.size() < 2 || nb_helpers == 0) {
+        bool retval = true;
+        for ( StreamProcessorVectorIterator it = processors.begin();
+                it != processors.end();
                 ++it ) {
-            // this is the delay in frames between the point where a frame is received and
-            // when it is transmitted again
-            unsigned int one_ringbuffer_in_frames = m_nb_buffers * m_period + (*it)->getExtraBufferFrames();
-            int64_t one_ringbuffer_in_ticks = (int64_t)(((float)one_ringbuffer_in_frames) * rate);
-    
-            // the data we are putting into the buffer is intended to be transmitted
-            // one ringbuffer size after it has been received
-            int64_t transmit_timestamp = addTicks(m_time_of_transfer, one_ringbuffer_in_ticks);
+            retval &= transferProcessor(*it, t);
+        }
+        return retval;
+    }
 
-            if(!(*it)->putFrames(m_period, transmit_timestamp)) {
-                debugWarning("could not putFrames(%u,%"PRIu64") to stream processor (%p)\n",
-                        m_period, transmit_timestamp, *it);
-                retval &= false; // buffer underrun
-            }
+    m_transfer_type = t;
+    m_transfer_next = 0;
+    m_transfer_failed = 0;
+    unsigned int i;
+    for (i = 0; i < nb_helpers; i++) {
+        sem_post(&m_transfer_start);
+    }
+    // take part ourselves
+    runTransferJobs();
+
+    // wait for the workers we woke up, they might still be busy with
+    // the last SP's
+    for (i = 0; i < nb_helpers; i++) {
+        while (sem_wait(&m_transfer_done) < 0 && errno == EINTR) {}
+    }
+    return m_transfer_failed == 0;
+}
+
+/**
+ * @brief Transfer SP's until there are none left
+ */
+void StreamProcessorManager::runTransferJobs() {
+    StreamProcessorVector &processors = (m_transfer_type==StreamProcessor::ePT_Receive
+                                         ? m_ReceiveProcessors : m_TransmitProcessors);
+    int nb_processors = processors.size();
+    int idx;
+    while ((idx = INC_ATOMIC(&m_transfer_next)) < nb_processors) {
+        if (!transferProcessor(processors[idx], m_transfer_type)) {
+            INC_ATOMIC(&m_transfer_failed);
         }
     }
-    return retval;
+}
+
+bool StreamProcessorManager::TransferWorker::Execute() {
+    while (sem_wait(&m_manager.m_transfer_start) < 0) {
+        if (errno != EINTR) return false;
+    }
+    if (m_manager.m_transfer_workers_exit) {
+        return false;
+    }
+    m_manager.runTransferJobs();
+    sem_post(&m_manager.m_transfer_done);
+    return true;
+}
+
+/**
+ * @brief Starts the transfer worker threads
+ *
+ * The number of workers is given by the streaming.transfer_workers
+ * setting, they run at the priority of the client thread since they do
+ * its work.
+ *
+ * @return true if successful
+ */
+bool
+StreamProcessorManager::setupTransferWorkers()
+{
+    clearTransferWorkers();
+
+    int32_t nb_workers = STREAMPROCESSORMANAGER_TRANSFER_WORKERS;
+    Util::Configuration &config = m_parent.getConfiguration();
+    config.getValueForSetting("streaming.transfer_workers", nb_workers);
+
+    // more workers than SP's of a direction don't help
+    int32_t max_workers = std::max(m_ReceiveProcessors.size(), m_TransmitProcessors.size());
+    max_workers -= 1;
+    if (nb_workers > max_workers) {
+        nb_workers = max_workers;
+    }
+    if (nb_workers <= 0) {
+        debugOutput(DEBUG_LEVEL_VERBOSE, "Transferring the SP's serially\n");
+        return true;
+    }
+
+    m_transfer_workers_exit = false;
+    for (int i = 0; i < nb_workers; i++) {
+        TransferWorker *worker = new TransferWorker(*this);
+        Util::Thread *thread = new Util::PosixThread(worker, "SPMXFER", m_thread_realtime,
+                                                    m_thread_priority, PTHREAD_CANCEL_DEFERRED);
+        if (thread->Start() != 0) {
+            debugError("Could not start transfer worker %d\n", i);
+            delete thread;
+            delete worker;
+            clearTransferWorkers();
+            return false;
+        }
+        m_transfer_workers.push_back(worker);
+        m_transfer_threads.push_back(thread);
+    }
+    debugOutput(DEBUG_LEVEL_VERBOSE, "Started %d transfer workers\n", nb_workers);
+    return true;
+}
+
+void
+StreamProcessorManager::clearTransferWorkers()
+{
+    if (m_transfer_threads.empty()) return;
+
+    // wake up the workers and have them exit
+    m_transfer_workers_exit = true;
+    unsigned int i;
+    for (i = 0; i < m_transfer_threads.size(); i++) {
+        sem_post(&m_transfer_start);
+    }
+    for (i = 0; i < m_transfer_threads.size(); i++) {
+        m_transfer_threads.at(i)->Stop();
+        delete m_transfer_threads.at(i);
+        delete m_transfer_workers.at(i);
+    }
+    m_transfer_threads.clear();
+    m_transfer_workers.clear();
+    // drain the wakeups that were not consumed
+    while (sem_trywait(&m_transfer_start) == 0) {}
+    m_transfer_workers_exit = false;
 }
 
 /**
@@ -1590,11 +2205,43 @@ bool StreamProcessorManager::transferSilence(enum StreamProcessor::eProcessorTyp
     return retval;
 }
 
+unsigned int
+StreamProcessorManager::getAudioSampleSize(enum eADT_AudioDataType t)
+{
+    switch(t) {
+        case eADT_Int16:
+            return 2;
+        case eADT_Float64:
+            return 8;
+        default:
+            return 4;
+    }
+}
+
+const char *
+StreamProcessorManager::getAudioDataTypeName(enum eADT_AudioDataType t)
+{
+    switch(t) {
+        case eADT_Int24:
+            return "int24";
+        case eADT_Float:
+            return "float";
+        case eADT_Int16:
+            return "int16";
+        case eADT_Int32:
+            return "int32";
+        case eADT_Float64:
+            return "float64";
+        default:
+            return "invalid";
+    }
+}
+
 void StreamProcessorManager::dumpInfo() {
     debugOutputShort( DEBUG_LEVEL_NORMAL, "----------------------------------------------------\n");
     debugOutputShort( DEBUG_LEVEL_NORMAL, "Dumping StreamProcessorManager information...\n");
     debugOutputShort( DEBUG_LEVEL_NORMAL, "Period count: %6d\n", m_nbperiods);
-    debugOutputShort( DEBUG_LEVEL_NORMAL, "Data type: %s\n", (m_audio_datatype==eADT_Float?"float":"int24"));
+    debugOutputShort( DEBUG_LEVEL_NORMAL, "Data type: %s\n", getAudioDataTypeName(m_audio_datatype));
 
     debugOutputShort( DEBUG_LEVEL_NORMAL, " Receive processors...\n");
     for ( StreamProcessorVectorIterator it = m_ReceiveProcessors.begin();
@@ -1610,6 +2257,19 @@ void StreamProcessorManager::dumpInfo() {
         (*it)->dumpInfo();
     }
 
+    if(!m_clock_domains.empty()) {
+        debugOutputShort( DEBUG_LEVEL_NORMAL, " Clock domains...\n");
+        for ( ClockDomainVectorIterator it = m_clock_domains.begin();
+            it != m_clock_domains.end();
+            ++it ) {
+            (*it)->show();
+        }
+    }
+
+    if(m_telemetry) {
+        m_telemetry->dumpInfo();
+    }
+
     debugOutputShort( DEBUG_LEVEL_NORMAL, "----------------------------------------------------\n");
 
     // list port info in verbose mode
@@ -1774,6 +2434,15 @@ Port* StreamProcessorManager::getPortByIndex(int idx, enum Port::E_Direction dir
 bool StreamProcessorManager::setThreadParameters(bool rt, int priority) {
     m_thread_realtime=rt;
     m_thread_priority=priority;
+    for ( TransferThreadVector::iterator it = m_transfer_threads.begin();
+          it != m_transfer_threads.end();
+          ++it ) {
+        if (rt) {
+            (*it)->AcquireRealTime(priority);
+        } else {
+            (*it)->DropRealTime();
+        }
+    }
     return true;
 }
 
@@ -32,14 +32,22 @@
 #include "libutil/Thread.h"
 #include "libutil/Mutex.h"
 #include "libutil/OptionContainer.h"
+#include "libutil/StreamTelemetry.h"
 
 #include <vector>
 #include <semaphore.h>
 
+namespace Util {
+    class Watchdog;
+    class ThreadDeadline;
+}
+
 class DeviceManager;
 
 namespace Streaming {
 
+class ClockDomain;
+
 class StreamProcessor;
 
 typedef std::vector<StreamProcessor *> StreamProcessorVector;
@@ -56,6 +64,9 @@ public:
     enum eADT_AudioDataType {
         eADT_Int24,
         eADT_Float,
+        eADT_Int16,
+        eADT_Int32,
+        eADT_Float64,
     };
 
     StreamProcessorManager(DeviceManager &parent);
@@ -85,7 +96,7 @@ public:
     bool unregisterProcessor(StreamProcessor *processor); ///< stop managing a streamprocessor
 
     bool streamingParamsOk(signed int period, signed int rate, signed int n_buffers);
-    void setPeriodSize(unsigned int period);
+    bool setPeriodSize(unsigned int period);
     unsigned int getPeriodSize()
             {return m_period;};
 
@@ -93,6 +104,9 @@ public:
         {m_audio_datatype = t; return true;};
     enum eADT_AudioDataType getAudioDataType()
         {return m_audio_datatype;}
+    /// the size of a sample of the audio data type, in bytes
+    static unsigned int getAudioSampleSize(enum eADT_AudioDataType t);
+    static const char *getAudioDataTypeName(enum eADT_AudioDataType t);
 
     void setNbBuffers(unsigned int nb_buffers)
             {m_nb_buffers = nb_buffers;};
@@ -135,6 +149,8 @@ public:
     void setNominalRate(unsigned int r) {m_nominal_framerate = r;};
     unsigned int getNominalRate() {return m_nominal_framerate;};
     uint64_t getTimeOfLastTransfer() { return m_time_of_transfer;};
+    /// the system time (usecs) at which the last waitForPeriod() was due to return
+    uint64_t getSystemTimeAtPeriod() { return m_system_time_at_period;};
 
 private:
     int m_delayed_usecs;
@@ -145,9 +161,77 @@ private:
     #ifdef DEBUG
     uint64_t m_time_of_transfer2;
     #endif
+    uint64_t m_system_time_at_period;
+
+    // telemetry
+public:
+    Util::StreamTelemetry *getTelemetry() {return m_telemetry;};
+private:
+    bool setupTelemetry();
+    void updateTelemetry(bool xrun_occurred);
+    void allocateTelemetrySlot(StreamProcessor *sp, unsigned int idx);
+    void detachTelemetry();
+    Util::StreamTelemetry *m_telemetry;
+    std::vector<Util::Watchdog *> m_telemetry_watchdogs;
+
+    // the deadline of the client's period processing, from the return of
+    // waitForPeriod() until it is called again
+    bool setupDeadline();
+    void clearDeadline();
+    Util::Watchdog *m_deadline_watchdog;
+    Util::ThreadDeadline *m_deadline;
+
+    // clock domains of devices that are not synced to the sync source
+private:
+    typedef std::vector<ClockDomain *> ClockDomainVector;
+    typedef std::vector<ClockDomain *>::iterator ClockDomainVectorIterator;
+    bool setupClockDomains();
+    void clearClockDomains();
+    void resetClockDomains();
+    ClockDomain *findClockDomain(FFADODevice &device);
+    ClockDomainVector m_clock_domains;
+
+    // parallel transfer of the SP's of one direction
+private:
+    /**
+     * @brief A thread that helps transferring the SP's of a period
+     *
+     * The SP's are handed out one at a time to the client thread and the
+     * workers, transfer() returns once all of them are done.
+     */
+    class TransferWorker : public Util::RunnableInterface
+    {
+    public:
+        TransferWorker(StreamProcessorManager &manager)
+            : m_manager( manager ) {};
+        virtual ~TransferWorker() {};
+        bool Init() {return true;};
+        bool Execute();
+    private:
+        StreamProcessorManager &m_manager;
+    };
+    typedef std::vector<TransferWorker *> TransferWorkerVector;
+    typedef std::vector<Util::Thread *> TransferThreadVector;
+
+    bool setupTransferWorkers();
+    void clearTransferWorkers();
+    bool transferProcessors(enum StreamProcessor::eProcessorType t);
+    bool transferProcessor(StreamProcessor *sp, enum StreamProcessor::eProcessorType t);
+    void runTransferJobs();
+
+    TransferWorkerVector m_transfer_workers;
+    TransferThreadVector m_transfer_threads;
+    sem_t m_transfer_start; // posted once for every worker that should help
+    sem_t m_transfer_done;  // posted by a worker when there are no SP's left
+    volatile int32_t m_transfer_next;   // index of the next SP to transfer
+    volatile int32_t m_transfer_failed;
+    enum StreamProcessor::eProcessorType m_transfer_type;
+    float m_transfer_ticks_per_frame;
+    bool m_transfer_workers_exit;
 
 public:
     bool handleXrun(); ///< reset the streams & buffers after xrun
+    void dumpFlightRecorders(const char *reason);
 
     bool setThreadParameters(bool rt, int priority);
 
@@ -173,6 +257,8 @@ protected: // FIXME: private?
 
     // thread related vars
     bool m_xrun_happened;
+    // the startup trace spans are not recorded while recovering
+    bool m_handling_xrun;
     int64_t m_activity_wait_timeout_nsec;
     bool m_thread_realtime;
     int m_thread_priority;
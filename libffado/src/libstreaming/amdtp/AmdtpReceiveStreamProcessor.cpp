@@ -25,6 +25,7 @@
 #include "AmdtpReceiveStreamProcessor.h"
 #include "AmdtpPort.h"
 #include "../StreamProcessorManager.h"
+#include "../util/SampleConversion.h"
 #include "devicemanager.h"
 
 #include "libieee1394/ieee1394service.h"
@@ -46,6 +47,8 @@ AmdtpReceiveStreamProcessor::AmdtpReceiveStreamProcessor(FFADODevice &parent, in
     : StreamProcessor(parent, ePT_Receive)
     , m_dimension( dimension )
     , m_nb_audio_ports( 0 )
+    , m_audio_ports_strided( false )
+    , m_nb_active_audio_ports( 0 )
     , m_nb_midi_ports( 0 )
     , mb_head( 0 )
     , mb_tail( 0 )
@@ -252,13 +255,31 @@ bool AmdtpReceiveStreamProcessor::processReadBlock(char *data,
     // update the variable parts of the cache
     updatePortCache();
 
-    // decode audio data
+    // decode audio data, the optimized versions only handle
+    // port buffers of their own
     switch(m_StreamProcessorManager.getAudioDataType()) {
         case StreamProcessorManager::eADT_Int24:
-            decodeAudioPortsInt24((quadlet_t *)data, offset, nevents);
+            if(m_audio_ports_strided) {
+                decodeAudioPortsConvert<SampleInt24>((quadlet_t *)data, offset, nevents);
+            } else {
+                decodeAudioPortsInt24((quadlet_t *)data, offset, nevents);
+            }
             break;
         case StreamProcessorManager::eADT_Float:
-            decodeAudioPortsFloat((quadlet_t *)data, offset, nevents);
+            if(m_audio_ports_strided) {
+                decodeAudioPortsConvert<SampleFloat>((quadlet_t *)data, offset, nevents);
+            } else {
+                decodeAudioPortsFloat((quadlet_t *)data, offset, nevents);
+            }
+            break;
+        case StreamProcessorManager::eADT_Int16:
+            decodeAudioPortsConvert<SampleInt16>((quadlet_t *)data, offset, nevents);
+            break;
+        case StreamProcessorManager::eADT_Int32:
+            decodeAudioPortsConvert<SampleInt32>((quadlet_t *)data, offset, nevents);
+            break;
+        case StreamProcessorManager::eADT_Float64:
+            decodeAudioPortsConvert<SampleFloat64>((quadlet_t *)data, offset, nevents);
             break;
     }
 
@@ -362,22 +383,22 @@ AmdtpReceiveStreamProcessor::decodeAudioPortsInt24(quadlet_t *data,
     quadlet_t *target_event;
     unsigned int i;
 
-    for (i = 0; i < m_nb_audio_ports; i++) {
-        struct _MBLA_port_cache &p = m_audio_ports.at(i);
-        target_event = (quadlet_t *)(data + i);
+    // only the enabled ports, the others are not touched at all
+    for (i = 0; i < m_nb_active_audio_ports; i++) {
+        unsigned int idx = m_active_audio_ports[i];
+        struct _MBLA_port_cache &p = m_audio_ports[idx];
+        target_event = (quadlet_t *)(data + idx);
 #ifdef DEBUG
         assert(nevents + offset <= p.buffer_size );
 #endif
 
-        if(p.buffer && p.enabled) {
-            quadlet_t *buffer = (quadlet_t *)(p.buffer);
-            buffer += offset;
+        quadlet_t *buffer = (quadlet_t *)(p.buffer);
+        buffer += offset;
 
-            for(j = 0; j < nevents; j += 1) {
-                *(buffer)=(CondSwapFromBus32((*target_event) ) & 0x00FFFFFF);
-                buffer++;
-                target_event+=m_dimension;
-            }
+        for(j = 0; j < nevents; j += 1) {
+            *(buffer)=(CondSwapFromBus32((*target_event) ) & 0x00FFFFFF);
+            buffer++;
+            target_event+=m_dimension;
         }
     }
 }
@@ -398,31 +419,74 @@ AmdtpReceiveStreamProcessor::decodeAudioPortsFloat(quadlet_t *data,
     unsigned int i;
     const float multiplier = 1.0f / (float)(0x7FFFFF);
 
-    for (i = 0; i < m_nb_audio_ports; i++) {
-        struct _MBLA_port_cache &p = m_audio_ports.at(i);
-        target_event = (quadlet_t *)(data + i);
+    // only the enabled ports, the others are not touched at all
+    for (i = 0; i < m_nb_active_audio_ports; i++) {
+        unsigned int idx = m_active_audio_ports[i];
+        struct _MBLA_port_cache &p = m_audio_ports[idx];
+        target_event = (quadlet_t *)(data + idx);
 #ifdef DEBUG
         assert(nevents + offset <= p.buffer_size );
 #endif
 
-        if(p.buffer && p.enabled) {
-            float *buffer = (float *)(p.buffer);
-            buffer += offset;
+        float *buffer = (float *)(p.buffer);
+        buffer += offset;
 
-            for(j = 0; j < nevents; j += 1) {
-                unsigned int v = CondSwapFromBus32(*target_event) & 0x00FFFFFF;
-                // sign-extend highest bit of 24-bit int
-                int tmp = (int)(v << 8) / 256;
-                *buffer = tmp * multiplier;
-                buffer++;
-                target_event+=m_dimension;
-            }
+        for(j = 0; j < nevents; j += 1) {
+            unsigned int v = CondSwapFromBus32(*target_event) & 0x00FFFFFF;
+            // sign-extend highest bit of 24-bit int
+            int tmp = (int)(v << 8) / 256;
+            *buffer = tmp * multiplier;
+            buffer++;
+            target_event+=m_dimension;
         }
     }
 }
 
 #endif
 
+/**
+ * @brief demux events to all audio ports, converting to the client's data type
+ *
+ * Used for the data types without an optimized version, and for
+ * interleaved port buffers.
+ *
+ * @param data 
+ * @param offset 
+ * @param nevents 
+ */
+template <class S>
+void
+AmdtpReceiveStreamProcessor::decodeAudioPortsConvert(quadlet_t *data,
+                                                      unsigned int offset,
+                                                      unsigned int nevents)
+{
+    unsigned int j;
+    quadlet_t *target_event;
+    unsigned int i;
+
+    // only the enabled ports, the others are not touched at all
+    for (i = 0; i < m_nb_active_audio_ports; i++) {
+        unsigned int idx = m_active_audio_ports[i];
+        struct _MBLA_port_cache &p = m_audio_ports[idx];
+        target_event = (quadlet_t *)(data + idx);
+#ifdef DEBUG
+        assert(nevents + offset <= p.buffer_size );
+#endif
+
+        typename S::sample_t *buffer = (typename S::sample_t *)(p.buffer);
+        const unsigned int stride = p.stride;
+        buffer += offset * stride;
+
+        for(j = 0; j < nevents; j += 1) {
+            uint32_t v = CondSwapFromBus32(*target_event) & 0x00FFFFFF;
+            // sign-extend highest bit of 24-bit int
+            *buffer = S::fromInt24((int32_t)(v << 8) >> 8);
+            buffer += stride;
+            target_event+=m_dimension;
+        }
+    }
+}
+
 /**
  * @brief decode all midi ports in the cache from events
  * @param data 
@@ -542,6 +606,7 @@ AmdtpReceiveStreamProcessor::initPortCache() {
                     return false;
                 }
                 p.buffer = NULL; // to be filled by updatePortCache
+                p.stride = 1;
                 #ifdef DEBUG
                 p.buffer_size = (*it)->getBufferSize();
                 #endif
@@ -559,6 +624,11 @@ next_index:
         continue;
     }
 
+    // reserve here such that updatePortCache() does not allocate
+    m_active_audio_ports.clear();
+    m_active_audio_ports.reserve(m_nb_audio_ports);
+    m_nb_active_audio_ports = 0;
+
     for(PortVectorIterator it = m_Ports.begin();
         it != m_Ports.end();
         ++it )
@@ -595,15 +665,23 @@ next_index:
 void
 AmdtpReceiveStreamProcessor::updatePortCache() {
     unsigned int idx;
+    m_audio_ports_strided = false;
+    m_active_audio_ports.clear();
     for (idx = 0; idx < m_nb_audio_ports; idx++) {
         struct _MBLA_port_cache& p = m_audio_ports.at(idx);
         AmdtpAudioPort *port = p.port;
         p.buffer = port->getBufferAddress();
+        p.stride = port->getBufferStride();
+        m_audio_ports_strided |= (p.stride != 1);
         p.enabled = !port->isDisabled();
+        if(p.buffer && p.enabled) {
+            m_active_audio_ports.push_back(idx);
+        }
 #ifdef DEBUG
 	p.buffer_size = port->getBufferSize();
 #endif
     }
+    m_nb_active_audio_ports = m_active_audio_ports.size();
     for (idx = 0; idx < m_nb_midi_ports; idx++) {
         struct _MIDI_port_cache& p = m_midi_ports.at(idx);
         AmdtpMidiPort *port = p.port;
@@ -80,6 +80,8 @@ protected:
 protected:
     void decodeAudioPortsFloat(quadlet_t *data, unsigned int offset, unsigned int nevents);
     void decodeAudioPortsInt24(quadlet_t *data, unsigned int offset, unsigned int nevents);
+    template <class S>
+    void decodeAudioPortsConvert(quadlet_t *data, unsigned int offset, unsigned int nevents);
     void decodeMidiPorts(quadlet_t *data, unsigned int offset, unsigned int nevents);
 
     unsigned int getSytInterval();
@@ -91,6 +93,7 @@ private: // local port caching for performance
     struct _MBLA_port_cache {
         AmdtpAudioPort*     port;
         void*               buffer;
+        unsigned int        stride;
         bool                enabled;
 #ifdef DEBUG
         unsigned int        buffer_size;
@@ -98,6 +101,11 @@ private: // local port caching for performance
     };
     std::vector<struct _MBLA_port_cache> m_audio_ports;
     unsigned int m_nb_audio_ports;
+    // true if one of the audio ports has an interleaved buffer
+    bool m_audio_ports_strided;
+    // the audio ports that are enabled and have a buffer
+    std::vector<unsigned int> m_active_audio_ports;
+    unsigned int m_nb_active_audio_ports;
 
     struct _MIDI_port_cache {
         AmdtpMidiPort*      port;
@@ -30,6 +30,7 @@
 
 #include "libutil/Time.h"
 #include "libutil/float_cast.h"
+#include "../util/SampleConversion.h"
 
 #include "libieee1394/ieee1394service.h"
 #include "libieee1394/IsoHandlerManager.h"
@@ -50,6 +51,8 @@ namespace Streaming
 AmdtpTransmitStreamProcessor::AmdtpTransmitStreamProcessor(FFADODevice &parent, int dimension)
         : StreamProcessor(parent, ePT_Transmit)
         , m_dimension( dimension )
+        , m_syt_interval( 0 )
+        , m_fdf( 0 )
         , m_dbc( 0 )
 #if AMDTP_ALLOW_PAYLOAD_IN_NODATA_XMIT
         , m_send_nodata_payload ( AMDTP_SEND_PAYLOAD_IN_NODATA_XMIT_BY_DEFAULT )
@@ -58,8 +61,13 @@ AmdtpTransmitStreamProcessor::AmdtpTransmitStreamProcessor(FFADODevice &parent,
         , m_transmit_transfer_delay ( AMDTP_TRANSMIT_TRANSFER_DELAY )
         , m_min_cycles_before_presentation ( AMDTP_MIN_CYCLES_BEFORE_PRESENTATION )
         , m_nb_audio_ports( 0 )
+        , m_audio_ports_strided( false )
+        , m_nb_active_audio_ports( 0 )
+        , m_audio_ports_sparse( false )
         , m_nb_midi_ports( 0 )
-{}
+{
+    updatePacketTemplates();
+}
 
 enum StreamProcessor::eChildReturnValue
 AmdtpTransmitStreamProcessor::generatePacketHeader (
@@ -69,19 +77,11 @@ AmdtpTransmitStreamProcessor::generatePacketHeader (
 {
     __builtin_prefetch(data, 1, 0); // prefetch events for write, no temporal locality
     struct iec61883_packet *packet = (struct iec61883_packet *)data;
+    // the header is completed by fill(No)DataPacketHeader()
     /* Our node ID can change after a bus reset, so it is best to fetch
     * our node ID for each packet. */
     packet->sid = m_local_node_id;
-
-    packet->eoh0 = 0;
-    packet->dbs = m_dimension;
-    packet->fn = 0;
-    packet->qpc = 0;
-    packet->sph = 0;
-    packet->reserved = 0;
     packet->dbc = m_dbc;
-    packet->eoh1 = 2;
-    packet->fmt = IEC61883_FMT_AMDTP;
 
     *tag = IEC61883_TAG_WITH_CIP;
     *sy = 0;
@@ -89,9 +89,13 @@ AmdtpTransmitStreamProcessor::generatePacketHeader (
     signed int fc;
     uint64_t presentation_time;
     unsigned int presentation_cycle;
+    unsigned int presentation_offset;
+    uint16_t presentation_syt;
     int cycles_until_presentation;
 
+#if DEBUG_EXTREME_ENABLE
     uint64_t transmit_at_time;
+#endif
     unsigned int transmit_at_cycle;
     int cycles_until_transmit;
 
@@ -106,16 +110,33 @@ AmdtpTransmitStreamProcessor::generatePacketHeader (
     // to be output by the device
     presentation_time = ( uint64_t ) ts_head_tmp;
 
-    // now we calculate the time when we have to transmit the sample block
+#if DEBUG_EXTREME_ENABLE
+    // the time when we have to transmit the sample block, only for
+    // the debug output since the transmit cycle is derived below
     transmit_at_time = substractTicks( presentation_time, m_transmit_transfer_delay );
+#endif
 
     // calculate the cycle this block should be presented in
     // (this is just a virtual calculation since at that time it should
     //  already be in the device's buffer)
-    presentation_cycle = ( unsigned int ) ( TICKS_TO_CYCLES ( presentation_time ) );
+    // the timestamp is below 128 seconds, so it fits 32 bits
+    {
+        uint32_t presentation_ticks = (uint32_t)presentation_time;
+        uint32_t cycles = presentation_ticks / TICKS_PER_CYCLE;
+        presentation_offset = presentation_ticks - cycles * TICKS_PER_CYCLE;
+        presentation_cycle = cycles % CYCLES_PER_SECOND;
+    }
+    presentation_syt = ((presentation_cycle & 0xF) << 12) | presentation_offset;
 
-    // calculate the cycle this block should be transmitted in
-    transmit_at_cycle = ( unsigned int ) ( TICKS_TO_CYCLES ( transmit_at_time ) );
+    // calculate the cycle this block should be transmitted in, using
+    // the transfer delay split in cycles and ticks by updatePacketTemplates()
+    transmit_at_cycle = presentation_cycle + CYCLES_PER_SECOND - m_transfer_delay_cycles;
+    if (presentation_offset < m_transfer_delay_offset) {
+        transmit_at_cycle--;
+    }
+    if (transmit_at_cycle >= CYCLES_PER_SECOND) {
+        transmit_at_cycle -= CYCLES_PER_SECOND;
+    }
 
     // we can check whether this cycle is within the 'window' we have
     // to send this packet.
@@ -213,7 +234,7 @@ AmdtpTransmitStreamProcessor::generatePacketHeader (
             if(cycles_until_presentation >= m_min_cycles_before_presentation)
             {
                 // we are not that late and can still try to transmit the packet
-                m_dbc += fillDataPacketHeader(packet, length, presentation_time);
+                m_dbc += fillDataPacketHeader(packet, length, presentation_syt);
                 m_last_timestamp = presentation_time;
                 return (fc < (signed)(2*m_syt_interval) ? eCRV_Defer : eCRV_Packet);
             }
@@ -225,7 +246,7 @@ AmdtpTransmitStreamProcessor::generatePacketHeader (
         else if(cycles_until_transmit <= m_max_cycles_to_transmit_early)
         {
             // it's time send the packet
-            m_dbc += fillDataPacketHeader(packet, length, presentation_time);
+            m_dbc += fillDataPacketHeader(packet, length, presentation_syt);
             m_last_timestamp = presentation_time;
 
             // for timestamp tracing
@@ -307,16 +328,7 @@ AmdtpTransmitStreamProcessor::generateSilentPacketHeader (
                        (unsigned int)TICKS_TO_CYCLES(m_last_timestamp));
 
     packet->sid = m_local_node_id;
-
-    packet->eoh0 = 0;
-    packet->dbs = m_dimension;
-    packet->fn = 0;
-    packet->qpc = 0;
-    packet->sph = 0;
-    packet->reserved = 0;
     packet->dbc = m_dbc;
-    packet->eoh1 = 2;
-    packet->fmt = IEC61883_FMT_AMDTP;
 
     *tag = IEC61883_TAG_WITH_CIP;
     *sy = 0;
@@ -344,16 +356,7 @@ AmdtpTransmitStreamProcessor::generateEmptyPacketHeader (
                        (int)CYCLE_TIMER_GET_CYCLES(pkt_ctr), m_last_timestamp,
                        (unsigned int)TICKS_TO_CYCLES(m_last_timestamp) );
     packet->sid = m_local_node_id;
-
-    packet->eoh0 = 0;
-    packet->dbs = m_dimension;
-    packet->fn = 0;
-    packet->qpc = 0;
-    packet->sph = 0;
-    packet->reserved = 0;
     packet->dbc = m_dbc;
-    packet->eoh1 = 2;
-    packet->fmt = IEC61883_FMT_AMDTP;
 
     *tag = IEC61883_TAG_WITH_CIP;
     *sy = 0;
@@ -371,18 +374,21 @@ AmdtpTransmitStreamProcessor::generateEmptyPacketData (
 
 unsigned int AmdtpTransmitStreamProcessor::fillDataPacketHeader (
     struct iec61883_packet *packet, unsigned int* length,
-    uint32_t ts )
+    uint16_t syt )
 {
+    // take the constant part from the template, keeping sid and dbc
+    packet->eoh0 = m_data_header.eoh0;
+    packet->dbs = m_data_header.dbs;
+    packet->fn = 0;
+    packet->qpc = 0;
+    packet->sph = 0;
+    packet->reserved = 0;
+    packet->eoh1 = m_data_header.eoh1;
+    packet->fmt = m_data_header.fmt;
+    packet->fdf = m_data_header.fdf;
+    packet->syt = CondSwapToBus16 ( syt );
 
-    packet->fdf = m_fdf;
-
-    // convert the timestamp to SYT format
-    uint16_t timestamp_SYT = TICKS_TO_SYT ( ts );
-    packet->syt = CondSwapToBus16 ( timestamp_SYT );
-
-    // FIXME: use a precomputed value here
-    *length = m_syt_interval*sizeof ( quadlet_t ) *m_dimension + 8;
-
+    *length = m_data_packet_length;
     return m_syt_interval;
 }
 
@@ -392,23 +398,63 @@ unsigned int AmdtpTransmitStreamProcessor::fillNoDataPacketHeader (
     // no-data packets have syt=0xFFFF
     // and (can) have the usual amount of events as dummy data
     // DBC is not increased
-    packet->fdf = IEC61883_FDF_NODATA;
-    packet->syt = 0xffff;
+    packet->eoh0 = m_nodata_header.eoh0;
+    packet->dbs = m_nodata_header.dbs;
+    packet->fn = 0;
+    packet->qpc = 0;
+    packet->sph = 0;
+    packet->reserved = 0;
+    packet->eoh1 = m_nodata_header.eoh1;
+    packet->fmt = m_nodata_header.fmt;
+    packet->fdf = m_nodata_header.fdf;
+    packet->syt = m_nodata_header.syt;
+
+    *length = m_nodata_packet_length;
+    return m_nodata_dbc_increment;
+}
+
+/**
+ * @brief precompute the parts of the packets that are constant
+ *
+ * Called when the SYT interval, FDF, transfer delay or no-data payload
+ * setting changes, such that the per-packet work is reduced to filling
+ * in the timestamp, sid and dbc.
+ */
+void
+AmdtpTransmitStreamProcessor::updatePacketTemplates()
+{
+    memset(&m_data_header, 0, sizeof(m_data_header));
+    m_data_header.eoh0 = 0;
+    m_data_header.dbs = m_dimension;
+    m_data_header.eoh1 = 2;
+    m_data_header.fmt = IEC61883_FMT_AMDTP;
+    m_data_header.fdf = m_fdf;
+
+    m_nodata_header = m_data_header;
+    m_nodata_header.fdf = IEC61883_FDF_NODATA;
+    m_nodata_header.syt = 0xffff;
+
+    m_data_packet_length = 2*sizeof ( quadlet_t ) + m_syt_interval * m_dimension * sizeof ( quadlet_t );
 
 #if AMDTP_ALLOW_PAYLOAD_IN_NODATA_XMIT
     if ( m_send_nodata_payload )
     { // no-data packets with payload (NOTE: DICE-II doesn't like that)
-        *length = 2*sizeof ( quadlet_t ) + m_syt_interval * m_dimension * sizeof ( quadlet_t );
-        return m_syt_interval;
+        m_nodata_packet_length = m_data_packet_length;
+        m_nodata_dbc_increment = m_syt_interval;
     } else { // no-data packets without payload
-        *length = 2*sizeof ( quadlet_t );
-        return 0;
+        m_nodata_packet_length = 2*sizeof ( quadlet_t );
+        m_nodata_dbc_increment = 0;
     }
 #else
     // no-data packets without payload
-    *length = 2*sizeof ( quadlet_t );
-    return 0;
+    m_nodata_packet_length = 2*sizeof ( quadlet_t );
+    m_nodata_dbc_increment = 0;
 #endif
+
+    // a delay of more than a second makes no sense
+    unsigned int delay = m_transmit_transfer_delay % TICKS_PER_SECOND;
+    m_transfer_delay_cycles = delay / TICKS_PER_CYCLE;
+    m_transfer_delay_offset = delay % TICKS_PER_CYCLE;
 }
 
 unsigned int
@@ -451,6 +497,7 @@ bool AmdtpTransmitStreamProcessor::prepareChild()
     debugOutput ( DEBUG_LEVEL_VERBOSE, "Preparing (%p)...\n", this );
     m_syt_interval = getSytInterval();
     m_fdf = getFDF();
+    updatePacketTemplates();
 
     debugOutput ( DEBUG_LEVEL_VERBOSE, " SYT interval / FDF             : %d / %d\n", m_syt_interval, m_fdf );
 #if AMDTP_ALLOW_PAYLOAD_IN_NODATA_XMIT
@@ -485,13 +532,36 @@ bool AmdtpTransmitStreamProcessor::processWriteBlock ( char *data,
     // update the variable parts of the cache
     updatePortCache();
 
-    // encode audio data
+    // encode audio data, the optimized versions only handle
+    // port buffers of their own, and convert all channels, so they
+    // are not used when most of the channels are disabled
     switch(m_StreamProcessorManager.getAudioDataType()) {
         case StreamProcessorManager::eADT_Int24:
-            encodeAudioPortsInt24((quadlet_t *)data, offset, nevents);
+            if(m_audio_ports_strided || m_audio_ports_sparse) {
+                encodeAudioPortsConvert<SampleInt24>((quadlet_t *)data, offset, nevents);
+            } else {
+                encodeAudioPortsInt24((quadlet_t *)data, offset, nevents);
+            }
             break;
         case StreamProcessorManager::eADT_Float:
-            encodeAudioPortsFloat((quadlet_t *)data, offset, nevents);
+            if(m_audio_ports_strided || m_audio_ports_sparse) {
+#if AMDTP_CLIP_FLOATS
+                encodeAudioPortsConvert<SampleFloatClipped>((quadlet_t *)data, offset, nevents);
+#else
+                encodeAudioPortsConvert<SampleFloat>((quadlet_t *)data, offset, nevents);
+#endif
+            } else {
+                encodeAudioPortsFloat((quadlet_t *)data, offset, nevents);
+            }
+            break;
+        case StreamProcessorManager::eADT_Int16:
+            encodeAudioPortsConvert<SampleInt16>((quadlet_t *)data, offset, nevents);
+            break;
+        case StreamProcessorManager::eADT_Int32:
+            encodeAudioPortsConvert<SampleInt32>((quadlet_t *)data, offset, nevents);
+            break;
+        case StreamProcessorManager::eADT_Float64:
+            encodeAudioPortsConvert<SampleFloat64>((quadlet_t *)data, offset, nevents);
             break;
     }
 
@@ -512,31 +582,93 @@ AmdtpTransmitStreamProcessor::transmitSilenceBlock(
 }
 
 /**
- * @brief encodes all audio ports in the cache to events (silent data)
+ * @brief mux all audio ports to events, converting from the client's data type
+ *
+ * Used for the data types without an optimized version, for
+ * interleaved port buffers, and when only a few ports are enabled. Only
+ * the enabled ports are converted, the others are filled with silence
+ * by fillAudioSilence().
+ *
  * @param data 
  * @param offset 
  * @param nevents 
  */
+template <class S>
 void
-AmdtpTransmitStreamProcessor::encodeAudioPortsSilence(quadlet_t *data,
+AmdtpTransmitStreamProcessor::encodeAudioPortsConvert(quadlet_t *data,
                                                       unsigned int offset,
                                                       unsigned int nevents)
 {
     unsigned int j;
     quadlet_t *target_event;
-    int i;
+    unsigned int i;
 
-    for (i = 0; i < m_nb_audio_ports; i++) {
-        target_event = (quadlet_t *)(data + i);
+    // the inactive ports get silence, written a frame at a time
+    if(m_nb_active_audio_ports < (unsigned int)m_nb_audio_ports) {
+        fillAudioSilence(data, nevents);
+    }
+
+    for (i = 0; i < m_nb_active_audio_ports; i++) {
+        unsigned int idx = m_active_audio_ports[i];
+        struct _MBLA_port_cache &p = m_audio_ports[idx];
+        target_event = (quadlet_t *)(data + idx);
+#ifdef DEBUG
+        assert(nevents + offset <= p.buffer_size );
+#endif
+
+        const typename S::sample_t *buffer = (const typename S::sample_t *)(p.buffer);
+        const unsigned int stride = p.stride;
+        buffer += offset * stride;
 
         for (j = 0;j < nevents; j += 1)
         {
-            *target_event = CONDSWAPTOBUS32_CONST(0x40000000);
+            uint32_t v = S::toInt24(*buffer);
+            *target_event = CondSwapToBus32((quadlet_t)((v & 0x00FFFFFF) | 0x40000000));
+            buffer += stride;
             target_event += m_dimension;
         }
     }
 }
 
+/**
+ * @brief encodes all audio ports in the cache to events (silent data)
+ * @param data 
+ * @param offset 
+ * @param nevents 
+ */
+void
+AmdtpTransmitStreamProcessor::encodeAudioPortsSilence(quadlet_t *data,
+                                                      unsigned int offset,
+                                                      unsigned int nevents)
+{
+    fillAudioSilence(data, nevents);
+}
+
+/**
+ * @brief fill the audio slots of the events with silence
+ *
+ * Copies the silent event template into the audio part of each event,
+ * which is a lot cheaper than writing the slots port by port.
+ *
+ * @param data 
+ * @param nevents 
+ */
+void
+AmdtpTransmitStreamProcessor::fillAudioSilence(quadlet_t *data,
+                                               unsigned int nevents)
+{
+    unsigned int j;
+    const size_t size = m_nb_audio_ports * sizeof(quadlet_t);
+    if(size == 0) return;
+    const quadlet_t *silence = &m_audio_silence_template[0];
+
+    for (j = 0;j < nevents; j += 1)
+    {
+        memcpy(data, silence, size);
+        data += m_dimension;
+    }
+}
+
 #ifdef __SSE2__
 #include <emmintrin.h>
 
@@ -1140,6 +1272,7 @@ AmdtpTransmitStreamProcessor::initPortCache() {
                     return false;
                 }
                 p.buffer = NULL; // to be filled by updatePortCache
+                p.stride = 1;
                 #ifdef DEBUG
                 p.buffer_size = (*it)->getBufferSize();
                 #endif
@@ -1157,6 +1290,13 @@ next_index:
         continue;
     }
 
+    // reserve here such that updatePortCache() does not allocate
+    m_active_audio_ports.clear();
+    m_active_audio_ports.reserve(m_nb_audio_ports);
+    m_nb_active_audio_ports = 0;
+    m_audio_silence_template.assign(m_nb_audio_ports,
+                                    CONDSWAPTOBUS32_CONST(0x40000000));
+
     for(PortVectorIterator it = m_Ports.begin();
         it != m_Ports.end();
         ++it )
@@ -1193,15 +1333,25 @@ next_index:
 void
 AmdtpTransmitStreamProcessor::updatePortCache() {
     int idx;
+    m_audio_ports_strided = false;
+    m_active_audio_ports.clear();
     for (idx = 0; idx < m_nb_audio_ports; idx++) {
         struct _MBLA_port_cache& p = m_audio_ports.at(idx);
         AmdtpAudioPort *port = p.port;
         p.buffer = port->getBufferAddress();
+        p.stride = port->getBufferStride();
+        m_audio_ports_strided |= (p.stride != 1);
         p.enabled = !port->isDisabled();
+        if(p.buffer && p.enabled) {
+            m_active_audio_ports.push_back(idx);
+        }
 #ifdef DEBUG
 	p.buffer_size = port->getBufferSize();
 #endif
     }
+    m_nb_active_audio_ports = m_active_audio_ports.size();
+    m_audio_ports_sparse = m_nb_active_audio_ports * 100
+                           <= (unsigned int)m_nb_audio_ports * AMDTP_SPARSE_ENCODE_MAX_ACTIVE_PERCENT;
     for (idx = 0; idx < m_nb_midi_ports; idx++) {
         struct _MIDI_port_cache& p = m_midi_ports.at(idx);
         AmdtpMidiPort *port = p.port;
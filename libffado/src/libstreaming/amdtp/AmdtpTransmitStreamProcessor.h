@@ -75,7 +75,8 @@ public:
 
 #if AMDTP_ALLOW_PAYLOAD_IN_NODATA_XMIT
 public:
-    void sendPayloadForNoDataPackets(bool b) {m_send_nodata_payload = b;};
+    void sendPayloadForNoDataPackets(bool b)
+                    {m_send_nodata_payload = b; updatePacketTemplates();};
 #endif
 
 public:
@@ -95,7 +96,7 @@ public:
     virtual unsigned int getTransferDelay()
                     {return m_transmit_transfer_delay;};
     virtual void setTransferDelay(unsigned int x)
-                    {m_transmit_transfer_delay = x;};
+                    {m_transmit_transfer_delay = x; updatePacketTemplates();};
     virtual int getMinCyclesBeforePresentation()
                     {return m_min_cycles_before_presentation;};
     virtual void setMinCyclesBeforePresentation(int x)
@@ -104,17 +105,23 @@ public:
 protected:
     bool processWriteBlock(char *data, unsigned int nevents, unsigned int offset);
     bool transmitSilenceBlock(char *data, unsigned int nevents, unsigned int offset);
+    void transmitFramesDropped(unsigned int nframes)
+                    {m_dbc += nframes;};
 
 private:
     unsigned int fillNoDataPacketHeader(struct iec61883_packet *packet, unsigned int* length);
-    unsigned int fillDataPacketHeader(struct iec61883_packet *packet, unsigned int* length, uint32_t ts);
+    unsigned int fillDataPacketHeader(struct iec61883_packet *packet, unsigned int* length, uint16_t syt);
+    void updatePacketTemplates();
 
     int transmitBlock(char *data, unsigned int nevents,
                         unsigned int offset);
 
     void encodeAudioPortsSilence(quadlet_t *data, unsigned int offset, unsigned int nevents);
+    void fillAudioSilence(quadlet_t *data, unsigned int nevents);
     void encodeAudioPortsFloat(quadlet_t *data, unsigned int offset, unsigned int nevents);
     void encodeAudioPortsInt24(quadlet_t *data, unsigned int offset, unsigned int nevents);
+    template <class S>
+    void encodeAudioPortsConvert(quadlet_t *data, unsigned int offset, unsigned int nevents);
     void encodeMidiPortsSilence(quadlet_t *data, unsigned int offset, unsigned int nevents);
     void encodeMidiPorts(quadlet_t *data, unsigned int offset, unsigned int nevents);
 
@@ -135,10 +142,22 @@ private:
     unsigned int m_transmit_transfer_delay;
     int m_min_cycles_before_presentation;
 
+private: // the parts of the packets that don't change while streaming
+    // the CIP header, sid and dbc are filled in per packet
+    struct iec61883_packet m_data_header;
+    struct iec61883_packet m_nodata_header;
+    unsigned int m_data_packet_length;
+    unsigned int m_nodata_packet_length;
+    unsigned int m_nodata_dbc_increment;
+    // m_transmit_transfer_delay split in cycles and ticks
+    unsigned int m_transfer_delay_cycles;
+    unsigned int m_transfer_delay_offset;
+
 private: // local port caching for performance
     struct _MBLA_port_cache {
         AmdtpAudioPort*     port;
         void*               buffer;
+        unsigned int        stride;
         bool                enabled;
 #ifdef DEBUG
         unsigned int        buffer_size;
@@ -146,6 +165,15 @@ private: // local port caching for performance
     };
     std::vector<struct _MBLA_port_cache> m_audio_ports;
     int m_nb_audio_ports;
+    // true if one of the audio ports has an interleaved buffer
+    bool m_audio_ports_strided;
+    // the audio ports that are enabled and have a buffer
+    std::vector<unsigned int> m_active_audio_ports;
+    unsigned int m_nb_active_audio_ports;
+    // true if few enough ports are active to encode them one by one
+    bool m_audio_ports_sparse;
+    // the audio part of a silent event, used to fill the inactive slots
+    std::vector<quadlet_t> m_audio_silence_template;
 
     struct _MIDI_port_cache {
         AmdtpMidiPort*      port;
@@ -36,6 +36,8 @@
 
 #include "libutil/ByteSwap.h"
 
+#include "../util/SampleConversion.h"
+
 #include <cstring>
 #include <math.h>
 #include <assert.h>
@@ -220,6 +222,23 @@ bool DigidesignReceiveStreamProcessor::processReadBlock(char *data,
     return no_problem;
 }
 
+// Decodes the packed 24-bit samples into a port buffer of any client
+// sample type S, see util/SampleConversion.h.
+template <class S>
+static void
+decodeSamples(typename S::sample_t *buffer, unsigned int stride,
+              unsigned char *src_data, unsigned int event_size, unsigned int nevents)
+{
+    for (unsigned int j = 0; j < nevents; j++) {
+        signed int v = (*src_data<<16)+(*(src_data+1)<<8)+*(src_data+2);
+        if (*src_data & 0x80)
+            v |= 0xff000000;
+        *buffer = S::fromInt24(v);
+        buffer += stride;
+        src_data += event_size;
+    }
+}
+
 signed int DigidesignReceiveStreamProcessor::decodeDigidesignEventsToPort(DigidesignAudioPort *p,
         quadlet_t *data, unsigned int offset, unsigned int nevents)
 {
@@ -265,6 +284,10 @@ signed int DigidesignReceiveStreamProcessor::decodeDigidesignEventsToPort(Digide
     unsigned char *src_data;
     src_data = (unsigned char *)data + p->getPosition();
 
+    // Interleaved client buffers have the samples of a port "stride"
+    // samples apart.
+    unsigned int stride = p->getBufferStride();
+
     switch(m_StreamProcessorManager.getAudioDataType()) {
         case StreamProcessorManager::eADT_Float:
             {
@@ -273,7 +296,7 @@ signed int DigidesignReceiveStreamProcessor::decodeDigidesignEventsToPort(Digide
 
                 assert(nevents + offset <= p->getBufferSize());
 
-                buffer+=offset;
+                buffer+=offset*stride;
 
                 for (j = 0; j < nevents; j += 1) { // decode max nsamples
 
@@ -282,7 +305,7 @@ signed int DigidesignReceiveStreamProcessor::decodeDigidesignEventsToPort(Digide
                     if (*src_data & 0x80)
                       v |= 0xff000000;
                     *buffer = v * multiplier;
-                    buffer++;
+                    buffer += stride;
                     src_data += m_event_size;
                 }
             }
@@ -298,7 +321,7 @@ signed int DigidesignReceiveStreamProcessor::decodeDigidesignEventsToPort(Digide
                 // channel, so the number of frames is the same as the
                 // number of quadlets to offset (assuming the port buffer
                 // uses one quadlet per sample, which is the case currently).
-                buffer+=offset;
+                buffer+=offset*stride;
 
                 for(j = 0; j < nevents; j += 1) { // Decode nsamples
                     *buffer = (*src_data<<16)+(*(src_data+1)<<8)+*(src_data+2);
@@ -309,12 +332,27 @@ signed int DigidesignReceiveStreamProcessor::decodeDigidesignEventsToPort(Digide
                     if (*src_data & 0x80)
                         *buffer |= 0xff000000;
 
-                    buffer++;
+                    buffer += stride;
                     src_data+=m_event_size;
                 }
             }
             break;
 
+        case StreamProcessorManager::eADT_Int16:
+            decodeSamples<SampleInt16>((int16_t *)p->getBufferAddress() + offset*stride,
+                                       stride, src_data, m_event_size, nevents);
+            break;
+
+        case StreamProcessorManager::eADT_Int32:
+            decodeSamples<SampleInt32>((int32_t *)p->getBufferAddress() + offset*stride,
+                                       stride, src_data, m_event_size, nevents);
+            break;
+
+        case StreamProcessorManager::eADT_Float64:
+            decodeSamples<SampleFloat64>((double *)p->getBufferAddress() + offset*stride,
+                                         stride, src_data, m_event_size, nevents);
+            break;
+
         default:
             // Unsupported type.
             break;
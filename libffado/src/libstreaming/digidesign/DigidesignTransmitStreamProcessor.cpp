@@ -37,6 +37,8 @@
 
 #include "libutil/ByteSwap.h"
 
+#include "../util/SampleConversion.h"
+
 #include <cstring>
 #include <assert.h>
 
@@ -618,6 +620,23 @@ DigidesignTransmitStreamProcessor::transmitSilenceBlock(char *data,
     return no_problem;
 }
 
+// Encodes a port buffer of any client sample type S (see
+// util/SampleConversion.h) into packed 24-bit samples.
+template <class S>
+static void
+encodeSamples(const typename S::sample_t *buffer, unsigned int stride,
+              unsigned char *target, unsigned int event_size, unsigned int nevents)
+{
+    for (unsigned int j = 0; j < nevents; j++) {
+        unsigned int v = S::toInt24(*buffer);
+        *target = (v >> 16) & 0xff;
+        *(target+1) = (v >> 8) & 0xff;
+        *(target+2) = v & 0xff;
+        buffer += stride;
+        target += event_size;
+    }
+}
+
 int DigidesignTransmitStreamProcessor::encodePortToDigidesignEvents(DigidesignAudioPort *p, quadlet_t *data,
                        unsigned int offset, unsigned int nevents) {
 // Encodes nevents worth of data from the given port into the given buffer.  The
@@ -647,6 +666,10 @@ int DigidesignTransmitStreamProcessor::encodePortToDigidesignEvents(DigidesignAu
     unsigned char *target;
     target = (unsigned char *)data + p->getPosition();
 
+    // Interleaved client buffers have the samples of a port "stride"
+    // samples apart.
+    unsigned int stride = p->getBufferStride();
+
     switch(m_StreamProcessorManager.getAudioDataType()) {
         default:
         case StreamProcessorManager::eADT_Int24:
@@ -659,14 +682,14 @@ int DigidesignTransmitStreamProcessor::encodePortToDigidesignEvents(DigidesignAu
                 // channel, so the number of frames is the same as the
                 // number of quadlets to offset (assuming the port buffer
                 // uses one quadlet per sample, which is the case currently).
-                buffer+=offset;
+                buffer+=offset*stride;
 
                 for(j = 0; j < nevents; j += 1) { // Decode nsamples
                     *target = (*buffer >> 16) & 0xff;
                     *(target+1) = (*buffer >> 8) & 0xff;
                     *(target+2) = (*buffer) & 0xff;
 
-                    buffer++;
+                    buffer += stride;
                     target+=m_event_size;
                 }
             }
@@ -678,7 +701,7 @@ int DigidesignTransmitStreamProcessor::encodePortToDigidesignEvents(DigidesignAu
 
                 assert(nevents + offset <= p->getBufferSize());
 
-                buffer+=offset;
+                buffer+=offset*stride;
 
                 for(j = 0; j < nevents; j += 1) { // decode max nsamples
                     float in = *buffer;
@@ -692,11 +715,23 @@ int DigidesignTransmitStreamProcessor::encodePortToDigidesignEvents(DigidesignAu
                     *(target+1) = (v >> 8) & 0xff;
                     *(target+2) = v & 0xff;
 
-                    buffer++;
+                    buffer += stride;
                     target+=m_event_size;
                 }
             }
             break;
+        case StreamProcessorManager::eADT_Int16:
+            encodeSamples<SampleInt16>((int16_t *)p->getBufferAddress() + offset*stride,
+                                       stride, target, m_event_size, nevents);
+            break;
+        case StreamProcessorManager::eADT_Int32:
+            encodeSamples<SampleInt32>((int32_t *)p->getBufferAddress() + offset*stride,
+                                       stride, target, m_event_size, nevents);
+            break;
+        case StreamProcessorManager::eADT_Float64:
+            encodeSamples<SampleFloat64>((double *)p->getBufferAddress() + offset*stride,
+                                         stride, target, m_event_size, nevents);
+            break;
     }
 
     return 0;
@@ -718,6 +753,9 @@ int DigidesignTransmitStreamProcessor::encodeSilencePortToDigidesignEvents(Digid
     default:
         case StreamProcessorManager::eADT_Int24:
         case StreamProcessorManager::eADT_Float:
+        case StreamProcessorManager::eADT_Int16:
+        case StreamProcessorManager::eADT_Int32:
+        case StreamProcessorManager::eADT_Float64:
         for (j = 0; j < nevents; j++) {
             *target = *(target+1) = *(target+2) = 0;
             target += m_event_size;
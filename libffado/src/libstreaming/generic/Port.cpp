@@ -39,6 +39,7 @@ Port::Port(PortManager& m, std::string name,
     , m_PortType( porttype )
     , m_Direction( direction )
     , m_buffer( NULL )
+    , m_buffer_stride( 1 )
     , m_manager( m )
     , m_State( E_Created )
 {
@@ -121,6 +122,17 @@ void Port::setBufferAddress(void *buff) {
     m_buffer=buff;
 }
 
+/**
+ * Set the distance between the samples of consecutive frames, in samples.
+ * This is 1 for a buffer of its own, and the number of channels for a
+ * port in an interleaved buffer.
+ *
+ * @param stride
+ */
+void Port::setBufferStride(unsigned int stride) {
+    m_buffer_stride = (stride ? stride : 1);
+}
+
 /// Enable the port. (this can be called anytime)
 void
 Port::enable()  {
@@ -160,6 +172,7 @@ void Port::show() {
     debugOutput(DEBUG_LEVEL_VERBOSE,"Enabled?      : %d\n", m_disabled==false);
     debugOutput(DEBUG_LEVEL_VERBOSE,"State?        : %d\n", m_State);
     debugOutput(DEBUG_LEVEL_VERBOSE,"Buffer Size   : %d\n", m_buffersize);
+    debugOutput(DEBUG_LEVEL_VERBOSE,"Buffer Stride : %d\n", m_buffer_stride);
     debugOutput(DEBUG_LEVEL_VERBOSE,"Event Size    : %d\n", getEventSize());
     debugOutput(DEBUG_LEVEL_VERBOSE,"Port Type     : %d\n", m_PortType);
     debugOutput(DEBUG_LEVEL_VERBOSE,"Direction     : %d\n", m_Direction);
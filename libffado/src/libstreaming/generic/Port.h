@@ -131,6 +131,15 @@ public:
     void setBufferAddress(void *buff);
     void *getBufferAddress();
 
+    /**
+     * \brief sets the distance between the samples of two frames
+     *
+     * counted in samples, 1 unless the buffer is interleaved
+     * with those of other ports
+     */
+    void setBufferStride(unsigned int stride);
+    unsigned int getBufferStride() {return m_buffer_stride;};
+
     PortManager& getManager() { return m_manager; };
 
     virtual void setVerboseLevel(int l);
@@ -146,6 +155,7 @@ protected:
     enum E_Direction m_Direction;
 
     void *m_buffer;
+    unsigned int m_buffer_stride;
 
     PortManager& m_manager;
 
@@ -23,6 +23,7 @@
 
 #include "StreamProcessor.h"
 #include "../StreamProcessorManager.h"
+#include "../util/Resampler.h"
 
 #include "devicemanager.h"
 
@@ -36,6 +37,7 @@
 
 #include <assert.h>
 #include <math.h>
+#include <string.h>
 
 #define SIGNAL_ACTIVITY_SPM { \
     m_StreamProcessorManager.signalActivity(); \
@@ -78,6 +80,11 @@ StreamProcessor::StreamProcessor(FFADODevice &parent, enum eProcessorType type)
     , m_max_fs_diff_norm ( 0.01 )
     , m_max_diff_ticks ( 50 )
     , m_in_xrun( false )
+    , m_busreset_pending( false )
+    , m_busreset_dropped_cycles( 0 )
+    , m_resync_transmit( false )
+    , m_telemetry( NULL )
+    , m_resampler( NULL )
 {
     // create the timestamped buffer and register ourselves as its client
     m_data_buffer = new Util::TimestampedBuffer(this);
@@ -89,6 +96,7 @@ StreamProcessor::~StreamProcessor() {
         debugOutput(DEBUG_LEVEL_VERBOSE,"Could not unregister stream processor with the Iso manager\n");
     }
 
+    if (m_resampler) delete m_resampler;
     if (m_data_buffer) delete m_data_buffer;
     if (m_scratch_buffer) delete[] m_scratch_buffer;
 }
@@ -144,23 +152,46 @@ StreamProcessor::handleBusResetDo()
     debugOutput(DEBUG_LEVEL_VERBOSE, "(%p) handling busreset\n", this);
     m_state = ePS_Error;
     // this will result in the SPM dying
-    m_in_xrun = true;
+    flagXrun();
     SIGNAL_ACTIVITY_ALL;
     return true;
 }
 
 bool
-StreamProcessor::handleBusReset()
+StreamProcessor::handleBusReset(bool resync_only)
 {
-    debugOutput(DEBUG_LEVEL_VERBOSE, "(%p) handling busreset\n", this);
-
-    // we are sure that we're not iterated since this is called from within the ISO manager thread
+    debugOutput(DEBUG_LEVEL_VERBOSE, "(%p) handling busreset%s\n",
+                this, (resync_only ? ", resync only" : ""));
 
     // lock the wait loop of the SPM, such that the client leaves us alone
     m_StreamProcessorManager.lockWaitLoop();
 
-    // pass on to the implementing classes
-    bool retval = handleBusResetDo();
+    bool retval = true;
+    if(resync_only && m_in_xrun) {
+        // the xrun was flagged before the reset was noticed,
+        // a resync can't undo that
+        debugOutput(DEBUG_LEVEL_VERBOSE, "(%p) already in xrun, no resync\n", this);
+        resync_only = false;
+    }
+    if(resync_only) {
+        // the stream kept running, but cycles might have been lost during
+        // the reset. Re-anchor the buffer timestamps on the next packet,
+        // or skip the frames that were due in the lost cycles.
+        if(getType() == ePT_Receive) {
+            m_correct_last_timestamp = true;
+        } else {
+            m_resync_transmit = true;
+        }
+    }
+    m_busreset_pending = false;
+
+    if(!resync_only) {
+        // the stream is restarted, the lost cycles don't matter anymore
+        m_busreset_dropped_cycles = 0;
+        m_resync_transmit = false;
+        // pass on to the implementing classes
+        retval = handleBusResetDo();
+    }
 
     // resume wait loop
     m_StreamProcessorManager.unlockWaitLoop();
@@ -168,11 +199,37 @@ StreamProcessor::handleBusReset()
     return retval;
 }
 
+/**
+ * Skips the frames that should have been sent in the cycles lost
+ * during a bus reset, such that the next packet carries the frames
+ * that are due now instead of being too late.
+ */
+void
+StreamProcessor::resyncTransmitBuffer()
+{
+    m_resync_transmit = false;
+    unsigned int nframes = (unsigned int)(m_busreset_dropped_cycles * TICKS_PER_CYCLE
+                                          / getTicksPerFrame());
+    m_busreset_dropped_cycles = 0;
+    if (nframes == 0) {
+        return;
+    }
+    if (nframes > m_data_buffer->getBufferFill()) {
+        nframes = m_data_buffer->getBufferFill();
+    }
+    debugOutput(DEBUG_LEVEL_VERBOSE, "(%p) dropping %u frames lost in bus reset\n", this, nframes);
+    if (!m_data_buffer->dropFrames(nframes)) {
+        debugWarning("(%p) could not drop %u frames\n", this, nframes);
+        return;
+    }
+    transmitFramesDropped(nframes);
+}
+
 void StreamProcessor::handlerDied()
 {
     debugWarning("Handler died for %p\n", this);
     m_state = ePS_Stopped;
-    m_in_xrun = true;
+    flagXrun();
     SIGNAL_ACTIVITY_ALL;
 }
 
@@ -446,9 +503,13 @@ StreamProcessor::putPacket(unsigned char *data, unsigned int length,
     if(dropped_cycles) {
         // make sure the last_timestamp is corrected
         m_correct_last_timestamp = true;
-        if (m_state == ePS_Running) {
+        if (m_busreset_pending) {
+            // the cycles were lost in a bus reset, whether that is
+            // an xrun is decided when the reset is handled
+            debugOutput(DEBUG_LEVEL_VERBOSE, "(%p) lost %u cycles in bus reset\n", this, dropped_cycles);
+        } else if (m_state == ePS_Running) {
             // this is an xrun situation
-            m_in_xrun = true;
+            flagXrun();
             debugOutput(DEBUG_LEVEL_NORMAL, "Should update state to WaitingForStreamDisable due to dropped packet xrun\n");
             m_cycle_to_switch_state = CYCLE_TIMER_GET_CYCLES(pkt_ctr) + 1; // switch in the next cycle
             m_next_state = ePS_WaitingForStreamDisable;
@@ -585,7 +646,7 @@ StreamProcessor::putPacket(unsigned char *data, unsigned int length,
         // allow for the xrun to be picked up
         if (result2 == eCRV_XRun) {
             debugOutput(DEBUG_LEVEL_NORMAL, "processPacketData xrun\n");
-            m_in_xrun = true;
+            flagXrun();
             debugOutput(DEBUG_LEVEL_VERBOSE, "Should update state to WaitingForStreamDisable due to data xrun\n");
             m_cycle_to_switch_state = CYCLE_TIMER_GET_CYCLES(pkt_ctr)+1; // switch in the next cycle
             m_next_state = ePS_WaitingForStreamDisable;
@@ -632,10 +693,15 @@ StreamProcessor::getPacket(unsigned char *data, unsigned int *length,
     uint64_t prev_timestamp;
     // note that we can ignore skipped cycles since
     // the protocol will take care of that
-    if (dropped_cycles > 0) {
+    if (dropped_cycles > 0 && m_busreset_pending) {
+        // the cycles were lost in a bus reset, whether that is
+        // an xrun is decided when the reset is handled
+        debugOutput(DEBUG_LEVEL_VERBOSE, "(%p) lost %u cycles in bus reset\n", this, dropped_cycles);
+        m_busreset_dropped_cycles += dropped_cycles;
+    } else if (dropped_cycles > 0) {
         // HACK: this should not be necessary, since the header generation functions should trigger the xrun.
         //       but apparently there are some issues with the 1394 stack
-        m_in_xrun = true;
+        flagXrun();
         if(m_state == ePS_Running) {
             debugShowBackLogLines(200);
             debugOutput(DEBUG_LEVEL_NORMAL, "dropped packets xrun (%u)\n", dropped_cycles);
@@ -651,6 +717,10 @@ StreamProcessor::getPacket(unsigned char *data, unsigned int *length,
         }
     }
 
+    if (m_resync_transmit) {
+        resyncTransmitBuffer();
+    }
+
 #ifdef DEBUG
     // bypass based upon state
     if (m_state == ePS_Invalid) {
@@ -767,7 +837,7 @@ StreamProcessor::getPacket(unsigned char *data, unsigned int *length,
             // allow for the xrun to be picked up
             if (result2 == eCRV_XRun) {
                 debugOutput(DEBUG_LEVEL_NORMAL, "generatePacketData xrun\n");
-                m_in_xrun = true;
+                flagXrun();
                 debugOutput(DEBUG_LEVEL_VERBOSE, "Should update state to WaitingForStreamDisable due to data xrun\n");
                 m_cycle_to_switch_state = CYCLE_TIMER_GET_CYCLES(pkt_ctr) + 1; // switch in the next cycle
                 m_next_state = ePS_WaitingForStreamDisable;
@@ -824,7 +894,7 @@ StreamProcessor::getPacket(unsigned char *data, unsigned int *length,
             }
         } else if (result == eCRV_XRun) { // pick up the possible xruns
             debugOutput(DEBUG_LEVEL_NORMAL, "generatePacketHeader xrun\n");
-            m_in_xrun = true;
+            flagXrun();
             debugOutput(DEBUG_LEVEL_VERBOSE, "Should update state to WaitingForStreamDisable due to header xrun\n");
             m_cycle_to_switch_state = CYCLE_TIMER_GET_CYCLES(pkt_ctr) + 1; // switch in the next cycle
             m_next_state = ePS_WaitingForStreamDisable;
@@ -945,6 +1015,9 @@ bool StreamProcessor::getFramesWet(unsigned int nbframes, int64_t ts) {
                       this, lag_ticks, lag_frames, srate, ts, ts_expected, fc);
     }
 #endif
+    if (m_resampler) {
+        return getFramesResampled(nbframes);
+    }
     // ask the buffer to process nbframes of frames
     // using it's registered client's processReadBlock(),
     // which should be ours
@@ -952,6 +1025,37 @@ bool StreamProcessor::getFramesWet(unsigned int nbframes, int64_t ts) {
     return true;
 }
 
+/**
+ * Reads the frames the resampler needs to produce nbframes frames at the
+ * sync source rate. The frames are decoded into the resampler's staging
+ * buffers in chunks of at most a period, since the port buffers are
+ * assumed to be one period long by the decoders.
+ */
+bool
+StreamProcessor::getFramesResampled(unsigned int nbframes)
+{
+    unsigned int needed = m_resampler->getFramesNeeded(nbframes);
+    if (needed > (unsigned int)m_data_buffer->getBufferFill()) {
+        debugWarning("(%p) need %u frames for resampling, have %d\n",
+                     this, needed, m_data_buffer->getBufferFill());
+        return false;
+    }
+    unsigned int max_chunk = m_StreamProcessorManager.getPeriodSize() & ~0x7;
+    unsigned int done = 0;
+    bool result = true;
+    while (done < needed && result) {
+        unsigned int chunk = needed - done;
+        if (chunk > max_chunk) chunk = max_chunk;
+        m_resampler->attachPorts(done);
+        result = m_data_buffer->blockProcessReadFrames(chunk);
+        done += chunk;
+    }
+    m_resampler->detachPorts();
+    if (!result) return false;
+    m_resampler->processRead(nbframes, needed);
+    return true;
+}
+
 bool StreamProcessor::getFramesDry(unsigned int nbframes, int64_t ts)
 {
     debugOutputExtreme(DEBUG_LEVEL_VERY_VERBOSE,
@@ -991,6 +1095,9 @@ StreamProcessor::putFramesWet(unsigned int nbframes, int64_t ts)
     debugOutputExtreme(DEBUG_LEVEL_ULTRA_VERBOSE,
                        "StreamProcessor::putFramesWet(%d, %"PRIu64")\n",
                        nbframes, ts);
+    if (m_resampler) {
+        return putFramesResampled(nbframes, ts);
+    }
     // transfer the data
     m_data_buffer->blockProcessWriteFrames(nbframes, ts);
     debugOutputExtreme(DEBUG_LEVEL_ULTRA_VERBOSE,
@@ -998,6 +1105,30 @@ StreamProcessor::putFramesWet(unsigned int nbframes, int64_t ts)
     return true; // FIXME: what about failure?
 }
 
+/**
+ * The resampler queues the frames it produces, and the buffer is written
+ * one period at a time. The timestamp of a period is derived from that of
+ * the last frame in the queue, which corresponds to ts.
+ */
+bool
+StreamProcessor::putFramesResampled(unsigned int nbframes, int64_t ts)
+{
+    unsigned int period = m_StreamProcessorManager.getPeriodSize();
+    unsigned int nb_periods = m_resampler->processWrite(nbframes);
+    unsigned int queued = m_resampler->getFramesQueued();
+    float tpf = getTicksPerFrame();
+    bool result = true;
+    for (unsigned int i = 0; i < nb_periods && result; i++) {
+        unsigned int frames_after = queued - (i + 1) * period;
+        int64_t period_ts = substractTicks(ts, (uint64_t)(frames_after * tpf));
+        m_resampler->attachPorts(i * period);
+        result = m_data_buffer->blockProcessWriteFrames(period, period_ts);
+    }
+    m_resampler->detachPorts();
+    m_resampler->consumePeriods(nb_periods);
+    return result;
+}
+
 bool
 StreamProcessor::putFramesDry(unsigned int nbframes, int64_t ts)
 {
@@ -1104,31 +1235,22 @@ StreamProcessor::provideSilenceToPort(Port *p, unsigned int offset, unsigned int
             }
             break;
         case Port::E_Audio:
-            switch(m_StreamProcessorManager.getAudioDataType()) {
-            case StreamProcessorManager::eADT_Int24:
-                {
-                    quadlet_t *buffer=(quadlet_t *)(p->getBufferAddress());
-                    assert(nevents + offset <= p->getBufferSize());
-                    buffer+=offset;
-    
-                    for(j = 0; j < nevents; j += 1) {
-                        *(buffer)=0;
-                        buffer++;
-                    }
-                }
-                break;
-            case StreamProcessorManager::eADT_Float:
-                {
-                    float *buffer=(float *)(p->getBufferAddress());
-                    assert(nevents + offset <= p->getBufferSize());
-                    buffer+=offset;
-    
+            {
+                // a zero bit pattern is silence for all data types
+                unsigned int size = StreamProcessorManager::getAudioSampleSize(m_StreamProcessorManager.getAudioDataType());
+                unsigned int stride = p->getBufferStride();
+                char *buffer=(char *)(p->getBufferAddress());
+                assert(nevents + offset <= p->getBufferSize());
+
+                if(stride == 1) {
+                    memset(buffer + offset * size, 0, nevents * size);
+                } else {
+                    buffer += offset * stride * size;
                     for(j = 0; j < nevents; j += 1) {
-                        *buffer = 0.0;
-                        buffer++;
+                        memset(buffer, 0, size);
+                        buffer += stride * size;
                     }
                 }
-                break;
             }
             break;
     }
@@ -1593,6 +1715,11 @@ StreamProcessor::doWaitForStreamEnable()
             }
 
             if (getType() == ePT_Transmit) {
+                // cycles lost in an earlier bus reset are not to be
+                // skipped in the new prefill
+                m_busreset_dropped_cycles = 0;
+                m_resync_transmit = false;
+
                 ringbuffer_size_frames = m_StreamProcessorManager.getNbBuffers() * m_StreamProcessorManager.getPeriodSize();
                 ringbuffer_size_frames += m_extra_buffer_frames;
 
@@ -1818,7 +1945,11 @@ bool StreamProcessor::canProducePacket()
 }
 bool StreamProcessor::canProducePeriod()
 {
-    return canProduce(m_StreamProcessorManager.getPeriodSize());
+    unsigned int period = m_StreamProcessorManager.getPeriodSize();
+    if (m_resampler) {
+        return canProduce(m_resampler->getPeriodsReady(period) * period);
+    }
+    return canProduce(period);
 }
 bool StreamProcessor::canProduce(unsigned int nframes)
 {
@@ -1848,7 +1979,11 @@ bool StreamProcessor::canConsumePacket()
 }
 bool StreamProcessor::canConsumePeriod()
 {
-    return canConsume(m_StreamProcessorManager.getPeriodSize());
+    unsigned int period = m_StreamProcessorManager.getPeriodSize();
+    if (m_resampler) {
+        return canConsume(m_resampler->getFramesNeeded(period));
+    }
+    return canConsume(period);
 }
 bool StreamProcessor::canConsume(unsigned int nframes)
 {
@@ -1941,6 +2076,52 @@ StreamProcessor::ePTToString(enum eProcessorType t) {
     }
 }
 
+/**
+ * @brief flag an xrun
+ *
+ * Sets the xrun flag. If the stream was running, the flight recorder
+ * is frozen such that the events leading up to the xrun are preserved
+ * until the StreamProcessorManager dumps them in handleXrun().
+ */
+void
+StreamProcessor::flagXrun()
+{
+    if(!m_in_xrun && m_state == ePS_Running) {
+        Util::FlightRecorder *rec = m_IsoHandlerManager.getFlightRecorder();
+        if(rec) {
+            Util::FlightRecord *r = rec->getRecord();
+            if(r) {
+                r->type = Util::FlightRecorder::eRT_Xrun;
+                // the DLL estimate, reading the register isn't RT safe here
+                r->now = m_1394service.getCycleTimer();
+                r->pkt_ctr = 0xFFFFFFFF;
+                r->handler = (m_processor_type == ePT_Transmit ? 0x80 : 0x00)
+                             | (m_channel < 0 ? 0x40 : (m_channel & 0x3F));
+                r->sp_state = m_state;
+                r->flags = Util::FlightRecorder::eRF_ClientXrun;
+                r->cycle = -1;
+                r->dropped = 0;
+                r->skipped = 0;
+                r->length = 0;
+                r->buffer_fill = m_data_buffer->getBufferFill();
+                r->result = 0;
+            }
+            rec->freeze();
+        }
+    }
+    m_in_xrun = true;
+}
+
+/***********************************************
+ * Telemetry                                   *
+ ***********************************************/
+void
+StreamProcessor::setTelemetrySlot(Util::TelemetryStreamSlot *slot)
+{
+    m_telemetry = slot;
+    m_data_buffer->setDllErrorHistogram(slot ? &slot->dll_error : NULL);
+}
+
 /***********************************************
  * Debug                                       *
  ***********************************************/
@@ -1973,6 +2154,16 @@ StreamProcessor::dumpInfo()
                                           24576000.0/m_data_buffer->getRate());
     #endif
     m_data_buffer->dumpInfo();
+    if (m_resampler) {
+        m_resampler->show();
+    }
+}
+
+void
+StreamProcessor::setResampler(Resampler *r)
+{
+    if (m_resampler) delete m_resampler;
+    m_resampler = r;
 }
 
 void
@@ -1988,6 +2179,7 @@ StreamProcessor::setVerboseLevel(int l) {
     setDebugLevel(l);
     PortManager::setVerboseLevel(l);
     m_data_buffer->setVerboseLevel(l);
+    if (m_resampler) m_resampler->setVerboseLevel(l);
     debugOutput( DEBUG_LEVEL_VERBOSE, "Setting verbose level to %d...\n", l );
 }
 
@@ -29,6 +29,7 @@
 #include "PortManager.h"
 
 #include "libutil/StreamStatistics.h"
+#include "libutil/StreamTelemetry.h"
 #include "libutil/TimestampedBuffer.h"
 #include "libutil/OptionContainer.h"
 
@@ -42,6 +43,7 @@ class IsoHandlerManager;
 namespace Streaming {
 
     class StreamProcessorManager;
+    class Resampler;
 /*!
 \brief Class providing a generic interface for Stream Processors
 
@@ -114,6 +116,8 @@ public: //--- state stuff
             {return m_state == ePS_DryRunning;};
     bool isStopped()
             {return m_state == ePS_Stopped;};
+    bool isCreated()
+            {return m_state == ePS_Created;};
     bool isWaitingForStream()
             {return m_state == ePS_WaitingForStream;};
     bool inError()
@@ -136,7 +140,21 @@ public: //--- state stuff
     bool init();
     bool prepare();
 
-    bool handleBusReset();
+    /**
+     * @brief handle a bus reset
+     * @param resync_only true if the stream survived the reset, in which
+     *        case the SP keeps running and only resynchronizes its buffer.
+     *        Otherwise, or when the SP has already flagged an xrun, the SP
+     *        goes into the error state.
+     */
+    bool handleBusReset(bool resync_only);
+    /**
+     * @brief a bus reset was detected but is not yet handled
+     *
+     * Until handleBusReset() is called, the cycles lost in the
+     * reset don't cause an xrun.
+     */
+    void notifyBusReset() {m_busreset_pending = true;};
 
     // the one to be implemented by the child class
     virtual bool handleBusResetDo();
@@ -264,6 +282,9 @@ protected: // the helper receive/transmit functions
         {debugWarning("call not allowed\n"); return false;};
     virtual bool transmitSilenceBlock(char *data, unsigned int nevents, unsigned int offset)
         {debugWarning("call not allowed\n"); return false;};
+    // frames were dropped from the buffer without being sent, e.g. the
+    // ones that were due in the cycles lost in a bus reset
+    virtual void transmitFramesDropped(unsigned int nframes) {};
 protected: // some generic helpers
     int provideSilenceToPort(Port *p, unsigned int offset, unsigned int nevents);
     bool provideSilenceBlock(unsigned int nevents, unsigned int offset);
@@ -273,9 +294,14 @@ private:
     bool getFramesWet(unsigned int nbframes, int64_t ts);
     bool putFramesDry(unsigned int nbframes, int64_t ts);
     bool putFramesWet(unsigned int nbframes, int64_t ts);
+    bool getFramesResampled(unsigned int nbframes);
+    bool putFramesResampled(unsigned int nbframes, int64_t ts);
+    void resyncTransmitBuffer();
 
     bool transferSilence(unsigned int size);
 
+    void flagXrun();
+
 public:
     // move to private?
     bool xrunOccurred() { return m_in_xrun; };
@@ -435,6 +461,26 @@ protected:
         signed int m_max_diff_ticks;
     private:
         bool m_in_xrun;
+        volatile bool m_busreset_pending;
+        // cycles the transmit handler lost during the pending bus reset
+        unsigned int m_busreset_dropped_cycles;
+        volatile bool m_resync_transmit;
+
+public:
+    // telemetry, the slot is owned by the StreamProcessorManager
+    void setTelemetrySlot(Util::TelemetryStreamSlot *slot);
+    Util::TelemetryStreamSlot *getTelemetrySlot() {return m_telemetry;};
+private:
+    Util::TelemetryStreamSlot *m_telemetry;
+
+public:
+    // resampling to the rate of the sync source, set by the
+    // StreamProcessorManager when the device is in a different clock domain
+    // (the SP takes ownership)
+    void setResampler(Resampler *r);
+    Resampler *getResampler() {return m_resampler;};
+private:
+    Resampler *m_resampler;
 
 public:
     // debug stuff
@@ -443,6 +489,8 @@ public:
     virtual void setVerboseLevel(int l);
     const char *getStateString()
         {return ePSToString(getState());};
+    int getStateId()
+        {return (int)getState();};
     const char *getTypeString()
         {return ePTToString(getType());};
 
@@ -84,6 +84,7 @@ uint32_t ts_sec = CYCLE_TIMER_GET_SECS(ct_now);
 MotuReceiveStreamProcessor::MotuReceiveStreamProcessor(FFADODevice &parent, unsigned int event_size)
     : StreamProcessor(parent, ePT_Receive)
     , m_event_size( event_size )
+    , m_audio_transpose( EventTranspose::eSF_Packed24 )
     , mb_head ( 0 )
     , mb_tail ( 0 )
 {
@@ -117,6 +118,11 @@ MotuReceiveStreamProcessor::getNominalFramesPerPacket() {
 bool
 MotuReceiveStreamProcessor::prepareChild() {
     debugOutput( DEBUG_LEVEL_VERBOSE, "Preparing (%p)...\n", this);
+
+    if (!initPortCache()) {
+        debugError("Could not init port cache\n");
+        return false;
+    }
     return true;
 }
 
@@ -266,101 +272,41 @@ bool MotuReceiveStreamProcessor::processReadBlock(char *data,
     if (m_motu_model != Motu::MOTU_MODEL_828MkI)
         decodeMotuCtrlEvents(data, nevents);
 
-    for ( PortVectorIterator it = m_Ports.begin();
-          it != m_Ports.end();
-          ++it ) {
-        if((*it)->isDisabled()) {continue;};
-
-        Port *port=(*it);
-
-        switch(port->getPortType()) {
-
-        case Port::E_Audio:
-            if(decodeMotuEventsToPort(static_cast<MotuAudioPort *>(*it), (quadlet_t *)data, offset, nevents)) {
-                debugWarning("Could not decode packet data to port %s\n",(*it)->getName().c_str());
-                no_problem=false;
-            }
-            break;
-        case Port::E_Midi:
-             if(decodeMotuMidiEventsToPort(static_cast<MotuMidiPort *>(*it), (quadlet_t *)data, offset, nevents)) {
-                 debugWarning("Could not decode packet midi data to port %s\n",(*it)->getName().c_str());
-                 no_problem=false;
-             }
-            break;
-
-        default: // ignore
-            break;
-        }
-    }
-    return no_problem;
-}
-
-signed int MotuReceiveStreamProcessor::decodeMotuEventsToPort(MotuAudioPort *p,
-        quadlet_t *data, unsigned int offset, unsigned int nevents)
-{
-    unsigned int j=0;
-
-    // Use char here since a port's source address won't necessarily be
-    // aligned; use of an unaligned quadlet_t may cause issues on
-    // certain architectures.  Besides, the source (data coming directly
-    // from the MOTU) isn't structured in quadlets anyway; it mainly
-    // consists of packed 24-bit integers.
-
-    unsigned char *src_data;
-    src_data = (unsigned char *)data + p->getPosition();
-
+    // the audio ports are converted in one go, disabled ports
+    // are skipped
+    m_audio_transpose.update();
     switch(m_StreamProcessorManager.getAudioDataType()) {
         default:
         case StreamProcessorManager::eADT_Int24:
-            {
-                quadlet_t *buffer=(quadlet_t *)(p->getBufferAddress());
-
-                assert(nevents + offset <= p->getBufferSize());
-
-                // Offset is in frames, but each port is only a single
-                // channel, so the number of frames is the same as the
-                // number of quadlets to offset (assuming the port buffer
-                // uses one quadlet per sample, which is the case currently).
-                buffer+=offset;
-
-                for(j = 0; j < nevents; j += 1) { // Decode nsamples
-                    *buffer = (*src_data<<16)+(*(src_data+1)<<8)+*(src_data+2);
-                    // Sign-extend highest bit of 24-bit int.
-                    // This isn't strictly needed since E_Int24 is a 24-bit,
-                    // but doing so shouldn't break anything and makes the data
-                    // easier to deal with during debugging.
-                    if (*src_data & 0x80)
-                        *buffer |= 0xff000000;
-
-                    buffer++;
-                    src_data+=m_event_size;
-                }
-            }
+            m_audio_transpose.decodeInt24((unsigned char *)data, offset, nevents);
             break;
         case StreamProcessorManager::eADT_Float:
-            {
-                const float multiplier = 1.0f / (float)(0x7FFFFF);
-                float *buffer=(float *)(p->getBufferAddress());
-
-                assert(nevents + offset <= p->getBufferSize());
-
-                buffer+=offset;
-
-                for(j = 0; j < nevents; j += 1) { // decode max nsamples
-
-                    signed int v = (*src_data<<16)+(*(src_data+1)<<8)+*(src_data+2);
-                    /* Sign-extend highest bit of incoming 24-bit integer */
-                    if (*src_data & 0x80)
-                      v |= 0xff000000;
-                    *buffer = v * multiplier;
-                    buffer++;
-                    src_data+=m_event_size;
-                }
-            }
+            m_audio_transpose.decodeFloat((unsigned char *)data, offset, nevents);
+            break;
+        case StreamProcessorManager::eADT_Int16:
+            m_audio_transpose.decodeInt16((unsigned char *)data, offset, nevents);
+            break;
+        case StreamProcessorManager::eADT_Int32:
+            m_audio_transpose.decodeInt32((unsigned char *)data, offset, nevents);
+            break;
+        case StreamProcessorManager::eADT_Float64:
+            m_audio_transpose.decodeFloat64((unsigned char *)data, offset, nevents);
             break;
     }
 
-    return 0;
+    for ( PortVectorIterator it = m_Ports.begin();
+          it != m_Ports.end();
+          ++it ) {
+        Port *port=(*it);
+        if(port->getPortType() != Port::E_Midi) continue;
+        if(port->isDisabled()) {continue;};
+
+        if(decodeMotuMidiEventsToPort(static_cast<MotuMidiPort *>(*it), (quadlet_t *)data, offset, nevents)) {
+            debugWarning("Could not decode packet midi data to port %s\n",(*it)->getName().c_str());
+            no_problem=false;
+        }
+    }
+    return no_problem;
 }
 
 int
@@ -572,4 +518,23 @@ MotuReceiveStreamProcessor::decodeMotuCtrlEvents(
     return 0;    
 }
 
+bool
+MotuReceiveStreamProcessor::initPortCache() {
+    // the audio ports go into the channel map, midi ports are
+    // handled separately
+    m_audio_transpose.clear();
+    for ( PortVectorIterator it = m_Ports.begin();
+          it != m_Ports.end();
+          ++it ) {
+        if((*it)->getPortType() != Port::E_Audio) continue;
+        MotuAudioPort *p = dynamic_cast<MotuAudioPort *>(*it);
+        if(p == NULL) {
+            debugError("Port is not a MotuAudioPort!\n");
+            return false;
+        }
+        m_audio_transpose.addChannel(p, p->getPosition());
+    }
+    return m_audio_transpose.init(m_event_size);
+}
+
 } // end of namespace Streaming
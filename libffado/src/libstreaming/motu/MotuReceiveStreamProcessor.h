@@ -33,6 +33,7 @@
 
 #include "../generic/StreamProcessor.h"
 #include "../util/cip.h"
+#include "../util/EventTranspose.h"
 
 namespace Streaming {
 
@@ -161,7 +162,6 @@ protected:
 private:
     bool decodePacketPorts(quadlet_t *data, unsigned int nevents, unsigned int dbc);
 
-    int decodeMotuEventsToPort(MotuAudioPort *, quadlet_t *data, unsigned int offset, unsigned int nevents);
     int decodeMotuMidiEventsToPort(MotuMidiPort *, quadlet_t *data, unsigned int offset, unsigned int nevents);
     int decodeMotuCtrlEvents(char *data, unsigned int nevents);
 
@@ -171,6 +171,10 @@ private:
      */
     unsigned int m_event_size;
 
+    // maps the audio ports onto the events
+    EventTranspose m_audio_transpose;
+    bool initPortCache();
+
     signed int m_motu_model;
     struct MotuDevControls m_devctrls;
 
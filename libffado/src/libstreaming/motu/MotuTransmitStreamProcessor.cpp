@@ -70,6 +70,7 @@ static inline uint32_t fullTicksToSph(int64_t timestamp) {
 MotuTransmitStreamProcessor::MotuTransmitStreamProcessor(FFADODevice &parent, unsigned int event_size )
         : StreamProcessor(parent, ePT_Transmit )
         , m_event_size( event_size )
+        , m_audio_transpose( EventTranspose::eSF_Packed24 )
         , m_motu_model( 0 )
         , m_tx_dbc( 0 )
         , mb_head( 0 )
@@ -564,6 +565,11 @@ unsigned int MotuTransmitStreamProcessor::fillNoDataPacketHeader (
 bool MotuTransmitStreamProcessor::prepareChild()
 {
     debugOutput ( DEBUG_LEVEL_VERBOSE, "Preparing (%p)...\n", this );
+
+    if (!initPortCache()) {
+        debugError("Could not init port cache\n");
+        return false;
+    }
     return true;
 }
 
@@ -587,36 +593,45 @@ bool MotuTransmitStreamProcessor::processWriteBlock(char *data,
         memset(data+4+i*m_event_size, 0x00, 6);
     }
 
+    // the audio ports are converted in one go, disabled ports
+    // are sent silence
+    m_audio_transpose.update();
+    switch(m_StreamProcessorManager.getAudioDataType()) {
+        default:
+        case StreamProcessorManager::eADT_Int24:
+            m_audio_transpose.encodeInt24((unsigned char *)data, offset, nevents);
+            break;
+        case StreamProcessorManager::eADT_Float:
+            m_audio_transpose.encodeFloat((unsigned char *)data, offset, nevents, MOTU_CLIP_FLOATS);
+            break;
+        case StreamProcessorManager::eADT_Int16:
+            m_audio_transpose.encodeInt16((unsigned char *)data, offset, nevents);
+            break;
+        case StreamProcessorManager::eADT_Int32:
+            m_audio_transpose.encodeInt32((unsigned char *)data, offset, nevents);
+            break;
+        case StreamProcessorManager::eADT_Float64:
+            m_audio_transpose.encodeFloat64((unsigned char *)data, offset, nevents);
+            break;
+    }
+
     for ( PortVectorIterator it = m_Ports.begin();
       it != m_Ports.end();
       ++it ) {
+        Port *port=(*it);
+        if(port->getPortType() != Port::E_Midi) continue;
+
         // If this port is disabled, unconditionally send it silence.
-        if((*it)->isDisabled()) {
-          if (encodeSilencePortToMotuEvents(static_cast<MotuAudioPort *>(*it), (quadlet_t *)data, offset, nevents)) {
-            debugWarning("Could not encode silence for disabled port %s to Motu events\n",(*it)->getName().c_str());
+        if(port->isDisabled()) {
+          if (encodeSilencePortToMotuMidiEvents(static_cast<MotuMidiPort *>(*it), (quadlet_t *)data, offset, nevents)) {
+            debugWarning("Could not encode silence for disabled port %s to Midi events\n",(*it)->getName().c_str());
             // Don't treat this as a fatal error at this point
           }
           continue;
         }
-
-        Port *port=(*it);
-
-        switch(port->getPortType()) {
-
-        case Port::E_Audio:
-            if (encodePortToMotuEvents(static_cast<MotuAudioPort *>(*it), (quadlet_t *)data, offset, nevents)) {
-                debugWarning("Could not encode port %s to Motu events\n",(*it)->getName().c_str());
-                no_problem=false;
-            }
-            break;
-        case Port::E_Midi:
-             if (encodePortToMotuMidiEvents(static_cast<MotuMidiPort *>(*it), (quadlet_t *)data, offset, nevents)) {
-                 debugWarning("Could not encode port %s to Midi events\n",(*it)->getName().c_str());
-                 no_problem=false;
-             }
-            break;
-        default: // ignore
-            break;
+        if (encodePortToMotuMidiEvents(static_cast<MotuMidiPort *>(*it), (quadlet_t *)data, offset, nevents)) {
+            debugWarning("Could not encode port %s to Midi events\n",(*it)->getName().c_str());
+            no_problem=false;
         }
     }
     return no_problem;
@@ -628,131 +643,22 @@ MotuTransmitStreamProcessor::transmitSilenceBlock(char *data,
     // This is the same as the non-silence version, except that is
     // doesn't read from the port buffers.
     bool no_problem = true;
+    m_audio_transpose.encodeSilence((unsigned char *)data, nevents);
+
     for ( PortVectorIterator it = m_Ports.begin();
       it != m_Ports.end();
       ++it ) {
         Port *port=(*it);
+        if(port->getPortType() != Port::E_Midi) continue;
 
-        switch(port->getPortType()) {
-
-        case Port::E_Audio:
-            if (encodeSilencePortToMotuEvents(static_cast<MotuAudioPort *>(*it), (quadlet_t *)data, offset, nevents)) {
-                debugWarning("Could not encode port %s to MBLA events\n",(*it)->getName().c_str());
-                no_problem = false;
-            }
-            break;
-        case Port::E_Midi:
-            if (encodeSilencePortToMotuMidiEvents(static_cast<MotuMidiPort *>(*it), (quadlet_t *)data, offset, nevents)) {
-                debugWarning("Could not encode port %s to Midi events\n",(*it)->getName().c_str());
-                no_problem = false;
-            }
-            break;
-        default: // ignore
-            break;
+        if (encodeSilencePortToMotuMidiEvents(static_cast<MotuMidiPort *>(*it), (quadlet_t *)data, offset, nevents)) {
+            debugWarning("Could not encode port %s to Midi events\n",(*it)->getName().c_str());
+            no_problem = false;
         }
     }
     return no_problem;
 }
 
-int MotuTransmitStreamProcessor::encodePortToMotuEvents(MotuAudioPort *p, quadlet_t *data,
-                       unsigned int offset, unsigned int nevents) {
-// Encodes nevents worth of data from the given port into the given buffer.  The
-// format of the buffer is precisely that which will be sent to the MOTU.
-// The basic idea:
-//   iterate over the ports
-//     * get port buffer address
-//     * loop over events
-//         - pick right sample in event based upon PortInfo
-//         - convert sample from Port format (E_Int24, E_Float, ..) to MOTU
-//           native format
-//
-// We include the ability to start the transfer from the given offset within
-// the port (expressed in frames) so the 'efficient' transfer method can be
-// utilised.
-
-    unsigned int j=0;
-
-    // Use char here since the target address won't necessarily be
-    // aligned; use of an unaligned quadlet_t may cause issues on certain
-    // architectures.  Besides, the target (data going directly to the MOTU)
-    // isn't structured in quadlets anyway; it mainly consists of packed
-    // 24-bit integers.
-    unsigned char *target;
-    target = (unsigned char *)data + p->getPosition();
-
-    switch(m_StreamProcessorManager.getAudioDataType()) {
-        default:
-        case StreamProcessorManager::eADT_Int24:
-            {
-                quadlet_t *buffer=(quadlet_t *)(p->getBufferAddress());
-
-                assert(nevents + offset <= p->getBufferSize());
-
-                // Offset is in frames, but each port is only a single
-                // channel, so the number of frames is the same as the
-                // number of quadlets to offset (assuming the port buffer
-                // uses one quadlet per sample, which is the case currently).
-                buffer+=offset;
-
-                for(j = 0; j < nevents; j += 1) { // Decode nsamples
-                    *target = (*buffer >> 16) & 0xff;
-                    *(target+1) = (*buffer >> 8) & 0xff;
-                    *(target+2) = (*buffer) & 0xff;
-
-                    buffer++;
-                    target+=m_event_size;
-                }
-            }
-            break;
-        case StreamProcessorManager::eADT_Float:
-            {
-                const float multiplier = (float)(0x7FFFFF);
-                float *buffer=(float *)(p->getBufferAddress());
-
-                assert(nevents + offset <= p->getBufferSize());
-
-                buffer+=offset;
-
-                for(j = 0; j < nevents; j += 1) { // decode max nsamples
-                    float in = *buffer;
-#if MOTU_CLIP_FLOATS
-                    if (unlikely(in > 1.0)) in = 1.0;
-                    if (unlikely(in < -1.0)) in = -1.0;
-#endif
-                    unsigned int v = lrintf(in * multiplier);
-                    *target = (v >> 16) & 0xff;
-                    *(target+1) = (v >> 8) & 0xff;
-                    *(target+2) = v & 0xff;
-
-                    buffer++;
-                    target+=m_event_size;
-                }
-            }
-            break;
-    }
-
-    return 0;
-}
-
-int MotuTransmitStreamProcessor::encodeSilencePortToMotuEvents(MotuAudioPort *p, quadlet_t *data,
-                       unsigned int offset, unsigned int nevents) {
-    unsigned int j=0;
-    unsigned char *target = (unsigned char *)data + p->getPosition();
-
-    switch (m_StreamProcessorManager.getAudioDataType()) {
-    default:
-        case StreamProcessorManager::eADT_Int24:
-        case StreamProcessorManager::eADT_Float:
-        for (j = 0; j < nevents; j++) {
-            *target = *(target+1) = *(target+2) = 0;
-            target += m_event_size;
-        }
-        break;
-    }
-
-    return 0;
-}
-
 int MotuTransmitStreamProcessor::encodePortToMotuMidiEvents(
                        MotuMidiPort *p, quadlet_t *data,
                        unsigned int offset, unsigned int nevents) {
@@ -821,4 +727,23 @@ int MotuTransmitStreamProcessor::encodeSilencePortToMotuMidiEvents(
     return 0;
 }
 
+bool
+MotuTransmitStreamProcessor::initPortCache() {
+    // the audio ports go into the channel map, midi ports are
+    // handled separately
+    m_audio_transpose.clear();
+    for ( PortVectorIterator it = m_Ports.begin();
+          it != m_Ports.end();
+          ++it ) {
+        if((*it)->getPortType() != Port::E_Audio) continue;
+        MotuAudioPort *p = dynamic_cast<MotuAudioPort *>(*it);
+        if(p == NULL) {
+            debugError("Port is not a MotuAudioPort!\n");
+            return false;
+        }
+        m_audio_transpose.addChannel(p, p->getPosition());
+    }
+    return m_audio_transpose.init(m_event_size);
+}
+
 } // end of namespace Streaming
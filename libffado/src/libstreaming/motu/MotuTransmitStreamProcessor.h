@@ -33,6 +33,7 @@
 
 #include "../generic/StreamProcessor.h"
 #include "../util/cip.h"
+#include "../util/EventTranspose.h"
 
 namespace Streaming {
 
@@ -82,6 +83,8 @@ public:
 protected:
     bool processWriteBlock(char *data, unsigned int nevents, unsigned int offset);
     bool transmitSilenceBlock(char *data, unsigned int nevents, unsigned int offset);
+    void transmitFramesDropped(unsigned int nframes)
+                    {m_tx_dbc = (m_tx_dbc + nframes) & 0xff;};
 
 private:
     unsigned int fillNoDataPacketHeader(quadlet_t *data, unsigned int* length);
@@ -93,11 +96,6 @@ private:
     bool encodePacketPorts(quadlet_t *data, unsigned int nevents,
                            unsigned int dbc);
 
-    int encodePortToMotuEvents(MotuAudioPort *, quadlet_t *data,
-                                unsigned int offset, unsigned int nevents);
-    int encodeSilencePortToMotuEvents(MotuAudioPort *, quadlet_t *data,
-                                unsigned int offset, unsigned int nevents);
-
     int encodePortToMotuMidiEvents(
                        MotuMidiPort *p, quadlet_t *data,
                        unsigned int offset, unsigned int nevents);
@@ -111,6 +109,10 @@ private:
      */
     unsigned int m_event_size;
 
+    // maps the audio ports onto the events
+    EventTranspose m_audio_transpose;
+    bool initPortCache();
+
     // To save time in the fast path, the number of pad bytes is stored
     // explicitly.
     unsigned int m_event_pad_bytes;
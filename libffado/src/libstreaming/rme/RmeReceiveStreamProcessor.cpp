@@ -65,6 +65,7 @@ RmeReceiveStreamProcessor::RmeReceiveStreamProcessor(FFADODevice &parent,
     , n_hw_tx_buffer_samples ( -1 )
     , m_rme_model( model )
     , m_event_size( event_size )
+    , m_audio_transpose( EventTranspose::eSF_Quadlet24 )
     , mb_head ( 0 )
     , mb_tail ( 0 )
 {
@@ -123,6 +124,11 @@ RmeReceiveStreamProcessor::prepareChild() {
     m_data_buffer->setMaxAbsDiff(10000);
     m_Parent.getDeviceManager().getStreamProcessorManager().setMaxDiffTicks(30720);
 
+    if (!initPortCache()) {
+        debugError("Could not init port cache\n");
+        return false;
+    }
+
     return true;
 }
 
@@ -260,98 +266,41 @@ bool RmeReceiveStreamProcessor::processReadBlock(char *data,
 {
     bool no_problem=true;
 
-    for ( PortVectorIterator it = m_Ports.begin();
-          it != m_Ports.end();
-          ++it ) {
-        if((*it)->isDisabled()) {continue;};
-
-        Port *port=(*it);
-
-        switch(port->getPortType()) {
-
-        case Port::E_Audio:
-            if(decodeRmeEventsToPort(static_cast<RmeAudioPort *>(*it), (quadlet_t *)data, offset, nevents)) {
-                debugWarning("Could not decode packet data to port %s\n",(*it)->getName().c_str());
-                no_problem=false;
-            }
-            break;
-        case Port::E_Midi:
-             if(decodeRmeMidiEventsToPort(static_cast<RmeMidiPort *>(*it), (quadlet_t *)data, offset, nevents)) {
-                 debugWarning("Could not decode packet midi data to port %s\n",(*it)->getName().c_str());
-                 no_problem=false;
-             }
-            break;
-
-        default: // ignore
-            break;
-        }
-    }
-    return no_problem;
-}
-
-signed int RmeReceiveStreamProcessor::decodeRmeEventsToPort(RmeAudioPort *p,
-        quadlet_t *data, unsigned int offset, unsigned int nevents)
-{
-    unsigned int j=0;
-
-    // For RME interfaces the audio data is contained in the most significant
-    // 24 bits of a 32-bit field.  Thus it makes sense to treat the source
-    // data as 32 bit and simply mask/shift as necessary to isolate the
-    // audio data.
-    quadlet_t *src_data;
-    src_data = data + p->getPosition()/4;
-
+    // the audio ports are converted in one go, disabled ports
+    // are skipped
+    m_audio_transpose.update();
     switch(m_StreamProcessorManager.getAudioDataType()) {
         default:
         case StreamProcessorManager::eADT_Int24:
-            {
-                quadlet_t *buffer=(quadlet_t *)(p->getBufferAddress());
-
-                assert(nevents + offset <= p->getBufferSize());
-
-                // Offset is in frames, but each port is only a single
-                // channel, so the number of frames is the same as the
-                // number of quadlets to offset (assuming the port buffer
-                // uses one quadlet per sample, which is the case currently).
-                buffer+=offset;
-
-                for(j = 0; j < nevents; j += 1) { // Decode nsamples
-                    *buffer = (*src_data >> 8) & 0x00ffffff;
-                    // Sign-extend highest bit of 24-bit int.  This isn't
-                    // strictly needed since E_Int24 is a 24-bit, but doing
-                    // so shouldn't break anything and makes the data easier
-                    // to deal with during debugging.
-                    if (*src_data & 0x80000000)
-                        *buffer |= 0xff000000;
-
-                    buffer++;
-                    src_data+=m_event_size/4;
-                }
-            }
+            m_audio_transpose.decodeInt24((unsigned char *)data, offset, nevents);
             break;
         case StreamProcessorManager::eADT_Float:
-            {
-                const float multiplier = 1.0f / (float)(0x7FFFFF);
-                float *buffer=(float *)(p->getBufferAddress());
-
-                assert(nevents + offset <= p->getBufferSize());
-
-                buffer+=offset;
-
-                for(j = 0; j < nevents; j += 1) { // decode max nsamples
-                    signed int v = (*src_data >> 8) & 0x00ffffff;
-                    /* Sign-extend highest bit of incoming 24-bit integer */
-                    if (*src_data & 0x80000000)
-                      v |= 0xff000000;
-                    *buffer = v * multiplier;
-                    buffer++;
-                    src_data+=m_event_size/4;
-                }
-            }
+            m_audio_transpose.decodeFloat((unsigned char *)data, offset, nevents);
+            break;
+        case StreamProcessorManager::eADT_Int16:
+            m_audio_transpose.decodeInt16((unsigned char *)data, offset, nevents);
+            break;
+        case StreamProcessorManager::eADT_Int32:
+            m_audio_transpose.decodeInt32((unsigned char *)data, offset, nevents);
+            break;
+        case StreamProcessorManager::eADT_Float64:
+            m_audio_transpose.decodeFloat64((unsigned char *)data, offset, nevents);
             break;
     }
 
-    return 0;
+    for ( PortVectorIterator it = m_Ports.begin();
+          it != m_Ports.end();
+          ++it ) {
+        Port *port=(*it);
+        if(port->getPortType() != Port::E_Midi) continue;
+        if(port->isDisabled()) {continue;};
+
+        if(decodeRmeMidiEventsToPort(static_cast<RmeMidiPort *>(*it), (quadlet_t *)data, offset, nevents)) {
+            debugWarning("Could not decode packet midi data to port %s\n",(*it)->getName().c_str());
+            no_problem=false;
+        }
+    }
+    return no_problem;
 }
 
 int
@@ -422,4 +371,23 @@ RmeReceiveStreamProcessor::decodeRmeMidiEventsToPort(
     return 0;    
 }
 
+bool
+RmeReceiveStreamProcessor::initPortCache() {
+    // the audio ports go into the channel map, midi ports are
+    // handled separately
+    m_audio_transpose.clear();
+    for ( PortVectorIterator it = m_Ports.begin();
+          it != m_Ports.end();
+          ++it ) {
+        if((*it)->getPortType() != Port::E_Audio) continue;
+        RmeAudioPort *p = dynamic_cast<RmeAudioPort *>(*it);
+        if(p == NULL) {
+            debugError("Port is not a RmeAudioPort!\n");
+            return false;
+        }
+        m_audio_transpose.addChannel(p, p->getPosition());
+    }
+    return m_audio_transpose.init(m_event_size);
+}
+
 } // end of namespace Streaming
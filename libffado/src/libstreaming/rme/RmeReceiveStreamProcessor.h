@@ -33,6 +33,7 @@
 
 #include "../generic/StreamProcessor.h"
 #include "../util/cip.h"
+#include "../util/EventTranspose.h"
 
 namespace Streaming {
 
@@ -83,7 +84,6 @@ protected:
 private:
     bool decodePacketPorts(quadlet_t *data, unsigned int nevents, unsigned int dbc);
 
-    int decodeRmeEventsToPort(RmeAudioPort *, quadlet_t *data, unsigned int offset, unsigned int nevents);
     int decodeRmeMidiEventsToPort(RmeMidiPort *, quadlet_t *data, unsigned int offset, unsigned int nevents);
 
     unsigned int m_rme_model;
@@ -93,6 +93,10 @@ private:
      */
     unsigned int m_event_size;
 
+    // maps the audio ports onto the events
+    EventTranspose m_audio_transpose;
+    bool initPortCache();
+
     /* A small MIDI buffer to cover for the case where we need to span a
      * period - that is, if more than one MIDI byte is sent per packet. 
      * Since the long-term average data rate must be close to the MIDI spec
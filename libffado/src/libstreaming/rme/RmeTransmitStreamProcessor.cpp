@@ -73,6 +73,7 @@ RmeTransmitStreamProcessor::RmeTransmitStreamProcessor(FFADODevice &parent,
         : StreamProcessor(parent, ePT_Transmit )
         , m_rme_model( model)
         , m_event_size( event_size )
+        , m_audio_transpose( EventTranspose::eSF_Quadlet24 )
         , m_tx_dbc( 0 )
         , mb_head( 0 )
         , mb_tail( 0 )
@@ -549,6 +550,11 @@ bool RmeTransmitStreamProcessor::prepareChild()
 
 // Unsure whether this helps yet.  Testing continues.
 m_dll_bandwidth_hz = 1.0; // 0.1;
+
+    if (!initPortCache()) {
+        debugError("Could not init port cache\n");
+        return false;
+    }
     return true;
 }
 
@@ -559,36 +565,45 @@ bool RmeTransmitStreamProcessor::processWriteBlock(char *data,
                        unsigned int nevents, unsigned int offset) {
     bool no_problem=true;
 
+    // the audio ports are converted in one go, disabled ports
+    // are sent silence
+    m_audio_transpose.update();
+    switch(m_StreamProcessorManager.getAudioDataType()) {
+        default:
+        case StreamProcessorManager::eADT_Int24:
+            m_audio_transpose.encodeInt24((unsigned char *)data, offset, nevents);
+            break;
+        case StreamProcessorManager::eADT_Float:
+            m_audio_transpose.encodeFloat((unsigned char *)data, offset, nevents, RME_CLIP_FLOATS);
+            break;
+        case StreamProcessorManager::eADT_Int16:
+            m_audio_transpose.encodeInt16((unsigned char *)data, offset, nevents);
+            break;
+        case StreamProcessorManager::eADT_Int32:
+            m_audio_transpose.encodeInt32((unsigned char *)data, offset, nevents);
+            break;
+        case StreamProcessorManager::eADT_Float64:
+            m_audio_transpose.encodeFloat64((unsigned char *)data, offset, nevents);
+            break;
+    }
+
     for ( PortVectorIterator it = m_Ports.begin();
       it != m_Ports.end();
       ++it ) {
+        Port *port=(*it);
+        if(port->getPortType() != Port::E_Midi) continue;
+
         // If this port is disabled, unconditionally send it silence.
-        if((*it)->isDisabled()) {
-          if (encodeSilencePortToRmeEvents(static_cast<RmeAudioPort *>(*it), (quadlet_t *)data, offset, nevents)) {
-            debugWarning("Could not encode silence for disabled port %s to Rme events\n",(*it)->getName().c_str());
+        if(port->isDisabled()) {
+          if (encodeSilencePortToRmeMidiEvents(static_cast<RmeMidiPort *>(*it), (quadlet_t *)data, offset, nevents)) {
+            debugWarning("Could not encode silence for disabled port %s to Midi events\n",(*it)->getName().c_str());
             // Don't treat this as a fatal error at this point
           }
           continue;
         }
-
-        Port *port=(*it);
-
-        switch(port->getPortType()) {
-
-        case Port::E_Audio:
-            if (encodePortToRmeEvents(static_cast<RmeAudioPort *>(*it), (quadlet_t *)data, offset, nevents)) {
-                debugWarning("Could not encode port %s to Rme events\n",(*it)->getName().c_str());
-                no_problem=false;
-            }
-            break;
-        case Port::E_Midi:
-             if (encodePortToRmeMidiEvents(static_cast<RmeMidiPort *>(*it), (quadlet_t *)data, offset, nevents)) {
-                 debugWarning("Could not encode port %s to Midi events\n",(*it)->getName().c_str());
-                 no_problem=false;
-             }
-            break;
-        default: // ignore
-            break;
+        if (encodePortToRmeMidiEvents(static_cast<RmeMidiPort *>(*it), (quadlet_t *)data, offset, nevents)) {
+            debugWarning("Could not encode port %s to Midi events\n",(*it)->getName().c_str());
+            no_problem=false;
         }
     }
     return no_problem;
@@ -600,120 +615,22 @@ RmeTransmitStreamProcessor::transmitSilenceBlock(char *data,
     // This is the same as the non-silence version, except that is
     // doesn't read from the port buffers.
     bool no_problem = true;
+    m_audio_transpose.encodeSilence((unsigned char *)data, nevents);
+
     for ( PortVectorIterator it = m_Ports.begin();
       it != m_Ports.end();
       ++it ) {
         Port *port=(*it);
+        if(port->getPortType() != Port::E_Midi) continue;
 
-        switch(port->getPortType()) {
-
-        case Port::E_Audio:
-            if (encodeSilencePortToRmeEvents(static_cast<RmeAudioPort *>(*it), (quadlet_t *)data, offset, nevents)) {
-                debugWarning("Could not encode port %s to MBLA events\n",(*it)->getName().c_str());
-                no_problem = false;
-            }
-            break;
-        case Port::E_Midi:
-            if (encodeSilencePortToRmeMidiEvents(static_cast<RmeMidiPort *>(*it), (quadlet_t *)data, offset, nevents)) {
-                debugWarning("Could not encode port %s to Midi events\n",(*it)->getName().c_str());
-                no_problem = false;
-            }
-            break;
-        default: // ignore
-            break;
+        if (encodeSilencePortToRmeMidiEvents(static_cast<RmeMidiPort *>(*it), (quadlet_t *)data, offset, nevents)) {
+            debugWarning("Could not encode port %s to Midi events\n",(*it)->getName().c_str());
+            no_problem = false;
         }
     }
     return no_problem;
 }
 
-int RmeTransmitStreamProcessor::encodePortToRmeEvents(RmeAudioPort *p, quadlet_t *data,
-                       unsigned int offset, unsigned int nevents) {
-// Encodes nevents worth of data from the given port into the given buffer.  The
-// format of the buffer is precisely that which will be sent to the RME.
-// The basic idea:
-//   iterate over the ports
-//     * get port buffer address
-//     * loop over events
-//         - pick right sample in event based upon PortInfo
-//         - convert sample from Port format (E_Int24, E_Float, ..) to RME
-//           native format
-//
-// We include the ability to start the transfer from the given offset within
-// the port (expressed in frames) so the 'efficient' transfer method can be
-// utilised.
-
-    unsigned int j=0;
-
-    quadlet_t *target;
-    target = data + p->getPosition()/4;
-
-    switch(m_StreamProcessorManager.getAudioDataType()) {
-        default:
-        case StreamProcessorManager::eADT_Int24:
-            {
-                quadlet_t *buffer=(quadlet_t *)(p->getBufferAddress());
-
-                assert(nevents + offset <= p->getBufferSize());
-
-                // Offset is in frames, but each port is only a single
-                // channel, so the number of frames is the same as the
-                // number of quadlets to offset (assuming the port buffer
-                // uses one quadlet per sample, which is the case currently).
-                buffer+=offset;
-
-                for(j = 0; j < nevents; j += 1) { // Decode nsamples
-                    *target = (*buffer & 0x00ffffff) << 8;
-                    buffer++;
-                    target+=m_event_size/4;
-                }
-            }
-            break;
-        case StreamProcessorManager::eADT_Float:
-            {
-                const float multiplier = (float)(0x7FFFFF);
-                float *buffer=(float *)(p->getBufferAddress());
-
-                assert(nevents + offset <= p->getBufferSize());
-
-                buffer+=offset;
-
-                for(j = 0; j < nevents; j += 1) { // decode max nsamples
-                    float in = *buffer;
-#if RME_CLIP_FLOATS
-                    if (unlikely(in > 1.0)) in = 1.0;
-                    if (unlikely(in < -1.0)) in = -1.0;
-#endif
-                    unsigned int v = lrintf(in * multiplier);
-                    *target = (v << 8);
-                    buffer++;
-                    target+=m_event_size/4;
-                }
-            }
-            break;
-    }
-
-    return 0;
-}
-
-int RmeTransmitStreamProcessor::encodeSilencePortToRmeEvents(RmeAudioPort *p, quadlet_t *data,
-                       unsigned int offset, unsigned int nevents) {
-    unsigned int j=0;
-    quadlet_t *target = data + p->getPosition()/4;
-
-    switch (m_StreamProcessorManager.getAudioDataType()) {
-    default:
-        case StreamProcessorManager::eADT_Int24:
-        case StreamProcessorManager::eADT_Float:
-        for (j = 0; j < nevents; j++) {
-            *target = 0;
-            target += m_event_size/4;
-        }
-        break;
-    }
-
-    return 0;
-}
-
 int RmeTransmitStreamProcessor::encodePortToRmeMidiEvents(
                        RmeMidiPort *p, quadlet_t *data,
                        unsigned int offset, unsigned int nevents) {
@@ -782,4 +699,23 @@ int RmeTransmitStreamProcessor::encodeSilencePortToRmeMidiEvents(
     return 0;
 }
 
+bool
+RmeTransmitStreamProcessor::initPortCache() {
+    // the audio ports go into the channel map, midi ports are
+    // handled separately
+    m_audio_transpose.clear();
+    for ( PortVectorIterator it = m_Ports.begin();
+          it != m_Ports.end();
+          ++it ) {
+        if((*it)->getPortType() != Port::E_Audio) continue;
+        RmeAudioPort *p = dynamic_cast<RmeAudioPort *>(*it);
+        if(p == NULL) {
+            debugError("Port is not a RmeAudioPort!\n");
+            return false;
+        }
+        m_audio_transpose.addChannel(p, p->getPosition());
+    }
+    return m_audio_transpose.init(m_event_size);
+}
+
 } // end of namespace Streaming
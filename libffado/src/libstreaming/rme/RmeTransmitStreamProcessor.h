@@ -33,6 +33,7 @@
 
 #include "../generic/StreamProcessor.h"
 #include "../util/cip.h"
+#include "../util/EventTranspose.h"
 
 namespace Streaming {
 
@@ -85,6 +86,8 @@ public:
 protected:
     bool processWriteBlock(char *data, unsigned int nevents, unsigned int offset);
     bool transmitSilenceBlock(char *data, unsigned int nevents, unsigned int offset);
+    void transmitFramesDropped(unsigned int nframes)
+                    {m_tx_dbc = (m_tx_dbc + nframes) & 0xff;};
 
 private:
     unsigned int fillNoDataPacketHeader(quadlet_t *data, unsigned int* length);
@@ -96,11 +99,6 @@ private:
     bool encodePacketPorts(quadlet_t *data, unsigned int nevents,
                            unsigned int dbc);
 
-    int encodePortToRmeEvents(RmeAudioPort *, quadlet_t *data,
-                                unsigned int offset, unsigned int nevents);
-    int encodeSilencePortToRmeEvents(RmeAudioPort *, quadlet_t *data,
-                                unsigned int offset, unsigned int nevents);
-
     int encodePortToRmeMidiEvents(
                        RmeMidiPort *p, quadlet_t *data,
                        unsigned int offset, unsigned int nevents);
@@ -116,6 +114,10 @@ private:
      */
     unsigned int m_event_size;
 
+    // maps the audio ports onto the events
+    EventTranspose m_audio_transpose;
+    bool initPortCache();
+
     // Keep track of transmission data block count
     unsigned int m_tx_dbc;
 
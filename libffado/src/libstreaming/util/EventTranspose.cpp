@@ -0,0 +1,310 @@
+/*
+ * Copyright (C) 2005-2008 by Pieter Palmers
+ *
+ * This file is part of FFADO
+ * FFADO = Free Firewire (pro-)audio drivers for linux
+ *
+ * FFADO is based upon FreeBoB
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) version 3 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "config.h"
+
+#include "EventTranspose.h"
+#include "SampleConversion.h"
+#include "../generic/Port.h"
+
+#include <algorithm>
+#include <assert.h>
+#include <stdint.h>
+
+#define likely(x)   __builtin_expect((x),1)
+#define unlikely(x) __builtin_expect((x),0)
+
+namespace Streaming {
+
+IMPL_DEBUG_MODULE( EventTranspose, EventTranspose, DEBUG_LEVEL_NORMAL );
+
+EventTranspose::EventTranspose(enum eSampleFormat format)
+: m_format( format )
+, m_event_size( 0 )
+{
+}
+
+void
+EventTranspose::clear()
+{
+    m_channels.clear();
+}
+
+void
+EventTranspose::addChannel(Port *port, unsigned int position)
+{
+    struct channel c;
+    c.port = port;
+    c.buffer = NULL; // to be filled by update()
+    c.stride = 1;
+    c.position = position;
+    c.enabled = false;
+    #ifdef DEBUG
+    c.buffer_size = port->getBufferSize();
+    #endif
+    m_channels.push_back(c);
+}
+
+bool
+EventTranspose::init(unsigned int event_size)
+{
+    m_event_size = event_size;
+
+    // sort on position such that the samples of a tile are written
+    // to/read from an event in ascending address order
+    std::sort(m_channels.begin(), m_channels.end(), positionLess);
+
+    unsigned int sample_size = (m_format == eSF_Quadlet24 ? 4 : 3);
+    for(unsigned int i = 0; i < m_channels.size(); i++) {
+        struct channel &c = m_channels.at(i);
+        if(c.position + sample_size > m_event_size) {
+            debugError("Port %s at position %u does not fit in an event of %u bytes\n",
+                       c.port->getName().c_str(), c.position, m_event_size);
+            return false;
+        }
+        if(m_format == eSF_Quadlet24 && (c.position & 0x03)) {
+            debugError("Port %s at position %u is not quadlet aligned\n",
+                       c.port->getName().c_str(), c.position);
+            return false;
+        }
+        debugOutput(DEBUG_LEVEL_VERBOSE, "Mapped port %s to position %u\n",
+                    c.port->getName().c_str(), c.position);
+    }
+    return true;
+}
+
+void
+EventTranspose::update()
+{
+    for(unsigned int i = 0; i < m_channels.size(); i++) {
+        struct channel &c = m_channels.at(i);
+        c.buffer = c.port->getBufferAddress();
+        c.stride = c.port->getBufferStride();
+        c.enabled = !c.port->isDisabled();
+        #ifdef DEBUG
+        c.buffer_size = c.port->getBufferSize();
+        #endif
+    }
+}
+
+/**
+ * Both directions walk the block in tiles. Within a tile the frames are the
+ * outer loop, such that each event is written/read in ascending address
+ * order, while each port buffer only contributes a short run of consecutive
+ * samples (one cache line for 16 frames). For interleaved port buffers the
+ * run is strided, but the tile then covers neighbouring channels of the
+ * same client frames as well.
+ *
+ * The conversion from/to the client's data type is done in the same loop.
+ */
+template <enum EventTranspose::eSampleFormat format, class S>
+void
+EventTranspose::encodeTiles(unsigned char *data, unsigned int offset, unsigned int nevents)
+{
+    const unsigned int nb_channels = m_channels.size();
+    struct channel *channels = &m_channels[0];
+
+    for(unsigned int f0 = 0; f0 < nevents; f0 += STREAMPROCESSOR_TRANSPOSE_TILE_FRAMES) {
+        unsigned int f1 = f0 + STREAMPROCESSOR_TRANSPOSE_TILE_FRAMES;
+        if(f1 > nevents) f1 = nevents;
+
+        for(unsigned int c0 = 0; c0 < nb_channels; c0 += STREAMPROCESSOR_TRANSPOSE_TILE_CHANNELS) {
+            unsigned int c1 = c0 + STREAMPROCESSOR_TRANSPOSE_TILE_CHANNELS;
+            if(c1 > nb_channels) c1 = nb_channels;
+
+            for(unsigned int f = f0; f < f1; f++) {
+                unsigned char *event = data + f * m_event_size;
+                for(unsigned int c = c0; c < c1; c++) {
+                    struct channel &ch = channels[c];
+                    uint32_t v = 0;
+                    if(likely(ch.enabled)) {
+                        #ifdef DEBUG
+                        assert(nevents + offset <= ch.buffer_size);
+                        #endif
+                        const typename S::sample_t *buffer = (const typename S::sample_t *)ch.buffer;
+                        v = S::toInt24(buffer[(offset + f) * ch.stride]);
+                    }
+                    unsigned char *target = event + ch.position;
+                    if(format == eSF_Packed24) {
+                        *target = (v >> 16) & 0xff;
+                        *(target+1) = (v >> 8) & 0xff;
+                        *(target+2) = v & 0xff;
+                    } else {
+                        *(uint32_t *)target = (v & 0x00ffffff) << 8;
+                    }
+                }
+            }
+        }
+    }
+}
+
+template <enum EventTranspose::eSampleFormat format, class S>
+void
+EventTranspose::decodeTiles(unsigned char *data, unsigned int offset, unsigned int nevents)
+{
+    const unsigned int nb_channels = m_channels.size();
+    struct channel *channels = &m_channels[0];
+
+    for(unsigned int f0 = 0; f0 < nevents; f0 += STREAMPROCESSOR_TRANSPOSE_TILE_FRAMES) {
+        unsigned int f1 = f0 + STREAMPROCESSOR_TRANSPOSE_TILE_FRAMES;
+        if(f1 > nevents) f1 = nevents;
+
+        for(unsigned int c0 = 0; c0 < nb_channels; c0 += STREAMPROCESSOR_TRANSPOSE_TILE_CHANNELS) {
+            unsigned int c1 = c0 + STREAMPROCESSOR_TRANSPOSE_TILE_CHANNELS;
+            if(c1 > nb_channels) c1 = nb_channels;
+
+            for(unsigned int f = f0; f < f1; f++) {
+                unsigned char *event = data + f * m_event_size;
+                for(unsigned int c = c0; c < c1; c++) {
+                    struct channel &ch = channels[c];
+                    if(unlikely(!ch.enabled)) continue;
+                    #ifdef DEBUG
+                    assert(nevents + offset <= ch.buffer_size);
+                    #endif
+
+                    unsigned char *src = event + ch.position;
+                    int32_t v;
+                    if(format == eSF_Packed24) {
+                        v = (*src << 16) + (*(src+1) << 8) + *(src+2);
+                        // Sign-extend highest bit of 24-bit int
+                        if (*src & 0x80)
+                            v |= 0xff000000;
+                    } else {
+                        uint32_t q = *(uint32_t *)src;
+                        v = (q >> 8) & 0x00ffffff;
+                        if (q & 0x80000000)
+                            v |= 0xff000000;
+                    }
+
+                    typename S::sample_t *buffer = (typename S::sample_t *)ch.buffer;
+                    buffer[(offset + f) * ch.stride] = S::fromInt24(v);
+                }
+            }
+        }
+    }
+}
+
+template <class S>
+void
+EventTranspose::encode(unsigned char *data, unsigned int offset, unsigned int nevents)
+{
+    if(m_channels.empty()) return;
+    if(m_format == eSF_Packed24) {
+        encodeTiles<eSF_Packed24, S>(data, offset, nevents);
+    } else {
+        encodeTiles<eSF_Quadlet24, S>(data, offset, nevents);
+    }
+}
+
+void
+EventTranspose::encodeInt24(unsigned char *data, unsigned int offset, unsigned int nevents)
+{
+    encode<SampleInt24>(data, offset, nevents);
+}
+
+void
+EventTranspose::encodeFloat(unsigned char *data, unsigned int offset, unsigned int nevents, bool clip)
+{
+    if(clip) {
+        encode<SampleFloatClipped>(data, offset, nevents);
+    } else {
+        encode<SampleFloat>(data, offset, nevents);
+    }
+}
+
+void
+EventTranspose::encodeInt16(unsigned char *data, unsigned int offset, unsigned int nevents)
+{
+    encode<SampleInt16>(data, offset, nevents);
+}
+
+void
+EventTranspose::encodeInt32(unsigned char *data, unsigned int offset, unsigned int nevents)
+{
+    encode<SampleInt32>(data, offset, nevents);
+}
+
+void
+EventTranspose::encodeFloat64(unsigned char *data, unsigned int offset, unsigned int nevents)
+{
+    encode<SampleFloat64>(data, offset, nevents);
+}
+
+void
+EventTranspose::encodeSilence(unsigned char *data, unsigned int nevents)
+{
+    unsigned int sample_size = (m_format == eSF_Quadlet24 ? 4 : 3);
+    for(unsigned int f = 0; f < nevents; f++) {
+        unsigned char *event = data + f * m_event_size;
+        for(unsigned int c = 0; c < m_channels.size(); c++) {
+            unsigned char *target = event + m_channels[c].position;
+            for(unsigned int i = 0; i < sample_size; i++) {
+                target[i] = 0;
+            }
+        }
+    }
+}
+
+template <class S>
+void
+EventTranspose::decode(unsigned char *data, unsigned int offset, unsigned int nevents)
+{
+    if(m_channels.empty()) return;
+    if(m_format == eSF_Packed24) {
+        decodeTiles<eSF_Packed24, S>(data, offset, nevents);
+    } else {
+        decodeTiles<eSF_Quadlet24, S>(data, offset, nevents);
+    }
+}
+
+void
+EventTranspose::decodeInt24(unsigned char *data, unsigned int offset, unsigned int nevents)
+{
+    decode<SampleInt24>(data, offset, nevents);
+}
+
+void
+EventTranspose::decodeFloat(unsigned char *data, unsigned int offset, unsigned int nevents)
+{
+    decode<SampleFloat>(data, offset, nevents);
+}
+
+void
+EventTranspose::decodeInt16(unsigned char *data, unsigned int offset, unsigned int nevents)
+{
+    decode<SampleInt16>(data, offset, nevents);
+}
+
+void
+EventTranspose::decodeInt32(unsigned char *data, unsigned int offset, unsigned int nevents)
+{
+    decode<SampleInt32>(data, offset, nevents);
+}
+
+void
+EventTranspose::decodeFloat64(unsigned char *data, unsigned int offset, unsigned int nevents)
+{
+    decode<SampleFloat64>(data, offset, nevents);
+}
+
+} // end of namespace Streaming
@@ -0,0 +1,136 @@
+/*
+ * Copyright (C) 2005-2008 by Pieter Palmers
+ *
+ * This file is part of FFADO
+ * FFADO = Free Firewire (pro-)audio drivers for linux
+ *
+ * FFADO is based upon FreeBoB
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) version 3 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef __FFADO_EVENTTRANSPOSE__
+#define __FFADO_EVENTTRANSPOSE__
+
+#include "debugmodule/debugmodule.h"
+
+#include <vector>
+
+namespace Streaming {
+
+class Port;
+
+/**
+ * @brief Converts between the audio port buffers and the events of a stream
+ *
+ * Holds the mapping of the audio ports of a stream processor to the position
+ * of their samples in an event, built once in prepareChild(). The conversion
+ * is done in tiles of a few channels by a few frames
+ * (STREAMPROCESSOR_TRANSPOSE_TILE_CHANNELS x STREAMPROCESSOR_TRANSPOSE_TILE_FRAMES),
+ * such that both the port buffers and the event data of a tile stay in
+ * the cache, instead of striding through the whole packet for every port.
+ *
+ * Used by the MOTU and RME stream processors.
+ */
+class EventTranspose
+{
+public:
+    enum eSampleFormat {
+        /// packed 24 bit big endian integer at a byte position (MOTU)
+        eSF_Packed24,
+        /// 24 bit integer in the upper bits of a host order quadlet (RME)
+        eSF_Quadlet24,
+    };
+
+    EventTranspose(enum eSampleFormat format);
+    virtual ~EventTranspose() {};
+
+    /// remove all channels from the map
+    void clear();
+    /**
+     * @brief add an audio port to the channel map
+     * @param port the port
+     * @param position byte offset of the port's sample within an event
+     */
+    void addChannel(Port *port, unsigned int position);
+    /**
+     * @brief finish building the channel map
+     * @param event_size size of an event in bytes
+     * @return true if the map is consistent
+     */
+    bool init(unsigned int event_size);
+
+    /**
+     * @brief refresh the buffer addresses and enabled state of the ports
+     *
+     * To be called once per processRead/WriteBlock() call.
+     */
+    void update();
+
+    /// port buffers -> events, disabled ports are encoded as silence
+    void encodeInt24(unsigned char *data, unsigned int offset, unsigned int nevents);
+    void encodeFloat(unsigned char *data, unsigned int offset, unsigned int nevents, bool clip);
+    void encodeInt16(unsigned char *data, unsigned int offset, unsigned int nevents);
+    void encodeInt32(unsigned char *data, unsigned int offset, unsigned int nevents);
+    void encodeFloat64(unsigned char *data, unsigned int offset, unsigned int nevents);
+    void encodeSilence(unsigned char *data, unsigned int nevents);
+
+    /// events -> port buffers, disabled ports are skipped
+    void decodeInt24(unsigned char *data, unsigned int offset, unsigned int nevents);
+    void decodeFloat(unsigned char *data, unsigned int offset, unsigned int nevents);
+    void decodeInt16(unsigned char *data, unsigned int offset, unsigned int nevents);
+    void decodeInt32(unsigned char *data, unsigned int offset, unsigned int nevents);
+    void decodeFloat64(unsigned char *data, unsigned int offset, unsigned int nevents);
+
+    unsigned int getNbChannels() {return m_channels.size();};
+
+    void setVerboseLevel(int l) {setDebugLevel(l);};
+
+private:
+    struct channel {
+        Port*           port;
+        void*           buffer;
+        unsigned int    stride;
+        unsigned int    position;
+        bool            enabled;
+#ifdef DEBUG
+        unsigned int    buffer_size;
+#endif
+    };
+
+    static bool positionLess(const struct channel &a, const struct channel &b)
+        {return a.position < b.position;};
+
+    // S is one of the sample classes of SampleConversion.h
+    template <enum eSampleFormat format, class S>
+    void encodeTiles(unsigned char *data, unsigned int offset, unsigned int nevents);
+    template <enum eSampleFormat format, class S>
+    void decodeTiles(unsigned char *data, unsigned int offset, unsigned int nevents);
+    template <class S>
+    void encode(unsigned char *data, unsigned int offset, unsigned int nevents);
+    template <class S>
+    void decode(unsigned char *data, unsigned int offset, unsigned int nevents);
+
+    enum eSampleFormat      m_format;
+    unsigned int            m_event_size;
+    std::vector<struct channel> m_channels;
+
+protected:
+    DECLARE_DEBUG_MODULE;
+};
+
+} // end of namespace Streaming
+
+#endif /* __FFADO_EVENTTRANSPOSE__ */
@@ -0,0 +1,725 @@
+/*
+ * Copyright (C) 2005-2008 by Pieter Palmers
+ *
+ * This file is part of FFADO
+ * FFADO = Free Firewire (pro-)audio drivers for linux
+ *
+ * FFADO is based upon FreeBoB
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) version 3 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "config.h"
+
+#include "Resampler.h"
+#include "SampleConversion.h"
+#include "../generic/StreamProcessor.h"
+#include "../generic/Port.h"
+
+#include "libutil/SystemTimeSource.h"
+#include "libutil/float_cast.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
+
+#if (STREAMPROCESSOR_RESAMPLER_HALF_TAPS % 2)
+#error STREAMPROCESSOR_RESAMPLER_HALF_TAPS should be a multiple of 2
+#endif
+
+#define RESAMPLER_TAPS      (2 * STREAMPROCESSOR_RESAMPLER_HALF_TAPS)
+
+// the cutoff of the filter, relative to the nyquist frequency
+#define RESAMPLER_CUTOFF    0.91
+// the beta parameter of the kaiser window
+#define RESAMPLER_BETA      8.0
+
+// the receive side reads in multiples of this, since the timestamped
+// buffer processes events in blocks of 8 frames
+#define RESAMPLER_READ_ALIGN 8
+
+namespace Streaming {
+
+IMPL_DEBUG_MODULE( ClockDomain, ClockDomain, DEBUG_LEVEL_NORMAL );
+IMPL_DEBUG_MODULE( Resampler, Resampler, DEBUG_LEVEL_NORMAL );
+
+// --- ClockDomain --- //
+
+ClockDomain::ClockDomain(StreamProcessor &master, StreamProcessor &reference)
+: m_master( &master )
+, m_reference( &reference )
+, m_fixed_ratio( 1.0 )
+, m_ratio( 1.0 )
+, m_ratio_dll( 1.0 )
+, m_fill_error( 0.0 )
+, m_fill_integral( 0.0 )
+, m_fill_target( 0 )
+, m_valid( false )
+{
+}
+
+ClockDomain::ClockDomain(double ratio)
+: m_master( NULL )
+, m_reference( NULL )
+, m_fixed_ratio( ratio )
+, m_ratio( ratio )
+, m_ratio_dll( ratio )
+, m_fill_error( 0.0 )
+, m_fill_integral( 0.0 )
+, m_fill_target( 0 )
+, m_valid( false )
+{
+}
+
+void
+ClockDomain::reset()
+{
+    m_ratio = m_fixed_ratio;
+    m_ratio_dll = m_fixed_ratio;
+    m_fill_error = 0.0;
+    m_fill_integral = 0.0;
+    m_fill_target = 0;
+    m_valid = false;
+}
+
+/**
+ * The ratio of the two rates is smoothed with a first order filter. This
+ * alone would let the buffer fill of the reference SP wander off, since
+ * the rates are measured against the cycle timer of the bus the SP is on.
+ * If both devices are on a different bus, the difference between the two
+ * cycle timers shows up as a steady drift of the buffer fill. Hence the
+ * fill error is fed back into the ratio (proportional + integral), which
+ * absorbs both the estimation error and the cross-bus drift.
+ */
+void
+ClockDomain::update(unsigned int period)
+{
+    if (m_master == NULL) {
+        // fixed ratio
+        return;
+    }
+    float tpf_master = m_master->getTicksPerFrame();
+    float tpf_reference = m_reference->getTicksPerFrame();
+    if (tpf_master <= 0.0 || tpf_reference <= 0.0) {
+        return;
+    }
+    double r = tpf_master / tpf_reference;
+    int fill = m_reference->getBufferFill();
+
+    if (!m_valid) {
+        m_ratio_dll = r;
+        m_ratio = r;
+        m_fill_target = fill;
+        m_valid = true;
+        debugOutput(DEBUG_LEVEL_VERBOSE, "(%p) start at ratio %f, fill target %d\n",
+                    this, r, fill);
+        return;
+    }
+
+    const double T = STREAMPROCESSOR_RESAMPLER_CONTROL_PERIODS;
+    const double P = period;
+
+    m_ratio_dll += (r - m_ratio_dll) / T;
+
+    double err = fill - m_fill_target;
+    m_fill_error += (err - m_fill_error) / T;
+    m_fill_integral += m_fill_error;
+    // prevent windup when the ratio saturates
+    double max_integral = 4.0 * T * T * P * STREAMPROCESSOR_RESAMPLER_MAX_RATIO_DEVIATION;
+    if (m_fill_integral > max_integral) m_fill_integral = max_integral;
+    if (m_fill_integral < -max_integral) m_fill_integral = -max_integral;
+
+    double ratio = m_ratio_dll
+                   + m_fill_error / (T * P)
+                   + m_fill_integral / (4.0 * T * T * P);
+
+    const double max_dev = STREAMPROCESSOR_RESAMPLER_MAX_RATIO_DEVIATION;
+    if (ratio > 1.0 + max_dev) ratio = 1.0 + max_dev;
+    if (ratio < 1.0 - max_dev) ratio = 1.0 - max_dev;
+    m_ratio = ratio;
+
+    debugOutputExtreme(DEBUG_LEVEL_VERY_VERBOSE,
+                       "(%p) r=%f, dll=%f, fill=%d (err %f, int %f) => %f\n",
+                       this, r, m_ratio_dll, fill, m_fill_error, m_fill_integral, m_ratio);
+}
+
+void
+ClockDomain::show()
+{
+    debugOutputShort( DEBUG_LEVEL_NORMAL, "  Clock domain of SP %p:\n", m_reference);
+    debugOutputShort( DEBUG_LEVEL_NORMAL, "   Ratio               : %f (measured %f)\n",
+                      m_ratio, m_ratio_dll);
+    debugOutputShort( DEBUG_LEVEL_NORMAL, "   Fill target         : %d, error %f, integral %f\n",
+                      m_fill_target, m_fill_error, m_fill_integral);
+}
+
+// --- Resampler --- //
+
+Resampler::Resampler(PortManager &ports, bool receive, ClockDomain &domain)
+: m_ports( ports )
+, m_domain( domain )
+, m_receive( receive )
+, m_datatype( StreamProcessorManager::eADT_Float )
+, m_period( 0 )
+, m_history_size( 0 )
+, m_queue_size( 0 )
+, m_attached( false )
+, m_fill( 0 )
+, m_pos( 0.0 )
+, m_step( 1.0 )
+, m_queued( 0 )
+, m_frame_index( NULL )
+, m_frame_coeffs( NULL )
+, m_scratch( NULL )
+, m_usecs( 0 )
+, m_max_usecs( 0 )
+, m_nb_samples( 0 )
+{
+}
+
+Resampler::~Resampler()
+{
+    detachPorts();
+    freeBuffers();
+}
+
+void
+Resampler::freeBuffers()
+{
+    for (unsigned int i = 0; i < m_channels.size(); i++) {
+        free(m_channels[i].history);
+        free(m_channels[i].output);
+    }
+    m_channels.clear();
+    free(m_frame_index);
+    m_frame_index = NULL;
+    free(m_frame_coeffs);
+    m_frame_coeffs = NULL;
+    free(m_scratch);
+    m_scratch = NULL;
+}
+
+static double
+besselI0(double x)
+{
+    double sum = 1.0;
+    double term = 1.0;
+    for (int k = 1; k < 50; k++) {
+        term *= (x / (2.0 * k)) * (x / (2.0 * k));
+        sum += term;
+        if (term < sum * 1e-12) break;
+    }
+    return sum;
+}
+
+/**
+ * Row p of the table holds the taps for an output position that lies
+ * p/PHASES frames after input frame HALF_TAPS-1 of the taps. There are
+ * PHASES+1 rows such that row p+1 always exists for the interpolation.
+ */
+const float *
+Resampler::getFilterTable()
+{
+    static float *table = NULL;
+    if (table) return table;
+
+    const unsigned int H = STREAMPROCESSOR_RESAMPLER_HALF_TAPS;
+    const unsigned int nb_phases = STREAMPROCESSOR_RESAMPLER_PHASES;
+    float *t;
+    if (posix_memalign((void **)&t, 16, (nb_phases + 1) * RESAMPLER_TAPS * sizeof(float))) {
+        return NULL;
+    }
+    const double norm = besselI0(RESAMPLER_BETA);
+    for (unsigned int p = 0; p <= nb_phases; p++) {
+        double frac = (double)p / nb_phases;
+        double sum = 0.0;
+        for (unsigned int k = 0; k < RESAMPLER_TAPS; k++) {
+            double d = (double)k - (H - 1) - frac;
+            double x = M_PI * RESAMPLER_CUTOFF * d;
+            double s = (fabs(x) < 1e-9 ? 1.0 : sin(x) / x);
+            double w = d / H;
+            w = (fabs(w) >= 1.0 ? 0.0 : besselI0(RESAMPLER_BETA * sqrt(1.0 - w * w)) / norm);
+            t[p * RESAMPLER_TAPS + k] = s * w;
+            sum += s * w;
+        }
+        // unity gain at DC for every phase
+        for (unsigned int k = 0; k < RESAMPLER_TAPS; k++) {
+            t[p * RESAMPLER_TAPS + k] /= sum;
+        }
+    }
+    table = t;
+    return table;
+}
+
+bool
+Resampler::init(unsigned int period, enum StreamProcessorManager::eADT_AudioDataType datatype)
+{
+    detachPorts();
+    freeBuffers();
+
+    if (getFilterTable() == NULL) {
+        debugError("Could not allocate filter table\n");
+        return false;
+    }
+
+    m_period = period;
+    m_datatype = datatype;
+
+    const unsigned int H = STREAMPROCESSOR_RESAMPLER_HALF_TAPS;
+    unsigned int max_frames = period + period / 64 + 4;
+    m_history_size = max_frames + 2 * H + 2 * RESAMPLER_READ_ALIGN;
+    m_queue_size = period + max_frames;
+
+    if (posix_memalign((void **)&m_frame_coeffs, 16, max_frames * RESAMPLER_TAPS * sizeof(float))) {
+        m_frame_coeffs = NULL;
+        debugError("Could not allocate coefficient buffer\n");
+        return false;
+    }
+    m_frame_index = (unsigned int *)calloc(max_frames, sizeof(unsigned int));
+    m_scratch = (float *)calloc(max_frames, sizeof(float));
+
+    for (int i = 0; i < m_ports.getPortCount(); i++) {
+        Port *p = m_ports.getPortAtIdx(i);
+        struct channel c;
+        c.port = p;
+        c.audio = (p->getPortType() == Port::E_Audio);
+        c.client_buffer = NULL;
+        c.client_stride = 1;
+        c.history = NULL;
+        c.size = (c.audio ? StreamProcessorManager::getAudioSampleSize(datatype) : sizeof(uint32_t));
+        // receive: decoded frames of one read, for events behind their
+        // history. transmit: output queue
+        unsigned int out_size = (m_receive ? m_history_size : m_queue_size);
+        c.output = (char *)calloc(out_size, c.size);
+        if (c.audio) {
+            c.history = (float *)calloc(m_history_size, sizeof(float));
+        }
+        m_channels.push_back(c);
+        if (c.output == NULL || (c.audio && c.history == NULL)
+            || m_frame_index == NULL || m_scratch == NULL) {
+            debugError("Could not allocate buffers for port %s\n", p->getName().c_str());
+            freeBuffers();
+            return false;
+        }
+        debugOutput(DEBUG_LEVEL_VERBOSE, "Resampling port %s (%s)\n",
+                    p->getName().c_str(), c.audio ? "filtered" : "events");
+    }
+
+    reset();
+    return true;
+}
+
+void
+Resampler::reset()
+{
+    const unsigned int H = STREAMPROCESSOR_RESAMPLER_HALF_TAPS;
+    for (unsigned int i = 0; i < m_channels.size(); i++) {
+        struct channel &c = m_channels.at(i);
+        if (c.history) {
+            memset(c.history, 0, m_history_size * sizeof(float));
+        }
+        if (m_receive && !c.audio) {
+            memset(c.output, 0, m_history_size * c.size);
+        }
+    }
+    // start with H-1 frames of silence in front
+    m_fill = H - 1;
+    m_pos = H - 1;
+    m_step = 1.0;
+    m_queued = 0;
+    m_usecs = 0;
+    m_max_usecs = 0;
+    m_nb_samples = 0;
+}
+
+void
+Resampler::attachPorts(unsigned int offset)
+{
+    if (m_receive) {
+        // the decoded frames are appended to the history
+        offset += m_fill;
+    }
+    assert(offset < (m_receive ? m_history_size : m_queue_size));
+    for (unsigned int i = 0; i < m_channels.size(); i++) {
+        struct channel &c = m_channels.at(i);
+        if (!m_attached) {
+            c.client_buffer = c.port->getBufferAddress();
+            c.client_stride = c.port->getBufferStride();
+            c.port->setBufferStride(1);
+        }
+        c.port->setBufferAddress(c.output + offset * c.size);
+    }
+    m_attached = true;
+}
+
+void
+Resampler::detachPorts()
+{
+    if (!m_attached) return;
+    for (unsigned int i = 0; i < m_channels.size(); i++) {
+        struct channel &c = m_channels.at(i);
+        c.port->setBufferAddress(c.client_buffer);
+        c.port->setBufferStride(c.client_stride);
+    }
+    m_attached = false;
+}
+
+/**
+ * Computes the input frame and the interpolated taps for nbframes output
+ * frames at positions start + i * step.
+ *
+ * @return the integer part of the position following the last frame
+ */
+unsigned int
+Resampler::computeCoefficients(double start, double step, unsigned int nbframes)
+{
+    const unsigned int H = STREAMPROCESSOR_RESAMPLER_HALF_TAPS;
+    const float *table = getFilterTable();
+    for (unsigned int i = 0; i < nbframes; i++) {
+        double pos = start + i * step;
+        unsigned int i0 = (unsigned int)pos;
+        double phase = (pos - i0) * STREAMPROCESSOR_RESAMPLER_PHASES;
+        unsigned int p = (unsigned int)phase;
+        float a = phase - p;
+        const float *t0 = table + p * RESAMPLER_TAPS;
+        const float *t1 = t0 + RESAMPLER_TAPS;
+        float *c = m_frame_coeffs + i * RESAMPLER_TAPS;
+        for (unsigned int k = 0; k < RESAMPLER_TAPS; k++) {
+            c[k] = t0[k] + a * (t1[k] - t0[k]);
+        }
+        m_frame_index[i] = i0 - (H - 1);
+    }
+    return (unsigned int)(start + nbframes * step);
+}
+
+void
+Resampler::filter(const float *in, float *out, unsigned int nbframes)
+{
+    for (unsigned int i = 0; i < nbframes; i++) {
+        const float *x = in + m_frame_index[i];
+        const float *c = m_frame_coeffs + i * RESAMPLER_TAPS;
+#ifdef __SSE__
+        __m128 acc = _mm_setzero_ps();
+        for (unsigned int k = 0; k < RESAMPLER_TAPS; k += 4) {
+            acc = _mm_add_ps(acc, _mm_mul_ps(_mm_loadu_ps(x + k), _mm_load_ps(c + k)));
+        }
+        // horizontal sum
+        acc = _mm_add_ps(acc, _mm_movehl_ps(acc, acc));
+        acc = _mm_add_ss(acc, _mm_shuffle_ps(acc, acc, 1));
+        _mm_store_ss(out + i, acc);
+#else
+        float acc = 0.0f;
+        for (unsigned int k = 0; k < RESAMPLER_TAPS; k++) {
+            acc += x[k] * c[k];
+        }
+        out[i] = acc;
+#endif
+    }
+}
+
+/**
+ * MIDI and control ports carry sparse events, which are moved to the frame
+ * at the same relative position in the destination. An event that would
+ * land on an occupied frame is moved to the next free one.
+ */
+void
+Resampler::moveEvents(const uint32_t *src, unsigned int nsrc, uint32_t *dst, unsigned int ndst)
+{
+    memset(dst, 0, ndst * sizeof(uint32_t));
+    if (nsrc == 0 || ndst == 0) return;
+    unsigned int next_free = 0;
+    for (unsigned int i = 0; i < nsrc; i++) {
+        if (src[i] == 0) continue;
+        unsigned int j = (unsigned int)(((uint64_t)i * ndst) / nsrc);
+        if (j < next_free) j = next_free;
+        if (j >= ndst) {
+            debugWarning("dropped event 0x%08X\n", src[i]);
+            continue;
+        }
+        dst[j] = src[i];
+        next_free = j + 1;
+    }
+}
+
+/**
+ * The received events are kept in a history that is indexed like the one
+ * of the audio. Output frame j of this read corresponds to history frame
+ * m_pos + j * m_step, an event is moved to the output frame nearest to its
+ * position and cleared from the history. Events that belong to a frame
+ * after this read stay in the history for the next one.
+ */
+void
+Resampler::readEvents(uint32_t *history, unsigned int nhistory, uint32_t *dst, unsigned int ndst)
+{
+    memset(dst, 0, ndst * sizeof(uint32_t));
+    unsigned int next_free = 0;
+    for (unsigned int i = 0; i < nhistory; i++) {
+        if (history[i] == 0) continue;
+        double pos = (i - m_pos) / m_step + 0.5;
+        unsigned int j = (pos > 0.0 ? (unsigned int)pos : 0);
+        if (j >= ndst) {
+            // the events are in order
+            break;
+        }
+        if (j < next_free) j = next_free;
+        if (j >= ndst) {
+            debugWarning("dropped event 0x%08X\n", history[i]);
+        } else {
+            dst[j] = history[i];
+            next_free = j + 1;
+        }
+        history[i] = 0;
+    }
+}
+
+template <class S>
+static void
+samplesToFloats(float *dst, const void *src, unsigned int stride, unsigned int nbframes)
+{
+    const typename S::sample_t *in = (const typename S::sample_t *)src;
+    for (unsigned int f = 0; f < nbframes; f++) {
+        dst[f] = S::toFloat(in[f * stride]);
+    }
+}
+
+template <class S>
+static void
+floatsToSamples(void *dst, unsigned int stride, const float *src, unsigned int nbframes)
+{
+    typename S::sample_t *out = (typename S::sample_t *)dst;
+    for (unsigned int f = 0; f < nbframes; f++) {
+        out[f * stride] = S::fromFloat(src[f]);
+    }
+}
+
+void
+Resampler::toFloats(float *dst, const void *src, unsigned int stride, unsigned int nbframes)
+{
+    switch (m_datatype) {
+        case StreamProcessorManager::eADT_Int24:
+            samplesToFloats<SampleInt24>(dst, src, stride, nbframes);
+            break;
+        case StreamProcessorManager::eADT_Float:
+            samplesToFloats<SampleFloat>(dst, src, stride, nbframes);
+            break;
+        case StreamProcessorManager::eADT_Int16:
+            samplesToFloats<SampleInt16>(dst, src, stride, nbframes);
+            break;
+        case StreamProcessorManager::eADT_Int32:
+            samplesToFloats<SampleInt32>(dst, src, stride, nbframes);
+            break;
+        case StreamProcessorManager::eADT_Float64:
+            samplesToFloats<SampleFloat64>(dst, src, stride, nbframes);
+            break;
+    }
+}
+
+void
+Resampler::fromFloats(void *dst, unsigned int stride, const float *src, unsigned int nbframes)
+{
+    switch (m_datatype) {
+        case StreamProcessorManager::eADT_Int24:
+            floatsToSamples<SampleInt24>(dst, stride, src, nbframes);
+            break;
+        case StreamProcessorManager::eADT_Float:
+            floatsToSamples<SampleFloat>(dst, stride, src, nbframes);
+            break;
+        case StreamProcessorManager::eADT_Int16:
+            floatsToSamples<SampleInt16>(dst, stride, src, nbframes);
+            break;
+        case StreamProcessorManager::eADT_Int32:
+            floatsToSamples<SampleInt32>(dst, stride, src, nbframes);
+            break;
+        case StreamProcessorManager::eADT_Float64:
+            floatsToSamples<SampleFloat64>(dst, stride, src, nbframes);
+            break;
+    }
+}
+
+void
+Resampler::shiftHistory(unsigned int consumed)
+{
+    if (consumed == 0) return;
+    assert(consumed <= m_fill);
+    for (unsigned int i = 0; i < m_channels.size(); i++) {
+        struct channel &c = m_channels.at(i);
+        if (c.history) {
+            memmove(c.history, c.history + consumed, (m_fill - consumed) * sizeof(float));
+        } else if (m_receive) {
+            memmove(c.output, c.output + consumed * c.size, (m_fill - consumed) * c.size);
+            memset(c.output + (m_fill - consumed) * c.size, 0, consumed * c.size);
+        }
+    }
+    m_fill -= consumed;
+    m_pos -= consumed;
+}
+
+unsigned int
+Resampler::getFramesNeeded(unsigned int nbframes)
+{
+    const unsigned int H = STREAMPROCESSOR_RESAMPLER_HALF_TAPS;
+    // the ratio is latched here, such that processRead() uses the
+    // same one as the check that decided the frames were available
+    m_step = m_domain.getRatio();
+    unsigned int last = (unsigned int)(m_pos + (nbframes - 1) * m_step);
+    unsigned int needed = last + H + 1;
+    if (needed <= m_fill) return 0;
+    needed -= m_fill;
+    return (needed + RESAMPLER_READ_ALIGN - 1) & ~(RESAMPLER_READ_ALIGN - 1);
+}
+
+void
+Resampler::processRead(unsigned int nbframes, unsigned int nread)
+{
+    ffado_microsecs_t start = Util::SystemTimeSource::getCurrentTimeAsUsecs();
+    unsigned int nb_filtered = 0;
+
+    assert(m_fill + nread <= m_history_size);
+    assert(!m_attached);
+    unsigned int next = computeCoefficients(m_pos, m_step, nbframes);
+
+    for (unsigned int i = 0; i < m_channels.size(); i++) {
+        struct channel &c = m_channels.at(i);
+        c.client_buffer = c.port->getBufferAddress();
+        unsigned int stride = c.port->getBufferStride();
+        if (!c.audio) {
+            // the events of this read were decoded behind the history
+            readEvents((uint32_t *)c.output, m_fill + nread, (uint32_t *)c.client_buffer, nbframes);
+            continue;
+        }
+        // the history is kept up to date for disabled ports too, such
+        // that enabling them does not produce a glitch
+        toFloats(c.history + m_fill, c.output + m_fill * c.size, 1, nread);
+        if (c.port->isDisabled()) continue;
+
+        if (m_datatype == StreamProcessorManager::eADT_Float && stride == 1) {
+            filter(c.history, (float *)c.client_buffer, nbframes);
+        } else {
+            filter(c.history, m_scratch, nbframes);
+            fromFloats(c.client_buffer, stride, m_scratch, nbframes);
+        }
+        nb_filtered++;
+    }
+    m_fill += nread;
+    m_pos += nbframes * m_step;
+    shiftHistory(next - (STREAMPROCESSOR_RESAMPLER_HALF_TAPS - 1));
+
+    ffado_microsecs_t usecs = Util::SystemTimeSource::getCurrentTimeAsUsecs() - start;
+    m_usecs += usecs;
+    if (usecs > m_max_usecs) m_max_usecs = usecs;
+    m_nb_samples += nb_filtered * nbframes;
+}
+
+unsigned int
+Resampler::getPeriodsReady(unsigned int nbframes)
+{
+    // the ratio can be up to MAX_RATIO_DEVIATION off, hence the + 1
+    unsigned int max_out = (unsigned int)(nbframes * m_domain.getRatio()) + 1;
+    return (m_queued + max_out) / m_period;
+}
+
+unsigned int
+Resampler::processWrite(unsigned int nbframes)
+{
+    const unsigned int H = STREAMPROCESSOR_RESAMPLER_HALF_TAPS;
+    ffado_microsecs_t start = Util::SystemTimeSource::getCurrentTimeAsUsecs();
+    unsigned int nb_filtered = 0;
+
+    assert(m_fill + nbframes <= m_history_size);
+    assert(!m_attached);
+
+    // the client frames are at the master rate, the output at the device's
+    m_step = 1.0 / m_domain.getRatio();
+    unsigned int fill = m_fill + nbframes;
+    unsigned int nb_out = 0;
+    if (fill >= m_pos + H + 1) {
+        nb_out = (unsigned int)((fill - H - 1 - m_pos) / m_step) + 1;
+    }
+    if (m_queued + nb_out > m_queue_size) {
+        debugWarning("output queue overflow, dropping %u frames\n",
+                     m_queued + nb_out - m_queue_size);
+        nb_out = m_queue_size - m_queued;
+    }
+    unsigned int next = computeCoefficients(m_pos, m_step, nb_out);
+
+    for (unsigned int i = 0; i < m_channels.size(); i++) {
+        struct channel &c = m_channels.at(i);
+        char *out = c.output + m_queued * c.size;
+        c.client_buffer = c.port->getBufferAddress();
+        if (!c.audio) {
+            moveEvents((uint32_t *)c.client_buffer, nbframes, (uint32_t *)out, nb_out);
+            continue;
+        }
+        toFloats(c.history + m_fill, c.client_buffer, c.port->getBufferStride(), nbframes);
+        if (c.port->isDisabled()) {
+            memset(out, 0, nb_out * c.size);
+            continue;
+        }
+
+        if (m_datatype == StreamProcessorManager::eADT_Float) {
+            filter(c.history, (float *)out, nb_out);
+        } else {
+            filter(c.history, m_scratch, nb_out);
+            fromFloats(out, 1, m_scratch, nb_out);
+        }
+        nb_filtered++;
+    }
+    m_fill = fill;
+    m_pos += nb_out * m_step;
+    m_queued += nb_out;
+    unsigned int keep_from = next - (H - 1);
+    shiftHistory(keep_from < m_fill ? keep_from : m_fill);
+
+    ffado_microsecs_t usecs = Util::SystemTimeSource::getCurrentTimeAsUsecs() - start;
+    m_usecs += usecs;
+    if (usecs > m_max_usecs) m_max_usecs = usecs;
+    m_nb_samples += nb_filtered * nb_out;
+
+    return m_queued / m_period;
+}
+
+void
+Resampler::consumePeriods(unsigned int nb_periods)
+{
+    unsigned int nb_frames = nb_periods * m_period;
+    assert(nb_frames <= m_queued);
+    for (unsigned int i = 0; i < m_channels.size(); i++) {
+        struct channel &c = m_channels.at(i);
+        memmove(c.output, c.output + nb_frames * c.size, (m_queued - nb_frames) * c.size);
+    }
+    m_queued -= nb_frames;
+}
+
+void
+Resampler::show()
+{
+    debugOutputShort( DEBUG_LEVEL_NORMAL, "  Resampler (%s, %zd ports):\n",
+                      (m_receive ? "receive" : "transmit"), m_channels.size());
+    debugOutputShort( DEBUG_LEVEL_NORMAL, "   Ratio               : %f\n", m_domain.getRatio());
+    debugOutputShort( DEBUG_LEVEL_NORMAL, "   History / queued    : %u / %u frames\n", m_fill, m_queued);
+    debugOutputShort( DEBUG_LEVEL_NORMAL, "   CPU time            : %"PRIu64" usecs (max %"PRIu64" per call)\n",
+                      m_usecs, m_max_usecs);
+    if (m_nb_samples) {
+        debugOutputShort( DEBUG_LEVEL_NORMAL, "   Cost                : %f nsecs per channel-frame\n",
+                          (1000.0 * m_usecs) / m_nb_samples);
+    }
+}
+
+} // end of namespace Streaming
@@ -0,0 +1,231 @@
+/*
+ * Copyright (C) 2005-2008 by Pieter Palmers
+ *
+ * This file is part of FFADO
+ * FFADO = Free Firewire (pro-)audio drivers for linux
+ *
+ * FFADO is based upon FreeBoB
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) version 3 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef __FFADO_RESAMPLER__
+#define __FFADO_RESAMPLER__
+
+#include "debugmodule/debugmodule.h"
+
+#include "../StreamProcessorManager.h"
+#include "../generic/PortManager.h"
+
+#include <vector>
+#include <stdint.h>
+
+namespace Streaming {
+
+/**
+ * @brief The clock of a device that is not synchronized to the sync source
+ *
+ * Tracks the sample rate of a device relative to that of the sync source.
+ * The rate of both is known from the DLL of their receive stream buffer,
+ * the ratio of the two is the nominal resampling ratio. Since this
+ * estimate is noisy, and since the cycle timers of different busses don't
+ * run at exactly the same rate, the ratio is corrected such that the
+ * buffer fill of the reference stream stays at the level it had when
+ * streaming started.
+ */
+class ClockDomain
+{
+public:
+    /**
+     * @param master the sync source
+     * @param reference a receive SP of the device that forms the domain
+     */
+    ClockDomain(StreamProcessor &master, StreamProcessor &reference);
+    /**
+     * @brief a domain that runs at a known, fixed ratio (not tracked)
+     * @param ratio the number of frames of the domain per frame of the sync source
+     */
+    ClockDomain(double ratio);
+    virtual ~ClockDomain() {};
+
+    /// the reference SP, only for a tracked domain
+    StreamProcessor &getReference() {return *m_reference;};
+
+    /// the number of frames of the domain per frame of the sync source
+    double getRatio() {return m_ratio;};
+
+    /// to be called when streaming (re)starts
+    void reset();
+    /// to be called after the reference SP has been read for a period
+    void update(unsigned int period);
+
+    void show();
+    void setVerboseLevel(int l) {setDebugLevel(l);};
+
+private:
+    StreamProcessor *m_master;
+    StreamProcessor *m_reference;
+
+    double  m_fixed_ratio;
+    double  m_ratio;
+    double  m_ratio_dll;
+    double  m_fill_error;
+    double  m_fill_integral;
+    int     m_fill_target;
+    bool    m_valid;
+
+protected:
+    DECLARE_DEBUG_MODULE;
+};
+
+/**
+ * @brief Resamples the ports of a stream processor to the sync source rate
+ *
+ * A receive SP decodes the frames it needs into staging buffers (through
+ * attachPorts()), which are then filtered into the client buffers at the
+ * rate of the sync source. The staging buffers are indexed like the
+ * filter history, the decoded frames are appended behind it. A transmit SP resamples the client buffers
+ * into an output queue, which is handed to the SP a period at a time,
+ * since the transmit buffer is always written in whole periods.
+ *
+ * The filter is a windowed sinc with STREAMPROCESSOR_RESAMPLER_HALF_TAPS
+ * taps on either side, stored for STREAMPROCESSOR_RESAMPLER_PHASES
+ * fractional positions and interpolated linearly in between. The
+ * coefficients for an output frame are computed once and used for all
+ * channels, such that the cost per channel is one dot product of
+ * 2*HALF_TAPS per frame (done with SSE where available).
+ *
+ * MIDI and control ports are not filtered, their events are moved to the
+ * nearest free frame at the new rate. Received events are kept in a
+ * history of their own, such that they get the same delay as the audio.
+ *
+ * The staging buffers and the output queue hold samples of the client's
+ * data type, such that the SP's encoder/decoder can be used as is. The
+ * filter works on floats, the samples are converted on the way in and out.
+ */
+class Resampler
+{
+public:
+    /**
+     * @param ports the ports to resample, those of a stream processor
+     * @param receive true for the ports of a receive SP
+     * @param domain the clock domain the ports are in
+     */
+    Resampler(PortManager &ports, bool receive, ClockDomain &domain);
+    virtual ~Resampler();
+
+    ClockDomain &getDomain() {return m_domain;};
+
+    /**
+     * @brief allocate the buffers for the ports of the parent SP
+     * @param period the period size
+     * @param datatype the data type of the audio port buffers
+     */
+    bool init(unsigned int period, enum StreamProcessorManager::eADT_AudioDataType datatype);
+    /// forget all history, to be called when streaming (re)starts
+    void reset();
+
+    /**
+     * @brief point the port buffers to the resampler's staging buffers
+     * @param offset the frame to point to. On the receive side relative to
+     *               the end of the history, i.e. the number of frames
+     *               decoded so far for this read.
+     */
+    void attachPorts(unsigned int offset);
+    /// restore the client's port buffers
+    void detachPorts();
+
+    // receive direction
+    /// the number of frames that have to be read to produce nbframes
+    unsigned int getFramesNeeded(unsigned int nbframes);
+    /**
+     * @brief filter the frames decoded into the staging buffers to the client buffers
+     * @param nbframes the number of frames to produce
+     * @param nread the number of frames that were decoded
+     */
+    void processRead(unsigned int nbframes, unsigned int nread);
+
+    // transmit direction
+    /**
+     * @brief filter the client buffers into the output queue
+     * @return the number of complete periods in the queue
+     */
+    unsigned int processWrite(unsigned int nbframes);
+    /// an upper bound for the periods processWrite() will return
+    unsigned int getPeriodsReady(unsigned int nbframes);
+    /// the number of frames in the output queue
+    unsigned int getFramesQueued() {return m_queued;};
+    /// remove periods from the output queue once they are written
+    void consumePeriods(unsigned int nb_periods);
+
+    void show();
+    void setVerboseLevel(int l) {setDebugLevel(l);};
+
+private:
+    struct channel {
+        Port*       port;
+        bool        audio;
+        void*       client_buffer;
+        unsigned int client_stride;
+        float*      history;    // filter input, with the history in front
+        char*       output;     // transmit output queue / receive staging,
+                                // for events also their history
+        unsigned int size;      // size of a sample in output
+    };
+
+    void freeBuffers();
+    unsigned int computeCoefficients(double start, double step, unsigned int nbframes);
+    void filter(const float *in, float *out, unsigned int nbframes);
+    void moveEvents(const uint32_t *src, unsigned int nsrc, uint32_t *dst, unsigned int ndst);
+    void readEvents(uint32_t *history, unsigned int nhistory, uint32_t *dst, unsigned int ndst);
+    void shiftHistory(unsigned int consumed);
+    void toFloats(float *dst, const void *src, unsigned int stride, unsigned int nbframes);
+    void fromFloats(void *dst, unsigned int stride, const float *src, unsigned int nbframes);
+
+    static const float *getFilterTable();
+
+    PortManager&            m_ports;
+    ClockDomain&            m_domain;
+    bool                    m_receive;
+    enum StreamProcessorManager::eADT_AudioDataType m_datatype;
+    unsigned int            m_period;
+    unsigned int            m_history_size;
+    unsigned int            m_queue_size;
+    std::vector<struct channel> m_channels;
+    bool                    m_attached;
+
+    // the filter state
+    unsigned int            m_fill;     // frames in the history buffers
+    double                  m_pos;      // position of the next output frame
+    double                  m_step;     // input frames per output frame
+    unsigned int            m_queued;   // frames in the output queue
+
+    // per output frame: the first input frame and the coefficients
+    unsigned int*           m_frame_index;
+    float*                  m_frame_coeffs;
+    float*                  m_scratch;
+
+    // cost accounting
+    uint64_t                m_usecs;
+    uint64_t                m_max_usecs;
+    uint64_t                m_nb_samples;
+
+protected:
+    DECLARE_DEBUG_MODULE;
+};
+
+} // end of namespace Streaming
+
+#endif /* __FFADO_RESAMPLER__ */
@@ -0,0 +1,145 @@
+/*
+ * Copyright (C) 2005-2008 by Pieter Palmers
+ *
+ * This file is part of FFADO
+ * FFADO = Free Firewire (pro-)audio drivers for linux
+ *
+ * FFADO is based upon FreeBoB
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) version 3 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef __FFADO_SAMPLECONVERSION__
+#define __FFADO_SAMPLECONVERSION__
+
+/**
+ * Conversion of the client's audio samples from and to the 24 bit
+ * integers carried in the streams. Each class describes one client
+ * sample format, and is used as template parameter of the encode/decode
+ * loops of the stream processors, such that the conversion is done in
+ * the same pass that (de)multiplexes the events.
+ *
+ * toInt24() returns the sample as a 24 bit value in the lower bits, the
+ * upper byte is undefined. fromInt24() takes a sign extended 24 bit value.
+ * toFloat()/fromFloat() convert from and to a float in [-1.0, 1.0], and
+ * are used where the samples have to be processed (e.g. resampling).
+ */
+
+#include "libutil/float_cast.h"
+
+#include <stdint.h>
+
+namespace Streaming {
+
+static inline int32_t
+floatToInt24(float v)
+{
+    if (v > 1.0f) v = 1.0f;
+    if (v < -1.0f) v = -1.0f;
+    return lrintf(v * (float)(0x7FFFFF));
+}
+
+static inline float
+int24ToFloat(int32_t v)
+{
+    return v * (1.0f / (float)(0x7FFFFF));
+}
+
+class SampleInt16
+{
+public:
+    typedef int16_t sample_t;
+    static inline int32_t toInt24(sample_t v)
+        {return ((int32_t)v) * 256;};
+    static inline sample_t fromInt24(int32_t v)
+        {return (sample_t)(v >> 8);};
+    static inline float toFloat(sample_t v)
+        {return int24ToFloat(toInt24(v));};
+    static inline sample_t fromFloat(float v)
+        {return fromInt24(floatToInt24(v));};
+};
+
+class SampleInt24
+{
+public:
+    typedef int32_t sample_t;
+    static inline int32_t toInt24(sample_t v)
+        {return v;};
+    static inline sample_t fromInt24(int32_t v)
+        {return v;};
+    // the upper byte of the client's sample is not necessarily the sign
+    static inline float toFloat(sample_t v)
+        {return int24ToFloat(((int32_t)((uint32_t)v << 8)) >> 8);};
+    static inline sample_t fromFloat(float v)
+        {return floatToInt24(v);};
+};
+
+class SampleInt32
+{
+public:
+    typedef int32_t sample_t;
+    static inline int32_t toInt24(sample_t v)
+        {return v >> 8;};
+    static inline sample_t fromInt24(int32_t v)
+        {return (int32_t)((uint32_t)v << 8);};
+    static inline float toFloat(sample_t v)
+        {return int24ToFloat(toInt24(v));};
+    static inline sample_t fromFloat(float v)
+        {return fromInt24(floatToInt24(v));};
+};
+
+class SampleFloat
+{
+public:
+    typedef float sample_t;
+    static inline int32_t toInt24(sample_t v)
+        {return lrintf(v * (float)(0x7FFFFF));};
+    static inline sample_t fromInt24(int32_t v)
+        {return int24ToFloat(v);};
+    static inline float toFloat(sample_t v)
+        {return v;};
+    static inline sample_t fromFloat(float v)
+        {return v;};
+};
+
+class SampleFloatClipped : public SampleFloat
+{
+public:
+    static inline int32_t toInt24(sample_t v)
+        {return floatToInt24(v);};
+};
+
+/// always clipped, a double that is out of range does not fit an int
+class SampleFloat64
+{
+public:
+    typedef double sample_t;
+    static inline int32_t toInt24(sample_t v)
+        {
+            if (v > 1.0) v = 1.0;
+            if (v < -1.0) v = -1.0;
+            return lrint(v * (double)(0x7FFFFF));
+        };
+    static inline sample_t fromInt24(int32_t v)
+        {return v * (1.0 / (double)(0x7FFFFF));};
+    static inline float toFloat(sample_t v)
+        {return (float)v;};
+    static inline sample_t fromFloat(float v)
+        {return v;};
+};
+
+} // end of namespace Streaming
+
+#endif /* __FFADO_SAMPLECONVERSION__ */
@@ -0,0 +1,491 @@
+/*
+ * Copyright (C) 2005-2008 by Pieter Palmers
+ *
+ * This file is part of FFADO
+ * FFADO = Free Firewire (pro-)audio drivers for linux
+ *
+ * FFADO is based upon FreeBoB
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) version 3 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#include "ConfigIndex.h"
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <stdio.h>
+
+namespace Util {
+
+IMPL_DEBUG_MODULE( ConfigIndex, ConfigIndex, DEBUG_LEVEL_NORMAL );
+
+ConfigIndex::ConfigIndex()
+    : m_base( NULL )
+    , m_size( 0 )
+    , m_map( NULL )
+    , m_map_size( 0 )
+{
+    // offset 0 is the empty string
+    m_strings.push_back('\0');
+}
+
+ConfigIndex::~ConfigIndex()
+{
+    unload();
+}
+
+void
+ConfigIndex::unload()
+{
+    if(m_map) {
+        munmap(m_map, m_map_size);
+        m_map = NULL;
+        m_map_size = 0;
+    }
+    m_base = NULL;
+    m_size = 0;
+}
+
+uint32_t
+ConfigIndex::hashString(const char *s)
+{
+    // FNV-1a
+    uint32_t h = 2166136261U;
+    while(*s) {
+        h ^= (unsigned char)*s++;
+        h *= 16777619U;
+    }
+    return h;
+}
+
+uint32_t
+ConfigIndex::hashDevice(uint32_t vendor_id, uint32_t model_id)
+{
+    uint32_t h = vendor_id * 2654435761U;
+    h ^= model_id + 0x9E3779B9U + (h << 6) + (h >> 2);
+    return h;
+}
+
+uint32_t
+ConfigIndex::nbBuckets(uint32_t nb_entries)
+{
+    uint32_t n = 16;
+    while(n < 2 * nb_entries) n <<= 1;
+    return n;
+}
+
+std::string
+ConfigIndex::getDeviceKey(uint32_t vendor_id, uint32_t model_id,
+                          const std::string &setting)
+{
+    // ':' can't occur in a setting name, so these never collide with a path
+    char tmp[32];
+    snprintf(tmp, sizeof(tmp), "%08X:%08X:", vendor_id, model_id);
+    return std::string(tmp) + setting;
+}
+
+uint32_t
+ConfigIndex::addString(const std::string &s)
+{
+    if(s.size() == 0) return 0;
+    uint32_t offset = m_strings.size();
+    m_strings.append(s);
+    m_strings.push_back('\0');
+    return offset;
+}
+
+// building
+void
+ConfigIndex::addSource(const std::string &path, uint64_t size,
+                       int64_t mtime_sec, int64_t mtime_nsec)
+{
+    ConfigIndexSource s;
+    memset(&s, 0, sizeof(s));
+    s.path = addString(path);
+    s.size = size;
+    s.mtime_sec = mtime_sec;
+    s.mtime_nsec = mtime_nsec;
+    m_sources.push_back(s);
+}
+
+bool
+ConfigIndex::hasDevice(uint32_t vendor_id, uint32_t model_id)
+{
+    uint64_t id = ((uint64_t)vendor_id << 32) | model_id;
+    return m_device_map.find(id) != m_device_map.end();
+}
+
+bool
+ConfigIndex::addDevice(uint32_t vendor_id, uint32_t model_id, uint32_t driver,
+                       const std::string &vendor_name, const std::string &model_name,
+                       bool valid_vme)
+{
+    if(hasDevice(vendor_id, model_id)) {
+        debugOutput(DEBUG_LEVEL_VERY_VERBOSE,
+                    "device %08X:%08X already present, ignoring\n",
+                    vendor_id, model_id);
+        return false;
+    }
+    ConfigIndexDevice d;
+    memset(&d, 0, sizeof(d));
+    d.vendor_id = vendor_id;
+    d.model_id = model_id;
+    d.driver = driver;
+    d.flags = (valid_vme ? eDF_ValidVME : 0);
+    d.vendor_name = addString(vendor_name);
+    d.model_name = addString(model_name);
+    m_device_map[((uint64_t)vendor_id << 32) | model_id] = m_devices.size();
+    m_devices.push_back(d);
+    return true;
+}
+
+bool
+ConfigIndex::addValue(const std::string &key, enum eValueType type,
+                      int64_t int_value, double float_value)
+{
+    if(m_value_map.find(key) != m_value_map.end()) {
+        debugOutput(DEBUG_LEVEL_VERY_VERBOSE,
+                    "setting '%s' already present, ignoring\n", key.c_str());
+        return false;
+    }
+    ConfigIndexValue v;
+    memset(&v, 0, sizeof(v));
+    v.key = addString(key);
+    v.type = type;
+    v.hash = hashString(key.c_str());
+    v.int_value = int_value;
+    v.float_value = float_value;
+    m_value_map[key] = m_values.size();
+    m_values.push_back(v);
+    return true;
+}
+
+bool
+ConfigIndex::finalize()
+{
+    unload();
+
+    uint32_t nb_device_buckets = nbBuckets(m_devices.size());
+    uint32_t nb_value_buckets = nbBuckets(m_values.size());
+
+    std::vector<uint32_t> device_buckets(nb_device_buckets, 0);
+    std::vector<uint32_t> value_buckets(nb_value_buckets, 0);
+
+    // chain the entries, keeping them in insertion order within a bucket
+    for(int i = m_devices.size() - 1; i >= 0; i--) {
+        ConfigIndexDevice &d = m_devices.at(i);
+        uint32_t b = hashDevice(d.vendor_id, d.model_id) & (nb_device_buckets - 1);
+        d.next = device_buckets.at(b);
+        device_buckets.at(b) = i + 1;
+    }
+    for(int i = m_values.size() - 1; i >= 0; i--) {
+        ConfigIndexValue &v = m_values.at(i);
+        uint32_t b = v.hash & (nb_value_buckets - 1);
+        v.next = value_buckets.at(b);
+        value_buckets.at(b) = i + 1;
+    }
+
+    #define CONFIGINDEX_ALIGN(x) (((x) + 7) & ~7)
+    ConfigIndexHeader h;
+    memset(&h, 0, sizeof(h));
+    h.magic = CONFIGINDEX_MAGIC;
+    h.version = CONFIGINDEX_VERSION;
+
+    uint32_t offset = CONFIGINDEX_ALIGN(sizeof(h));
+    h.nb_sources = m_sources.size();
+    h.sources_offset = offset;
+    offset += CONFIGINDEX_ALIGN(h.nb_sources * sizeof(ConfigIndexSource));
+    h.nb_devices = m_devices.size();
+    h.devices_offset = offset;
+    offset += CONFIGINDEX_ALIGN(h.nb_devices * sizeof(ConfigIndexDevice));
+    h.nb_device_buckets = nb_device_buckets;
+    h.device_buckets_offset = offset;
+    offset += CONFIGINDEX_ALIGN(nb_device_buckets * sizeof(uint32_t));
+    h.nb_values = m_values.size();
+    h.values_offset = offset;
+    offset += CONFIGINDEX_ALIGN(h.nb_values * sizeof(ConfigIndexValue));
+    h.nb_value_buckets = nb_value_buckets;
+    h.value_buckets_offset = offset;
+    offset += CONFIGINDEX_ALIGN(nb_value_buckets * sizeof(uint32_t));
+    h.strings_offset = offset;
+    h.strings_size = m_strings.size();
+    offset += CONFIGINDEX_ALIGN(h.strings_size);
+    h.total_size = offset;
+    #undef CONFIGINDEX_ALIGN
+
+    m_image.assign(h.total_size, 0);
+    char *p = &m_image[0];
+    memcpy(p, &h, sizeof(h));
+    if(h.nb_sources) {
+        memcpy(p + h.sources_offset, &m_sources[0], h.nb_sources * sizeof(ConfigIndexSource));
+    }
+    if(h.nb_devices) {
+        memcpy(p + h.devices_offset, &m_devices[0], h.nb_devices * sizeof(ConfigIndexDevice));
+    }
+    memcpy(p + h.device_buckets_offset, &device_buckets[0], nb_device_buckets * sizeof(uint32_t));
+    if(h.nb_values) {
+        memcpy(p + h.values_offset, &m_values[0], h.nb_values * sizeof(ConfigIndexValue));
+    }
+    memcpy(p + h.value_buckets_offset, &value_buckets[0], nb_value_buckets * sizeof(uint32_t));
+    memcpy(p + h.strings_offset, m_strings.data(), h.strings_size);
+
+    m_base = p;
+    m_size = h.total_size;
+
+    debugOutput(DEBUG_LEVEL_VERBOSE,
+                "compiled index: %u sources, %u devices, %u settings, %u bytes\n",
+                h.nb_sources, h.nb_devices, h.nb_values, h.total_size);
+    return true;
+}
+
+bool
+ConfigIndex::save(std::string filename)
+{
+    if(m_base == NULL || m_image.size() == 0) {
+        debugError("No compiled index to save\n");
+        return false;
+    }
+
+    // make sure the directory exists
+    std::string::size_type slash = filename.rfind('/');
+    if(slash != std::string::npos && slash > 0) {
+        std::string dir = filename.substr(0, slash);
+        struct stat buf;
+        if(stat(dir.c_str(), &buf) != 0) {
+            if(mkdir(dir.c_str(), S_IRWXU | S_IRWXG) != 0) {
+                debugOutput(DEBUG_LEVEL_VERBOSE, "Could not create directory %s: %s\n",
+                            dir.c_str(), strerror(errno));
+                return false;
+            }
+        }
+    }
+
+    // write to a temporary file and move it in place, such that
+    // concurrent readers never see a partial index
+    char tmp[32];
+    snprintf(tmp, sizeof(tmp), ".%d", (int)getpid());
+    std::string tmpname = filename + tmp;
+
+    int fd = open(tmpname.c_str(), O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+    if(fd < 0) {
+        debugOutput(DEBUG_LEVEL_VERBOSE, "Could not create %s: %s\n",
+                    tmpname.c_str(), strerror(errno));
+        return false;
+    }
+    const char *p = &m_image[0];
+    size_t left = m_image.size();
+    while(left) {
+        ssize_t n = write(fd, p, left);
+        if(n < 0) {
+            if(errno == EINTR) continue;
+            debugWarning("Could not write %s: %s\n", tmpname.c_str(), strerror(errno));
+            close(fd);
+            unlink(tmpname.c_str());
+            return false;
+        }
+        p += n;
+        left -= n;
+    }
+    if(close(fd) != 0 || rename(tmpname.c_str(), filename.c_str()) != 0) {
+        debugWarning("Could not save %s: %s\n", filename.c_str(), strerror(errno));
+        unlink(tmpname.c_str());
+        return false;
+    }
+    debugOutput(DEBUG_LEVEL_VERBOSE, "saved index to %s\n", filename.c_str());
+    return true;
+}
+
+// using
+bool
+ConfigIndex::load(std::string filename)
+{
+    unload();
+    m_image.clear();
+
+    int fd = open(filename.c_str(), O_RDONLY);
+    if(fd < 0) {
+        debugOutput(DEBUG_LEVEL_VERBOSE, "Could not open %s: %s\n",
+                    filename.c_str(), strerror(errno));
+        return false;
+    }
+    struct stat buf;
+    if(fstat(fd, &buf) != 0 || buf.st_size < (off_t)sizeof(ConfigIndexHeader)
+       || buf.st_size > 0x7FFFFFFF) {
+        debugOutput(DEBUG_LEVEL_VERBOSE, "%s is not a valid index\n", filename.c_str());
+        close(fd);
+        return false;
+    }
+    void *map = mmap(NULL, buf.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if(map == MAP_FAILED) {
+        debugWarning("Could not map %s: %s\n", filename.c_str(), strerror(errno));
+        return false;
+    }
+    m_map = map;
+    m_map_size = buf.st_size;
+    m_base = (const char *)map;
+    m_size = buf.st_size;
+
+    if(!validate()) {
+        debugOutput(DEBUG_LEVEL_VERBOSE, "%s is not a valid index\n", filename.c_str());
+        unload();
+        return false;
+    }
+    debugOutput(DEBUG_LEVEL_VERBOSE, "mapped index %s: %u devices, %u settings\n",
+                filename.c_str(), getHeader()->nb_devices, getHeader()->nb_values);
+    return true;
+}
+
+bool
+ConfigIndex::validate()
+{
+    const ConfigIndexHeader *h = getHeader();
+    if(h->magic != CONFIGINDEX_MAGIC || h->version != CONFIGINDEX_VERSION
+       || h->total_size != m_size) {
+        return false;
+    }
+    #define CONFIGINDEX_FITS(offset, nb, size) \
+        ((offset) <= m_size && (uint64_t)(nb) * (size) <= m_size - (offset))
+    if(!CONFIGINDEX_FITS(h->sources_offset, h->nb_sources, sizeof(ConfigIndexSource))
+       || !CONFIGINDEX_FITS(h->devices_offset, h->nb_devices, sizeof(ConfigIndexDevice))
+       || !CONFIGINDEX_FITS(h->device_buckets_offset, h->nb_device_buckets, sizeof(uint32_t))
+       || !CONFIGINDEX_FITS(h->values_offset, h->nb_values, sizeof(ConfigIndexValue))
+       || !CONFIGINDEX_FITS(h->value_buckets_offset, h->nb_value_buckets, sizeof(uint32_t))
+       || !CONFIGINDEX_FITS(h->strings_offset, h->strings_size, 1)) {
+        return false;
+    }
+    #undef CONFIGINDEX_FITS
+    // the bucket masks need a power of two
+    if(h->nb_device_buckets == 0 || (h->nb_device_buckets & (h->nb_device_buckets - 1))
+       || h->nb_value_buckets == 0 || (h->nb_value_buckets & (h->nb_value_buckets - 1))) {
+        return false;
+    }
+    // all strings have to be terminated
+    if(h->strings_size == 0 || m_base[h->strings_offset + h->strings_size - 1] != '\0') {
+        return false;
+    }
+    return true;
+}
+
+bool
+ConfigIndex::isUpToDate(const std::vector<std::string> &paths)
+{
+    if(m_base == NULL) return false;
+    const ConfigIndexHeader *h = getHeader();
+    if(h->nb_sources != paths.size()) {
+        debugOutput(DEBUG_LEVEL_VERBOSE, "index compiled from %u files, %zd open\n",
+                    h->nb_sources, paths.size());
+        return false;
+    }
+    const ConfigIndexSource *s = (const ConfigIndexSource *)(m_base + h->sources_offset);
+    for(unsigned int i = 0; i < h->nb_sources; i++) {
+        const std::string &path = paths.at(i);
+        if(path != getString(s[i].path)) {
+            debugOutput(DEBUG_LEVEL_VERBOSE, "index compiled from %s instead of %s\n",
+                        getString(s[i].path), path.c_str());
+            return false;
+        }
+        struct stat buf;
+        if(stat(path.c_str(), &buf) != 0
+           || (uint64_t)buf.st_size != s[i].size
+           || (int64_t)buf.st_mtim.tv_sec != s[i].mtime_sec
+           || (int64_t)buf.st_mtim.tv_nsec != s[i].mtime_nsec) {
+            debugOutput(DEBUG_LEVEL_VERBOSE, "%s changed since the index was compiled\n",
+                        path.c_str());
+            return false;
+        }
+    }
+    return true;
+}
+
+const char *
+ConfigIndex::getString(uint32_t offset)
+{
+    if(m_base == NULL) return "";
+    const ConfigIndexHeader *h = getHeader();
+    if(offset >= h->strings_size) return "";
+    return m_base + h->strings_offset + offset;
+}
+
+const ConfigIndexDevice *
+ConfigIndex::findDevice(uint32_t vendor_id, uint32_t model_id)
+{
+    if(m_base == NULL) return NULL;
+    const ConfigIndexHeader *h = getHeader();
+    const ConfigIndexDevice *devices = (const ConfigIndexDevice *)(m_base + h->devices_offset);
+    const uint32_t *buckets = (const uint32_t *)(m_base + h->device_buckets_offset);
+
+    uint32_t idx = buckets[hashDevice(vendor_id, model_id) & (h->nb_device_buckets - 1)];
+    // the chain length is bounded to survive a corrupt (cyclic) index
+    for(uint32_t n = 0; idx && idx <= h->nb_devices && n < h->nb_devices; n++) {
+        const ConfigIndexDevice *d = &devices[idx - 1];
+        if(d->vendor_id == vendor_id && d->model_id == model_id) {
+            return d;
+        }
+        idx = d->next;
+    }
+    return NULL;
+}
+
+const ConfigIndexValue *
+ConfigIndex::findValue(const std::string &key)
+{
+    if(m_base == NULL) return NULL;
+    const ConfigIndexHeader *h = getHeader();
+    const ConfigIndexValue *values = (const ConfigIndexValue *)(m_base + h->values_offset);
+    const uint32_t *buckets = (const uint32_t *)(m_base + h->value_buckets_offset);
+
+    uint32_t hash = hashString(key.c_str());
+    uint32_t idx = buckets[hash & (h->nb_value_buckets - 1)];
+    for(uint32_t n = 0; idx && idx <= h->nb_values && n < h->nb_values; n++) {
+        const ConfigIndexValue *v = &values[idx - 1];
+        if(v->hash == hash && key == getString(v->key)) {
+            return v;
+        }
+        idx = v->next;
+    }
+    return NULL;
+}
+
+void
+ConfigIndex::show()
+{
+    if(m_base == NULL) {
+        debugOutput(DEBUG_LEVEL_NORMAL, "Configuration index: none\n");
+        return;
+    }
+    #ifdef DEBUG_MESSAGES
+    const ConfigIndexHeader *h = getHeader();
+    debugOutput(DEBUG_LEVEL_NORMAL, "Configuration index (%s, %u bytes):\n",
+                (m_map ? "mapped" : "compiled"), h->total_size);
+    for(unsigned int i = 0; i < h->nb_sources; i++) {
+        const ConfigIndexSource *s = (const ConfigIndexSource *)(m_base + h->sources_offset) + i;
+        debugOutput(DEBUG_LEVEL_NORMAL, " source %u: %s (%llu bytes)\n",
+                    i, getString(s->path), (unsigned long long)s->size);
+    }
+    debugOutput(DEBUG_LEVEL_NORMAL, " %u devices in %u buckets\n",
+                h->nb_devices, h->nb_device_buckets);
+    debugOutput(DEBUG_LEVEL_NORMAL, " %u settings in %u buckets\n",
+                h->nb_values, h->nb_value_buckets);
+    #endif
+}
+
+} // namespace Util
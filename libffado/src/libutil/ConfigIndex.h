@@ -0,0 +1,187 @@
+/*
+ * Copyright (C) 2005-2008 by Pieter Palmers
+ *
+ * This file is part of FFADO
+ * FFADO = Free Firewire (pro-)audio drivers for linux
+ *
+ * FFADO is based upon FreeBoB
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) version 3 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#ifndef __UTIL_CONFIG_INDEX__
+#define __UTIL_CONFIG_INDEX__
+
+#include "debugmodule/debugmodule.h"
+
+#include <string>
+#include <vector>
+#include <map>
+#include <stdint.h>
+
+#define CONFIGINDEX_MAGIC               0x46464349 // 'FFCI'
+#define CONFIGINDEX_VERSION             1
+
+namespace Util {
+
+/**
+ * @brief The layout of a configuration index file
+ *
+ * All offsets are relative to the start of the file, strings are offsets
+ * into the (NUL terminated) string table. The hash tables are arrays of
+ * entry index + 1 (0 = empty), collisions are chained through 'next'.
+ * The file is in host byte order, it is a cache and not meant to be
+ * shared between machines.
+ */
+struct ConfigIndexHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t total_size;
+    uint32_t strings_offset;
+    uint32_t strings_size;
+    uint32_t nb_sources;
+    uint32_t sources_offset;
+    uint32_t nb_devices;
+    uint32_t devices_offset;
+    uint32_t nb_device_buckets;
+    uint32_t device_buckets_offset;
+    uint32_t nb_values;
+    uint32_t values_offset;
+    uint32_t nb_value_buckets;
+    uint32_t value_buckets_offset;
+    uint32_t reserved;
+};
+
+/// a configuration file the index was compiled from
+struct ConfigIndexSource {
+    uint32_t path;
+    uint32_t reserved;
+    uint64_t size;
+    int64_t  mtime_sec;
+    int64_t  mtime_nsec;
+};
+
+/// a device_definitions entry
+struct ConfigIndexDevice {
+    uint32_t vendor_id;
+    uint32_t model_id;
+    uint32_t driver;
+    uint32_t flags;
+    uint32_t vendor_name;
+    uint32_t model_name;
+    uint32_t next;
+    uint32_t reserved;
+};
+
+/// a scalar setting
+struct ConfigIndexValue {
+    uint32_t key;
+    uint32_t type;
+    uint32_t hash;
+    uint32_t next;
+    int64_t  int_value;
+    double   float_value;
+};
+
+/**
+ * @brief A compiled, hashed index of the configuration files
+ *
+ * Holds the vendor/model table and the scalar settings of a set of
+ * configuration files, such that they can be looked up in O(1) without
+ * parsing the files. The index is built once, saved, and mapped
+ * read-only by later processes as long as the files it was compiled
+ * from didn't change (see isUpToDate()).
+ *
+ * When the same device or setting occurs more than once, the first one
+ * added is kept, hence the files have to be added in priority order.
+ */
+class ConfigIndex
+{
+public:
+    enum eValueType {
+        eVT_Int     = 1,
+        eVT_Int64   = 2,
+        eVT_Float   = 3,
+        eVT_Other   = 4, // strings, booleans, groups and lists
+    };
+    enum eDeviceFlags {
+        eDF_ValidVME = 0x01, // has the vendor/model names and the driver
+    };
+
+public:
+    ConfigIndex();
+    virtual ~ConfigIndex();
+
+    // building
+    void addSource(const std::string &path, uint64_t size, int64_t mtime_sec, int64_t mtime_nsec);
+    bool hasDevice(uint32_t vendor_id, uint32_t model_id);
+    bool addDevice(uint32_t vendor_id, uint32_t model_id, uint32_t driver,
+                   const std::string &vendor_name, const std::string &model_name,
+                   bool valid_vme);
+    bool addValue(const std::string &key, enum eValueType type,
+                  int64_t int_value, double float_value);
+    bool finalize();
+    bool save(std::string filename);
+
+    // using
+    bool load(std::string filename);
+    bool isUpToDate(const std::vector<std::string> &paths);
+
+    const ConfigIndexDevice *findDevice(uint32_t vendor_id, uint32_t model_id);
+    const ConfigIndexValue *findValue(const std::string &key);
+    const char *getString(uint32_t offset);
+
+    /// the key of a device setting in the value table
+    static std::string getDeviceKey(uint32_t vendor_id, uint32_t model_id,
+                                    const std::string &setting);
+
+    void show();
+    void setVerboseLevel(int l) {setDebugLevel(l);};
+
+private:
+    static uint32_t hashString(const char *s);
+    static uint32_t hashDevice(uint32_t vendor_id, uint32_t model_id);
+    static uint32_t nbBuckets(uint32_t nb_entries);
+
+    uint32_t addString(const std::string &s);
+    bool validate();
+    void unload();
+
+    const ConfigIndexHeader *getHeader()
+        {return (const ConfigIndexHeader *)m_base;};
+
+    // the index under construction
+    std::vector<ConfigIndexSource>  m_sources;
+    std::vector<ConfigIndexDevice>  m_devices;
+    std::vector<ConfigIndexValue>   m_values;
+    std::map<uint64_t, uint32_t>    m_device_map;
+    std::map<std::string, uint32_t> m_value_map;
+    std::string                     m_strings;
+    std::vector<char>               m_image;
+
+    // the index in use, either m_image or a mapped file
+    const char *                    m_base;
+    uint32_t                        m_size;
+    void *                          m_map;
+    size_t                          m_map_size;
+
+protected:
+    DECLARE_DEBUG_MODULE;
+};
+
+} // namespace Util
+
+#endif // __UTIL_CONFIG_INDEX__
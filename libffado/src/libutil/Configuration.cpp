@@ -21,23 +21,46 @@
  *
  */
 
+#include "config.h"
+
 #include "Configuration.h"
+#include "ConfigIndex.h"
 
 #include <stdint.h>
 #include <stdlib.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 using namespace libconfig;
 namespace Util {
 
 IMPL_DEBUG_MODULE( Configuration, Configuration, DEBUG_LEVEL_NORMAL );
 
+static std::string
+expandHome(std::string filename)
+{
+    // fix up the '~' as homedir
+    std::string::size_type pos = filename.find_first_of("~");
+    if(pos != std::string::npos) {
+        char *homedir = getenv("HOME");
+        if(homedir) {
+            std::string home = homedir;
+            filename.replace( pos, 1, home, 0, home.length());
+        }
+    }
+    return filename;
+}
+
 Configuration::Configuration()
+    : m_index( NULL )
 {
 
 }
 
 Configuration::~Configuration()
 {
+    dropIndex();
     while(m_ConfigFiles.size()) {
         delete m_ConfigFiles.back();
         m_ConfigFiles.pop_back();
@@ -57,25 +80,24 @@ Configuration::openFile(std::string filename, enum eFileMode mode)
     switch(mode) {
         case eFM_ReadOnly:
         case eFM_ReadWrite:
-            try {
-                c->readFile();
-            } catch (FileIOException& e) {
+#if CONFIGINDEX_ENABLE
+            // the file is only parsed when the index turns out to be stale
+            if(!c->exists()) {
                 debugOutput(DEBUG_LEVEL_VERBOSE, "Could not open file: %s\n", filename.c_str());
                 delete c;
                 return false;
-            } catch (ParseException& e) {
-                debugWarning("Could not parse file: %s\n", filename.c_str());
-                delete c;
-                return false;
-            } catch (...) {
-                debugWarning("Unknown exception when opening file: %s\n", filename.c_str());
+            }
+#else
+            if(!c->load()) {
                 delete c;
                 return false;
             }
+#endif
             break;
         default:
             break;
     }
+    dropIndex();
     m_ConfigFiles.push_back(c);
     return true;
 }
@@ -89,6 +111,7 @@ Configuration::closeFile(std::string filename)
         ConfigFile *c = m_ConfigFiles.at(idx);
         m_ConfigFiles.erase(m_ConfigFiles.begin()+idx);
         delete c;
+        dropIndex();
         return true;
     } else {
         debugError("file not open\n");
@@ -110,6 +133,11 @@ Configuration::saveFile(std::string name)
             debugOutput(DEBUG_LEVEL_VERBOSE, "Not saving temporary config file: %s\n", c->getName().c_str());
             break;
         case eFM_ReadWrite:
+            if(!c->isLoaded()) {
+                // never parsed, hence not modified either
+                debugOutput(DEBUG_LEVEL_VERBOSE, "Not saving unchanged config file: %s\n", c->getName().c_str());
+                break;
+            }
             debugOutput(DEBUG_LEVEL_VERBOSE, "Saving config file: %s\n", c->getName().c_str());
             try {
                 c->writeFile();
@@ -138,6 +166,10 @@ Configuration::save()
             debugOutput(DEBUG_LEVEL_VERBOSE, "Not saving temporary config file: %s\n", c->getName().c_str());
             break;
         case eFM_ReadWrite:
+            if(!c->isLoaded()) {
+                debugOutput(DEBUG_LEVEL_VERBOSE, "Not saving unchanged config file: %s\n", c->getName().c_str());
+                break;
+            }
             debugOutput(DEBUG_LEVEL_VERBOSE, "Saving config file: %s\n", c->getName().c_str());
             try {
                 c->writeFile();
@@ -231,6 +263,22 @@ Configuration::ConfigFile::showSetting(libconfig::Setting &s, std::string prefix
 bool
 Configuration::getValueForSetting(std::string path, int32_t &ref)
 {
+    ConfigIndex *index = getIndex();
+    if(index) {
+        const ConfigIndexValue *v = index->findValue(path);
+        if(v == NULL) {
+            debugOutput(DEBUG_LEVEL_VERY_VERBOSE, "path '%s' not found\n", path.c_str());
+            return false;
+        }
+        if(v->type != ConfigIndex::eVT_Int) {
+            debugWarning("path '%s' has wrong type\n", path.c_str());
+            return false;
+        }
+        ref = (int32_t)v->int_value;
+        debugOutput(DEBUG_LEVEL_VERY_VERBOSE, "path '%s' has value %d\n", path.c_str(), ref);
+        return true;
+    }
+
     libconfig::Setting *s = getSetting( path );
     if(s) {
         // FIXME: this can be done using the libconfig methods
@@ -252,6 +300,22 @@ Configuration::getValueForSetting(std::string path, int32_t &ref)
 bool
 Configuration::getValueForSetting(std::string path, int64_t &ref)
 {
+    ConfigIndex *index = getIndex();
+    if(index) {
+        const ConfigIndexValue *v = index->findValue(path);
+        if(v == NULL) {
+            debugOutput(DEBUG_LEVEL_VERY_VERBOSE, "path '%s' not found\n", path.c_str());
+            return false;
+        }
+        if(v->type != ConfigIndex::eVT_Int64) {
+            debugWarning("path '%s' has wrong type\n", path.c_str());
+            return false;
+        }
+        ref = v->int_value;
+        debugOutput(DEBUG_LEVEL_VERY_VERBOSE, "path '%s' has value %"PRId64"\n", path.c_str(), ref);
+        return true;
+    }
+
     libconfig::Setting *s = getSetting( path );
     if(s) {
         // FIXME: this can be done using the libconfig methods
@@ -273,6 +337,22 @@ Configuration::getValueForSetting(std::string path, int64_t &ref)
 bool
 Configuration::getValueForSetting(std::string path, float &ref)
 {
+    ConfigIndex *index = getIndex();
+    if(index) {
+        const ConfigIndexValue *v = index->findValue(path);
+        if(v == NULL) {
+            debugOutput(DEBUG_LEVEL_VERY_VERBOSE, "path '%s' not found\n", path.c_str());
+            return false;
+        }
+        if(v->type != ConfigIndex::eVT_Float) {
+            debugWarning("path '%s' has wrong type\n", path.c_str());
+            return false;
+        }
+        ref = (float)v->float_value;
+        debugOutput(DEBUG_LEVEL_VERY_VERBOSE, "path '%s' has value %f\n", path.c_str(), ref);
+        return true;
+    }
+
     libconfig::Setting *s = getSetting( path );
     if(s) {
         // FIXME: this can be done using the libconfig methods
@@ -294,6 +374,7 @@ Configuration::getValueForSetting(std::string path, float &ref)
 libconfig::Setting *
 Configuration::getSetting( std::string path )
 {
+    loadFiles();
     for ( std::vector<ConfigFile *>::iterator it = m_ConfigFiles.begin();
       it != m_ConfigFiles.end();
       ++it )
@@ -313,6 +394,25 @@ Configuration::getSetting( std::string path )
 bool
 Configuration::getValueForDeviceSetting(unsigned int vendor_id, unsigned model_id, std::string setting, int32_t &ref)
 {
+    ConfigIndex *index = getIndex();
+    if(index) {
+        if(index->findDevice(vendor_id, model_id) == NULL) {
+            debugOutput(DEBUG_LEVEL_VERBOSE, "device %X/%X not found\n", vendor_id, model_id);
+            return false;
+        }
+        const ConfigIndexValue *v =
+            index->findValue(ConfigIndex::getDeviceKey(vendor_id, model_id, setting));
+        if(v == NULL) {
+            debugOutput(DEBUG_LEVEL_VERBOSE, "Setting %s not found\n", setting.c_str());
+            return false;
+        }
+        if(v->type != ConfigIndex::eVT_Int) {
+            return false;
+        }
+        ref = (int32_t)v->int_value;
+        return true;
+    }
+
     libconfig::Setting *s = getDeviceSetting( vendor_id, model_id );
     if(s) {
         try {
@@ -330,11 +430,34 @@ Configuration::getValueForDeviceSetting(unsigned int vendor_id, unsigned model_i
 bool
 Configuration::getValueForDeviceSetting(unsigned int vendor_id, unsigned model_id, std::string setting, int64_t &ref)
 {
+    ConfigIndex *index = getIndex();
+    if(index) {
+        if(index->findDevice(vendor_id, model_id) == NULL) {
+            debugOutput(DEBUG_LEVEL_VERBOSE, "device %X/%X not found\n", vendor_id, model_id);
+            return false;
+        }
+        const ConfigIndexValue *v =
+            index->findValue(ConfigIndex::getDeviceKey(vendor_id, model_id, setting));
+        if(v == NULL) {
+            debugOutput(DEBUG_LEVEL_VERBOSE, "Setting %s not found\n", setting.c_str());
+            return false;
+        }
+        if(v->type != ConfigIndex::eVT_Int && v->type != ConfigIndex::eVT_Int64) {
+            return false;
+        }
+        ref = v->int_value;
+        return true;
+    }
+
     libconfig::Setting *s = getDeviceSetting( vendor_id, model_id );
     if(s) {
         try {
             long long int refverylong = ref;
-            return s->lookupValue(setting, refverylong);
+            if(s->lookupValue(setting, refverylong)) {
+                ref = refverylong;
+                return true;
+            }
+            return false;
         } catch (...) {
             debugOutput(DEBUG_LEVEL_VERBOSE, "Setting %s not found\n", setting.c_str());
             return false;
@@ -348,6 +471,25 @@ Configuration::getValueForDeviceSetting(unsigned int vendor_id, unsigned model_i
 bool
 Configuration::getValueForDeviceSetting(unsigned int vendor_id, unsigned model_id, std::string setting, float &ref)
 {
+    ConfigIndex *index = getIndex();
+    if(index) {
+        if(index->findDevice(vendor_id, model_id) == NULL) {
+            debugOutput(DEBUG_LEVEL_VERBOSE, "device %X/%X not found\n", vendor_id, model_id);
+            return false;
+        }
+        const ConfigIndexValue *v =
+            index->findValue(ConfigIndex::getDeviceKey(vendor_id, model_id, setting));
+        if(v == NULL) {
+            debugOutput(DEBUG_LEVEL_VERBOSE, "Setting %s not found\n", setting.c_str());
+            return false;
+        }
+        if(v->type != ConfigIndex::eVT_Float) {
+            return false;
+        }
+        ref = (float)v->float_value;
+        return true;
+    }
+
     libconfig::Setting *s = getDeviceSetting( vendor_id, model_id );
     if(s) {
         try {
@@ -365,6 +507,7 @@ Configuration::getValueForDeviceSetting(unsigned int vendor_id, unsigned model_i
 libconfig::Setting *
 Configuration::getDeviceSetting( unsigned int vendor_id, unsigned model_id )
 {
+    loadFiles();
     for ( std::vector<ConfigFile *>::iterator it = m_ConfigFiles.begin();
       it != m_ConfigFiles.end();
       ++it )
@@ -403,6 +546,24 @@ Configuration::getDeviceSetting( unsigned int vendor_id, unsigned model_id )
 Configuration::VendorModelEntry
 Configuration::findDeviceVME( unsigned int vendor_id, unsigned model_id )
 {
+    ConfigIndex *index = getIndex();
+    if(index) {
+        const ConfigIndexDevice *d = index->findDevice(vendor_id, model_id);
+        if(d) {
+            if(d->flags & ConfigIndex::eDF_ValidVME) {
+                struct VendorModelEntry vme;
+                vme.vendor_id = d->vendor_id;
+                vme.model_id = d->model_id;
+                vme.vendor_name = index->getString(d->vendor_name);
+                vme.model_name = index->getString(d->model_name);
+                vme.driver = d->driver;
+                return vme;
+            }
+            debugWarning("Bogus format\n");
+        }
+        struct VendorModelEntry invalid;
+        return invalid;
+    }
 
     // FIXME: clean this pointer/reference mess please
     Setting *ps = getDeviceSetting(vendor_id, model_id);
@@ -470,10 +631,14 @@ void
 Configuration::show()
 {
     debugOutput(DEBUG_LEVEL_NORMAL, "Configuration:\n");
+    loadFiles();
     for (unsigned int idx = 0; idx < m_ConfigFiles.size(); idx++) {
         ConfigFile *c = m_ConfigFiles.at(idx);
         c->show();
     }
+    if(m_index) {
+        m_index->show();
+    }
 }
 
 int
@@ -517,35 +682,231 @@ Configuration::convertDriver(const std::string& driver) const {
 }
 
 void
-Configuration::ConfigFile::readFile()
+Configuration::loadFiles()
 {
-    std::string filename = m_name;
-    // fix up the '~' as homedir
-    std::string::size_type pos = filename.find_first_of("~");
-    if(pos != std::string::npos) {
-        char *homedir = getenv("HOME");
-        if(homedir) {
-            std::string home = homedir;
-            filename.replace( pos, 1, home, 0, home.length());
+    for (unsigned int idx = 0; idx < m_ConfigFiles.size(); ) {
+        ConfigFile *c = m_ConfigFiles.at(idx);
+        if(c->load()) {
+            idx++;
+            continue;
         }
+        // a file that can't be parsed is not used, as if it
+        // could not be opened
+        m_ConfigFiles.erase(m_ConfigFiles.begin()+idx);
+        delete c;
+        dropIndex();
     }
-    Config::readFile(filename.c_str());
 }
 
 void
-Configuration::ConfigFile::writeFile()
+Configuration::dropIndex()
 {
-    std::string filename = m_name;
-    // fix up the '~' as homedir
-    std::string::size_type pos = filename.find_first_of("~");
-    if(pos != std::string::npos) {
-        char *homedir = getenv("HOME");
-        if(homedir) {
-            std::string home = homedir;
-            filename.replace( pos, 1, home, 0, home.length());
+    delete m_index;
+    m_index = NULL;
+}
+
+ConfigIndex *
+Configuration::getIndex()
+{
+#if CONFIGINDEX_ENABLE
+    if(m_index) return m_index;
+
+    std::vector<std::string> paths;
+    for (unsigned int idx = 0; idx < m_ConfigFiles.size(); idx++) {
+        ConfigFile *c = m_ConfigFiles.at(idx);
+        if(c->getMode() == eFM_Temporary) continue;
+        paths.push_back(c->getPath());
+    }
+
+    std::string filename = expandHome(CONFIGINDEX_FILE);
+    ConfigIndex *index = new ConfigIndex();
+    index->setVerboseLevel(getDebugLevel());
+    if(index->load(filename) && index->isUpToDate(paths)) {
+        debugOutput(DEBUG_LEVEL_VERBOSE, "Using configuration index %s\n", filename.c_str());
+        m_index = index;
+        return m_index;
+    }
+
+    debugOutput(DEBUG_LEVEL_VERBOSE, "Compiling configuration index\n");
+    if(!compileIndex(*index)) {
+        debugWarning("Could not compile the configuration index\n");
+        delete index;
+        return NULL;
+    }
+    // the compiled index is used regardless, saving it only
+    // spares the next process the parsing
+    if(!index->save(filename)) {
+        debugOutput(DEBUG_LEVEL_VERBOSE, "Could not save configuration index to %s\n",
+                    filename.c_str());
+    }
+    m_index = index;
+    return m_index;
+#else
+    return NULL;
+#endif
+}
+
+bool
+Configuration::compileIndex(ConfigIndex &index)
+{
+    loadFiles();
+    for ( std::vector<ConfigFile *>::iterator it = m_ConfigFiles.begin();
+      it != m_ConfigFiles.end();
+      ++it )
+    {
+        ConfigFile *c = *it;
+        // temporary files have no backing file to check against,
+        // they are empty anyway
+        if(c->getMode() == eFM_Temporary) continue;
+        index.addSource(c->getPath(), c->getSize(), c->getMTimeSec(), c->getMTimeNSec());
+        Setting &root = c->getRoot();
+        unsigned int children = root.getLength();
+        for(unsigned int i = 0; i < children; i++) {
+            indexSettings(index, root[i], "");
+        }
+        indexDevices(index, *c);
+    }
+    return index.finalize();
+}
+
+void
+Configuration::indexSettings(ConfigIndex &index, Setting &s, std::string key)
+{
+    key += s.getName();
+    switch(s.getType()) {
+    case Setting::TypeGroup:
+        {
+            index.addValue(key, ConfigIndex::eVT_Other, 0, 0.0);
+            unsigned int children = s.getLength();
+            for(unsigned int i = 0; i < children; i++) {
+                indexSettings(index, s[i], key + ".");
+            }
+        }
+        break;
+    case Setting::TypeInt:
+        {
+            int32_t i = s;
+            index.addValue(key, ConfigIndex::eVT_Int, i, 0.0);
+        }
+        break;
+    case Setting::TypeInt64:
+        {
+            int64_t i = s;
+            index.addValue(key, ConfigIndex::eVT_Int64, i, 0.0);
         }
+        break;
+    case Setting::TypeFloat:
+        {
+            double f = s;
+            index.addValue(key, ConfigIndex::eVT_Float, 0, f);
+        }
+        break;
+    default:
+        // can be found, but not retrieved through the value accessors
+        index.addValue(key, ConfigIndex::eVT_Other, 0, 0.0);
+        break;
+    }
+}
+
+void
+Configuration::indexDevices(ConfigIndex &index, ConfigFile &c)
+{
+    Setting *list;
+    try {
+        list = &c.lookup("device_definitions");
+    } catch (...) {
+        debugOutput(DEBUG_LEVEL_VERBOSE, "  %s has no device definitions\n", c.getName().c_str());
+        return;
+    }
+    unsigned int children = list->getLength();
+    for(unsigned int i = 0; i < children; i++) {
+        Setting &s = (*list)[i];
+        uint32_t vid, mid;
+        try {
+            Setting &vendorid = s["vendorid"];
+            Setting &modelid = s["modelid"];
+            vid = vendorid;
+            mid = modelid;
+        } catch (...) {
+            debugWarning("Bogus format\n");
+            continue;
+        }
+        // the first definition of a device is the one that is used
+        if(index.hasDevice(vid, mid)) continue;
+
+        bool valid = true;
+        std::string vendor_name;
+        std::string model_name;
+        unsigned int driver = eD_Unknown;
+        try {
+            const char *tmp = s["vendorname"];
+            vendor_name = tmp;
+            tmp = s["modelname"];
+            model_name = tmp;
+            if (!s.lookupValue("driver", driver))
+            {
+                std::string drv = s["driver"];
+                driver = convertDriver(drv);
+            }
+        } catch (...) {
+            valid = false;
+        }
+        index.addDevice(vid, mid, driver, vendor_name, model_name, valid);
+
+        unsigned int settings = s.getLength();
+        for(unsigned int j = 0; j < settings; j++) {
+            indexSettings(index, s[j], ConfigIndex::getDeviceKey(vid, mid, ""));
+        }
+    }
+}
+
+std::string
+Configuration::ConfigFile::getPath()
+{
+    return expandHome(m_name);
+}
+
+bool
+Configuration::ConfigFile::exists()
+{
+    struct stat buf;
+    return stat(getPath().c_str(), &buf) == 0;
+}
+
+bool
+Configuration::ConfigFile::load()
+{
+    if(m_loaded) return true;
+    std::string filename = getPath();
+
+    // stamp the file before parsing, such that a change while
+    // parsing makes the index stale
+    struct stat buf;
+    if(stat(filename.c_str(), &buf) == 0) {
+        m_size = buf.st_size;
+        m_mtime_sec = buf.st_mtim.tv_sec;
+        m_mtime_nsec = buf.st_mtim.tv_nsec;
+    }
+    try {
+        Config::readFile(filename.c_str());
+    } catch (FileIOException& e) {
+        debugOutput(DEBUG_LEVEL_VERBOSE, "Could not open file: %s\n", m_name.c_str());
+        return false;
+    } catch (ParseException& e) {
+        debugWarning("Could not parse file: %s\n", m_name.c_str());
+        return false;
+    } catch (...) {
+        debugWarning("Unknown exception when opening file: %s\n", m_name.c_str());
+        return false;
     }
-    Config::writeFile(filename.c_str());
+    m_loaded = true;
+    return true;
+}
+
+void
+Configuration::ConfigFile::writeFile()
+{
+    Config::writeFile(getPath().c_str());
 }
 
 Configuration::VendorModelEntry::VendorModelEntry()
@@ -28,13 +28,21 @@
 #include "libconfig.h++"
 
 #include <vector>
+#include <stdint.h>
 
 namespace Util {
+
+class ConfigIndex;
+
 /**
  * A class that manages several configuration files
  * the idea is that you can have a system config file
  * and then a user-defined config file
  *
+ * The files are only parsed when needed: the device table and the
+ * settings are looked up in a compiled index (see ConfigIndex) that is
+ * rebuilt when one of the files changed.
+ *
  * note: not thread safe!
  */
 
@@ -88,20 +96,35 @@ private:
         , m_parent(c)
         , m_name( n )
         , m_mode( mode )
+        , m_loaded( mode == eFM_Temporary )
+        , m_size( 0 )
+        , m_mtime_sec( 0 )
+        , m_mtime_nsec( 0 )
         , m_debugModule(c.m_debugModule)
         {};
         ~ConfigFile() {};
-        void readFile();
+        bool exists();
+        bool load();
         void writeFile();
         void show();
         void showSetting(libconfig::Setting &, std::string prefix = "");
 
         std::string getName() {return m_name;};
+        std::string getPath();
         enum eFileMode getMode() {return m_mode;};
+        bool isLoaded() {return m_loaded;};
+        uint64_t getSize() {return m_size;};
+        int64_t getMTimeSec() {return m_mtime_sec;};
+        int64_t getMTimeNSec() {return m_mtime_nsec;};
     private:
         Configuration &m_parent;
         std::string    m_name;
         enum eFileMode m_mode;
+        bool           m_loaded;
+        // the stamp of the file as it was parsed
+        uint64_t       m_size;
+        int64_t        m_mtime_sec;
+        int64_t        m_mtime_nsec;
     private:
         DECLARE_DEBUG_MODULE_REFERENCE;
     };
@@ -160,12 +183,21 @@ private:
     int findFileName(std::string s);
 
     unsigned int convertDriver(const std::string & driver) const;
+
+    void loadFiles();
+    ConfigIndex *getIndex();
+    void dropIndex();
+    bool compileIndex(ConfigIndex &index);
+    void indexSettings(ConfigIndex &index, libconfig::Setting &s, std::string key);
+    void indexDevices(ConfigIndex &index, ConfigFile &c);
     
     // important: keep 1-1 mapping for these two!
     // cannot use map since we need the vector order to
     // provide priorities
     std::vector<ConfigFile *> m_ConfigFiles;
 
+    ConfigIndex *m_index;
+
     DECLARE_DEBUG_MODULE;
 };
 
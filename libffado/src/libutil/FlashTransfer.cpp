@@ -0,0 +1,305 @@
+/*
+ * Copyright (C) 2005-2008 by Pieter Palmers
+ *
+ * This file is part of FFADO
+ * FFADO = Free Firewire (pro-)audio drivers for linux
+ *
+ * FFADO is based upon FreeBoB
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) version 3 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "config.h"
+
+#include "FlashTransfer.h"
+#include "SystemTimeSource.h"
+
+#include <string.h>
+#include <unistd.h>
+
+namespace Util {
+
+IMPL_DEBUG_MODULE( FlashTransfer, FlashTransfer, DEBUG_LEVEL_NORMAL );
+
+FlashTransfer::FlashTransfer(FlashTarget &target)
+: m_target( target )
+, m_skip_unchanged( true )
+, m_verify( true )
+{
+    resetStatistics();
+}
+
+void
+FlashTransfer::resetStatistics()
+{
+    m_blocks_written = 0;
+    m_blocks_skipped = 0;
+    m_blocks_erased = 0;
+    m_quads_read = 0;
+    m_quads_written = 0;
+    m_nb_polls = 0;
+    m_usecs = 0;
+}
+
+void
+FlashTransfer::showStatistics()
+{
+    debugOutput(DEBUG_LEVEL_NORMAL, "Flash transfer statistics\n");
+    debugOutput(DEBUG_LEVEL_NORMAL, " blocks written : %u\n", m_blocks_written);
+    debugOutput(DEBUG_LEVEL_NORMAL, " blocks skipped : %u\n", m_blocks_skipped);
+    debugOutput(DEBUG_LEVEL_NORMAL, " blocks erased  : %u\n", m_blocks_erased);
+    debugOutput(DEBUG_LEVEL_NORMAL, " quadlets read  : %u\n", m_quads_read);
+    debugOutput(DEBUG_LEVEL_NORMAL, " quadlets written: %u\n", m_quads_written);
+    debugOutput(DEBUG_LEVEL_NORMAL, " status polls   : %u\n", m_nb_polls);
+    debugOutput(DEBUG_LEVEL_NORMAL, " time           : %"PRIu64" msec\n", m_usecs / 1000);
+}
+
+/**
+ * @brief CRC-32 (IEEE 802.3) over a quadlet buffer
+ */
+uint32_t
+FlashTransfer::crc32(const uint32_t *buffer, unsigned int nb_quads, uint32_t crc)
+{
+    static uint32_t table[256];
+    static bool table_valid = false;
+    if(!table_valid) {
+        for(uint32_t i = 0; i < 256; i++) {
+            uint32_t c = i;
+            for(int k = 0; k < 8; k++) {
+                c = (c & 1) ? (0xEDB88320 ^ (c >> 1)) : (c >> 1);
+            }
+            table[i] = c;
+        }
+        table_valid = true;
+    }
+
+    const uint8_t *p = (const uint8_t *)buffer;
+    crc = ~crc;
+    for(unsigned int i = 0; i < nb_quads * 4; i++) {
+        crc = table[(crc ^ p[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+bool
+FlashTransfer::waitForCompletion(FlashStatusSource &src, unsigned int timeout_msecs,
+                                 unsigned int *nb_polls)
+{
+    ffado_microsecs_t start = SystemTimeSource::getCurrentTimeAsUsecs();
+    ffado_microsecs_t timeout = (ffado_microsecs_t)timeout_msecs * 1000;
+    unsigned int interval = FLASHTRANSFER_POLL_MIN_USECS;
+
+    while(true) {
+        usleep(interval);
+        if(nb_polls) (*nb_polls)++;
+
+        switch(src.getFlashStatus()) {
+            case FlashStatusSource::eFS_Ready:
+                return true;
+            case FlashStatusSource::eFS_Error:
+                return false;
+            default:
+                break;
+        }
+        if(SystemTimeSource::getCurrentTimeAsUsecs() - start > timeout) {
+            return false;
+        }
+        interval *= 2;
+        if(interval > FLASHTRANSFER_POLL_MAX_USECS) {
+            interval = FLASHTRANSFER_POLL_MAX_USECS;
+        }
+    }
+}
+
+bool
+FlashTransfer::read(uint64_t addr, uint32_t *buffer, unsigned int nb_quads)
+{
+    unsigned int max_quads = m_target.getMaxReadQuads();
+    while(nb_quads) {
+        unsigned int xfer_quads = (nb_quads > max_quads ? max_quads : nb_quads);
+        if(!m_target.readFlashBlock(addr, buffer, xfer_quads)) {
+            debugError("Flash read failed at 0x%012"PRIX64" (%u quadlets)\n", addr, xfer_quads);
+            return false;
+        }
+        m_quads_read += xfer_quads;
+        nb_quads -= xfer_quads;
+        buffer += xfer_quads;
+        addr += xfer_quads * 4;
+    }
+    return true;
+}
+
+bool
+FlashTransfer::writeBlocks(uint64_t addr, uint32_t *buffer, unsigned int nb_quads)
+{
+    unsigned int max_quads = m_target.getMaxWriteQuads();
+    while(nb_quads) {
+        unsigned int xfer_quads = (nb_quads > max_quads ? max_quads : nb_quads);
+        if(!m_target.writeFlashBlock(addr, buffer, xfer_quads)) {
+            debugError("Flash write failed at 0x%012"PRIX64" (%u quadlets)\n", addr, xfer_quads);
+            return false;
+        }
+        if(m_target.pollAfterWrite()
+           && !waitForCompletion(m_target, m_target.getWriteTimeoutMsecs(), &m_nb_polls)) {
+            debugError("Flash write did not complete at 0x%012"PRIX64"\n", addr);
+            return false;
+        }
+        m_quads_written += xfer_quads;
+        nb_quads -= xfer_quads;
+        buffer += xfer_quads;
+        addr += xfer_quads * 4;
+    }
+    return true;
+}
+
+/**
+ * @brief write one erase block (or part of it)
+ *
+ * addr/nb_quads should not cross an erase block boundary. When only
+ * part of the erase block is written, the rest of it is preserved.
+ */
+bool
+FlashTransfer::writeEraseBlock(uint64_t addr, uint32_t *buffer, unsigned int nb_quads)
+{
+    unsigned int block_quads = m_target.getEraseBlockQuads(addr);
+    uint64_t block_addr = addr;
+    unsigned int offset = 0;
+    if(block_quads) {
+        block_addr = addr & ~((uint64_t)block_quads * 4 - 1);
+        offset = (addr - block_addr) / 4;
+    } else {
+        block_quads = nb_quads;
+    }
+    bool partial = (offset != 0 || nb_quads != block_quads);
+
+    uint32_t *data = buffer;
+    uint32_t *current = NULL;
+    uint32_t *merged = NULL;
+    bool result = false;
+
+    if(m_skip_unchanged || partial) {
+        current = new uint32_t[block_quads];
+        if(!read(block_addr, current, block_quads)) goto out;
+
+        if(m_skip_unchanged
+           && crc32(current + offset, nb_quads) == crc32(buffer, nb_quads)
+           && memcmp(current + offset, buffer, nb_quads * 4) == 0) {
+            debugOutput(DEBUG_LEVEL_VERBOSE, "block 0x%012"PRIX64" unchanged, skipping\n", block_addr);
+            m_blocks_skipped++;
+            result = true;
+            goto out;
+        }
+        if(partial) {
+            merged = new uint32_t[block_quads];
+            memcpy(merged, current, block_quads * 4);
+            memcpy(merged + offset, buffer, nb_quads * 4);
+            data = merged;
+        }
+    }
+
+    if(m_target.getEraseBlockQuads(block_addr)) {
+        // no need to erase a block that is already blank
+        bool blank = false;
+        if(current) {
+            blank = true;
+            for(unsigned int i = 0; i < block_quads; i++) {
+                if(current[i] != 0xFFFFFFFF) {
+                    blank = false;
+                    break;
+                }
+            }
+        }
+        if(!blank) {
+            if(!m_target.eraseFlashBlock(block_addr)) {
+                debugError("Could not erase flash block at 0x%012"PRIX64"\n", block_addr);
+                goto out;
+            }
+            if(!waitForCompletion(m_target, m_target.getEraseTimeoutMsecs(), &m_nb_polls)) {
+                debugError("Erase did not complete at 0x%012"PRIX64"\n", block_addr);
+                goto out;
+            }
+            m_blocks_erased++;
+        }
+    }
+
+    if(!writeBlocks(block_addr, data, block_quads)) goto out;
+    m_blocks_written++;
+
+    if(m_verify) {
+        // reuse the read buffer, its contents are no longer needed
+        if(current == NULL) current = new uint32_t[block_quads];
+        if(!read(block_addr, current, block_quads)) goto out;
+        if(crc32(current, block_quads) != crc32(data, block_quads)) {
+            debugError("Verify failed for block 0x%012"PRIX64"\n", block_addr);
+            goto out;
+        }
+    }
+    result = true;
+
+out:
+    delete[] current;
+    delete[] merged;
+    return result;
+}
+
+/**
+ * @brief write a buffer to the flash
+ *
+ * Erases the affected erase blocks if the target requires so. The parts
+ * of erase blocks that are not covered by the buffer are preserved.
+ *
+ * @param addr start address (bytes, quadlet aligned)
+ * @param buffer data to write
+ * @param nb_quads length of the buffer in quadlets
+ * @return true if successful
+ */
+bool
+FlashTransfer::write(uint64_t addr, uint32_t *buffer, unsigned int nb_quads)
+{
+    if(addr & 0x03) {
+        debugError("start address not quadlet aligned: 0x%012"PRIX64"\n", addr);
+        return false;
+    }
+    ffado_microsecs_t start = SystemTimeSource::getCurrentTimeAsUsecs();
+
+    while(nb_quads) {
+        // the unit of work is an erase block, or the largest write
+        // if the flash doesn't need erasing
+        unsigned int unit_quads = m_target.getEraseBlockQuads(addr);
+        unsigned int xfer_quads;
+        if(unit_quads) {
+            uint64_t block_addr = addr & ~((uint64_t)unit_quads * 4 - 1);
+            xfer_quads = unit_quads - (addr - block_addr) / 4;
+        } else {
+            xfer_quads = m_target.getMaxWriteQuads();
+        }
+        if(xfer_quads > nb_quads) xfer_quads = nb_quads;
+
+        if(!writeEraseBlock(addr, buffer, xfer_quads)) {
+            m_usecs += SystemTimeSource::getCurrentTimeAsUsecs() - start;
+            return false;
+        }
+        nb_quads -= xfer_quads;
+        buffer += xfer_quads;
+        addr += xfer_quads * 4;
+    }
+
+    m_usecs += SystemTimeSource::getCurrentTimeAsUsecs() - start;
+    debugOutput(DEBUG_LEVEL_VERBOSE, "wrote %u blocks, skipped %u unchanged, %u status polls\n",
+                m_blocks_written, m_blocks_skipped, m_nb_polls);
+    return true;
+}
+
+} // namespace Util
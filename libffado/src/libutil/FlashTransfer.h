@@ -0,0 +1,152 @@
+/*
+ * Copyright (C) 2005-2008 by Pieter Palmers
+ *
+ * This file is part of FFADO
+ * FFADO = Free Firewire (pro-)audio drivers for linux
+ *
+ * FFADO is based upon FreeBoB
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) version 3 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef __UTIL_FLASH_TRANSFER__
+#define __UTIL_FLASH_TRANSFER__
+
+#include "debugmodule/debugmodule.h"
+
+#include <stdint.h>
+
+namespace Util {
+
+/**
+ * @brief Something that can report whether a (flash) operation completed
+ */
+class FlashStatusSource
+{
+public:
+    enum eFlashStatus {
+        eFS_Ready,
+        eFS_Busy,
+        eFS_Error,
+    };
+
+    virtual ~FlashStatusSource() {};
+    virtual eFlashStatus getFlashStatus() = 0;
+};
+
+/**
+ * @brief The device side of a flash transfer
+ *
+ * Implemented by the device specific code, used by FlashTransfer.
+ * Addresses are byte addresses, lengths are in quadlets.
+ */
+class FlashTarget : public FlashStatusSource
+{
+public:
+    virtual ~FlashTarget() {};
+
+    /// the largest read a single transaction supports
+    virtual unsigned int getMaxReadQuads() = 0;
+    /// the largest write a single transaction supports
+    virtual unsigned int getMaxWriteQuads() = 0;
+    /**
+     * @brief the size of the erase block containing addr
+     * @return the erase block size in quadlets, 0 if the flash
+     *         doesn't have to be erased before writing
+     */
+    virtual unsigned int getEraseBlockQuads(uint64_t addr) {return 0;};
+
+    virtual bool readFlashBlock(uint64_t addr, uint32_t *buffer, unsigned int nb_quads) = 0;
+    virtual bool writeFlashBlock(uint64_t addr, uint32_t *buffer, unsigned int nb_quads) = 0;
+    virtual bool eraseFlashBlock(uint64_t addr) {return false;};
+
+    /// true if the device has to be polled for completion after a write
+    virtual bool pollAfterWrite() {return true;};
+    /// the time the transfer engine waits for a write to complete
+    virtual unsigned int getWriteTimeoutMsecs() {return 1000;};
+    /// the time the transfer engine waits for an erase to complete
+    virtual unsigned int getEraseTimeoutMsecs() {return 10000;};
+};
+
+/**
+ * @brief Block transfer engine for flash and firmware updates
+ *
+ * Transfers are split in the largest blocks the target supports. Writes
+ * are done per erase block: the current contents are read first and
+ * the block is skipped when its CRC matches that of the new data.
+ * Changed blocks are erased, written and verified before moving on to the
+ * next block, such that unchanged blocks are only read once. All waits
+ * are done by polling the status of the target with an increasing
+ * interval instead of sleeping for a fixed time.
+ */
+class FlashTransfer
+{
+public:
+    FlashTransfer(FlashTarget &target);
+    virtual ~FlashTransfer() {};
+
+    bool read(uint64_t addr, uint32_t *buffer, unsigned int nb_quads);
+    bool write(uint64_t addr, uint32_t *buffer, unsigned int nb_quads);
+
+    /// skip blocks that already contain the data to be written (default: on)
+    void setSkipUnchanged(bool b) {m_skip_unchanged = b;};
+    /// read back and compare each written block (default: on)
+    void setVerify(bool b) {m_verify = b;};
+
+    void resetStatistics();
+    void showStatistics();
+
+    void setVerboseLevel(int l) {setDebugLevel(l);};
+
+    /**
+     * @brief wait until the source reports completion
+     *
+     * Polls the status, starting with an interval of FLASHTRANSFER_POLL_MIN_USECS
+     * that doubles after every busy status until FLASHTRANSFER_POLL_MAX_USECS.
+     *
+     * @param src the status source
+     * @param timeout_msecs time after which the wait is aborted
+     * @param nb_polls if not NULL, incremented with the number of status polls
+     * @return true if the source reported ready, false on error or timeout
+     */
+    static bool waitForCompletion(FlashStatusSource &src, unsigned int timeout_msecs,
+                                  unsigned int *nb_polls = NULL);
+
+    static uint32_t crc32(const uint32_t *buffer, unsigned int nb_quads, uint32_t crc = 0);
+
+private:
+    bool writeEraseBlock(uint64_t addr, uint32_t *buffer, unsigned int nb_quads);
+    bool writeBlocks(uint64_t addr, uint32_t *buffer, unsigned int nb_quads);
+
+    FlashTarget&    m_target;
+    bool            m_skip_unchanged;
+    bool            m_verify;
+
+    // statistics
+    unsigned int    m_blocks_written;
+    unsigned int    m_blocks_skipped;
+    unsigned int    m_blocks_erased;
+    unsigned int    m_quads_read;
+    unsigned int    m_quads_written;
+    unsigned int    m_nb_polls;
+    uint64_t        m_usecs;
+
+protected:
+    DECLARE_DEBUG_MODULE;
+};
+
+} // namespace Util
+
+#endif // __UTIL_FLASH_TRANSFER__
@@ -0,0 +1,255 @@
+/*
+ * Copyright (C) 2005-2008 by Pieter Palmers
+ *
+ * This file is part of FFADO
+ * FFADO = Free Firewire (pro-)audio drivers for linux
+ *
+ * FFADO is based upon FreeBoB
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) version 3 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "config.h"
+
+#include "FlightRecorder.h"
+#include "PosixThread.h"
+#include "SystemTimeSource.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+namespace Util {
+
+IMPL_DEBUG_MODULE( FlightRecorder, FlightRecorder, DEBUG_LEVEL_NORMAL );
+
+FlightRecorder::FlightRecorder(std::string name, unsigned int nb_records)
+: m_name( name )
+, m_nb_records( 0 )
+, m_mask( 0 )
+, m_records( NULL )
+, m_write_idx( 0 )
+, m_frozen( 0 )
+, m_dump_count( 0 )
+, m_snapshot( NULL )
+, m_snapshot_nb_records( 0 )
+, m_snapshot_time( 0 )
+, m_snapshot_pending( 0 )
+, m_writer( NULL )
+{
+    sem_init(&m_snapshot_sem, 0, 0);
+    memset(m_snapshot_reason, 0, sizeof(m_snapshot_reason));
+    // round down to a power of two
+    m_nb_records = 1;
+    while(m_nb_records * 2 <= nb_records) {
+        m_nb_records *= 2;
+    }
+    m_mask = m_nb_records - 1;
+}
+
+FlightRecorder::~FlightRecorder()
+{
+    if(m_writer) {
+        m_writer->Stop();
+        delete m_writer;
+    }
+    // a dump that was not written yet
+    if(m_snapshot_pending) {
+        writeSnapshot();
+    }
+    if(m_records) {
+        munlock(m_records, m_nb_records * sizeof(FlightRecord));
+        delete[] m_records;
+    }
+    if(m_snapshot) {
+        munlock(m_snapshot, m_nb_records * sizeof(FlightRecord));
+        delete[] m_snapshot;
+    }
+    sem_destroy(&m_snapshot_sem);
+}
+
+bool
+FlightRecorder::init()
+{
+    if(m_records) {
+        debugOutput(DEBUG_LEVEL_VERBOSE, "(%p, %s) already initialized\n", this, m_name.c_str());
+        return true;
+    }
+    m_records = new FlightRecord[m_nb_records];
+    if(m_records == NULL) {
+        debugError("(%p, %s) could not allocate %u records\n", this, m_name.c_str(), m_nb_records);
+        return false;
+    }
+    m_snapshot = new FlightRecord[m_nb_records];
+    // touch all pages such that the RT path doesn't page fault
+    memset(m_records, 0, m_nb_records * sizeof(FlightRecord));
+    memset(m_snapshot, 0, m_nb_records * sizeof(FlightRecord));
+    if(mlock(m_records, m_nb_records * sizeof(FlightRecord))
+       || mlock(m_snapshot, m_nb_records * sizeof(FlightRecord))) {
+        debugOutput(DEBUG_LEVEL_VERBOSE, "(%p, %s) could not mlock records: %s\n",
+                    this, m_name.c_str(), strerror(errno));
+    }
+    m_write_idx = 0;
+    m_frozen = 0;
+
+    m_writer = new Util::PosixThread(this, "FLIGHTREC", false, 0, PTHREAD_CANCEL_DEFERRED);
+    if(m_writer->Start() != 0) {
+        debugError("(%p, %s) could not start the writer thread\n", this, m_name.c_str());
+        delete m_writer;
+        m_writer = NULL;
+        return false;
+    }
+    debugOutput(DEBUG_LEVEL_VERBOSE, "(%p, %s) %u records (%u bytes)\n",
+                this, m_name.c_str(), m_nb_records,
+                (unsigned int)(m_nb_records * sizeof(FlightRecord)));
+    return true;
+}
+
+/**
+ * @brief write the recorder contents to disk
+ *
+ * Copies the records to the snapshot buffer, oldest first, and has the
+ * writer thread write them to FLIGHTRECORDER_DUMP_DIR. The recording is
+ * frozen only while the records are copied, no file I/O is done by the
+ * caller. A dump that is requested while the previous one is still being
+ * written is skipped.
+ *
+ * The files are rotated: at most FLIGHTRECORDER_MAX_DUMPS are kept, a
+ * later dump replaces the oldest one.
+ *
+ * @param reason short description of why the dump was taken
+ * @return true if the dump was queued
+ */
+bool
+FlightRecorder::dump(const char *reason)
+{
+    if(m_records == NULL || m_writer == NULL) return false;
+    if(m_snapshot_pending) {
+        debugOutput(DEBUG_LEVEL_VERBOSE, "(%p, %s) previous dump still pending, skipping %s\n",
+                    this, m_name.c_str(), reason);
+        return false;
+    }
+
+    bool was_frozen = isFrozen();
+    freeze();
+
+    uint32_t end = (uint32_t)m_write_idx;
+    uint32_t nb_records = (end < m_nb_records ? end : m_nb_records);
+    uint32_t start = end - nb_records;
+
+    // copy in (at most) two chunks to unwrap the ring
+    uint32_t first = start & m_mask;
+    uint32_t nb_first = m_nb_records - first;
+    if(nb_first > nb_records) nb_first = nb_records;
+    memcpy(m_snapshot, &m_records[first], nb_first * sizeof(FlightRecord));
+    if(nb_records > nb_first) {
+        memcpy(m_snapshot + nb_first, &m_records[0], (nb_records - nb_first) * sizeof(FlightRecord));
+    }
+
+    if(!was_frozen) thaw();
+
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    m_snapshot_time = tv.tv_sec * 1000000ULL + tv.tv_usec;
+    m_snapshot_nb_records = nb_records;
+    strncpy(m_snapshot_reason, reason, sizeof(m_snapshot_reason) - 1);
+
+    m_snapshot_pending = 1;
+    sem_post(&m_snapshot_sem);
+    return true;
+}
+
+bool
+FlightRecorder::Execute()
+{
+    // wake up regularly such that the thread can be stopped
+    struct timespec ts;
+    Util::SystemTimeSource::clockGettime(&ts);
+    ts.tv_nsec += 100 * 1000 * 1000;
+    if(ts.tv_nsec >= 1000 * 1000 * 1000) {
+        ts.tv_sec++;
+        ts.tv_nsec -= 1000 * 1000 * 1000;
+    }
+    if(sem_timedwait(&m_snapshot_sem, &ts) != 0) {
+        return true;
+    }
+    if(m_snapshot_pending) {
+        writeSnapshot();
+        m_snapshot_pending = 0;
+    }
+    return true;
+}
+
+/**
+ * The dump directory is usually world writable, hence the file is created
+ * exclusively and not through a symlink. The previous file with the same
+ * name is removed first, which only succeeds if it is ours.
+ */
+bool
+FlightRecorder::writeSnapshot()
+{
+    char filename[256];
+    snprintf(filename, sizeof(filename), "%s/ffado-flightrec-%s-%d-%u.bin",
+             FLIGHTRECORDER_DUMP_DIR, m_name.c_str(), (int)getpid(),
+             m_dump_count % FLIGHTRECORDER_MAX_DUMPS);
+    m_dump_count++;
+
+    if(unlink(filename) != 0 && errno != ENOENT) {
+        debugError("(%p, %s) could not remove %s: %s\n",
+                   this, m_name.c_str(), filename, strerror(errno));
+        return false;
+    }
+    int fd = open(filename, O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW, S_IRUSR | S_IWUSR);
+    FILE *f = (fd >= 0 ? fdopen(fd, "w") : NULL);
+    if(f == NULL) {
+        debugError("(%p, %s) could not open %s: %s\n",
+                   this, m_name.c_str(), filename, strerror(errno));
+        if(fd >= 0) close(fd);
+        return false;
+    }
+
+    uint32_t nb_records = m_snapshot_nb_records;
+    struct FlightRecorderFileHeader hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.magic = FLIGHTRECORDER_MAGIC;
+    hdr.version = FLIGHTRECORDER_VERSION;
+    hdr.record_size = sizeof(FlightRecord);
+    hdr.nb_records = nb_records;
+    hdr.pid = getpid();
+    hdr.time_usecs = m_snapshot_time;
+    strncpy(hdr.name, m_name.c_str(), sizeof(hdr.name) - 1);
+    strncpy(hdr.reason, m_snapshot_reason, sizeof(hdr.reason) - 1);
+
+    bool result = (fwrite(&hdr, sizeof(hdr), 1, f) == 1);
+    if(result && nb_records) {
+        result = (fwrite(m_snapshot, sizeof(FlightRecord), nb_records, f) == nb_records);
+    }
+    if(fclose(f) != 0) result = false;
+
+    if(!result) {
+        debugError("(%p, %s) could not write %s\n", this, m_name.c_str(), filename);
+        return false;
+    }
+    debugOutput(DEBUG_LEVEL_NORMAL, "Flight recorder: dumped %u records to %s (%s, dump %u)\n",
+                nb_records, filename, m_snapshot_reason, m_dump_count);
+    return true;
+}
+
+} // namespace Util
@@ -0,0 +1,162 @@
+/*
+ * Copyright (C) 2005-2008 by Pieter Palmers
+ *
+ * This file is part of FFADO
+ * FFADO = Free Firewire (pro-)audio drivers for linux
+ *
+ * FFADO is based upon FreeBoB
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) version 3 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef __UTIL_FLIGHT_RECORDER__
+#define __UTIL_FLIGHT_RECORDER__
+
+#include "debugmodule/debugmodule.h"
+#include "libutil/Atomic.h"
+#include "libutil/Thread.h"
+
+#include <string>
+#include <stdint.h>
+#include <semaphore.h>
+
+#define FLIGHTRECORDER_MAGIC            0x46465252 // 'FFRR'
+#define FLIGHTRECORDER_VERSION          1
+
+namespace Util {
+
+/**
+ * @brief One flight recorder record (32 bytes)
+ */
+struct FlightRecord {
+    uint32_t seq;         // sequence number of the record
+    uint32_t now;         // cycle timer at iterate()
+    uint32_t pkt_ctr;     // (reconstructed) cycle timer of the packet
+    uint8_t  type;        // enum FlightRecorder::eRecordType
+    uint8_t  handler;     // 0x80 = transmit, 0x40 = no channel, lower bits = iso channel
+    uint8_t  sp_state;    // state of the StreamProcessor
+    uint8_t  flags;       // eRecordFlags
+    int16_t  cycle;       // cycle number as passed by libraw1394
+    uint16_t dropped;     // dropped cycles
+    uint16_t skipped;     // skipped cycles
+    uint16_t length;      // packet length
+    int32_t  buffer_fill; // StreamProcessor buffer fill (frames)
+    uint32_t result;      // disposition returned by the client
+};
+
+/**
+ * @brief The header of a flight recorder dump file
+ *
+ * The header is followed by nb_records FlightRecords,
+ * oldest first.
+ */
+struct FlightRecorderFileHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t record_size;
+    uint32_t nb_records;
+    uint32_t pid;
+    uint32_t reserved;
+    uint64_t time_usecs;
+    char     name[32];
+    char     reason[32];
+};
+
+/**
+ * @brief A fixed-size binary flight recorder
+ *
+ * Records are fixed-size binary structures in a power-of-two sized ring.
+ * Recording a record costs an atomic increment and a few stores, there
+ * is no formatting involved, so it can be used on every ISO callback.
+ * Multiple threads can record concurrently.
+ *
+ * When something goes wrong dump() takes a snapshot of the records, which
+ * a thread of the recorder writes to disk. Recording continues meanwhile.
+ */
+class FlightRecorder : public Util::RunnableInterface
+{
+public:
+    enum eRecordType {
+        eRT_Invalid = 0,
+        eRT_Iterate,
+        eRT_PutPacket,
+        eRT_GetPacket,
+        eRT_Xrun,
+    };
+    enum eRecordFlags {
+        eRF_None        = 0x00,
+        eRF_ClientXrun  = 0x01,
+    };
+
+public:
+    FlightRecorder(std::string name, unsigned int nb_records);
+    virtual ~FlightRecorder();
+
+    bool init();
+
+    /**
+     * @brief get a record to fill (RT safe)
+     * @return a pointer to the record, or NULL if the recorder is frozen
+     */
+    inline FlightRecord *getRecord() {
+        if(m_frozen || m_records == NULL) return NULL;
+        uint32_t idx = (uint32_t)INC_ATOMIC(&m_write_idx);
+        FlightRecord *r = &m_records[idx & m_mask];
+        r->seq = idx;
+        return r;
+    };
+
+    /**
+     * @brief freeze the recorder contents (RT safe)
+     */
+    void freeze() {m_frozen = 1;};
+    void thaw() {m_frozen = 0;};
+    bool isFrozen() {return m_frozen != 0;};
+
+    bool dump(const char *reason);
+
+    void setVerboseLevel(int l) {setDebugLevel(l);};
+
+    // the writer thread
+    bool Init() {return true;};
+    bool Execute();
+
+private:
+    bool writeSnapshot();
+
+    std::string     m_name;
+    unsigned int    m_nb_records;
+    uint32_t        m_mask;
+    FlightRecord*   m_records;
+    volatile int32_t m_write_idx;
+    volatile int32_t m_frozen;
+    unsigned int    m_dump_count;
+
+    // the records of the last dump, until they are written
+    FlightRecord*   m_snapshot;
+    uint32_t        m_snapshot_nb_records;
+    uint64_t        m_snapshot_time;
+    char            m_snapshot_reason[32];
+    volatile int32_t m_snapshot_pending;
+    sem_t           m_snapshot_sem;
+    Util::Thread*   m_writer;
+
+protected:
+    DECLARE_DEBUG_MODULE;
+};
+
+} // namespace Util
+
+#endif // __UTIL_FLIGHT_RECORDER__
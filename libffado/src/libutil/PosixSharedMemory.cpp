@@ -28,6 +28,10 @@
 #include <string.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <signal.h>
 
 namespace Util {
 
@@ -118,7 +122,7 @@ PosixSharedMemory::Open(enum eDirection d)
 }
 
 bool
-PosixSharedMemory::Create(enum eDirection d)
+PosixSharedMemory::Create(enum eDirection d, bool exclusive)
 {
     debugOutput(DEBUG_LEVEL_VERBOSE, 
                 "(%p, %s) create dir: %d, size: %u \n",
@@ -130,13 +134,24 @@ PosixSharedMemory::Create(enum eDirection d)
     // open the shared memory segment
     // always create it readwrite, if not, the other side can't map
     // it correctly, nor can we truncate it to the right length.
-    int fd = shm_open(m_name.c_str(), O_RDWR|O_CREAT, S_IRWXU);
+    int fd = shm_open(m_name.c_str(), O_RDWR|O_CREAT|(exclusive ? O_EXCL : 0), S_IRWXU);
     if (fd < 0) {
+        if (exclusive && errno == EEXIST) {
+            // someone else owns it, leave it alone
+            debugOutput(DEBUG_LEVEL_VERBOSE, "(%p, %s) segment already exists\n",
+                        this, m_name.c_str());
+            return false;
+        }
         debugError("(%p, %s) Cannot open shared memory: %s\n",
                     this, m_name.c_str(), strerror (errno));
         close(fd);
         return false;
     }
+    if (exclusive) {
+        // we created it, so we have to remove it, also when
+        // the rest of the setup fails
+        m_owner = true;
+    }
 
     // set size
     if (ftruncate (fd, m_size) < 0) {
@@ -173,6 +188,61 @@ PosixSharedMemory::Create(enum eDirection d)
     return true;
 }
 
+std::string
+PosixSharedMemory::getProcessName(std::string prefix, int pid)
+{
+    char tmp[16];
+    snprintf(tmp, sizeof(tmp), "-%d", pid);
+    return prefix + tmp;
+}
+
+std::vector<std::string>
+PosixSharedMemory::findSegments(std::string prefix)
+{
+    // POSIX doesn't provide a way to list the segments, on linux
+    // they are the files in /dev/shm
+    std::vector<std::string> names;
+    DIR *dir = opendir("/dev/shm");
+    if(dir == NULL) return names;
+    prefix += "-";
+    struct dirent *entry;
+    while((entry = readdir(dir)) != NULL) {
+        if(strncmp(entry->d_name, prefix.c_str(), prefix.size()) == 0) {
+            names.push_back(entry->d_name);
+        }
+    }
+    closedir(dir);
+    return names;
+}
+
+int
+PosixSharedMemory::removeStaleSegments(std::string prefix)
+{
+    // a process that crashed never unlinked its segment
+    int nb_removed = 0;
+    std::vector<std::string> names = findSegments(prefix);
+    for(unsigned int i=0; i < names.size(); i++) {
+        const char *pid_str = names[i].c_str() + prefix.size() + 1;
+        char *end;
+        long pid = strtol(pid_str, &end, 10);
+        if(*pid_str == '\0' || *end != '\0' || pid <= 0) continue;
+
+        // signal 0 only checks whether the process exists. EPERM means
+        // that it does, but belongs to someone else.
+        if(kill((pid_t)pid, 0) == 0 || errno != ESRCH) continue;
+
+        if(shm_unlink(names[i].c_str()) == 0) {
+            debugOutput(DEBUG_LEVEL_VERBOSE,
+                        "removed stale segment %s\n", names[i].c_str());
+            nb_removed++;
+        } else {
+            debugWarning("Could not remove stale segment %s: %s\n",
+                         names[i].c_str(), strerror(errno));
+        }
+    }
+    return nb_removed;
+}
+
 bool
 PosixSharedMemory::Close()
 {
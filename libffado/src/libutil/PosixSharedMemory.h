@@ -27,6 +27,7 @@
 #include "debugmodule/debugmodule.h"
 
 #include <string>
+#include <vector>
 
 namespace Util {
 
@@ -62,7 +63,14 @@ public:
      */
     bool LockInMemory(bool lock);
 
-    virtual bool Create(enum eDirection d=eD_ReadWrite);
+    /**
+     * Creates the segment
+     * @param d direction
+     * @param exclusive fail if the segment exists already, instead
+     *                  of taking it over
+     * @return true if successful
+     */
+    virtual bool Create(enum eDirection d=eD_ReadWrite, bool exclusive=false);
     virtual bool Open(enum eDirection d=eD_ReadWrite);
     virtual bool Close();
 
@@ -75,6 +83,13 @@ public:
     virtual void show();
     virtual void setVerboseLevel(int l) {setDebugLevel(l);};
 
+    /// the name of the segment of a process, i.e. "<prefix>-<pid>"
+    static std::string getProcessName(std::string prefix, int pid);
+    /// the names of all per-process segments with this prefix
+    static std::vector<std::string> findSegments(std::string prefix);
+    /// unlinks the per-process segments whose process no longer exists
+    static int removeStaleSegments(std::string prefix);
+
 protected:
     DECLARE_DEBUG_MODULE;
 
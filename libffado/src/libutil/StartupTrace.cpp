@@ -0,0 +1,204 @@
+/*
+ * Copyright (C) 2005-2008 by Pieter Palmers
+ *
+ * This file is part of FFADO
+ * FFADO = Free Firewire (pro-)audio drivers for linux
+ *
+ * FFADO is based upon FreeBoB
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) version 3 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#include "config.h"
+
+#include "StartupTrace.h"
+#include "PosixMutex.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+namespace Util {
+
+IMPL_DEBUG_MODULE( StartupTrace, StartupTrace, DEBUG_LEVEL_NORMAL );
+
+volatile int32_t StartupTrace::m_async_transactions = 0;
+// created at load time, such that instance() needs no locking
+StartupTrace StartupTrace::m_instance;
+
+StartupTrace::StartupTrace()
+: m_enabled( 0 )
+, m_dropped( 0 )
+, m_lock( new Util::PosixMutex("STRACE") )
+{
+    const char *filename = getenv("FFADO_STARTUP_TRACE");
+    if(filename && *filename) {
+        m_filename = filename;
+        m_enabled = 1;
+    }
+}
+
+StartupTrace::~StartupTrace()
+{
+    delete m_lock;
+}
+
+StartupTrace *
+StartupTrace::instance()
+{
+    return &m_instance;
+}
+
+void
+StartupTrace::setFile(std::string filename)
+{
+    Util::MutexLockHelper lock(*m_lock);
+    // the environment takes precedence
+    if(m_filename.size()) return;
+    m_filename = filename;
+    m_enabled = (m_filename.size() != 0);
+}
+
+void
+StartupTrace::addSpan(const struct sSpan &s)
+{
+    Util::MutexLockHelper lock(*m_lock);
+    if(m_spans.size() >= STARTUPTRACE_MAX_SPANS) {
+        m_dropped++;
+        return;
+    }
+    m_spans.push_back(s);
+}
+
+static std::string
+escapeJson(const std::string &s)
+{
+    std::string retval;
+    for(unsigned int i = 0; i < s.size(); i++) {
+        char c = s[i];
+        if(c == '"' || c == '\\') {
+            retval += '\\';
+            retval += c;
+        } else if((unsigned char)c < 0x20) {
+            retval += ' ';
+        } else {
+            retval += c;
+        }
+    }
+    return retval;
+}
+
+bool
+StartupTrace::write()
+{
+    std::vector<struct sSpan> spans;
+    std::string filename;
+    unsigned int dropped;
+    {
+        Util::MutexLockHelper lock(*m_lock);
+        if(m_filename.size() == 0) return true;
+        spans = m_spans;
+        filename = m_filename;
+        dropped = m_dropped;
+    }
+
+    // the trace is rewritten on every start. The default location is a
+    // shared directory, hence replace the file instead of opening it
+    // through whatever is there (e.g. a symlink planted by someone else)
+    if(unlink(filename.c_str()) != 0 && errno != ENOENT) {
+        debugError("Could not remove %s: %s\n", filename.c_str(), strerror(errno));
+        return false;
+    }
+    int fd = open(filename.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW, S_IRUSR | S_IWUSR);
+    FILE *f = (fd >= 0 ? fdopen(fd, "w") : NULL);
+    if(f == NULL) {
+        debugError("Could not open %s: %s\n", filename.c_str(), strerror(errno));
+        if(fd >= 0) close(fd);
+        return false;
+    }
+
+    int pid = (int)getpid();
+    fprintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    fprintf(f, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"libffado\"}}", pid);
+    for ( std::vector<struct sSpan>::iterator it = spans.begin();
+          it != spans.end();
+          ++it )
+    {
+        fprintf(f, ",\n{\"name\":\"%s\",\"cat\":\"ffado\",\"ph\":\"X\","
+                   "\"ts\":%"PRIu64",\"dur\":%"PRIu64",\"pid\":%d,\"tid\":%d,"
+                   "\"args\":{\"detail\":\"%s\",\"async_transactions\":%u}}",
+                it->name, (uint64_t)it->start, (uint64_t)it->duration, pid, it->tid,
+                escapeJson(it->detail).c_str(), it->async_transactions);
+    }
+    fprintf(f, "\n]}\n");
+    bool result = (ferror(f) == 0);
+    if(fclose(f) != 0) result = false;
+
+    if(!result) {
+        debugError("Could not write %s\n", filename.c_str());
+        return false;
+    }
+    debugOutput(DEBUG_LEVEL_NORMAL, "Startup trace: wrote %u spans to %s\n",
+                (unsigned int)spans.size(), filename.c_str());
+    if(dropped) {
+        debugWarning("Startup trace: %u spans were dropped\n", dropped);
+    }
+    return true;
+}
+
+// --- TraceSpan
+
+TraceSpan::TraceSpan(const char *name)
+{
+    begin(name, true);
+}
+
+TraceSpan::TraceSpan(const char *name, bool active)
+{
+    begin(name, active);
+}
+
+TraceSpan::TraceSpan(const char *name, const std::string &detail)
+{
+    begin(name, true);
+    if(m_active) m_span.detail = detail;
+}
+
+void
+TraceSpan::begin(const char *name, bool active)
+{
+    m_active = active && StartupTrace::instance()->isEnabled();
+    if(!m_active) return;
+    m_span.name = name;
+    m_span.start = Util::SystemTimeSource::getCurrentTimeAsUsecs();
+    m_span.async_transactions = StartupTrace::getAsyncTransactions();
+}
+
+TraceSpan::~TraceSpan()
+{
+    if(!m_active) return;
+    m_span.duration = Util::SystemTimeSource::getCurrentTimeAsUsecs() - m_span.start;
+    m_span.async_transactions = StartupTrace::getAsyncTransactions() - m_span.async_transactions;
+    m_span.tid = (int)syscall(SYS_gettid);
+    StartupTrace::instance()->addSpan(m_span);
+}
+
+} // namespace Util
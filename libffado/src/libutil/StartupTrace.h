@@ -0,0 +1,132 @@
+/*
+ * Copyright (C) 2005-2008 by Pieter Palmers
+ *
+ * This file is part of FFADO
+ * FFADO = Free Firewire (pro-)audio drivers for linux
+ *
+ * FFADO is based upon FreeBoB
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) version 3 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#ifndef __UTIL_STARTUP_TRACE__
+#define __UTIL_STARTUP_TRACE__
+
+#include "debugmodule/debugmodule.h"
+#include "libutil/Atomic.h"
+#include "libutil/SystemTimeSource.h"
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+namespace Util {
+
+class Mutex;
+
+/**
+ * @brief Collects timing spans of the startup phases
+ *
+ * The phases of bringing up the streaming (discovery, prepare, stream
+ * start, the SPM sync start) are recorded as spans using TraceSpan.
+ * Every span carries the number of async transactions issued on the
+ * bus while it was open.
+ *
+ * The spans are written as a Chrome trace event file (JSON) that can be
+ * loaded in chrome://tracing or ui.perfetto.dev, either to the file named
+ * by the FFADO_STARTUP_TRACE environment variable, or to
+ * STARTUPTRACE_DUMP_DIR when the startup_trace.enable setting is set.
+ *
+ * Nothing is recorded unless a file was set. The number of spans is
+ * bounded, so the recording can stay on. The instance is created when
+ * the library is loaded.
+ */
+class StartupTrace
+{
+public:
+    struct sSpan {
+        const char *        name;
+        std::string         detail;
+        ffado_microsecs_t   start;
+        ffado_microsecs_t   duration;
+        int                 tid;
+        unsigned int        async_transactions;
+    };
+
+    static StartupTrace *instance();
+
+    void setFile(std::string filename);
+    /// lock free
+    bool isEnabled() {return m_enabled != 0;};
+
+    void addSpan(const struct sSpan &s);
+    /// write all spans recorded so far, if a file was set
+    bool write();
+
+    /// to be called for every async transaction (RT safe)
+    static inline void countAsyncTransaction() {
+        INC_ATOMIC(&m_async_transactions);
+    };
+    static inline unsigned int getAsyncTransactions() {
+        return (unsigned int)m_async_transactions;
+    };
+
+    void setVerboseLevel(int l) {setDebugLevel(l);};
+
+private:
+    StartupTrace();
+    ~StartupTrace();
+
+    static StartupTrace     m_instance;
+    static volatile int32_t m_async_transactions;
+
+    volatile int32_t        m_enabled;
+    std::string             m_filename;
+    std::vector<struct sSpan> m_spans;
+    unsigned int            m_dropped;
+    Util::Mutex*            m_lock;
+
+protected:
+    DECLARE_DEBUG_MODULE;
+};
+
+/**
+ * @brief A scoped startup trace span
+ *
+ * The span covers the lifetime of the object, e.g.
+ *   Util::TraceSpan span("discover", device->getConfigRom().getGuidString());
+ * It does nothing when tracing is off when it is created, or when active
+ * is false (for code that also runs outside of the startup, e.g. on the
+ * xrun recovery path).
+ */
+class TraceSpan
+{
+public:
+    TraceSpan(const char *name);
+    TraceSpan(const char *name, bool active);
+    TraceSpan(const char *name, const std::string &detail);
+    ~TraceSpan();
+
+private:
+    void begin(const char *name, bool active);
+
+    bool m_active;
+    struct StartupTrace::sSpan m_span;
+};
+
+} // namespace Util
+
+#endif // __UTIL_STARTUP_TRACE__
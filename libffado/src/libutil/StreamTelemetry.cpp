@@ -0,0 +1,246 @@
+/*
+ * Copyright (C) 2005-2008 by Pieter Palmers
+ *
+ * This file is part of FFADO
+ * FFADO = Free Firewire (pro-)audio drivers for linux
+ *
+ * FFADO is based upon FreeBoB
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) version 3 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "StreamTelemetry.h"
+#include "PosixSharedMemory.h"
+
+#include <string.h>
+#include <unistd.h>
+
+namespace Util {
+
+IMPL_DEBUG_MODULE( StreamTelemetry, StreamTelemetry, DEBUG_LEVEL_NORMAL );
+
+StreamTelemetry::StreamTelemetry(std::string name)
+: m_name( name )
+, m_shm( NULL )
+, m_segment( NULL )
+, m_local_segment( NULL )
+{
+
+}
+
+StreamTelemetry::~StreamTelemetry()
+{
+    if(m_shm) {
+        m_shm->LockInMemory(false);
+        delete m_shm;
+    }
+    if(m_local_segment) {
+        delete m_local_segment;
+    }
+}
+
+bool
+StreamTelemetry::init()
+{
+    if(m_segment) {
+        debugOutput(DEBUG_LEVEL_VERBOSE, "(%p) already initialized\n", this);
+        return true;
+    }
+
+    m_shm = new PosixSharedMemory(m_name, sizeof(TelemetrySegment));
+    if(m_shm == NULL) {
+        debugError("Could not allocate shared memory object\n");
+        return false;
+    }
+    m_shm->setVerboseLevel(getDebugLevel());
+    if(m_shm->Create(PosixSharedMemory::eD_ReadWrite, true)) {
+        m_segment = (TelemetrySegment *)m_shm->requestBlock(0, sizeof(TelemetrySegment));
+    }
+    if(m_segment == NULL) {
+        debugWarning("Could not create telemetry segment '%s', using private memory\n",
+                     m_name.c_str());
+        delete m_shm;
+        m_shm = NULL;
+        m_local_segment = new TelemetrySegment;
+        m_segment = m_local_segment;
+    } else if(!m_shm->LockInMemory(true)) {
+        debugWarning("Could not memlock telemetry segment\n");
+    }
+
+    memset((void *)m_segment, 0, sizeof(TelemetrySegment));
+    m_segment->version = STREAMTELEMETRY_VERSION;
+    m_segment->nb_slots = STREAMTELEMETRY_SLOTS;
+    m_segment->nb_thread_slots = STREAMTELEMETRY_THREAD_SLOTS;
+    m_segment->nb_buckets = STREAMTELEMETRY_NB_BUCKETS;
+    m_segment->pid = getpid();
+    // the magic is written last, readers use it to detect a valid segment
+    __sync_synchronize();
+    m_segment->magic = STREAMTELEMETRY_MAGIC;
+
+    debugOutput(DEBUG_LEVEL_VERBOSE, "(%p) telemetry segment '%s' (%u bytes, %s)\n",
+                this, m_name.c_str(), (unsigned int)sizeof(TelemetrySegment),
+                (m_shm ? "shared" : "private"));
+    return true;
+}
+
+TelemetryStreamSlot *
+StreamTelemetry::allocateSlot(std::string name, int type)
+{
+    if(m_segment == NULL) {
+        debugError("(%p) not initialized\n", this);
+        return NULL;
+    }
+    for(unsigned int i=0; i < STREAMTELEMETRY_SLOTS; i++) {
+        TelemetryStreamSlot *slot = &m_segment->slots[i];
+        if(slot->in_use) continue;
+        memset((void *)slot, 0, sizeof(TelemetryStreamSlot));
+        strncpy(slot->name, name.c_str(), STREAMTELEMETRY_NAME_LEN - 1);
+        slot->type = type;
+        slot->channel = -1;
+        __sync_synchronize();
+        slot->in_use = 1;
+        debugOutput(DEBUG_LEVEL_VERBOSE, "(%p) allocated slot %u for '%s'\n",
+                    this, i, name.c_str());
+        return slot;
+    }
+    debugWarning("No free telemetry slot for '%s'\n", name.c_str());
+    return NULL;
+}
+
+void
+StreamTelemetry::releaseSlot(TelemetryStreamSlot *slot)
+{
+    if(slot == NULL) return;
+    slot->in_use = 0;
+}
+
+TelemetryThreadSlot *
+StreamTelemetry::allocateThreadSlot(std::string name)
+{
+    if(m_segment == NULL) {
+        debugError("(%p) not initialized\n", this);
+        return NULL;
+    }
+    for(unsigned int i=0; i < STREAMTELEMETRY_THREAD_SLOTS; i++) {
+        TelemetryThreadSlot *slot = &m_segment->threads[i];
+        if(slot->in_use) continue;
+        memset((void *)slot, 0, sizeof(TelemetryThreadSlot));
+        strncpy(slot->name, name.c_str(), STREAMTELEMETRY_NAME_LEN - 1);
+        __sync_synchronize();
+        slot->in_use = 1;
+        debugOutput(DEBUG_LEVEL_VERBOSE, "(%p) allocated thread slot %u for '%s'\n",
+                    this, i, name.c_str());
+        return slot;
+    }
+    debugWarning("No free telemetry thread slot for '%s'\n", name.c_str());
+    return NULL;
+}
+
+void
+StreamTelemetry::releaseThreadSlot(TelemetryThreadSlot *slot)
+{
+    if(slot == NULL) return;
+    slot->in_use = 0;
+}
+
+uint32_t
+StreamTelemetry::bucketUpperBound(unsigned int bucket)
+{
+    if(bucket == 0) return 0;
+    if(bucket >= 32) return 0xFFFFFFFF;
+    return (1U << bucket) - 1;
+}
+
+void
+StreamTelemetry::resetHistogram(TelemetryHistogram *h)
+{
+    memset((void *)h, 0, sizeof(TelemetryHistogram));
+}
+
+void
+StreamTelemetry::subtractHistogram(TelemetryHistogram *result,
+                                   const TelemetryHistogram *now,
+                                   const TelemetryHistogram *prev)
+{
+    uint32_t count = 0;
+    for(unsigned int i=0; i < STREAMTELEMETRY_NB_BUCKETS; i++) {
+        result->buckets[i] = now->buckets[i] - prev->buckets[i];
+        count += result->buckets[i];
+    }
+    // recount from the buckets since the snapshots are not atomic
+    result->count = count;
+    result->sum = now->sum - prev->sum;
+    result->max = now->max;
+}
+
+uint32_t
+StreamTelemetry::getPercentile(const TelemetryHistogram *h, float pct)
+{
+    uint32_t total = 0;
+    for(unsigned int i=0; i < STREAMTELEMETRY_NB_BUCKETS; i++) {
+        total += h->buckets[i];
+    }
+    if(total == 0) return 0;
+
+    uint64_t target = (uint64_t)(total * pct / 100.0);
+    if(target >= total) target = total - 1;
+
+    uint64_t seen = 0;
+    for(unsigned int i=0; i < STREAMTELEMETRY_NB_BUCKETS; i++) {
+        seen += h->buckets[i];
+        if(seen > target) {
+            uint32_t bound = bucketUpperBound(i);
+            // the upper bucket bound can overshoot the real maximum
+            return (bound > h->max ? h->max : bound);
+        }
+    }
+    return h->max;
+}
+
+void
+StreamTelemetry::dumpInfo()
+{
+    debugOutputShort( DEBUG_LEVEL_NORMAL, "Telemetry segment '%s' (%s)\n",
+                      m_name.c_str(), (m_shm ? "shared" : "private"));
+    if(m_segment == NULL) return;
+    debugOutputShort( DEBUG_LEVEL_NORMAL, " Periods: %u, xruns: %u, wake latency p99: %u usec\n",
+                      m_segment->periods, m_segment->xruns,
+                      getPercentile(&m_segment->wake_latency, 99.0));
+    for(unsigned int i=0; i < STREAMTELEMETRY_SLOTS; i++) {
+        TelemetryStreamSlot *slot = &m_segment->slots[i];
+        if(!slot->in_use) continue;
+        debugOutputShort( DEBUG_LEVEL_NORMAL, " %2u: %s, dropped: %u, skipped: %u, fill p50/p99: %u/%u\n",
+                          i, slot->name, slot->dropped_cycles, slot->skipped_cycles,
+                          getPercentile(&slot->buffer_fill, 50.0),
+                          getPercentile(&slot->buffer_fill, 99.0));
+    }
+    for(unsigned int i=0; i < STREAMTELEMETRY_THREAD_SLOTS; i++) {
+        TelemetryThreadSlot *slot = &m_segment->threads[i];
+        if(!slot->in_use) continue;
+        debugOutputShort( DEBUG_LEVEL_NORMAL, " T%u: %s, budget: %u usec, overruns: %u/%u, max late: %u usec, util p99: %u%%%s\n",
+                          i, slot->name, slot->budget, slot->overruns, slot->iterations,
+                          slot->max_lateness, getPercentile(&slot->utilisation, 99.0),
+                          (slot->demoted ? ", demoted" : ""));
+    }
+}
+
+void
+StreamTelemetry::setVerboseLevel(int l)
+{
+    setDebugLevel(l);
+    if(m_shm) m_shm->setVerboseLevel(l);
+}
+
+} // namespace Util
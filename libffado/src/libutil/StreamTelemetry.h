@@ -0,0 +1,198 @@
+/*
+ * Copyright (C) 2005-2008 by Pieter Palmers
+ *
+ * This file is part of FFADO
+ * FFADO = Free Firewire (pro-)audio drivers for linux
+ *
+ * FFADO is based upon FreeBoB
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) version 3 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef __UTIL_STREAM_TELEMETRY__
+#define __UTIL_STREAM_TELEMETRY__
+
+#include "debugmodule/debugmodule.h"
+
+#include <string>
+#include <stdint.h>
+
+#define STREAMTELEMETRY_MAGIC           0x46465431 // 'FFT1'
+#define STREAMTELEMETRY_VERSION         2
+#define STREAMTELEMETRY_NB_BUCKETS      32
+#define STREAMTELEMETRY_NAME_LEN        64
+#define STREAMTELEMETRY_SLOTS           16
+#define STREAMTELEMETRY_THREAD_SLOTS    8
+
+namespace Util {
+
+class PosixSharedMemory;
+
+/**
+ * @brief A log2-bucketed histogram that can live in shared memory.
+ *
+ * Bucket 0 counts the value 0, bucket n (n > 0) counts the values in
+ * [2^(n-1), 2^n). The last bucket also collects everything above.
+ *
+ * Every histogram has exactly one writer thread, so updates are plain
+ * stores without any locking. The count is updated last, such that a
+ * reader never sees more samples than are present in the buckets.
+ * Readers take a snapshot and tolerate slightly inconsistent sums.
+ */
+struct TelemetryHistogram {
+    volatile uint32_t count;
+    volatile uint32_t max;
+    volatile uint64_t sum;
+    volatile uint32_t buckets[STREAMTELEMETRY_NB_BUCKETS];
+};
+
+/**
+ * @brief Per-stream telemetry, one slot per StreamProcessor.
+ *
+ * packet_latency and the dropped/skipped counters and histograms are
+ * written by the ISO thread handling the stream. dll_error is written by
+ * the thread that fills the stream buffer: the ISO thread for a receive
+ * stream, the client thread in transfer() for a transmit stream.
+ * buffer_fill, xruns and channel are written by the thread that returns
+ * from waitForPeriod().
+ */
+struct TelemetryStreamSlot {
+    char name[STREAMTELEMETRY_NAME_LEN];
+    volatile int32_t in_use;
+    volatile int32_t type; // 0 = receive, 1 = transmit
+    volatile int32_t channel;
+    volatile uint32_t xruns;
+    volatile uint32_t dropped_cycles;
+    volatile uint32_t skipped_cycles;
+
+    TelemetryHistogram packet_latency; // ticks between cycle timer read and packet cycle
+    TelemetryHistogram buffer_fill;    // frames, sampled at the period boundary
+    TelemetryHistogram dll_error;      // abs DLL error, in ticks
+    TelemetryHistogram dropped;        // dropped cycles per event
+    TelemetryHistogram skipped;        // skipped cycles per event
+};
+
+/**
+ * @brief Per-thread deadline statistics, one slot per monitored RT thread.
+ *
+ * The statistics are collected by the thread itself (see
+ * Util::ThreadDeadline) and copied into the slot by the watchdog at every
+ * check interval, hence they lag behind by at most one interval.
+ */
+struct TelemetryThreadSlot {
+    char name[STREAMTELEMETRY_NAME_LEN];
+    volatile int32_t in_use;
+    volatile int32_t policy;        // Util::ThreadDeadline::eDemotionPolicy
+    volatile int32_t demoted;
+    volatile uint32_t budget;       // usecs per iteration
+    volatile uint32_t iterations;
+    volatile uint32_t overruns;
+    volatile uint32_t max_lateness; // usecs
+    volatile uint32_t stalls;
+    volatile uint64_t busy_usecs;
+
+    TelemetryHistogram utilisation; // percent of the budget used per iteration
+    TelemetryHistogram lateness;    // usecs past the deadline, overruns only
+};
+
+/**
+ * @brief The layout of the telemetry shared memory segment
+ */
+struct TelemetrySegment {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t nb_slots;
+    uint32_t nb_buckets;
+    uint32_t pid;
+    volatile uint32_t periods;
+    volatile uint32_t xruns;
+    uint32_t nb_thread_slots;
+
+    TelemetryHistogram wake_latency; // usecs that waitForPeriod woke up late
+    TelemetryStreamSlot slots[STREAMTELEMETRY_SLOTS];
+    TelemetryThreadSlot threads[STREAMTELEMETRY_THREAD_SLOTS];
+};
+
+/**
+ * @brief Streaming telemetry exported through POSIX shared memory
+ *
+ * The owner (the StreamProcessorManager) creates the segment and hands
+ * out slots. The RT threads only ever call the static mark() on a
+ * histogram pointer they own. External tools (ffado-telemetry) open the
+ * segment read-only and compute percentiles from snapshots, so they
+ * never touch the RT path.
+ *
+ * If the shared memory segment cannot be created, the telemetry falls
+ * back to process-private memory such that the writers always have a
+ * valid target.
+ */
+class StreamTelemetry
+{
+public:
+    StreamTelemetry(std::string name);
+    virtual ~StreamTelemetry();
+
+    bool init();
+    bool isShared() {return m_shm != NULL;};
+
+    TelemetryStreamSlot *allocateSlot(std::string name, int type);
+    void releaseSlot(TelemetryStreamSlot *slot);
+    TelemetryThreadSlot *allocateThreadSlot(std::string name);
+    void releaseThreadSlot(TelemetryThreadSlot *slot);
+
+    TelemetrySegment *getSegment() {return m_segment;};
+
+    /**
+     * @brief add a sample to a histogram (RT safe, single writer)
+     * @param h the histogram, can be NULL in which case this is a no-op
+     * @param value the sample value
+     */
+    static inline void mark(TelemetryHistogram *h, uint32_t value) {
+        if (h == NULL) return;
+        h->buckets[bucketForValue(value)]++;
+        h->sum += value;
+        if (value > h->max) h->max = value;
+        h->count++;
+    };
+    static inline unsigned int bucketForValue(uint32_t value) {
+        if (value == 0) return 0;
+        unsigned int b = 32 - __builtin_clz(value);
+        if (b >= STREAMTELEMETRY_NB_BUCKETS) b = STREAMTELEMETRY_NB_BUCKETS - 1;
+        return b;
+    };
+    static uint32_t bucketUpperBound(unsigned int bucket);
+
+    static void resetHistogram(TelemetryHistogram *h);
+    static void subtractHistogram(TelemetryHistogram *result,
+                                  const TelemetryHistogram *now,
+                                  const TelemetryHistogram *prev);
+    static uint32_t getPercentile(const TelemetryHistogram *h, float pct);
+
+    void dumpInfo();
+    void setVerboseLevel(int l);
+
+private:
+    std::string         m_name;
+    PosixSharedMemory*  m_shm;
+    TelemetrySegment*   m_segment;
+    TelemetrySegment*   m_local_segment;
+
+protected:
+    DECLARE_DEBUG_MODULE;
+};
+
+} // namespace Util
+
+#endif // __UTIL_STREAM_TELEMETRY__
@@ -24,6 +24,7 @@
 #include "config.h"
 
 #include "libutil/Atomic.h"
+#include "libutil/StreamTelemetry.h"
 #include "libieee1394/cycletimer.h"
 
 #include "TimestampedBuffer.h"
@@ -76,7 +77,8 @@ TimestampedBuffer::TimestampedBuffer(TimestampedBufferClient *c)
       m_dll_e2(0.0), m_dll_b(DLL_COEFF_B), m_dll_c(DLL_COEFF_C),
       m_nominal_rate(0.0), m_current_rate(0.0), m_update_period(0),
       // half a cycle is what we consider 'normal'
-      m_max_abs_diff(3072/2)
+      m_max_abs_diff(3072/2),
+      m_dll_error_histogram(NULL)
 {
     pthread_mutex_init(&m_framecounter_lock, NULL);
 }
@@ -1074,6 +1076,7 @@ void TimestampedBuffer::incrementFrameCounter(unsigned int nbframes, ffado_times
 #endif
 
     double err = diff;
+    StreamTelemetry::mark(m_dll_error_histogram, (uint32_t)(err < 0 ? -err : err));
     debugOutputShortExtreme(DEBUG_LEVEL_VERY_VERBOSE,
                             "diff2="TIMESTAMP_FORMAT_SPEC" err=%f\n",
                             diff, err);
@@ -42,6 +42,7 @@ namespace Util
 {
 
 class TimestampedBufferClient;
+struct TelemetryHistogram;
 
 /**
     * \brief Class implementing a frame buffer that is time-aware
@@ -146,6 +147,7 @@ class TimestampedBuffer
         float getNominalRate() {return m_nominal_rate;};
         float getRate();
         void setRate(float rate);
+        void setDllErrorHistogram(TelemetryHistogram *h) {m_dll_error_histogram = h;};
 
         bool setUpdatePeriod ( unsigned int t );
         unsigned int getUpdatePeriod();
@@ -208,6 +210,9 @@ class TimestampedBuffer
         unsigned int m_update_period;
 
         unsigned int m_max_abs_diff;
+
+        // telemetry
+        TelemetryHistogram *m_dll_error_histogram;
 };
 
 /**
@@ -24,6 +24,7 @@
 #include "Watchdog.h"
 #include "SystemTimeSource.h"
 #include "PosixThread.h"
+#include "PosixMutex.h"
 
 #include "config.h"
 
@@ -35,10 +36,87 @@
 #include <time.h>
 #include <unistd.h>
 #include <poll.h>
+#include <pthread.h>
+#include <string.h>
 
 namespace Util {
 
 IMPL_DEBUG_MODULE( Watchdog, Watchdog, DEBUG_LEVEL_NORMAL );
+IMPL_DEBUG_MODULE( ThreadDeadline, ThreadDeadline, DEBUG_LEVEL_NORMAL );
+
+// --- the deadline of a thread --- //
+ThreadDeadline::ThreadDeadline(std::string name, Thread *thread,
+                               unsigned int budget_usecs, enum eDemotionPolicy policy)
+    : m_name( name )
+    , m_thread( thread )
+    , m_active( false )
+    , m_release( 0 )
+    , m_start( 0 )
+    , m_consecutive_overruns( 0 )
+    , m_overrun_bursts( 0 )
+    , m_slot( NULL )
+    , m_checked_busy_usecs( 0 )
+    , m_checked_overrun_bursts( 0 )
+    , m_checked_release( 0 )
+    , m_demoted_from_rt( false )
+    , m_clean_intervals( 0 )
+{
+    memset((void *)&m_record, 0, sizeof(TelemetryThreadSlot));
+    strncpy(m_record.name, name.c_str(), STREAMTELEMETRY_NAME_LEN - 1);
+    m_record.in_use = 1;
+    m_record.budget = budget_usecs;
+    m_record.policy = policy;
+}
+
+void
+ThreadDeadline::begin(ffado_microsecs_t release)
+{
+    m_start = SystemTimeSource::getCurrentTimeAsUsecs();
+    m_release = (release < m_start ? release : m_start);
+    m_active = true;
+}
+
+void
+ThreadDeadline::end()
+{
+    if(!m_active) return;
+    ffado_microsecs_t now = SystemTimeSource::getCurrentTimeAsUsecs();
+    m_active = false;
+
+    uint32_t budget = m_record.budget;
+    uint64_t used = now - m_release;
+    m_record.busy_usecs += now - m_start;
+    if(budget) {
+        uint64_t pct = used * 100 / budget;
+        StreamTelemetry::mark(&m_record.utilisation, (pct > 0xFFFFFFFFULL ? 0xFFFFFFFF : (uint32_t)pct));
+        if(used > budget) {
+            uint32_t late = (used - budget > 0xFFFFFFFFULL ? 0xFFFFFFFF : (uint32_t)(used - budget));
+            m_record.overruns++;
+            if(late > m_record.max_lateness) m_record.max_lateness = late;
+            StreamTelemetry::mark(&m_record.lateness, late);
+            if(++m_consecutive_overruns == WATCHDOG_DEADLINE_OVERRUN_LIMIT) {
+                m_overrun_bursts++;
+            }
+        } else {
+            m_consecutive_overruns = 0;
+        }
+    }
+    m_record.iterations++;
+}
+
+void
+ThreadDeadline::show()
+{
+    debugOutputShort(DEBUG_LEVEL_NORMAL, "  %s: budget %u usec, policy %d%s\n",
+                     m_name.c_str(), m_record.budget, m_record.policy,
+                     (m_record.demoted ? ", demoted" : ""));
+    debugOutputShort(DEBUG_LEVEL_NORMAL, "   iterations: %u, overruns: %u, stalls: %u, max lateness: %u usec\n",
+                     m_record.iterations, m_record.overruns, m_record.stalls, m_record.max_lateness);
+    debugOutputShort(DEBUG_LEVEL_NORMAL, "   utilisation p50/p99/max: %u/%u/%u %%\n",
+                     StreamTelemetry::getPercentile(&m_record.utilisation, 50.0),
+                     StreamTelemetry::getPercentile(&m_record.utilisation, 99.0),
+                     m_record.utilisation.max);
+}
 
 // --- Watchdog thread common ancestor --- ///
 Watchdog::WatchdogTask::WatchdogTask(Watchdog& parent, unsigned int interval_usecs)
@@ -117,65 +195,7 @@ Watchdog::WatchdogCheckTask::Execute()
     if (Watchdog::WatchdogTask::Execute() == false)
         return false;
 
-    if(m_parent.getHartbeat()) {
-        debugOutput(DEBUG_LEVEL_VERY_VERBOSE,
-                    "(%p) watchdog %p still alive\n", this, &m_parent);
-        m_parent.clearHartbeat();
-    } else {
-        debugWarning("(%p) watchdog %p died\n", this, &m_parent);
-        // set all watched threads to non-rt scheduling
-        m_parent.rescheduleThreads();
-    }
-
-    #ifdef DEBUG
-    uint64_t now = Util::SystemTimeSource::getCurrentTimeAsUsecs();
-    int diff = now - m_last_loop_entry;
-    if(diff < 100) {
-        debugOutputExtreme(DEBUG_LEVEL_VERY_VERBOSE,
-                           "(%p) short loop detected (%d usec), cnt: %d\n",
-                           this, diff, m_successive_short_loops);
-        m_successive_short_loops++;
-        if(m_successive_short_loops > 100) {
-            debugError("Shutting down runaway thread\n");
-            return false;
-        }
-    } else {
-        // reset the counter
-        m_successive_short_loops = 0;
-    }
-    m_last_loop_entry = now;
-    #endif
-
-    return true;
-}
-
-// --- hartbeat Thread --- //
-
-Watchdog::WatchdogHartbeatTask::WatchdogHartbeatTask(Watchdog& parent, unsigned int interval_usecs)
-    : WatchdogTask( parent, interval_usecs )
-    , m_debugModule( parent.m_debugModule )
-{
-}
-
-bool
-Watchdog::WatchdogHartbeatTask::Init()
-{
-    #ifdef DEBUG
-    m_last_loop_entry = 0;
-    m_successive_short_loops = 0;
-    #endif
-    return Watchdog::WatchdogTask::Init();
-}
-
-bool
-Watchdog::WatchdogHartbeatTask::Execute()
-{
-    if (Watchdog::WatchdogTask::Execute() == false)
-        return false;
-
-    debugOutput(DEBUG_LEVEL_VERY_VERBOSE,
-                "(%p) watchdog %p hartbeat\n", this, &m_parent);
-    m_parent.setHartbeat();
+    m_parent.checkDeadlines();
 
     #ifdef DEBUG
     uint64_t now = Util::SystemTimeSource::getCurrentTimeAsUsecs();
@@ -201,26 +221,26 @@ Watchdog::WatchdogHartbeatTask::Execute()
 
 // the actual watchdog class
 Watchdog::Watchdog()
-: m_hartbeat( true )
+: m_deadlines_lock( new Util::PosixMutex("WDGDL") )
+, m_telemetry( NULL )
+, m_last_check( 0 )
 , m_check_interval( WATCHDOG_DEFAULT_CHECK_INTERVAL_USECS )
 , m_realtime( WATCHDOG_DEFAULT_RUN_REALTIME )
 , m_priority( WATCHDOG_DEFAULT_PRIORITY )
 , m_CheckThread( NULL )
-, m_HartbeatThread( NULL )
 , m_CheckTask( NULL )
-, m_HartbeatTask( NULL )
 {
 }
 
 Watchdog::Watchdog(unsigned int interval_usec, bool realtime, unsigned int priority)
-: m_hartbeat( true )
+: m_deadlines_lock( new Util::PosixMutex("WDGDL") )
+, m_telemetry( NULL )
+, m_last_check( 0 )
 , m_check_interval( interval_usec )
 , m_realtime( realtime )
 , m_priority( priority )
 , m_CheckThread( NULL )
-, m_HartbeatThread( NULL )
 , m_CheckTask( NULL )
-, m_HartbeatTask( NULL )
 {
 }
 
@@ -236,18 +256,18 @@ Watchdog::~Watchdog()
         //m_CheckThread->Kill();
         delete m_CheckThread;
     }
-    if (m_HartbeatThread) {
-        m_HartbeatTask->ReqStop();
-        m_HartbeatThread->Stop();
-        //m_HartbeatThread->Kill();
-        delete m_HartbeatThread;
-    }
     if (m_CheckTask) {
         delete m_CheckTask;
     }
-    if (m_HartbeatTask) {
-        delete m_HartbeatTask;
+    setTelemetry(NULL);
+    for ( ThreadDeadlineVectorIterator it = m_deadlines.begin();
+      it != m_deadlines.end();
+      ++it )
+    {
+        debugWarning("Thread '%s' still registered\n", (*it)->getName().c_str());
+        delete *it;
     }
+    delete m_deadlines_lock;
 }
 
 void
@@ -260,22 +280,6 @@ bool
 Watchdog::start()
 {
     debugOutput( DEBUG_LEVEL_VERBOSE, "(%p) Starting watchdog...\n", this);
-    debugOutput( DEBUG_LEVEL_VERBOSE, "Create hartbeat task/thread for %p...\n", this);
-    m_HartbeatTask = new WatchdogHartbeatTask( *this, m_check_interval/2 );
-    if(!m_HartbeatTask) {
-        debugFatal("No hartbeat task\n");
-        return false;
-    }
-    m_HartbeatThread = new Util::PosixThread(m_HartbeatTask, "WDGHBT", false,
-                                             0, PTHREAD_CANCEL_ASYNCHRONOUS);
-    if(!m_HartbeatThread) {
-        debugFatal("No hartbeat thread\n");
-        return false;
-    }
-    debugOutput( DEBUG_LEVEL_VERBOSE,
-                 " hartbeat task: %p, thread %p...\n",
-                 m_HartbeatTask, m_HartbeatThread);
-
     debugOutput( DEBUG_LEVEL_VERBOSE, "Create check task/thread for %p...\n", this);
     m_CheckTask = new WatchdogCheckTask( *this, m_check_interval );
     if(!m_CheckTask) {
@@ -300,10 +304,7 @@ Watchdog::start()
     }
 
     // start threads
-    if (m_HartbeatThread->Start() != 0) {
-        debugFatal("Could not start hartbeat thread\n");
-        return false;
-    }
+    m_last_check = Util::SystemTimeSource::getCurrentTimeAsUsecs();
     if (m_CheckThread->Start() != 0) {
         debugFatal("Could not start check thread\n");
         return false;
@@ -330,59 +331,227 @@ Watchdog::setThreadParameters(bool rt, int priority)
     return true;
 }
 
-/**
- * register a thread to the watchdog
- * @param thread
- * @return
- */
-bool
-Watchdog::registerThread(Thread *thread)
+ThreadDeadline *
+Watchdog::registerThread(std::string name, Thread *thread,
+                         unsigned int budget_usecs,
+                         enum ThreadDeadline::eDemotionPolicy policy)
 {
-    assert(thread);
-    debugOutput( DEBUG_LEVEL_VERBOSE, "(%p) Adding thread %p\n",
-        this, thread);
-
-    for ( ThreadVectorIterator it = m_Threads.begin();
-      it != m_Threads.end();
-      ++it )
-    {
-        if(*it == thread) {
-            debugError("Thread %p already registered with watchdog\n", thread);
-            return false;
+    debugOutput( DEBUG_LEVEL_VERBOSE, "(%p) Adding thread '%s' (%p), budget %u usec, policy %d\n",
+        this, name.c_str(), thread, budget_usecs, policy);
+
+    Util::MutexLockHelper lock(*m_deadlines_lock);
+    if (thread) {
+        for ( ThreadDeadlineVectorIterator it = m_deadlines.begin();
+          it != m_deadlines.end();
+          ++it )
+        {
+            if((*it)->m_thread == thread) {
+                debugError("Thread %p already registered with watchdog\n", thread);
+                return NULL;
+            }
         }
     }
-    m_Threads.push_back(thread);
-    return true;
+    ThreadDeadline *d = new ThreadDeadline(name, thread, budget_usecs, policy);
+    if (m_telemetry) {
+        d->m_slot = m_telemetry->allocateThreadSlot(name);
+    }
+    m_deadlines.push_back(d);
+    return d;
 }
 
 bool
-Watchdog::unregisterThread(Thread *thread)
+Watchdog::unregisterThread(ThreadDeadline *deadline)
 {
-    assert(thread);
-    debugOutput( DEBUG_LEVEL_VERBOSE, "(%p) unregistering thread %p\n", this, thread);
+    if (deadline == NULL) return false;
+    debugOutput( DEBUG_LEVEL_VERBOSE, "(%p) unregistering thread '%s'\n",
+                 this, deadline->getName().c_str());
 
-    for ( ThreadVectorIterator it = m_Threads.begin();
-      it != m_Threads.end();
+    Util::MutexLockHelper lock(*m_deadlines_lock);
+    for ( ThreadDeadlineVectorIterator it = m_deadlines.begin();
+      it != m_deadlines.end();
       ++it )
     {
-        if(*it == thread) {
-            m_Threads.erase(it);
+        if(*it == deadline) {
+            if (m_telemetry) {
+                m_telemetry->releaseThreadSlot(deadline->m_slot);
+            }
+            m_deadlines.erase(it);
+            delete deadline;
             return true;
         }
     }
-    debugOutput( DEBUG_LEVEL_VERBOSE, "(%p) thread %p not found \n", this, thread);
+    debugOutput( DEBUG_LEVEL_VERBOSE, "(%p) thread '%s' not found \n",
+                 this, deadline->getName().c_str());
     return false; //not found
 }
 
-void Watchdog::rescheduleThreads()
+void
+Watchdog::setTelemetry(StreamTelemetry *telemetry)
+{
+    Util::MutexLockHelper lock(*m_deadlines_lock);
+    if (telemetry == m_telemetry) return;
+    for ( ThreadDeadlineVectorIterator it = m_deadlines.begin();
+      it != m_deadlines.end();
+      ++it )
+    {
+        if (m_telemetry) {
+            m_telemetry->releaseThreadSlot((*it)->m_slot);
+        }
+        (*it)->m_slot = NULL;
+        if (telemetry) {
+            (*it)->m_slot = telemetry->allocateThreadSlot((*it)->getName());
+        }
+    }
+    m_telemetry = telemetry;
+}
+
+void
+Watchdog::demote(ThreadDeadline *d, const char *reason)
+{
+    if (d->m_record.demoted) return;
+    // only a thread that runs RT now gets RT scheduling back later
+    d->m_demoted_from_rt = false;
+    if (d->m_thread) {
+        int policy;
+        struct sched_param param;
+        if (pthread_getschedparam(d->m_thread->GetThreadID(), &policy, &param) == 0
+            && (policy == SCHED_FIFO || policy == SCHED_RR)) {
+            d->m_demoted_from_rt = true;
+        }
+    }
+    if (d->m_demoted_from_rt) {
+        debugWarning("(%p) thread '%s' %s, dropping RT scheduling\n",
+                     this, d->getName().c_str(), reason);
+        d->m_thread->DropRealTime();
+    } else {
+        debugWarning("(%p) thread '%s' %s\n",
+                     this, d->getName().c_str(), reason);
+    }
+    d->m_record.demoted = 1;
+    d->m_clean_intervals = 0;
+}
+
+void
+Watchdog::promote(ThreadDeadline *d)
+{
+    if (!d->m_record.demoted) return;
+    if (d->m_demoted_from_rt) {
+        debugOutput(DEBUG_LEVEL_NORMAL, "(%p) thread '%s' recovered, restoring RT scheduling\n",
+                    this, d->getName().c_str());
+        d->m_thread->AcquireRealTime();
+    } else {
+        debugOutput(DEBUG_LEVEL_NORMAL, "(%p) thread '%s' recovered\n",
+                    this, d->getName().c_str());
+    }
+    d->m_record.demoted = 0;
+    d->m_demoted_from_rt = false;
+}
+
+/**
+ * @brief Checks the deadlines of all threads and publishes the statistics
+ *
+ * Called from the check thread once every check interval. Only reads what
+ * the monitored threads write, the demoted flag and the stall count are
+ * the only fields of the record written here. A demoted thread is promoted
+ * again after WATCHDOG_DEADLINE_PROMOTE_INTERVALS consecutive intervals
+ * without stall, runaway or overrun burst, such that a thread that
+ * misbehaves every few intervals doesn't flip between RT and non-RT.
+ */
+void
+Watchdog::checkDeadlines()
 {
-    debugOutput( DEBUG_LEVEL_VERBOSE, "(%p) rescheduling threads\n", this);
+    ffado_microsecs_t now = Util::SystemTimeSource::getCurrentTimeAsUsecs();
+    uint64_t interval = now - m_last_check;
+    m_last_check = now;
+
+    Util::MutexLockHelper lock(*m_deadlines_lock);
+    for ( ThreadDeadlineVectorIterator it = m_deadlines.begin();
+      it != m_deadlines.end();
+      ++it )
+    {
+        ThreadDeadline *d = *it;
+        enum ThreadDeadline::eDemotionPolicy policy = d->getPolicy();
+        bool clean = true;
+
+        // an iteration that is running for too long
+        ffado_microsecs_t release = d->m_release;
+        if (d->m_active && now > release + WATCHDOG_DEADLINE_STALL_USECS) {
+            clean = false;
+        }
+        if (d->m_active && release != d->m_checked_release
+            && now > release + WATCHDOG_DEADLINE_STALL_USECS) {
+            d->m_checked_release = release;
+            d->m_record.stalls++;
+            if (policy != ThreadDeadline::eDP_Never) {
+                demote(d, "stalled");
+            } else {
+                debugOutput(DEBUG_LEVEL_VERBOSE, "(%p) thread '%s' stalled\n",
+                            this, d->getName().c_str());
+            }
+        }
+
+        // a thread that hogs the CPU. The part of the current iteration
+        // that ran so far counts as well, such that a long iteration is
+        // spread over the intervals it spans instead of being accounted
+        // to the interval in which it ends.
+        uint64_t busy = d->m_record.busy_usecs;
+        ffado_microsecs_t start = d->m_start;
+        if (d->m_active && now > start) {
+            busy += now - start;
+        }
+        uint64_t busy_delta = 0;
+        if (busy > d->m_checked_busy_usecs) {
+            busy_delta = busy - d->m_checked_busy_usecs;
+            d->m_checked_busy_usecs = busy;
+        }
+        if (busy_delta > interval) {
+            busy_delta = interval;
+        }
+        if (interval > 0
+            && busy_delta * 100 > interval * WATCHDOG_DEADLINE_MAX_LOAD_PCT) {
+            clean = false;
+            if (policy != ThreadDeadline::eDP_Never) {
+                demote(d, "is a runaway");
+            }
+        }
+
+        // repeated overruns
+        uint32_t bursts = d->m_overrun_bursts;
+        if (bursts != d->m_checked_overrun_bursts) {
+            d->m_checked_overrun_bursts = bursts;
+            clean = false;
+            if (policy == ThreadDeadline::eDP_OnOverrun) {
+                demote(d, "keeps overrunning its deadline");
+            } else {
+                debugOutput(DEBUG_LEVEL_VERBOSE, "(%p) thread '%s' overran %d times in a row\n",
+                            this, d->getName().c_str(), WATCHDOG_DEADLINE_OVERRUN_LIMIT);
+            }
+        }
 
-    for ( ThreadVectorIterator it = m_Threads.begin();
-      it != m_Threads.end();
+        if (!clean) {
+            d->m_clean_intervals = 0;
+        } else if (d->m_record.demoted
+                   && ++d->m_clean_intervals >= WATCHDOG_DEADLINE_PROMOTE_INTERVALS) {
+            promote(d);
+        }
+
+        if (d->m_slot) {
+            memcpy((void *)d->m_slot, (const void *)&d->m_record, sizeof(TelemetryThreadSlot));
+        }
+    }
+}
+
+void
+Watchdog::show()
+{
+    debugOutputShort(DEBUG_LEVEL_NORMAL, " Watchdog %p, check interval %u usec\n",
+                     this, m_check_interval);
+    Util::MutexLockHelper lock(*m_deadlines_lock);
+    for ( ThreadDeadlineVectorIterator it = m_deadlines.begin();
+      it != m_deadlines.end();
       ++it )
     {
-        (*it)->DropRealTime();
+        (*it)->show();
     }
 }
 
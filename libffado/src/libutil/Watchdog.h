@@ -26,14 +26,113 @@
 
 #include "debugmodule/debugmodule.h"
 #include "libutil/Thread.h"
+#include "libutil/StreamTelemetry.h"
+#include "libutil/SystemTimeSource.h"
+
+#include <vector>
+#include <string>
 
 namespace Util {
 
-typedef std::vector<Thread *> ThreadVector;
-typedef std::vector<Thread *>::iterator ThreadVectorIterator;
+class Mutex;
+
+/**
+ * @brief The deadline of one periodic RT thread
+ *
+ * The thread calls begin() when an iteration is released (e.g. when its
+ * poll() returns or its sleep ends) and end() when the iteration is done.
+ * An iteration is due budget usecs after its release time. The statistics
+ * are collected by the thread itself with plain stores, the watchdog only
+ * reads them, so the RT path takes no locks.
+ *
+ * The watchdog decides on demotion to non-RT scheduling according to the
+ * policy of the thread:
+ *  - eDP_Never: the statistics are collected, the thread is never demoted
+ *  - eDP_OnStall: the thread is demoted when a single iteration takes
+ *    longer than WATCHDOG_DEADLINE_STALL_USECS, or when the thread keeps
+ *    the CPU busy for more than WATCHDOG_DEADLINE_MAX_LOAD_PCT of a check
+ *    interval (a runaway thread)
+ *  - eDP_OnOverrun: as eDP_OnStall, and also after
+ *    WATCHDOG_DEADLINE_OVERRUN_LIMIT consecutive overruns
+ *
+ * A demoted thread gets its RT scheduling back after
+ * WATCHDOG_DEADLINE_PROMOTE_INTERVALS consecutive check intervals in which
+ * none of these conditions was seen, if it was an RT thread when it was
+ * demoted.
+ */
+class ThreadDeadline
+{
+    friend class Watchdog;
+public:
+    enum eDemotionPolicy {
+        eDP_Never = 0,
+        eDP_OnStall = 1,
+        eDP_OnOverrun = 2
+    };
+
+    ThreadDeadline(std::string name, Thread *thread,
+                   unsigned int budget_usecs, enum eDemotionPolicy policy);
+    virtual ~ThreadDeadline() {};
+
+    /// set the budget per iteration, to be called from the owning thread
+    void setBudget(unsigned int budget_usecs) {m_record.budget = budget_usecs;};
+    unsigned int getBudget() {return m_record.budget;};
+    void setPolicy(enum eDemotionPolicy policy) {m_record.policy = policy;};
+    enum eDemotionPolicy getPolicy() {return (enum eDemotionPolicy)m_record.policy;};
+
+    /**
+     * @brief start an iteration (RT safe)
+     * @param release the time at which the iteration was due to start
+     */
+    void begin(ffado_microsecs_t release);
+    /// start an iteration that is released now (RT safe)
+    void begin() {begin(SystemTimeSource::getCurrentTimeAsUsecs());};
+    /// end the current iteration, no-op if none is running (RT safe)
+    void end();
+    /// abandon the current iteration without accounting it (RT safe)
+    void cancel() {m_active = false;};
+
+    std::string getName() {return m_name;};
+    bool isDemoted() {return m_record.demoted;};
+    const TelemetryThreadSlot &getStatistics() {return m_record;};
+
+    void show();
 
-class IsoHandlerManager;
+private:
+    std::string         m_name;
+    Thread *            m_thread;
+
+    // written by the owning thread only
+    volatile bool       m_active;
+    volatile ffado_microsecs_t m_release;
+    volatile ffado_microsecs_t m_start;
+    unsigned int        m_consecutive_overruns;
+    volatile uint32_t   m_overrun_bursts;
+    TelemetryThreadSlot m_record;
+
+    // owned by the watchdog
+    TelemetryThreadSlot *m_slot;
+    uint64_t            m_checked_busy_usecs;
+    uint32_t            m_checked_overrun_bursts;
+    ffado_microsecs_t   m_checked_release;
+    bool                m_demoted_from_rt;
+    unsigned int        m_clean_intervals;
 
+protected:
+    DECLARE_DEBUG_MODULE;
+};
+
+typedef std::vector<ThreadDeadline *> ThreadDeadlineVector;
+typedef std::vector<ThreadDeadline *>::iterator ThreadDeadlineVectorIterator;
+
+/**
+ * @brief Monitors the deadlines of the RT threads
+ *
+ * A check thread inspects the deadlines of all registered threads at every
+ * check interval, demotes the threads that misbehave according to their
+ * policy, and copies their statistics into the telemetry segment if one is
+ * attached.
+ */
 class Watchdog
 {
 private:
@@ -70,55 +169,52 @@ private:
         DECLARE_DEBUG_MODULE_REFERENCE;
     };
 
-    class WatchdogHartbeatTask : public WatchdogTask
-    {
-    public:
-        WatchdogHartbeatTask(Watchdog& parent, unsigned int interval_usecs);
-        virtual ~WatchdogHartbeatTask() {};
-
-        bool Init();
-        bool Execute();
-    private:
-        // debug stuff
-        #ifdef DEBUG
-            uint64_t m_last_loop_entry;
-            int m_successive_short_loops;
-        #endif
-        DECLARE_DEBUG_MODULE_REFERENCE;
-    };
-
 public:
     Watchdog();
     Watchdog(unsigned int interval_usec, bool realtime, unsigned int priority);
     virtual ~Watchdog();
 
-    bool registerThread(Thread *thread);
-    bool unregisterThread(Thread *thread);
+    /**
+     * @brief register a thread whose deadlines are to be monitored
+     * @param name the name used in the log and in the telemetry
+     * @param thread the thread to demote, NULL if it is not ours
+     * @param budget_usecs the budget of an iteration
+     * @param policy the demotion policy
+     * @return the deadline, owned by the watchdog, NULL on failure
+     */
+    ThreadDeadline *registerThread(std::string name, Thread *thread,
+                                   unsigned int budget_usecs,
+                                   enum ThreadDeadline::eDemotionPolicy policy);
+    /// unregister (and delete) a deadline, the thread should no longer use it
+    bool unregisterThread(ThreadDeadline *deadline);
+
+    /// publish the deadline statistics in a telemetry segment (NULL to detach)
+    void setTelemetry(StreamTelemetry *telemetry);
 
     bool start();
 
     bool setThreadParameters(bool rt, int priority);
 
+    void show();
     void setVerboseLevel(int i);
 
 protected:
-    bool getHartbeat() {return m_hartbeat;};
-    void clearHartbeat() {m_hartbeat=false;};
-    void setHartbeat() {m_hartbeat=true;};
-
-    void rescheduleThreads();
+    void checkDeadlines();
 
 private:
-    ThreadVector    m_Threads;
-    bool            m_hartbeat;
+    void demote(ThreadDeadline *d, const char *reason);
+    void promote(ThreadDeadline *d);
+
+    ThreadDeadlineVector m_deadlines;
+    Mutex *         m_deadlines_lock;
+    StreamTelemetry *m_telemetry;
+    ffado_microsecs_t m_last_check;
 
     unsigned int    m_check_interval;
     bool            m_realtime;
     int             m_priority;
     Util::Thread *  m_CheckThread;
-    Util::Thread *  m_HartbeatThread;
     WatchdogCheckTask *     m_CheckTask;
-    WatchdogHartbeatTask *  m_HartbeatTask;
 
     DECLARE_DEBUG_MODULE;
 };
@@ -126,5 +222,3 @@ private:
 } // end of namespace Util
 
 #endif /* __FFADO_WATCHDOG__ */
-
-
@@ -28,38 +28,105 @@
 #include "rme/rme_avdevice.h"
 #include "rme/fireface_def.h"
 
+#include "libutil/FlashTransfer.h"
+
 #include "debugmodule/debugmodule.h"
 
 #define MAX_FLASH_BUSY_RETRIES    25
 
 namespace Rme {
 
-signed int 
-Device::wait_while_busy(unsigned int init_delay_ms) 
+// The flash busy state of a Fireface, as seen by Util::FlashTransfer
+class FlashBusyStatus : public Util::FlashStatusSource
 {
-    signed int i;
-    quadlet_t status;
-
-    // Wait for the device to become available for a new command.  A delay
-    // of init_delay_ms is executed prior to each test of the device status.
-    for (i=0; i<MAX_FLASH_BUSY_RETRIES; i++) {
-        usleep(init_delay_ms*1000);
-        if (m_rme_model == RME_MODEL_FIREFACE400) {
-            status = readRegister(RME_FF400_FLASH_STAT_REG);
-            if (status == 0)
-                break;
-        } else 
-        if (m_rme_model == RME_MODEL_FIREFACE800) {
-            status = readRegister(RME_FF_STATUS_REG1);
-            if (status & 0x40000000)
-                break;
+public:
+    FlashBusyStatus(Device &dev) : m_dev(dev) {};
+    virtual eFlashStatus getFlashStatus() {
+        quadlet_t status;
+        if (m_dev.getRmeModel() == RME_MODEL_FIREFACE400) {
+            status = m_dev.readRegister(RME_FF400_FLASH_STAT_REG);
+            return (status == 0) ? eFS_Ready : eFS_Busy;
         } else {
-            debugOutput(DEBUG_LEVEL_ERROR, "unimplemented model %d\n", m_rme_model);
-            return -1;
+            status = m_dev.readRegister(RME_FF_STATUS_REG1);
+            return (status & 0x40000000) ? eFS_Ready : eFS_Busy;
         }
+    };
+private:
+    Device &m_dev;
+};
+
+// The Fireface flash as seen by Util::FlashTransfer.  The flash is erased
+// per region by erase_flash(), so the engine doesn't erase.  Every block
+// transfer waits for the device itself, since the device needs a
+// minimum delay before its busy flag can be trusted.
+class FlashAccess : public Util::FlashTarget
+{
+public:
+    FlashAccess(Device &dev) : m_dev(dev), m_status(dev) {};
+
+    virtual eFlashStatus getFlashStatus() {
+        return m_status.getFlashStatus();
+    };
+    virtual unsigned int getMaxReadQuads() {
+        return m_dev.m_rme_model == RME_MODEL_FIREFACE800 ? RME_FF_FLASH_SECTOR_SIZE_QUADS : 32;
+    };
+    virtual unsigned int getMaxWriteQuads() {
+        return getMaxReadQuads();
+    };
+    virtual bool pollAfterWrite() {return false;};
+
+    virtual bool readFlashBlock(uint64_t addr, uint32_t *buffer, unsigned int nb_quads) {
+        if (m_dev.m_rme_model == RME_MODEL_FIREFACE800) {
+            return m_dev.readBlock(addr, buffer, nb_quads) == 0;
+        }
+        quadlet_t block_desc[2];
+        block_desc[0] = (addr & 0xffffffff);
+        block_desc[1] = nb_quads * sizeof(quadlet_t);
+        // Program the read address and size, execute the read and wait
+        // for its completion, then read from the bounce buffer
+        return m_dev.writeBlock(RME_FF400_FLASH_BLOCK_ADDR_REG, block_desc, 2) == 0
+            && m_dev.writeRegister(RME_FF400_FLASH_CMD_REG, RME_FF400_FLASH_CMD_READ) == 0
+            && m_dev.wait_while_busy(2) == 0
+            && m_dev.readBlock(RME_FF400_FLASH_READ_BUFFER, buffer, nb_quads) == 0;
+    };
+    virtual bool writeFlashBlock(uint64_t addr, uint32_t *buffer, unsigned int nb_quads) {
+        if (m_dev.m_rme_model == RME_MODEL_FIREFACE800) {
+            return m_dev.writeBlock(addr, buffer, nb_quads) == 0
+                && m_dev.wait_while_busy(5) == 0;
+        }
+        quadlet_t block_desc[2];
+        block_desc[0] = (addr & 0xffffffff);
+        block_desc[1] = nb_quads * sizeof(quadlet_t);
+        // Send data to the flash buffer, program the destination address
+        // and size, then execute the write and wait for its completion
+        return m_dev.writeBlock(RME_FF400_FLASH_WRITE_BUFFER, buffer, nb_quads) == 0
+            && m_dev.writeBlock(RME_FF400_FLASH_BLOCK_ADDR_REG, block_desc, 2) == 0
+            && m_dev.writeRegister(RME_FF400_FLASH_CMD_REG, RME_FF400_FLASH_CMD_WRITE) == 0
+            && m_dev.wait_while_busy(2) == 0;
+    };
+private:
+    Device &m_dev;
+    FlashBusyStatus m_status;
+};
+
+signed int 
+Device::wait_while_busy(unsigned int init_delay_ms) 
+{
+    // Wait for the device to become available for a new command.  The
+    // device doesn't raise its busy flag right away, so the status can
+    // only be trusted after init_delay_ms.  From then on it is polled
+    // with an increasing interval until the device is ready; the wait is
+    // given up after MAX_FLASH_BUSY_RETRIES times init_delay_ms.
+    if (m_rme_model != RME_MODEL_FIREFACE400 && m_rme_model != RME_MODEL_FIREFACE800) {
+        debugOutput(DEBUG_LEVEL_ERROR, "unimplemented model %d\n", m_rme_model);
+        return -1;
     }
 
-    if (i == MAX_FLASH_BUSY_RETRIES)
+    FlashBusyStatus status(*this);
+    usleep(init_delay_ms*1000);
+    if (status.getFlashStatus() == Util::FlashStatusSource::eFS_Ready)
+        return 0;
+    if (!Util::FlashTransfer::waitForCompletion(status, init_delay_ms*(MAX_FLASH_BUSY_RETRIES-1)))
         return -1;
     return 0;
 }
@@ -90,41 +157,14 @@ Device::read_flash(fb_nodeaddr_t addr, quadlet_t *buf, unsigned int n_quads)
     // hold the result.  Return 0 on success, -1 on error.  The caller must ensure
     // that the flash source address makes sense for the device in use.
 
-    unsigned int xfer_size;
-    unsigned int err = 0;
-    quadlet_t block_desc[2];
-    quadlet_t ff400_addr = (addr & 0xffffffff);
-
-    if (m_rme_model == RME_MODEL_FIREFACE800) {
-        do {
-            xfer_size = (n_quads > RME_FF_FLASH_SECTOR_SIZE_QUADS)?RME_FF_FLASH_SECTOR_SIZE_QUADS:n_quads;
-            err |= readBlock(addr, buf, xfer_size);
-            n_quads -= xfer_size;
-            buf += xfer_size;
-            addr += xfer_size*sizeof(quadlet_t);
-        } while (n_quads>0 && !err);
-    } else {
-        // FF400 case follows
-        do {
-            xfer_size = (n_quads > 32)?32:n_quads;
-            block_desc[0] = ff400_addr;
-            block_desc[1] = xfer_size * sizeof(quadlet_t);
-            // Program the read address and size
-            err |= writeBlock(RME_FF400_FLASH_BLOCK_ADDR_REG, block_desc, 2);
-            // Execute the read and wait for its completion
-            err |= writeRegister(RME_FF400_FLASH_CMD_REG, RME_FF400_FLASH_CMD_READ);
-           if (!err)
-               wait_while_busy(2);
-            // Read from bounce buffer into final destination
-            err |= readBlock(RME_FF400_FLASH_READ_BUFFER, buf, xfer_size);
-
-            n_quads -= xfer_size;
-            ff400_addr += xfer_size*sizeof(quadlet_t);
-            buf += xfer_size;
-        } while (n_quads>0 && !err);
+    if (m_rme_model != RME_MODEL_FIREFACE400 && m_rme_model != RME_MODEL_FIREFACE800) {
+        debugOutput(DEBUG_LEVEL_ERROR, "unimplemented model %d\n", m_rme_model);
+        return -1;
     }
 
-    return err?-1:0;
+    FlashAccess flash(*this);
+    Util::FlashTransfer xfer(flash);
+    return xfer.read(addr, buf, n_quads) ? 0 : -1;
 }
 
 signed int
@@ -185,50 +225,21 @@ Device::write_flash(fb_nodeaddr_t addr, quadlet_t *buf, unsigned int n_quads)
 {
     // Write "n_quads" quadlets to the Fireface Flash starting at address
     // addr.  Return 0 on success, -1 on error.  The caller must ensure the
-    // supplied address is appropriate for the device in use.
-
-    unsigned int xfer_size;
-    unsigned int err = 0;
-    quadlet_t block_desc[2];
-    quadlet_t ff400_addr = (addr & 0xffffffff);
+    // supplied address is appropriate for the device in use.  The region
+    // has to be erased with erase_flash() first.
 
-    if (m_rme_model == RME_MODEL_FIREFACE800) {
-        do {
-            xfer_size = (n_quads > RME_FF_FLASH_SECTOR_SIZE_QUADS)?RME_FF_FLASH_SECTOR_SIZE_QUADS:n_quads;
-            err |= writeBlock(addr, buf, xfer_size);
-            if (!err) {
-                err = wait_while_busy(5) != 0;
-                if (err)
-                    debugOutput(DEBUG_LEVEL_WARNING, "device still busy after flash write\n");
-            } else
-                debugOutput(DEBUG_LEVEL_WARNING, "flash writeBlock() failed\n");
-            n_quads -= xfer_size;
-            buf += xfer_size;
-            addr += xfer_size*sizeof(quadlet_t);
-        } while (n_quads>0 && !err);
-        return err?-1:0;
+    if (m_rme_model != RME_MODEL_FIREFACE400 && m_rme_model != RME_MODEL_FIREFACE800) {
+        debugOutput(DEBUG_LEVEL_ERROR, "unimplemented model %d\n", m_rme_model);
+        return -1;
     }
 
-    // FF400 case follows
-    do {
-        xfer_size = (n_quads > 32)?32:n_quads;
-        // Send data to flash buffer
-        err |= writeBlock(RME_FF400_FLASH_WRITE_BUFFER, buf, xfer_size);
-        // Program the destination address and size
-        block_desc[0] = ff400_addr;
-        block_desc[1] = xfer_size * sizeof(quadlet_t);
-        err |= writeBlock(RME_FF400_FLASH_BLOCK_ADDR_REG, block_desc, 2);
-        // Execute the write and wait for its completion
-        err |= writeRegister(RME_FF400_FLASH_CMD_REG, RME_FF400_FLASH_CMD_WRITE);
-        if (!err)
-            wait_while_busy(2);
-
-        n_quads -= xfer_size;
-        ff400_addr += xfer_size*sizeof(quadlet_t);
-        buf += xfer_size;
-    } while (n_quads>0 && !err);
-
-    return err?-1:0;
+    FlashAccess flash(*this);
+    Util::FlashTransfer xfer(flash);
+    // The region was just erased, so there is nothing to skip.  The
+    // blocks are not read back, as before.
+    xfer.setSkipUnchanged(false);
+    xfer.setVerify(false);
+    return xfer.write(addr, buf, n_quads) ? 0 : -1;
 }
 
 
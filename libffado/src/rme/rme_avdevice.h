@@ -182,6 +182,7 @@ private:
     unsigned long long int flash_mixer_hw_addr();
 
     /* Low-level flash memory functions */
+    friend class FlashAccess;
     signed int wait_while_busy(unsigned int init_delay);
     signed int get_revision(unsigned int *revision);
     signed int read_flash(fb_nodeaddr_t addr, quadlet_t *buf, unsigned int n_quads);
@@ -28,17 +28,29 @@
 #include "libcontrol/CrossbarRouter.h"
 #include "libutil/Time.h"
 #include "libutil/PosixMutex.h"
+#include "libutil/PosixThread.h"
+#include "libutil/SystemTimeSource.h"
+
+#include <errno.h>
+#include <sstream>
 
 namespace DBusControl {
 
 IMPL_DEBUG_MODULE( Element, Element, DEBUG_LEVEL_NORMAL );
+IMPL_DEBUG_MODULE( ChangeNotifier, ChangeNotifier, DEBUG_LEVEL_NORMAL );
+IMPL_DEBUG_MODULE( CallPool, CallPool, DEBUG_LEVEL_NORMAL );
 
 // --- Element
 Element::Element( DBus::Connection& connection, std::string p, Element* parent, Control::Element &slave)
 : DBus::ObjectAdaptor(connection, p)
 , m_Parent(parent)
 , m_Slave(slave)
+, m_SlaveGone( false )
 , m_UpdateLock( NULL )
+, m_ChangeNotifier( NULL )
+, m_CallPool( NULL )
+, m_SerializationKey( NULL )
+, m_valueFunctor( NULL )
 {
     debugOutput( DEBUG_LEVEL_VERBOSE, "Created Element on '%s'\n",
                  path().c_str() );
@@ -48,8 +60,129 @@ Element::Element( DBus::Connection& connection, std::string p, Element* parent,
     } else {
         m_UpdateLock = NULL;
     }
+    // the devices are the children of the root, the calls for the
+    // elements of one device are serialized. The key is the control
+    // element, such that other users of the device can use it too.
+    if(parent == NULL || parent->m_Parent == NULL) {
+        m_SerializationKey = &slave;
+    } else {
+        m_SerializationKey = parent->m_SerializationKey;
+    }
     // set verbose level AFTER allocating the lock
     setVerboseLevel(m_Slave.getVerboseLevel());
+
+    // follow the value changes of the slave
+    m_valueFunctor = new MemberSignalFunctor1< Element*,
+                      void (Element::*)(int) >
+                      ( this, &Element::valueChanged, (int)Control::Element::eS_ValueChanged );
+    if(!m_Slave.addSignalHandler(m_valueFunctor)) {
+        debugWarning("Could not add value change signal functor\n");
+    }
+}
+
+Element::~Element()
+{
+    if(!m_SlaveGone && !m_Slave.remSignalHandler(m_valueFunctor)) {
+        debugWarning("Could not remove value change signal functor\n");
+    }
+    delete m_valueFunctor;
+
+    // drop the changes and calls that are still pending
+    ChangeNotifier *n = getChangeNotifier();
+    if(n) n->elementRemoved(this);
+    CallPool *pool = getCallPool();
+    if(pool) pool->cancel(this);
+
+    if(m_UpdateLock) delete m_UpdateLock;
+}
+
+void
+Element::setSlaveGone()
+{
+    m_SlaveGone = true;
+}
+
+void
+Element::valueChanged(int idx)
+{
+    debugOutput( DEBUG_LEVEL_VERY_VERBOSE, "value %d of '%s' changed\n",
+                 idx, path().c_str() );
+    ChangeNotifier *n = getChangeNotifier();
+    if(n) n->elementChanged(this, idx);
+}
+
+void
+Element::setChangeNotifier(ChangeNotifier *n)
+{
+    if(m_Parent) {
+        debugError("Only the root element has a change notifier\n");
+        return;
+    }
+    m_ChangeNotifier = n;
+}
+
+ChangeNotifier *
+Element::getChangeNotifier()
+{
+    if(m_Parent) {
+        return m_Parent->getChangeNotifier();
+    } else {
+        return m_ChangeNotifier;
+    }
+}
+
+void
+Element::setCallPool(CallPool *p)
+{
+    if(m_Parent) {
+        debugError("Only the root element has a call pool\n");
+        return;
+    }
+    m_CallPool = p;
+}
+
+CallPool *
+Element::getCallPool()
+{
+    if(m_Parent) {
+        return m_Parent->getCallPool();
+    } else {
+        return m_CallPool;
+    }
+}
+
+void
+Element::deferCall(DeferredCall *c)
+{
+    CallPool *pool = getCallPool();
+    if(pool == NULL || !pool->submit(c)) {
+        delete c;
+        return;
+    }
+    // unwinds to the adaptor, the call is the tag of the reply
+    return_later(c);
+}
+
+void
+Element::sendReply(DeferredCall *c)
+{
+    DBus::ObjectAdaptor::Continuation *ret = find_continuation(c);
+    if(ret == NULL) {
+        debugWarning("No pending reply for %s on '%s'\n", c->m_method, path().c_str());
+        return;
+    }
+    c->writeReply(ret->writer());
+    return_now(ret);
+}
+
+DeferredCall::DeferredCall(Element &e, const char *method)
+: m_element( e )
+, m_method( method )
+, m_key( e.getSerializationKey() )
+, m_queued( 0 )
+, m_started( 0 )
+, m_finished( 0 )
+{
 }
 
 void Element::setVerboseLevel( const int32_t &i)
@@ -167,7 +300,7 @@ Container::~Container() {
 
     Destroyed(); //send dbus signal
 
-    if(m_updateFunctor) {
+    if(m_updateFunctor && !m_SlaveGone) {
         if(!m_Slave.remSignalHandler(m_updateFunctor)) {
             debugWarning("Could not remove update signal functor\n");
         }
@@ -182,6 +315,18 @@ Container::~Container() {
     }
 }
 
+void
+Container::setSlaveGone()
+{
+    Element::setSlaveGone();
+    for ( ElementVectorIterator it = m_Children.begin();
+      it != m_Children.end();
+      ++it )
+    {
+        (*it)->setSlaveGone();
+    }
+}
+
 void
 Container::setVerboseLevel( const int32_t & i)
 {
@@ -199,6 +344,13 @@ Container::getNbElements( ) {
     return m_Slave.countElements();
 }
 
+std::vector< std::string >
+Container::getCallStatistics( ) {
+    CallPool *pool = getCallPool();
+    if(pool) return pool->getStatistics();
+    return std::vector< std::string >();
+}
+
 std::string
 Container::getElementName( const int32_t& i ) {
     int nbElements=m_Slave.countElements();
@@ -282,6 +434,7 @@ Container::updateTree()
     // do the actual remove
     while(to_remove.size()) {
         Element * e = *(to_remove.begin());
+        e->setSlaveGone();
         removeElement(e);
         to_remove.erase(to_remove.begin());
     }
@@ -463,8 +616,17 @@ Continuous::Continuous( DBus::Connection& connection, std::string p, Element* pa
 
 double
 Continuous::setValue( const double& value )
+{
+    deferCall(new MemberCall1< Continuous, double, double >
+                  (*this, &Continuous::doSetValue, "Continuous.setValue", value));
+    return doSetValue(value);
+}
+
+double
+Continuous::doSetValue( const double& value )
 {
     m_Slave.setValue(value);
+    m_Slave.notifyValueChanged();
 /*    
     SleepRelativeUsec(1000*500);
     
@@ -475,7 +637,15 @@ Continuous::setValue( const double& value )
 }
 
 double
-Continuous::getValue(  )
+Continuous::getValue( )
+{
+    deferCall(new MemberCall0< Continuous, double >
+                  (*this, &Continuous::doGetValue, "Continuous.getValue"));
+    return doGetValue();
+}
+
+double
+Continuous::doGetValue(  )
 {
     double val = m_Slave.getValue();
     debugOutput( DEBUG_LEVEL_VERBOSE, "getValue() => %lf\n", val );
@@ -484,8 +654,17 @@ Continuous::getValue(  )
 
 double
 Continuous::setValueIdx( const int32_t & idx, const double& value )
+{
+    deferCall(new MemberCall2< Continuous, double, int32_t, double >
+                  (*this, &Continuous::doSetValueIdx, "Continuous.setValueIdx", idx, value));
+    return doSetValueIdx(idx, value);
+}
+
+double
+Continuous::doSetValueIdx( const int32_t & idx, const double& value )
 {
     m_Slave.setValue(idx, value);
+    m_Slave.notifyValueChanged(idx);
 /*    
     SleepRelativeUsec(1000*500);
     
@@ -497,6 +676,14 @@ Continuous::setValueIdx( const int32_t & idx, const double& value )
 
 double
 Continuous::getValueIdx( const int32_t & idx )
+{
+    deferCall(new MemberCall1< Continuous, double, int32_t >
+                  (*this, &Continuous::doGetValueIdx, "Continuous.getValueIdx", idx));
+    return doGetValueIdx(idx);
+}
+
+double
+Continuous::doGetValueIdx( const int32_t & idx )
 {
     double val = m_Slave.getValue(idx);
     debugOutput( DEBUG_LEVEL_VERBOSE, "getValue(%d) => %lf\n", idx, val );
@@ -531,8 +718,17 @@ Discrete::Discrete( DBus::Connection& connection, std::string p, Element* parent
 
 int32_t
 Discrete::setValue( const int32_t& value )
+{
+    deferCall(new MemberCall1< Discrete, int32_t, int32_t >
+                  (*this, &Discrete::doSetValue, "Discrete.setValue", value));
+    return doSetValue(value);
+}
+
+int32_t
+Discrete::doSetValue( const int32_t& value )
 {
     m_Slave.setValue(value);
+    m_Slave.notifyValueChanged();
     
 /*    SleepRelativeUsec(1000*500);
     debugOutput( DEBUG_LEVEL_VERBOSE, "setValue(%d) => %d\n", value, m_Slave.getValue() );
@@ -543,6 +739,14 @@ Discrete::setValue( const int32_t& value )
 
 int32_t
 Discrete::getValue()
+{
+    deferCall(new MemberCall0< Discrete, int32_t >
+                  (*this, &Discrete::doGetValue, "Discrete.getValue"));
+    return doGetValue();
+}
+
+int32_t
+Discrete::doGetValue()
 {
     int32_t val = m_Slave.getValue();
     debugOutput( DEBUG_LEVEL_VERBOSE, "getValue() => %d\n", val );
@@ -551,8 +755,17 @@ Discrete::getValue()
 
 int32_t
 Discrete::setValueIdx( const int32_t& idx, const int32_t& value )
+{
+    deferCall(new MemberCall2< Discrete, int32_t, int32_t, int32_t >
+                  (*this, &Discrete::doSetValueIdx, "Discrete.setValueIdx", idx, value));
+    return doSetValueIdx(idx, value);
+}
+
+int32_t
+Discrete::doSetValueIdx( const int32_t& idx, const int32_t& value )
 {
     m_Slave.setValue(idx, value);
+    m_Slave.notifyValueChanged(idx);
     
 /*    SleepRelativeUsec(1000*500);
     debugOutput( DEBUG_LEVEL_VERBOSE, "setValue(%d) => %d\n", value, m_Slave.getValue() );
@@ -563,6 +776,14 @@ Discrete::setValueIdx( const int32_t& idx, const int32_t& value )
 
 int32_t
 Discrete::getValueIdx( const int32_t& idx )
+{
+    deferCall(new MemberCall1< Discrete, int32_t, int32_t >
+                  (*this, &Discrete::doGetValueIdx, "Discrete.getValueIdx", idx));
+    return doGetValueIdx(idx);
+}
+
+int32_t
+Discrete::doGetValueIdx( const int32_t& idx )
 {
     int32_t val = m_Slave.getValue(idx);
     debugOutput( DEBUG_LEVEL_VERBOSE, "getValue(%d) => %d\n", idx, val );
@@ -581,8 +802,17 @@ Text::Text( DBus::Connection& connection, std::string p, Element* parent, Contro
 
 std::string
 Text::setValue( const std::string& value )
+{
+    deferCall(new MemberCall1< Text, std::string, std::string >
+                  (*this, &Text::doSetValue, "Text.setValue", value));
+    return doSetValue(value);
+}
+
+std::string
+Text::doSetValue( const std::string& value )
 {
     m_Slave.setValue(value);
+    m_Slave.notifyValueChanged();
     
 /*    SleepRelativeUsec(1000*500);
     debugOutput( DEBUG_LEVEL_VERBOSE, "setValue(%d) => %d\n", value, m_Slave.getValue() );
@@ -593,6 +823,14 @@ Text::setValue( const std::string& value )
 
 std::string
 Text::getValue()
+{
+    deferCall(new MemberCall0< Text, std::string >
+                  (*this, &Text::doGetValue, "Text.getValue"));
+    return doGetValue();
+}
+
+std::string
+Text::doGetValue()
 {
     std::string val = m_Slave.getValue();
     debugOutput( DEBUG_LEVEL_VERBOSE, "getValue() => %s\n", val.c_str() );
@@ -611,6 +849,14 @@ Register::Register( DBus::Connection& connection, std::string p, Element* parent
 
 uint64_t
 Register::setValue( const uint64_t& addr, const uint64_t& value )
+{
+    deferCall(new MemberCall2< Register, uint64_t, uint64_t, uint64_t >
+                  (*this, &Register::doSetValue, "Register.setValue", addr, value));
+    return doSetValue(addr, value);
+}
+
+uint64_t
+Register::doSetValue( const uint64_t& addr, const uint64_t& value )
 {
     m_Slave.setValue(addr, value);
     
@@ -623,6 +869,14 @@ Register::setValue( const uint64_t& addr, const uint64_t& value )
 
 uint64_t
 Register::getValue( const uint64_t& addr )
+{
+    deferCall(new MemberCall1< Register, uint64_t, uint64_t >
+                  (*this, &Register::doGetValue, "Register.getValue", addr));
+    return doGetValue(addr);
+}
+
+uint64_t
+Register::doGetValue( const uint64_t& addr )
 {
     uint64_t val = m_Slave.getValue(addr);
     debugOutput( DEBUG_LEVEL_VERBOSE, "getValue(%"PRId64") => %"PRId64"\n", addr, val );
@@ -641,13 +895,31 @@ Enum::Enum( DBus::Connection& connection, std::string p, Element* parent, Contro
 
 int32_t
 Enum::select( const int32_t& idx )
+{
+    deferCall(new MemberCall1< Enum, int32_t, int32_t >
+                  (*this, &Enum::doSelect, "Enum.select", idx));
+    return doSelect(idx);
+}
+
+int32_t
+Enum::doSelect( const int32_t& idx )
 {
     debugOutput( DEBUG_LEVEL_VERY_VERBOSE, "select(%d)\n", idx );
-    return  m_Slave.select(idx);
+    int32_t retval = m_Slave.select(idx);
+    if(retval) m_Slave.notifyValueChanged();
+    return retval;
 }
 
 int32_t
 Enum::selected()
+{
+    deferCall(new MemberCall0< Enum, int32_t >
+                  (*this, &Enum::doSelected, "Enum.selected"));
+    return doSelected();
+}
+
+int32_t
+Enum::doSelected()
 {
     int retval = m_Slave.selected();
     debugOutput( DEBUG_LEVEL_VERY_VERBOSE, "selected() => %d\n", retval );
@@ -687,13 +959,31 @@ AttributeEnum::AttributeEnum( DBus::Connection& connection, std::string p, Eleme
 
 int32_t
 AttributeEnum::select( const int32_t& idx )
+{
+    deferCall(new MemberCall1< AttributeEnum, int32_t, int32_t >
+                  (*this, &AttributeEnum::doSelect, "AttributeEnum.select", idx));
+    return doSelect(idx);
+}
+
+int32_t
+AttributeEnum::doSelect( const int32_t& idx )
 {
     debugOutput( DEBUG_LEVEL_VERY_VERBOSE, "select(%d)\n", idx );
-    return  m_Slave.select(idx);
+    int32_t retval = m_Slave.select(idx);
+    if(retval) m_Slave.notifyValueChanged();
+    return retval;
 }
 
 int32_t
 AttributeEnum::selected()
+{
+    deferCall(new MemberCall0< AttributeEnum, int32_t >
+                  (*this, &AttributeEnum::doSelected, "AttributeEnum.selected"));
+    return doSelected();
+}
+
+int32_t
+AttributeEnum::doSelected()
 {
     int retval = m_Slave.selected();
     debugOutput( DEBUG_LEVEL_VERY_VERBOSE, "selected() => %d\n", retval );
@@ -726,6 +1016,14 @@ AttributeEnum::getEnumLabel( const int32_t & idx )
 
 std::string
 AttributeEnum::getAttributeValue( const int32_t & idx )
+{
+    deferCall(new MemberCall1< AttributeEnum, std::string, int32_t >
+                  (*this, &AttributeEnum::doGetAttributeValue, "AttributeEnum.getAttributeValue", idx));
+    return doGetAttributeValue(idx);
+}
+
+std::string
+AttributeEnum::doGetAttributeValue( const int32_t & idx )
 {
     std::string retval = m_Slave.getAttributeValue(idx);
     debugOutput( DEBUG_LEVEL_VERBOSE, "getAttributeValue(%d) => %s\n", idx, retval.c_str() );
@@ -812,12 +1110,31 @@ MatrixMixer::canWrite( const int32_t& row, const int32_t& col) {
 }
 
 double
-MatrixMixer::setValue( const int32_t& row, const int32_t& col, const double& val ) {
-    return m_Slave.setValue(row,col,val);
+MatrixMixer::setValue( const int32_t& row, const int32_t& col, const double& val )
+{
+    deferCall(new MemberCall3< MatrixMixer, double, int32_t, int32_t, double >
+                  (*this, &MatrixMixer::doSetValue, "MatrixMixer.setValue", row, col, val));
+    return doSetValue(row, col, val);
 }
 
 double
-MatrixMixer::getValue( const int32_t& row, const int32_t& col) {
+MatrixMixer::doSetValue( const int32_t& row, const int32_t& col, const double& val ) {
+    double retval = m_Slave.setValue(row,col,val);
+    // the index of a cell is row * nb_cols + col
+    m_Slave.notifyValueChanged(row * m_Slave.getColCount() + col);
+    return retval;
+}
+
+double
+MatrixMixer::getValue( const int32_t& row, const int32_t& col )
+{
+    deferCall(new MemberCall2< MatrixMixer, double, int32_t, int32_t >
+                  (*this, &MatrixMixer::doGetValue, "MatrixMixer.getValue", row, col));
+    return doGetValue(row, col);
+}
+
+double
+MatrixMixer::doGetValue( const int32_t& row, const int32_t& col) {
     return m_Slave.getValue(row,col);
 }
 
@@ -856,11 +1173,15 @@ MatrixMixer::availableConnectionsForCol( const int32_t& col) {
 }
 bool
 MatrixMixer::connectRowTo( const int32_t& row, const std::string& target) {
-    return m_Slave.connectRowTo(row, target);
+    bool retval = m_Slave.connectRowTo(row, target);
+    if(retval) m_Slave.notifyValueChanged();
+    return retval;
 }
 bool
 MatrixMixer::connectColTo( const int32_t& col, const std::string& target) {
-    return m_Slave.connectColTo(col, target);
+    bool retval = m_Slave.connectColTo(col, target);
+    if(retval) m_Slave.notifyValueChanged();
+    return retval;
 }
 
 // --- CrossbarRouter
@@ -918,11 +1239,29 @@ CrossbarRouter::canConnect(const std::string &source, const std::string &dest)
 bool
 CrossbarRouter::setConnectionState(const std::string &source, const std::string &dest, const bool &enable)
 {
-    return m_Slave.setConnectionState(source, dest, enable);
+    deferCall(new MemberCall3< CrossbarRouter, bool, std::string, std::string, bool >
+                  (*this, &CrossbarRouter::doSetConnectionState, "CrossbarRouter.setConnectionState", source, dest, enable));
+    return doSetConnectionState(source, dest, enable);
+}
+
+bool
+CrossbarRouter::doSetConnectionState(const std::string &source, const std::string &dest, const bool &enable)
+{
+    bool retval = m_Slave.setConnectionState(source, dest, enable);
+    if(retval) m_Slave.notifyValueChanged();
+    return retval;
 }
 
 bool
 CrossbarRouter::getConnectionState(const std::string &source, const std::string &dest)
+{
+    deferCall(new MemberCall2< CrossbarRouter, bool, std::string, std::string >
+                  (*this, &CrossbarRouter::doGetConnectionState, "CrossbarRouter.getConnectionState", source, dest));
+    return doGetConnectionState(source, dest);
+}
+
+bool
+CrossbarRouter::doGetConnectionState(const std::string &source, const std::string &dest)
 {
     return m_Slave.getConnectionState(source, dest);
 }
@@ -930,7 +1269,17 @@ CrossbarRouter::getConnectionState(const std::string &source, const std::string
 bool
 CrossbarRouter::clearAllConnections()
 {
-    return m_Slave.clearAllConnections();
+    deferCall(new MemberCall0< CrossbarRouter, bool >
+                  (*this, &CrossbarRouter::doClearAllConnections, "CrossbarRouter.clearAllConnections"));
+    return doClearAllConnections();
+}
+
+bool
+CrossbarRouter::doClearAllConnections()
+{
+    bool retval = m_Slave.clearAllConnections();
+    if(retval) m_Slave.notifyValueChanged();
+    return retval;
 }
 
 bool
@@ -941,11 +1290,27 @@ CrossbarRouter::hasPeakMetering()
 
 double
 CrossbarRouter::getPeakValue(const std::string &dest)
+{
+    deferCall(new MemberCall1< CrossbarRouter, double, std::string >
+                  (*this, &CrossbarRouter::doGetPeakValue, "CrossbarRouter.getPeakValue", dest));
+    return doGetPeakValue(dest);
+}
+
+double
+CrossbarRouter::doGetPeakValue(const std::string &dest)
 {
     return m_Slave.getPeakValue(dest);
 }
 std::vector< DBus::Struct<std::string, double> >
 CrossbarRouter::getPeakValues()
+{
+    deferCall(new MemberCall0< CrossbarRouter, std::vector< DBus::Struct<std::string, double> > >
+                  (*this, &CrossbarRouter::doGetPeakValues, "CrossbarRouter.getPeakValues"));
+    return doGetPeakValues();
+}
+
+std::vector< DBus::Struct<std::string, double> >
+CrossbarRouter::doGetPeakValues()
 {
     std::map<std::string, double> peakvalues = m_Slave.getPeakValues();
     std::vector< DBus::Struct<std::string, double> > ret;
@@ -979,13 +1344,31 @@ Boolean::Boolean( DBus::Connection& connection, std::string p, Element* parent,
 
 bool
 Boolean::select( const bool& value )
+{
+    deferCall(new MemberCall1< Boolean, bool, bool >
+                  (*this, &Boolean::doSelect, "Boolean.select", value));
+    return doSelect(value);
+}
+
+bool
+Boolean::doSelect( const bool& value )
 {
     debugOutput( DEBUG_LEVEL_VERY_VERBOSE, "select(%d)\n", value );
-    return  m_Slave.select(value);
+    bool retval = m_Slave.select(value);
+    if(retval) m_Slave.notifyValueChanged();
+    return retval;
 }
 
 bool
 Boolean::selected()
+{
+    deferCall(new MemberCall0< Boolean, bool >
+                  (*this, &Boolean::doSelected, "Boolean.selected"));
+    return doSelected();
+}
+
+bool
+Boolean::doSelected()
 {
     bool retval = m_Slave.selected();
     debugOutput( DEBUG_LEVEL_VERY_VERBOSE, "selected() => %d\n", retval );
@@ -1000,5 +1383,486 @@ Boolean::getBooleanLabel( const bool& value )
     return retval;
 }
 
+// --- ChangeNotifier
+
+ChangeNotifier::ChangeNotifier(Element &root, unsigned int interval_usecs)
+: m_root( root )
+, m_interval( interval_usecs )
+, m_lock( new Util::PosixMutex("CTLSIG") )
+, m_thread( NULL )
+, m_signals_sent( 0 )
+, m_changes_coalesced( 0 )
+{
+}
+
+ChangeNotifier::~ChangeNotifier()
+{
+    stop();
+    delete m_lock;
+}
+
+bool
+ChangeNotifier::start()
+{
+    if(m_thread) {
+        debugOutput( DEBUG_LEVEL_VERBOSE, "(%p) already running\n", this);
+        return true;
+    }
+    m_thread = new Util::PosixThread(this, "CTLSIG", false,
+                                     0, PTHREAD_CANCEL_DEFERRED);
+    if(m_thread->Start() != 0) {
+        debugError("Could not start change notification thread\n");
+        delete m_thread;
+        m_thread = NULL;
+        return false;
+    }
+    debugOutput( DEBUG_LEVEL_VERBOSE, "(%p) sending value changes every %u usecs\n",
+                 this, m_interval);
+    return true;
+}
+
+bool
+ChangeNotifier::stop()
+{
+    if(m_thread) {
+        m_thread->Stop();
+        delete m_thread;
+        m_thread = NULL;
+    }
+    return true;
+}
+
+void
+ChangeNotifier::elementChanged(Element *e, int idx)
+{
+    Util::MutexLockHelper lock(*m_lock);
+    std::map<Element *, int>::iterator it = m_pending.find(e);
+    if(it == m_pending.end()) {
+        m_pending[e] = idx;
+    } else {
+        // more than one value changed since the last signal
+        if(it->second != idx) it->second = -1;
+        m_changes_coalesced++;
+    }
+}
+
+void
+ChangeNotifier::elementRemoved(Element *e)
+{
+    Util::MutexLockHelper lock(*m_lock);
+    m_pending.erase(e);
+}
+
+bool
+ChangeNotifier::Execute()
+{
+    Util::SystemTimeSource::SleepUsecRelative(m_interval);
+    bool pending;
+    m_lock->Lock();
+    pending = !m_pending.empty();
+    m_lock->Unlock();
+    if(pending) flush();
+    return true;
+}
+
+void
+ChangeNotifier::flush()
+{
+    // the handlers can't be removed while we signal
+    m_root.Lock();
+
+    std::map<Element *, int> changes;
+    m_lock->Lock();
+    changes.swap(m_pending);
+    m_lock->Unlock();
+
+    std::map<Container *, std::vector<std::string> > subtrees;
+    for ( std::map<Element *, int>::iterator it = changes.begin();
+          it != changes.end();
+          ++it )
+    {
+        Element *e = it->first;
+        e->ValueChanged(it->second);
+        m_signals_sent++;
+
+        // a changed container is part of its own subtree
+        for(Element *p = e; p != NULL; p = p->m_Parent) {
+            Container *c = dynamic_cast<Container *>(p);
+            if(c) subtrees[c].push_back(e->path());
+        }
+    }
+    for ( std::map<Container *, std::vector<std::string> >::iterator it = subtrees.begin();
+          it != subtrees.end();
+          ++it )
+    {
+        it->first->SubtreeChanged(it->second);
+        m_signals_sent++;
+    }
+
+    m_root.Unlock();
+    debugOutput( DEBUG_LEVEL_VERY_VERBOSE, "sent %u element changes\n",
+                 (unsigned int)changes.size());
+}
+
+// --- CallPool
+
+CallPool::CallPool(DBus::BusDispatcher &d, unsigned int nb_workers)
+: m_dispatcher( d )
+, m_pipe( NULL )
+, m_nb_workers( nb_workers )
+, m_lock( new Util::PosixMutex("CTLCALL") )
+, m_paused( false )
+{
+    sem_init(&m_work, 0, 0);
+}
+
+CallPool::~CallPool()
+{
+    stop();
+    // calls that never got a reply
+    for ( std::deque<DeferredCall *>::iterator it = m_queued.begin();
+          it != m_queued.end();
+          ++it )
+    {
+        delete *it;
+    }
+    for ( std::vector<DeferredCall *>::iterator it = m_completed.begin();
+          it != m_completed.end();
+          ++it )
+    {
+        delete *it;
+    }
+    sem_destroy(&m_work);
+    delete m_lock;
+}
+
+bool
+CallPool::start()
+{
+    if(m_threads.size()) {
+        debugOutput( DEBUG_LEVEL_VERBOSE, "(%p) already running\n", this);
+        return true;
+    }
+    m_pipe = m_dispatcher.add_pipe(&CallPool::replyHandler, this);
+    if(m_pipe == NULL) {
+        debugError("Could not create the reply pipe\n");
+        return false;
+    }
+    for(unsigned int i = 0; i < m_nb_workers; i++) {
+        Worker *w = new Worker(*this);
+        Util::Thread *t = new Util::PosixThread(w, "CTLCALL", false,
+                                                0, PTHREAD_CANCEL_DEFERRED);
+        if(t->Start() != 0) {
+            debugError("Could not start call worker %u\n", i);
+            delete t;
+            delete w;
+            stop();
+            return false;
+        }
+        m_workers.push_back(w);
+        m_threads.push_back(t);
+    }
+    debugOutput( DEBUG_LEVEL_VERBOSE, "(%p) %u call workers running\n",
+                 this, m_nb_workers);
+    return true;
+}
+
+bool
+CallPool::stop()
+{
+    // the running calls complete, the queued ones are not started anymore
+    for(unsigned int i = 0; i < m_threads.size(); i++) {
+        m_threads.at(i)->Stop();
+        delete m_threads.at(i);
+        delete m_workers.at(i);
+    }
+    m_threads.clear();
+    m_workers.clear();
+    if(m_pipe) {
+        m_dispatcher.del_pipe(m_pipe);
+        m_pipe = NULL;
+    }
+    return true;
+}
+
+bool
+CallPool::submit(DeferredCall *c)
+{
+    if(m_threads.size() == 0) return false;
+    c->m_queued = Util::SystemTimeSource::getCurrentTimeAsUsecs();
+    m_lock->Lock();
+    m_queued.push_back(c);
+    m_lock->Unlock();
+    sem_post(&m_work);
+    debugOutput( DEBUG_LEVEL_VERY_VERBOSE, "queued %s on '%s'\n",
+                 c->m_method, c->m_element.path().c_str());
+    return true;
+}
+
+// NOTE: call with the lock held
+bool
+CallPool::isKeyBusy(void *key)
+{
+    for ( std::vector<DeferredCall *>::iterator it = m_running.begin();
+          it != m_running.end();
+          ++it )
+    {
+        if((*it)->m_key == key) return true;
+    }
+    for ( std::vector<void *>::iterator it = m_acquired.begin();
+          it != m_acquired.end();
+          ++it )
+    {
+        if(*it == key) return true;
+    }
+    return false;
+}
+
+bool
+CallPool::tryAcquire(void *key)
+{
+    Util::MutexLockHelper lock(*m_lock);
+    // the devices are not accessed while paused
+    if(m_paused || isKeyBusy(key)) return false;
+    m_acquired.push_back(key);
+    return true;
+}
+
+void
+CallPool::release(void *key)
+{
+    Util::MutexLockHelper lock(*m_lock);
+    for ( std::vector<void *>::iterator it = m_acquired.begin();
+          it != m_acquired.end();
+          ++it )
+    {
+        if(*it == key) {
+            m_acquired.erase(it);
+            break;
+        }
+    }
+    // the calls that waited for this device
+    for ( std::deque<DeferredCall *>::iterator it = m_queued.begin();
+          it != m_queued.end();
+          ++it )
+    {
+        if((*it)->m_key == key) {
+            sem_post(&m_work);
+            break;
+        }
+    }
+}
+
+bool
+CallPool::runOne()
+{
+    // wake up regularly such that the worker can be stopped
+    struct timespec ts;
+    Util::SystemTimeSource::clockGettime(&ts);
+    ts.tv_nsec += 100 * 1000 * 1000;
+    if(ts.tv_nsec >= 1000 * 1000 * 1000) {
+        ts.tv_sec++;
+        ts.tv_nsec -= 1000 * 1000 * 1000;
+    }
+    if(sem_timedwait(&m_work, &ts) != 0) {
+        return true;
+    }
+
+    // the first call for a device that has no call running
+    DeferredCall *c = NULL;
+    m_lock->Lock();
+    for ( std::deque<DeferredCall *>::iterator it = m_queued.begin();
+          !m_paused && it != m_queued.end();
+          ++it )
+    {
+        if(!isKeyBusy((*it)->m_key)) {
+            c = *it;
+            m_queued.erase(it);
+            m_running.push_back(c);
+            break;
+        }
+    }
+    m_lock->Unlock();
+    // all queued calls wait for a device or the pool is paused, the worker
+    // that completes the running call or resume() picks them up
+    if(c == NULL) return true;
+
+    c->m_started = Util::SystemTimeSource::getCurrentTimeAsUsecs();
+    c->execute();
+    c->m_finished = Util::SystemTimeSource::getCurrentTimeAsUsecs();
+
+    m_lock->Lock();
+    for ( std::vector<DeferredCall *>::iterator it = m_running.begin();
+          it != m_running.end();
+          ++it )
+    {
+        if(*it == c) {
+            m_running.erase(it);
+            break;
+        }
+    }
+    m_completed.push_back(c);
+
+    struct sMethodStats &s = m_stats[c->m_method];
+    ffado_microsecs_t exec = c->m_finished - c->m_started;
+    ffado_microsecs_t wait = c->m_started - c->m_queued;
+    s.calls++;
+    s.total_exec += exec;
+    if(exec > s.max_exec) s.max_exec = exec;
+    s.total_wait += wait;
+    if(wait > s.max_wait) s.max_wait = wait;
+
+    // the calls that waited for this device
+    for ( std::deque<DeferredCall *>::iterator it = m_queued.begin();
+          it != m_queued.end();
+          ++it )
+    {
+        if((*it)->m_key == c->m_key) {
+            sem_post(&m_work);
+            break;
+        }
+    }
+    m_lock->Unlock();
+
+    // have the dispatcher send the reply
+    char b = 0;
+    m_pipe->write(&b, 1);
+    return true;
+}
+
+void
+CallPool::replyHandler(const void *data, void *buffer, unsigned int nbyte)
+{
+    CallPool *pool = (CallPool *)data;
+    pool->sendReplies();
+}
+
+void
+CallPool::sendReplies()
+{
+    // the lock keeps the elements from being deleted
+    Util::MutexLockHelper lock(*m_lock);
+    for ( std::vector<DeferredCall *>::iterator it = m_completed.begin();
+          it != m_completed.end();
+          ++it )
+    {
+        DeferredCall *c = *it;
+        c->m_element.sendReply(c);
+        delete c;
+    }
+    m_completed.clear();
+}
+
+void
+CallPool::cancel(Element *e)
+{
+    while(true) {
+        bool running = false;
+        m_lock->Lock();
+        for ( std::deque<DeferredCall *>::iterator it = m_queued.begin();
+              it != m_queued.end(); )
+        {
+            if(&(*it)->m_element == e) {
+                delete *it;
+                it = m_queued.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        for ( std::vector<DeferredCall *>::iterator it = m_completed.begin();
+              it != m_completed.end(); )
+        {
+            if(&(*it)->m_element == e) {
+                delete *it;
+                it = m_completed.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        for ( std::vector<DeferredCall *>::iterator it = m_running.begin();
+              it != m_running.end();
+              ++it )
+        {
+            if(&(*it)->m_element == e) running = true;
+        }
+        m_lock->Unlock();
+        if(!running) return;
+        // a worker executes a call on the element, it can't be deleted
+        // before that call completed
+        Util::SystemTimeSource::SleepUsecRelative(1000);
+    }
+}
+
+void
+CallPool::pause()
+{
+    m_lock->Lock();
+    m_paused = true;
+    m_lock->Unlock();
+    while(true) {
+        m_lock->Lock();
+        bool running = (m_running.size() != 0 || m_acquired.size() != 0);
+        m_lock->Unlock();
+        if(!running) break;
+        Util::SystemTimeSource::SleepUsecRelative(1000);
+    }
+    debugOutput( DEBUG_LEVEL_VERBOSE, "(%p) paused\n", this);
+}
+
+void
+CallPool::resume()
+{
+    m_lock->Lock();
+    m_paused = false;
+    // the workers consumed the wakeups of the calls queued while paused
+    unsigned int nb_queued = m_queued.size();
+    m_lock->Unlock();
+    for(unsigned int i = 0; i < nb_queued; i++) {
+        sem_post(&m_work);
+    }
+    debugOutput( DEBUG_LEVEL_VERBOSE, "(%p) resumed, %u calls queued\n",
+                 this, nb_queued);
+}
+
+std::vector< std::string >
+CallPool::getStatistics()
+{
+    std::vector< std::string > retval;
+    Util::MutexLockHelper lock(*m_lock);
+    for ( std::map<std::string, struct sMethodStats>::iterator it = m_stats.begin();
+          it != m_stats.end();
+          ++it )
+    {
+        struct sMethodStats &s = it->second;
+        std::ostringstream line;
+        line << it->first << ": calls=" << s.calls
+             << " exec_avg=" << (s.calls ? s.total_exec / s.calls : 0)
+             << " exec_max=" << s.max_exec
+             << " wait_avg=" << (s.calls ? s.total_wait / s.calls : 0)
+             << " wait_max=" << s.max_wait << " usec";
+        retval.push_back(line.str());
+    }
+    return retval;
+}
+
+void
+CallPool::show()
+{
+    std::vector< std::string > stats = getStatistics();
+    debugOutput( DEBUG_LEVEL_NORMAL, "CallPool %p: %u workers\n", this, m_nb_workers);
+    for ( std::vector< std::string >::iterator it = stats.begin();
+          it != stats.end();
+          ++it )
+    {
+        debugOutput( DEBUG_LEVEL_NORMAL, " %s\n", it->c_str());
+    }
+}
+
+void
+CallPool::setVerboseLevel(int l)
+{
+    setDebugLevel(l);
+    m_lock->setVerboseLevel(l);
+}
 
 } // end of namespace Control
@@ -31,8 +31,15 @@
 #include "controlserver-glue.h"
 
 #include "libcontrol/BasicElements.h"
+#include "libcontrol/ControlState.h"
 #include "libieee1394/configrom.h"
 #include "libutil/Mutex.h"
+#include "libutil/Thread.h"
+#include "libutil/SystemTimeSource.h"
+
+#include <semaphore.h>
+#include <map>
+#include <deque>
 
 namespace Control {
     class MatrixMixer;
@@ -43,6 +50,9 @@ namespace DBusControl {
 
 class Element;
 class Container;
+class ChangeNotifier;
+class CallPool;
+class DeferredCall;
 
 template< typename CalleePtr, typename MemFunPtr >
 class MemberSignalFunctor0
@@ -103,11 +113,13 @@ class Element
 , public DBus::ObjectAdaptor
 {
 friend class Container; // required to have container access other slave elements
+friend class ChangeNotifier; // walks the parents and takes the update lock
 public:
 
     Element( DBus::Connection& connection,
              std::string p, Element *,
              Control::Element &slave );
+    virtual ~Element();
 
     uint64_t getId( );
     std::string getName( );
@@ -119,16 +131,47 @@ public:
     void setVerboseLevel( const int32_t &);
     int32_t getVerboseLevel();
 
+    // called when the value of the slave changed
+    void valueChanged(int idx);
+
+    // only for the root of the tree
+    void setChangeNotifier(ChangeNotifier *n);
+    ChangeNotifier *getChangeNotifier();
+    void setCallPool(CallPool *p);
+    CallPool *getCallPool();
+
+    // the calls for elements with the same key are serialized, the key
+    // is the control element of the device
+    void *getSerializationKey() {return m_SerializationKey;};
+    // sends the reply of a call that completed, from the dispatcher thread
+    void sendReply(DeferredCall *c);
+
+    // the slave has been removed from its container and might be gone,
+    // it is not accessed anymore when this handler is deleted
+    virtual void setSlaveGone();
+
 protected:
     void Lock();
     void Unlock();
     bool isLocked();
     Util::Mutex* getLock();
 
+    /**
+     * Hands the call to a worker of the call pool. Doesn't return if that
+     * succeeds, the reply is sent when the call completed. Otherwise the
+     * call is deleted and the caller should execute it directly.
+     */
+    void deferCall(DeferredCall *c);
+
     Element *           m_Parent;
     Control::Element &  m_Slave;
+    bool                m_SlaveGone;
 private:
     Util::Mutex*        m_UpdateLock;
+    ChangeNotifier*     m_ChangeNotifier;
+    CallPool*           m_CallPool;
+    void *              m_SerializationKey;
+    Control::SignalFunctor * m_valueFunctor;
 protected:
     DECLARE_DEBUG_MODULE;
 };
@@ -136,6 +179,263 @@ typedef std::vector<Element *> ElementVector;
 typedef std::vector<Element *>::iterator ElementVectorIterator;
 typedef std::vector<Element *>::const_iterator ConstElementVectorIterator;
 
+/**
+ * @brief Sends the value changes of the elements as D-Bus signals
+ *
+ * The changes are collected as they are notified and sent at most once
+ * per interval, such that a fast changing control doesn't flood the bus:
+ * - a ValueChanged signal on every element that changed. The index is that
+ *   of the changed value if only one changed, -1 otherwise.
+ * - a SubtreeChanged signal on every container above them, carrying the
+ *   paths of the elements that changed. A client can subscribe to the
+ *   device manager container to follow all controls.
+ */
+class ChangeNotifier
+: public Util::RunnableInterface
+{
+public:
+    ChangeNotifier(Element &root, unsigned int interval_usecs);
+    virtual ~ChangeNotifier();
+
+    bool start();
+    bool stop();
+
+    void elementChanged(Element *e, int idx);
+    void elementRemoved(Element *e);
+
+    bool Init() {return true;};
+    bool Execute();
+
+    unsigned int getNbSignalsSent() {return m_signals_sent;};
+    unsigned int getNbChangesCoalesced() {return m_changes_coalesced;};
+
+    void setVerboseLevel(int l) {setDebugLevel(l);};
+
+private:
+    void flush();
+
+    Element &                   m_root;
+    unsigned int                m_interval;
+    Util::Mutex*                m_lock;
+    std::map<Element *, int>    m_pending;
+    Util::Thread*               m_thread;
+    unsigned int                m_signals_sent;
+    unsigned int                m_changes_coalesced;
+
+protected:
+    DECLARE_DEBUG_MODULE;
+};
+
+/**
+ * @brief A method call that is executed by a worker of the CallPool
+ *
+ * The D-Bus reply is deferred and sent from the dispatcher thread once the
+ * call completed. The call object is also the tag of the reply.
+ */
+class DeferredCall
+: public DBus::Tag
+{
+public:
+    DeferredCall(Element &e, const char *method);
+    virtual ~DeferredCall() {};
+
+    // executed by a worker
+    virtual void execute() = 0;
+    // writes the result into the reply, executed by the dispatcher thread
+    virtual void writeReply(DBus::MessageIter &w) = 0;
+
+    Element &           m_element;
+    const char *        m_method;
+    void *              m_key;
+    ffado_microsecs_t   m_queued;
+    ffado_microsecs_t   m_started;
+    ffado_microsecs_t   m_finished;
+};
+
+template< typename Callee, typename R >
+class MemberCall0
+    : public DeferredCall
+{
+public:
+    typedef R (Callee::*MemFunPtr)();
+    MemberCall0( Callee& callee, MemFunPtr pMemFun, const char *method )
+        : DeferredCall( callee, method )
+        , m_callee( callee )
+        , m_pMemFun( pMemFun )
+        {}
+
+    virtual void execute()
+        { m_result = ( m_callee.*m_pMemFun )(); }
+    virtual void writeReply(DBus::MessageIter &w)
+        { w << m_result; }
+private:
+    Callee&    m_callee;
+    MemFunPtr  m_pMemFun;
+    R          m_result;
+};
+
+template< typename Callee, typename R, typename A1 >
+class MemberCall1
+    : public DeferredCall
+{
+public:
+    typedef R (Callee::*MemFunPtr)( const A1& );
+    MemberCall1( Callee& callee, MemFunPtr pMemFun, const char *method,
+                 const A1& a1 )
+        : DeferredCall( callee, method )
+        , m_callee( callee )
+        , m_pMemFun( pMemFun )
+        , m_a1( a1 )
+        {}
+
+    virtual void execute()
+        { m_result = ( m_callee.*m_pMemFun )( m_a1 ); }
+    virtual void writeReply(DBus::MessageIter &w)
+        { w << m_result; }
+private:
+    Callee&    m_callee;
+    MemFunPtr  m_pMemFun;
+    A1         m_a1;
+    R          m_result;
+};
+
+template< typename Callee, typename R, typename A1, typename A2 >
+class MemberCall2
+    : public DeferredCall
+{
+public:
+    typedef R (Callee::*MemFunPtr)( const A1&, const A2& );
+    MemberCall2( Callee& callee, MemFunPtr pMemFun, const char *method,
+                 const A1& a1, const A2& a2 )
+        : DeferredCall( callee, method )
+        , m_callee( callee )
+        , m_pMemFun( pMemFun )
+        , m_a1( a1 )
+        , m_a2( a2 )
+        {}
+
+    virtual void execute()
+        { m_result = ( m_callee.*m_pMemFun )( m_a1, m_a2 ); }
+    virtual void writeReply(DBus::MessageIter &w)
+        { w << m_result; }
+private:
+    Callee&    m_callee;
+    MemFunPtr  m_pMemFun;
+    A1         m_a1;
+    A2         m_a2;
+    R          m_result;
+};
+
+template< typename Callee, typename R, typename A1, typename A2, typename A3 >
+class MemberCall3
+    : public DeferredCall
+{
+public:
+    typedef R (Callee::*MemFunPtr)( const A1&, const A2&, const A3& );
+    MemberCall3( Callee& callee, MemFunPtr pMemFun, const char *method,
+                 const A1& a1, const A2& a2, const A3& a3 )
+        : DeferredCall( callee, method )
+        , m_callee( callee )
+        , m_pMemFun( pMemFun )
+        , m_a1( a1 )
+        , m_a2( a2 )
+        , m_a3( a3 )
+        {}
+
+    virtual void execute()
+        { m_result = ( m_callee.*m_pMemFun )( m_a1, m_a2, m_a3 ); }
+    virtual void writeReply(DBus::MessageIter &w)
+        { w << m_result; }
+private:
+    Callee&    m_callee;
+    MemFunPtr  m_pMemFun;
+    A1         m_a1;
+    A2         m_a2;
+    A3         m_a3;
+    R          m_result;
+};
+
+/**
+ * @brief Executes the deferred method calls in a set of worker threads
+ *
+ * The calls for the elements of different devices run concurrently, such
+ * that a slow device doesn't block the others. The calls for the elements
+ * of one device are executed one at a time, in the order they came in.
+ * The completed calls are handed back to the dispatcher thread through a
+ * dispatcher pipe, the replies are sent from there.
+ *
+ * The execution and queueing time of the calls is accounted per method.
+ */
+class CallPool
+: public Control::AccessSerializer
+{
+public:
+    CallPool(DBus::BusDispatcher &d, unsigned int nb_workers);
+    virtual ~CallPool();
+
+    bool start();
+    bool stop();
+
+    bool submit(DeferredCall *c);
+    // drops the calls of an element that is about to be deleted
+    void cancel(Element *e);
+
+    // no new calls are started while paused, pause() returns once the
+    // running calls completed. Used while the devices are rediscovered.
+    void pause();
+    void resume();
+
+    // lets another thread access a device, no call for it runs meanwhile
+    virtual bool tryAcquire(void *key);
+    virtual void release(void *key);
+
+    std::vector< std::string > getStatistics();
+    void show();
+    void setVerboseLevel(int l);
+
+private:
+    class Worker : public Util::RunnableInterface
+    {
+    public:
+        Worker(CallPool &p) : m_pool( p ) {};
+        virtual ~Worker() {};
+        bool Init() {return true;};
+        bool Execute() {return m_pool.runOne();};
+    private:
+        CallPool &m_pool;
+    };
+
+    bool runOne();
+    bool isKeyBusy(void *key);
+    void sendReplies();
+    static void replyHandler(const void *data, void *buffer, unsigned int nbyte);
+
+    struct sMethodStats {
+        unsigned int        calls;
+        ffado_microsecs_t   total_exec;
+        ffado_microsecs_t   max_exec;
+        ffado_microsecs_t   total_wait;
+        ffado_microsecs_t   max_wait;
+    };
+
+    DBus::BusDispatcher &           m_dispatcher;
+    DBus::Pipe *                    m_pipe;
+    unsigned int                    m_nb_workers;
+    std::vector<Worker *>           m_workers;
+    std::vector<Util::Thread *>     m_threads;
+    Util::Mutex*                    m_lock;
+    bool                            m_paused;
+    sem_t                           m_work;
+    std::deque<DeferredCall *>      m_queued;
+    std::vector<DeferredCall *>     m_running;
+    std::vector<DeferredCall *>     m_completed;
+    std::vector<void *>             m_acquired;
+    std::map<std::string, struct sMethodStats> m_stats;
+
+protected:
+    DECLARE_DEBUG_MODULE;
+};
+
 class Container
 : public org::ffado::Control::Element::Container_adaptor
 , public DBusControl::Element
@@ -148,11 +448,13 @@ public:
 
     int32_t getNbElements( );
     std::string getElementName( const int32_t& );
+    std::vector< std::string > getCallStatistics( );
 
     void updated(int new_nb_elements);
     void destroyed();
 
     void setVerboseLevel( const int32_t &);
+    virtual void setSlaveGone();
 private:
     Element *createHandler(Element *, Control::Element& e);
     void updateTree();
@@ -182,6 +484,13 @@ public:
     double getValueIdx( const int32_t & idx );
 
 private:
+    // executed by the call pool
+    double doSetValue( const double & value );
+    double doGetValue( );
+    double doSetValueIdx( const int32_t & idx,
+                          const double & value );
+    double doGetValueIdx( const int32_t & idx );
+
     Control::Continuous &m_Slave;
 };
 
@@ -201,6 +510,13 @@ public:
     int32_t getValueIdx( const int32_t & idx );
 
 private:
+    // executed by the call pool
+    int32_t doSetValue( const int32_t & value );
+    int32_t doGetValue( );
+    int32_t doSetValueIdx( const int32_t & idx,
+                           const int32_t & value );
+    int32_t doGetValueIdx( const int32_t & idx );
+
     Control::Discrete &m_Slave;
 };
 
@@ -217,6 +533,10 @@ public:
     std::string getValue( );
 
 private:
+    // executed by the call pool
+    std::string doSetValue( const std::string & value );
+    std::string doGetValue( );
+
     Control::Text &m_Slave;
 };
 
@@ -233,6 +553,10 @@ public:
     uint64_t getValue( const uint64_t & addr );
 
 private:
+    // executed by the call pool
+    uint64_t doSetValue( const uint64_t & addr, const uint64_t & value );
+    uint64_t doGetValue( const uint64_t & addr );
+
     Control::Register &m_Slave;
 };
 
@@ -252,6 +576,10 @@ public:
     bool devConfigChanged( const int32_t & );
 
 private:
+    // executed by the call pool
+    int32_t doSelect( const int32_t & idx );
+    int32_t doSelected( );
+
     Control::Enum &m_Slave;
 };
 
@@ -273,6 +601,11 @@ public:
     std::string getAttributeName( const int32_t & idx );
 
 private:
+    // executed by the call pool
+    int32_t doSelect( const int32_t & idx );
+    int32_t doSelected( );
+    std::string doGetAttributeValue( const int32_t & idx );
+
     Control::AttributeEnum &m_Slave;
 };
 
@@ -327,6 +660,10 @@ public:
     bool connectColTo( const int32_t&, const std::string& );
 
 private:
+    // executed by the call pool
+    double doSetValue( const int32_t&, const int32_t&, const double& );
+    double doGetValue( const int32_t&, const int32_t& );
+
     Control::MatrixMixer &m_Slave;
 };
 
@@ -356,6 +693,13 @@ public:
     std::vector< DBus::Struct<std::string, double> > getPeakValues();
 
 private:
+    // executed by the call pool
+    bool  doSetConnectionState(const std::string &source, const std::string &dest, const bool &enable);
+    bool  doGetConnectionState(const std::string &source, const std::string &dest);
+    bool  doClearAllConnections();
+    double doGetPeakValue(const std::string &dest);
+    std::vector< DBus::Struct<std::string, double> > doGetPeakValues();
+
     Control::CrossbarRouter &m_Slave;
 };
 
@@ -373,6 +717,10 @@ public:
     std::string getBooleanLabel( const bool& value );
 
 private:
+    // executed by the call pool
+    bool doSelect( const bool& value );
+    bool doSelected();
+
     Control::Boolean &m_Slave;
 };
 }
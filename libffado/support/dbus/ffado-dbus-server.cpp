@@ -26,6 +26,7 @@
  * This version uses the CPP API
  */
 
+#include "config.h"
 #include "version.h"
 
 #include <semaphore.h>
@@ -40,8 +41,11 @@
 #include <dbus-c++/dbus.h>
 #include "controlserver.h"
 #include "libcontrol/BasicElements.h"
+#include "libcontrol/ControlState.h"
 
 #include "libutil/Functors.h"
+#include "libutil/Configuration.h"
+#include "libutil/PosixSharedMemory.h"
 
 #include <signal.h>
 
@@ -49,6 +53,7 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <unistd.h>
 
 #include <vector>
 #include <string>
@@ -62,8 +67,11 @@ DECLARE_GLOBAL_DEBUG_MODULE;
 // DBUS stuff
 DBus::BusDispatcher dispatcher;
 DBusControl::Container *container = NULL;
+DBusControl::ChangeNotifier *notifier = NULL;
+DBusControl::CallPool *callpool = NULL;
 DBus::Connection * global_conn;
 DeviceManager *m_deviceManager = NULL;
+Control::StatePublisher *m_statePublisher = NULL;
 
 // signal handler
 int run=1;
@@ -208,6 +216,15 @@ void
 preUpdateHandler()
 {
     debugOutput( DEBUG_LEVEL_NORMAL, "got pre-update notification...\n" );
+    // the published control state refers to elements that are about to go
+    if(m_statePublisher) {
+        m_statePublisher->invalidate();
+    }
+    // the running calls access the devices, have them complete and don't
+    // start new ones until the control tree is updated
+    if(callpool) {
+        callpool->pause();
+    }
     // stop receiving dbus events since the control structure is going to
     // be changed
     dispatcher.leave();
@@ -220,6 +237,16 @@ postUpdateHandler()
     // the signal handlers registered by the elements should have taken
     // care of updating the control tree
 
+    // publish the state of the new control tree
+    if(m_statePublisher) {
+        m_statePublisher->rebuild();
+    }
+
+    // the calls on elements that are gone have been dropped
+    if(callpool) {
+        callpool->resume();
+    }
+
     // signal that we can start receiving dbus events again
     sem_post(&run_sem);
 }
@@ -287,6 +314,23 @@ main( int argc, char **argv )
         return exitfunction(-1);
     }
 
+    // publish the control state in shared memory
+    int32_t controlstate_enable = CONTROLSTATE_ENABLE;
+    m_deviceManager->getConfiguration().getValueForSetting("controlstate.enable",
+                                                           controlstate_enable);
+    if(controlstate_enable) {
+        m_statePublisher = new Control::StatePublisher(*m_deviceManager,
+            Util::PosixSharedMemory::getProcessName(CONTROLSTATE_SHM_NAME, getpid()));
+        if ( arguments.verbose ) {
+            m_statePublisher->setVerboseLevel(arguments.verbose);
+        }
+        if(!m_statePublisher->init() || !m_statePublisher->start()) {
+            debugWarning("Could not publish the control state\n");
+            delete m_statePublisher;
+            m_statePublisher = NULL;
+        }
+    }
+
     // add pre-update handler
     Util::Functor* preupdate_functor = new Util::CallbackFunctor0< void (*)() >
                 ( &preUpdateHandler, false );
@@ -326,6 +370,47 @@ main( int argc, char **argv )
     // unlock the control tree since the tree is built
     m_deviceManager->unlockControl();
 
+    // send the value changes as signals
+    int32_t signal_interval = CONTROLSERVER_SIGNAL_INTERVAL_USECS;
+    m_deviceManager->getConfiguration().getValueForSetting("controlserver.signal_interval_usecs",
+                                                           signal_interval);
+    if(signal_interval > 0) {
+        notifier = new DBusControl::ChangeNotifier(*container, signal_interval);
+        if ( arguments.verbose ) {
+            notifier->setVerboseLevel(arguments.verbose);
+        }
+        if(notifier->start()) {
+            container->setChangeNotifier(notifier);
+        } else {
+            debugWarning("Could not start the value change notifications\n");
+            delete notifier;
+            notifier = NULL;
+        }
+    }
+
+    // execute the method calls outside of the dispatcher, such that
+    // a slow device doesn't hold up the calls for the others
+    int32_t worker_threads = CONTROLSERVER_WORKER_THREADS;
+    m_deviceManager->getConfiguration().getValueForSetting("controlserver.worker_threads",
+                                                           worker_threads);
+    if(worker_threads > 0) {
+        callpool = new DBusControl::CallPool(dispatcher, worker_threads);
+        if ( arguments.verbose ) {
+            callpool->setVerboseLevel(arguments.verbose);
+        }
+        if(callpool->start()) {
+            container->setCallPool(callpool);
+            // the state refresh doesn't read a device while a call runs on it
+            if(m_statePublisher) {
+                m_statePublisher->setAccessSerializer(callpool);
+            }
+        } else {
+            debugWarning("Could not start the call workers, executing calls inline\n");
+            delete callpool;
+            callpool = NULL;
+        }
+    }
+
     printMessage("DBUS service running\n");
     printMessage("press ctrl-c to stop it & exit\n");
     
@@ -345,12 +430,32 @@ main( int argc, char **argv )
         debugError("could not unregister post update notifier");
     }
     delete postupdate_functor;
+    if(notifier) {
+        notifier->stop();
+        container->setChangeNotifier(NULL);
+        delete notifier;
+        notifier = NULL;
+    }
+    if(callpool) {
+        if(m_statePublisher) {
+            m_statePublisher->setAccessSerializer(NULL);
+        }
+        callpool->stop();
+        callpool->show();
+        container->setCallPool(NULL);
+        delete callpool;
+        callpool = NULL;
+    }
     delete container;
 
     signal (SIGINT, SIG_DFL);
     signal (SIGTERM, SIG_DFL);
 
     printMessage("server stopped\n");
+    if(m_statePublisher) {
+        delete m_statePublisher;
+        m_statePublisher = NULL;
+    }
     delete m_deviceManager;
     return exitfunction(0);
 }
@@ -35,6 +35,8 @@
 #include <iostream>
 #include <cstdlib>
 #include <cstring>
+#include <vector>
+#include <pthread.h>
 
 #define MAGIC_THAT_SAYS_I_KNOW_WHAT_IM_DOING 0x001807198000LL
 
@@ -48,9 +50,11 @@ const char *argp_program_bug_address = "<ffado-devel@lists.sf.net>";
 const char *doc = "bridgeco-downloader -- firmware downloader application for BridgeCo devices\n\n"
                     "OPERATION: GUID display\n"
                     "           GUID setguid NEW_GUID\n"
-                    "           GUID firmware FILE\n"
-                    "           GUID cne FILE\n"
-                    "           GUID bcd FILE\n";
+                    "           GUID[,GUID...] firmware FILE\n"
+                    "           GUID[,GUID...] cne FILE\n"
+                    "           GUID bcd FILE\n\n"
+                    "When a list of GUIDs is given, the devices are updated in parallel.\n"
+                    "They should all be of the same model.\n";
 static struct argp_option _options[] = {
     {"verbose",   'v', "level",     0,  "Produce verbose output" },
     {"port",      'p', "PORT",      0,  "Set port" },
@@ -62,6 +66,120 @@ static struct argp_option _options[] = {
 };
 struct argp_option* options = _options;
 
+struct download_job
+{
+    BeBoB::BootloaderManager* mgr;
+    fb_octlet_t guid;
+    bool cne;
+    std::string filename;
+    bool result;
+};
+
+static void*
+download_thread( void* arg )
+{
+    struct download_job* job = ( struct download_job* )arg;
+    if ( job->cne ) {
+        job->result = job->mgr->downloadCnE( job->filename );
+    } else {
+        job->result = job->mgr->downloadFirmware( job->filename );
+    }
+    return NULL;
+}
+
+static int
+find_node( Ieee1394Service& service, fb_octlet_t guid )
+{
+    for (int i = 0; i < service.getNodeCount(); i++) {
+        ConfigRom configRom(service, i);
+        configRom.initialize();
+
+        if (configRom.getGuid() == guid)
+            return configRom.getNodeId();
+    }
+    return -1;
+}
+
+static int
+parallel_download( Ieee1394Service& service, std::vector<fb_octlet_t>& guids )
+{
+    bool cne;
+    if ( strcmp( args->args[1], "firmware" ) == 0 ) {
+        cne = false;
+    } else if ( strcmp( args->args[1], "cne" ) == 0 ) {
+        cne = true;
+    } else {
+        cerr << "Only the firmware and cne operations support multiple devices" << endl;
+        return -1;
+    }
+    if ( !args->args[2] ) {
+        cerr << "FILE argument is missing" << endl;
+        return -1;
+    }
+
+    std::vector<download_job> jobs( guids.size() );
+    for ( unsigned int i = 0; i < guids.size(); i++ ) {
+        int node_id = find_node( service, guids[i] );
+        if ( node_id < 0 ) {
+            cerr << "Could not find device with GUID 0x" << hex << guids[i] << dec << endl;
+            for ( unsigned int j = 0; j < i; j++ ) {
+                delete jobs[j].mgr;
+            }
+            return -1;
+        }
+        jobs[i].mgr = new BeBoB::BootloaderManager( service, node_id );
+        jobs[i].guid = guids[i];
+        jobs[i].cne = cne;
+        jobs[i].filename = args->args[2];
+        jobs[i].result = false;
+        jobs[i].mgr->setForceOperations( args->force == 1 );
+        jobs[i].mgr->setStartBootloader( args->no_bootloader_restart != 1 );
+        // the progress output of the devices would get mixed up
+        jobs[i].mgr->setProgressOutput( false );
+        jobs[i].mgr->printInfoRegisters();
+
+        if ( jobs[i].mgr->getConfigRom()->getModelId()
+             != jobs[0].mgr->getConfigRom()->getModelId() ) {
+            cerr << "Device 0x" << hex << guids[i] << dec
+                 << " is not of the same model as the first device" << endl;
+            for ( unsigned int j = 0; j <= i; j++ ) {
+                delete jobs[j].mgr;
+            }
+            return -1;
+        }
+    }
+
+    std::vector<pthread_t> threads( jobs.size() );
+    std::vector<bool> started( jobs.size(), false );
+    for ( unsigned int i = 0; i < jobs.size(); i++ ) {
+        if ( pthread_create( &threads[i], NULL, download_thread, &jobs[i] ) ) {
+            cerr << "Could not start download thread" << endl;
+        } else {
+            started[i] = true;
+        }
+    }
+    for ( unsigned int i = 0; i < jobs.size(); i++ ) {
+        if ( started[i] ) {
+            pthread_join( threads[i], NULL );
+        }
+    }
+
+    int retval = 0;
+    for ( unsigned int i = 0; i < jobs.size(); i++ ) {
+        cout << "Device 0x" << hex << jobs[i].guid << dec << ": "
+             << ( jobs[i].result ? "download was successful" : "download failed" ) << endl;
+        jobs[i].mgr->printTimingReport();
+        if ( !jobs[i].result ) {
+            retval = -1;
+        }
+        delete jobs[i].mgr;
+    }
+    if ( retval == 0 ) {
+        cout << "Please reboot the devices by removing the power and firewire connections." << endl;
+    }
+    return retval;
+}
+
 int
 main( int argc, char** argv )
 {
@@ -85,11 +203,16 @@ main( int argc, char** argv )
     char* tail;
     int node_id = -1;
 
-    fb_octlet_t guid = strtoll(args->args[0], &tail, 0);
-    if (errno) {
-        perror("argument parsing failed:");
-        return -1;
-    }
+    std::vector<fb_octlet_t> guids;
+    tail = args->args[0];
+    do {
+        guids.push_back( strtoll(tail, &tail, 0) );
+        if (errno || (*tail != ',' && *tail != 0)) {
+            perror("argument parsing failed:");
+            return -1;
+        }
+    } while (*tail++ == ',');
+    fb_octlet_t guid = guids[0];
 
     if(args->magic != MAGIC_THAT_SAYS_I_KNOW_WHAT_IM_DOING) {
         printf("Magic number not correct. Please specify the correct magic using the '-m' option.\n");
@@ -109,14 +232,11 @@ main( int argc, char** argv )
     }
     service.setVerboseLevel( args->verbose );
 
-    for (int i = 0; i < service.getNodeCount(); i++) {
-        ConfigRom configRom(service, i);
-        configRom.initialize();
-
-        if (configRom.getGuid() == guid)
-            node_id = configRom.getNodeId();
+    if (guids.size() > 1) {
+        return parallel_download( service, guids );
     }
 
+    node_id = find_node( service, guid );
     if (node_id < 0) {
         cerr << "Could not find device with matching GUID" << endl;
         return -1;
@@ -140,7 +260,9 @@ main( int argc, char** argv )
         char* tail;
         fb_octlet_t guid = strtoll(args->args[2], &tail, 0 );
 
-        if ( !blMgr.programGUID( guid ) ) {
+        bool result = blMgr.programGUID( guid );
+        blMgr.printTimingReport();
+        if ( !result ) {
             cerr << "Failed to set GUID" << endl;
             return -1;
         } else {
@@ -154,7 +276,9 @@ main( int argc, char** argv )
         std::string str( args->args[2] );
 
         blMgr.setStartBootloader( args->no_bootloader_restart != 1 );
-        if ( !blMgr.downloadFirmware( str ) ) {
+        bool result = blMgr.downloadFirmware( str );
+        blMgr.printTimingReport();
+        if ( !result ) {
             cerr << "Failed to download firmware" << endl;
             return -1;
         } else {
@@ -168,7 +292,9 @@ main( int argc, char** argv )
         }
         std::string str( args->args[2] );
 
-        if ( !blMgr.downloadCnE( str ) ) {
+        bool result = blMgr.downloadCnE( str );
+        blMgr.printTimingReport();
+        if ( !result ) {
             cerr << "Failed to download CnE" << endl;
             return -1;
         } else {
@@ -383,13 +383,7 @@ main( int argc, char** argv )
             return -1;
         }
 
-        printMessage(" erasing memory...\n");
-        if (!util.eraseBlocks(start_addr, len)) {
-            printMessage("  Could not erase memory\n");
-            delete dev;
-            return -1;
-        }
-
+        // the changed blocks are erased while uploading
         printMessage(" uploading to device...\n");
         if (!util.writeFirmwareToDevice(ref)) {
             printMessage("  Could not write firmware to device\n");
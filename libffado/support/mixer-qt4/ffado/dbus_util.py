@@ -161,6 +161,20 @@ class ControlInterface:
             log.error("Failed to get enum count %s on server %s" % (path, self.servername))
             return 0
 
+    def registerChangeCallback(self, subpath, callback):
+        """ Calls callback(paths) when controls at or below subpath changed.
+
+        The server coalesces the changes, such that this doesn't need
+        to be rate limited by the caller.
+        """
+        try:
+            path = self.basepath + subpath
+            dev = self.bus.get_object(self.servername, path)
+            dev.connect_to_signal("SubtreeChanged", callback, \
+                                  dbus_interface="org.ffado.Control.Element.Container")
+        except:
+            log.error("Failed to connect to changes of %s on server %s" % (path, self.servername))
+
 class DeviceManagerInterface:
     """ Implementation of the singleton """
     def __init__(self, servername, basepath):
@@ -346,63 +346,102 @@ class AudioFire(QWidget):
 
         self.streaming_state = ss
 
+    def refreshMatrixVolume(self, ctrl, info):
+        vol = self.hw.getMatrixMixerValue(info[0], info[1], info[2])
+        #vol = 0x01000000-vol
+        log.debug("%s volume is %d" % (ctrl.objectName() , vol))
+        ctrl.setValue(vol)
+
+    def refreshMatrixButton(self, ctrl, info):
+        state = self.hw.getMatrixMixerValue(info[0], info[1], info[2])
+        log.debug("%s state is %d" % (ctrl.objectName() , state))
+        if state:
+            ctrl.setChecked(True)
+        else:
+            ctrl.setChecked(False)
+
+    def refreshMatrixRotary(self, ctrl, info):
+        vol = self.hw.getMatrixMixerValue(info[0], info[1], info[2])
+        log.debug("%s value is %d" % (ctrl.objectName(), vol))
+        ctrl.setValue(vol)
+
+    def refreshVolume(self, ctrl, info):
+        vol = self.hw.getContignuous(info[0])
+        #vol = 0x01000000-vol
+        log.debug("%s volume is %d" % (ctrl.objectName() , vol))
+        ctrl.setValue(vol)
+
+    def refreshSelector(self, ctrl, info):
+        state = self.hw.getDiscrete(info[0])
+        log.debug("%s state is %d" % (ctrl.objectName() , state))
+        if state:
+            ctrl.setChecked(True)
+        else:
+            ctrl.setChecked(False)
+
+    def refreshSPDIFmodeControl(self, ctrl, info):
+        state = self.hw.getDiscrete(info[0])
+        log.debug("%s state is %d" % (ctrl.objectName() , state))
+        if state == info[1]:
+            ctrl.setChecked(True)
+        else:
+            ctrl.setChecked(False)
+
+    def refreshDigIfaceControl(self, ctrl, info):
+        state = self.hw.getDiscrete(info[0])
+        # 0/2/3 is available but GUI set 0/1/2
+        if state > 0:
+            state -= 1
+        ctrl.setCurrentIndex(state)
+
+    def refreshPlbkRouteControl(self, ctrl, info):
+        sink = info[1]
+        src = self.hw.getDiscrete(info[0], sink)
+        ctrl.setCurrentIndex(src)
+        self.setStreamLabel(src, sink)
+
+    def valuesChanged(self, paths):
+        # The server sends this when a control was changed, e.g. by another
+        # client. Only the widgets of the changed controls are re-read. The
+        # widget signals are blocked, such that the refresh isn't written
+        # back to the device.
+        changed = set([str(p) for p in paths])
+        for ctrls, refresh in self.RefreshHandlers:
+            for ctrl, info in ctrls.iteritems():
+                if (self.hw.basepath + info[0]) in changed:
+                    ctrl.blockSignals(True)
+                    refresh(ctrl, info)
+                    ctrl.blockSignals(False)
+
     def initValues(self):
         log.debug("Init values")
 
         for ctrl, info in self.MatrixVolumeControls.iteritems():
-            vol = self.hw.getMatrixMixerValue(self.MatrixVolumeControls[ctrl][0],
-                                                self.MatrixVolumeControls[ctrl][1],
-                                                self.MatrixVolumeControls[ctrl][2])
-
-            #vol = 0x01000000-vol
-            log.debug("%s volume is %d" % (ctrl.objectName() , vol))
-            ctrl.setValue(vol)
+            self.refreshMatrixVolume(ctrl, info)
 
             # connect the UI element
             QObject.connect(ctrl,SIGNAL('valueChanged(int)'),self.updateMatrixVolume)
 
         for ctrl, info in self.MatrixButtonControls.iteritems():
-            state = self.hw.getMatrixMixerValue(self.MatrixButtonControls[ctrl][0],
-                                                self.MatrixButtonControls[ctrl][1],
-                                                self.MatrixButtonControls[ctrl][2])
-
-            log.debug("%s state is %d" % (ctrl.objectName() , state))
-            if state:
-                ctrl.setChecked(True)
-            else:
-                ctrl.setChecked(False)
+            self.refreshMatrixButton(ctrl, info)
 
             # connect the UI element
             QObject.connect(ctrl,SIGNAL('clicked(bool)'),self.updateMatrixButton)
 
         for ctrl, info in self.MatrixRotaryControls.iteritems():
-            vol = self.hw.getMatrixMixerValue(self.MatrixRotaryControls[ctrl][0],
-                                                self.MatrixRotaryControls[ctrl][1],
-                                                self.MatrixRotaryControls[ctrl][2])
-
-            log.debug("%s value is %d" % (ctrl.objectName(), vol))
-            ctrl.setValue(vol)
+            self.refreshMatrixRotary(ctrl, info)
 
             # connect the UI element
             QObject.connect(ctrl,SIGNAL('valueChanged(int)'),self.updateMatrixRotary)
 
         for ctrl, info in self.VolumeControls.iteritems():
-            vol = self.hw.getContignuous(self.VolumeControls[ctrl][0])
-
-            #vol = 0x01000000-vol
-            log.debug("%s volume is %d" % (ctrl.objectName() , vol))
-            ctrl.setValue(vol)
+            self.refreshVolume(ctrl, info)
 
             # connect the UI element
             QObject.connect(ctrl,SIGNAL('valueChanged(int)'),self.updateVolume)
 
         for ctrl, info in self.SelectorControls.iteritems():
-            state = self.hw.getDiscrete(self.SelectorControls[ctrl][0])
-            log.debug("%s state is %d" % (ctrl.objectName() , state))
-            if state:
-                ctrl.setChecked(True)
-            else:
-                ctrl.setChecked(False)
+            self.refreshSelector(ctrl, info)
 
             # connect the UI element
             QObject.connect(ctrl,SIGNAL('clicked(bool)'),self.updateSelector)
@@ -412,31 +451,33 @@ class AudioFire(QWidget):
             QObject.connect(ctrl,SIGNAL('clicked()'),self.updateTrigger)
 
         for ctrl, info in self.SPDIFmodeControls.iteritems():
-            state = self.hw.getDiscrete(self.SPDIFmodeControls[ctrl][0])
-            log.debug("%s state is %d" % (ctrl.objectName() , state))
-            if state == self.SPDIFmodeControls[ctrl][1]:
-                ctrl.setChecked(True)
-            else:
-                ctrl.setChecked(False)
+            self.refreshSPDIFmodeControl(ctrl, info)
 
             # connect the UI element
             QObject.connect(ctrl,SIGNAL('toggled(bool)'),self.updateSPDIFmodeControl)
 
         for ctrl, info in self.DigIfaceControls.iteritems():
-            state = self.hw.getDiscrete(self.DigIfaceControls[ctrl][0])
-            # 0/2/3 is available but GUI set 0/1/2
-            if state > 0:
-                state -= 1
-            ctrl.setCurrentIndex(state)
+            self.refreshDigIfaceControl(ctrl, info)
             QObject.connect(ctrl, SIGNAL('activated(int)'), self.updateDigIfaceControl)
 
         for ctrl, info in self.PlbkRouteControls.iteritems():
-            sink = self.PlbkRouteControls[ctrl][1]
-            src = self.hw.getDiscrete(self.PlbkRouteControls[ctrl][0], sink)
-            ctrl.setCurrentIndex(src)
-            self.setStreamLabel(src, sink)
+            self.refreshPlbkRouteControl(ctrl, info)
             QObject.connect(ctrl, SIGNAL('activated(int)'), self.updatePlbkRouteControl)
 
+        # follow the changes made by other clients
+        self.RefreshHandlers = [
+            (self.MatrixVolumeControls, self.refreshMatrixVolume),
+            (self.MatrixButtonControls, self.refreshMatrixButton),
+            (self.MatrixRotaryControls, self.refreshMatrixRotary),
+            (self.VolumeControls, self.refreshVolume),
+            (self.SelectorControls, self.refreshSelector),
+            (self.SPDIFmodeControls, self.refreshSPDIFmodeControl),
+            (self.DigIfaceControls, self.refreshDigIfaceControl),
+            (self.PlbkRouteControls, self.refreshPlbkRouteControl),
+        ]
+        self.hw.registerChangeCallback("", self.valuesChanged)
+
+        # the streaming state has no change signal, it is still polled
         self.update_timer = QTimer(self)
         QObject.connect(self.update_timer, SIGNAL('timeout()'), self.polledUpdate)
         self.update_timer.start(1000)
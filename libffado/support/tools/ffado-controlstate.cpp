@@ -0,0 +1,273 @@
+/*
+ * Copyright (C) 2005-2008 by Pieter Palmers
+ *
+ * This file is part of FFADO
+ * FFADO = Free Firewire (pro-)audio drivers for linux
+ *
+ * FFADO is based upon FreeBoB
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) version 3 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * Reads the control state segment published by ffado-dbus-server.
+ * The segment is mapped read-only, neither the server nor the devices
+ * are involved.
+ */
+
+#include "config.h"
+
+#include "libutil/PosixSharedMemory.h"
+#include "libcontrol/ControlState.h"
+
+#include <argp.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+
+using namespace Control;
+
+DECLARE_GLOBAL_DEBUG_MODULE;
+
+int run;
+
+static void sighandler(int sig)
+{
+    run = 0;
+}
+
+////////////////////////////////////////////////
+// arg parsing
+////////////////////////////////////////////////
+const char *argp_program_version = "ffado-controlstate 0.1";
+const char *argp_program_bug_address = "<ffado-devel@lists.sf.net>";
+static char doc[] = "ffado-controlstate -- show the state of the FFADO controls.\n\n"
+                    "Prints the control values published by ffado-dbus-server. When an "
+                    "interval is given, only the values that changed are printed at "
+                    "every interval.";
+static char args_doc[] = "";
+static struct argp_option options[] = {
+    {"verbose",   'v', "LEVEL",     0,  "Produce verbose output" },
+    {"name",      'n', "NAME",      0,  "Name of the control state segment" },
+    {"pid",       'p', "PID",       0,  "Process id of the control state segment owner" },
+    {"interval",  'i', "MSEC",      0,  "Refresh interval (0 = print once)" },
+    {"filter",    'f', "TEXT",      0,  "Only show the controls whose path contains TEXT" },
+   { 0 }
+};
+
+struct arguments
+{
+    arguments()
+        : verbose( 0 )
+        , name( NULL )
+        , pid( 0 )
+        , interval( 0 )
+        , filter( NULL )
+        {}
+
+    long int verbose;
+    const char *name;
+    long int pid;
+    long int interval;
+    const char *filter;
+} arguments;
+
+// Parse a single option.
+static error_t
+parse_opt( int key, char* arg, struct argp_state* state )
+{
+    struct arguments* arguments = ( struct arguments* ) state->input;
+
+    char* tail;
+    errno = 0;
+    switch (key) {
+    case 'v':
+        arguments->verbose = strtol( arg, &tail, 0 );
+        if ( errno ) {
+            fprintf( stderr,  "Could not parse 'verbose' argument\n" );
+            return ARGP_ERR_UNKNOWN;
+        }
+        break;
+    case 'n':
+        arguments->name = arg;
+        break;
+    case 'p':
+        arguments->pid = strtol( arg, &tail, 0 );
+        if ( errno || arguments->pid <= 0 ) {
+            fprintf( stderr,  "Could not parse 'pid' argument\n" );
+            return ARGP_ERR_UNKNOWN;
+        }
+        break;
+    case 'i':
+        arguments->interval = strtol( arg, &tail, 0 );
+        if ( errno || arguments->interval < 0 ) {
+            fprintf( stderr,  "Could not parse 'interval' argument\n" );
+            return ARGP_ERR_UNKNOWN;
+        }
+        break;
+    case 'f':
+        arguments->filter = arg;
+        break;
+    default:
+        return ARGP_ERR_UNKNOWN;
+    }
+    return 0;
+}
+
+static struct argp argp = { options, parse_opt, args_doc, doc };
+
+static void
+printEntry(const ControlStateEntry *e)
+{
+    switch(e->type) {
+        case eCST_Continuous:
+            printf("%-60s %g [%g..%g]", e->path, e->value, e->minimum, e->maximum);
+            break;
+        case eCST_Discrete:
+        case eCST_MatrixCell:
+            printf("%-60s %g", e->path, e->value);
+            break;
+        case eCST_Enum:
+        case eCST_Boolean:
+            printf("%-60s %d (%s)", e->path, (int)e->value, e->text);
+            break;
+        case eCST_AttributeEnum:
+            printf("%-60s %d (%s)", e->path, (int)e->value, e->text);
+            if(e->status >= 0) {
+                printf(" %s", (e->status ? "locked" : "unlocked"));
+            }
+            break;
+        case eCST_Text:
+            printf("%-60s '%s'", e->path, e->text);
+            break;
+        default:
+            printf("%-60s ?", e->path);
+            break;
+    }
+    printf("%s\n", (e->flags & CONTROLSTATE_FLAG_LIVE ? " *" : ""));
+}
+
+///////////////////////////
+// main
+//////////////////////////
+int
+main(int argc, char **argv)
+{
+    run = 1;
+    signal (SIGINT, sighandler);
+    signal (SIGPIPE, sighandler);
+
+    if ( argp_parse ( &argp, argc, argv, 0, 0, &arguments ) ) {
+        fprintf( stderr, "Could not parse command line\n" );
+        exit(-1);
+    }
+
+    setDebugLevel(arguments.verbose);
+
+    // every process has its own segment
+    std::string name;
+    if(arguments.name) {
+        name = arguments.name;
+    } else if(arguments.pid) {
+        name = Util::PosixSharedMemory::getProcessName(CONTROLSTATE_SHM_NAME, arguments.pid);
+    } else {
+        std::vector<std::string> names = Util::PosixSharedMemory::findSegments(CONTROLSTATE_SHM_NAME);
+        if(names.size() == 0) {
+            fprintf( stderr, "No control state segment found. Is ffado-dbus-server running?\n" );
+            exit(-1);
+        }
+        if(names.size() > 1) {
+            fprintf( stderr, "More than one control state segment, select one with --pid or --name:\n" );
+            for(unsigned int i=0; i < names.size(); i++) {
+                fprintf( stderr, "  %s\n", names.at(i).c_str() );
+            }
+            exit(-1);
+        }
+        name = names.at(0);
+    }
+
+    Util::PosixSharedMemory shm(name, sizeof(ControlStateSegment));
+    shm.setVerboseLevel(arguments.verbose);
+    // read-write, since the reader heartbeat is written
+    if(!shm.Open(Util::PosixSharedMemory::eD_ReadWrite)) {
+        fprintf( stderr, "Could not open control state segment '%s'. Is ffado-dbus-server running?\n",
+                 name.c_str() );
+        exit(-1);
+    }
+    ControlStateSegment *seg = (ControlStateSegment *)shm.requestBlock(0, sizeof(ControlStateSegment));
+    if(seg == NULL) {
+        fprintf( stderr, "Could not map control state segment\n" );
+        exit(-1);
+    }
+    if(seg->magic != CONTROLSTATE_MAGIC || seg->version != CONTROLSTATE_VERSION
+       || seg->max_entries != CONTROLSTATE_MAX_ENTRIES
+       || seg->entry_size != sizeof(ControlStateEntry)) {
+        fprintf( stderr, "Control state segment '%s' has an incompatible layout\n",
+                 name.c_str() );
+        exit(-1);
+    }
+
+    // the server only reads the values from the devices while it sees a
+    // reader, wait until it did two refreshes
+    seg->reader_heartbeat++;
+    uint32_t refreshes = seg->refreshes;
+    for(int i = 0; i < 100 && seg->refreshes - refreshes < 2; i++) {
+        usleep(CONTROLSTATE_REFRESH_INTERVAL_USECS / 20);
+    }
+
+    // the change count of each entry as last printed
+    uint32_t *printed = new uint32_t[CONTROLSTATE_MAX_ENTRIES];
+    uint32_t layout = 0xFFFFFFFF;
+
+    do {
+        seg->reader_heartbeat++;
+        uint32_t layout_now = seg->layout_seq;
+        if(layout_now & 1) {
+            // the server is rebuilding the entries
+            usleep(10000);
+            continue;
+        }
+        if(layout_now != layout) {
+            printf("--- pid %u: %u controls\n", seg->pid, seg->nb_entries);
+            memset(printed, 0xFF, CONTROLSTATE_MAX_ENTRIES * sizeof(uint32_t));
+            layout = layout_now;
+        }
+        unsigned int nb_entries = seg->nb_entries;
+        for(unsigned int i=0; i < nb_entries && i < CONTROLSTATE_MAX_ENTRIES; i++) {
+            ControlStateEntry e;
+            if(!StatePublisher::readEntry(&seg->entries[i], &e)) {
+                continue;
+            }
+            // not read from the device yet
+            if(e.changes == 0) continue;
+            if(e.changes == printed[i]) continue;
+            printed[i] = e.changes;
+            e.path[CONTROLSTATE_PATH_LEN - 1] = 0;
+            e.text[CONTROLSTATE_TEXT_LEN - 1] = 0;
+            if(arguments.filter && strstr(e.path, arguments.filter) == NULL) continue;
+            printEntry(&e);
+        }
+        fflush(stdout);
+        if(arguments.interval) {
+            usleep(arguments.interval * 1000);
+        }
+    } while(run && arguments.interval);
+
+    delete[] printed;
+    return 0;
+}
@@ -0,0 +1,123 @@
+/*
+ * Copyright (C) 2005-2008 by Pieter Palmers
+ *
+ * This file is part of FFADO
+ * FFADO = Free Firewire (pro-)audio drivers for linux
+ *
+ * FFADO is based upon FreeBoB
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) version 3 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * Decodes a flight recorder dump as written on xrun.
+ */
+
+#include "config.h"
+
+#include "libutil/FlightRecorder.h"
+#include "libieee1394/cycletimer.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+using namespace Util;
+
+DECLARE_GLOBAL_DEBUG_MODULE;
+
+static const char *
+recordTypeToString(int type)
+{
+    switch(type) {
+        case FlightRecorder::eRT_Iterate: return "ITER";
+        case FlightRecorder::eRT_PutPacket: return "PUT ";
+        case FlightRecorder::eRT_GetPacket: return "GET ";
+        case FlightRecorder::eRT_Xrun: return "XRUN";
+        default: return "????";
+    }
+}
+
+static void
+printCtr(uint32_t ctr)
+{
+    if(ctr == 0xFFFFFFFF) {
+        printf("  ---:----:----");
+    } else {
+        printf("  %03u:%04u:%04u",
+               (unsigned int)CYCLE_TIMER_GET_SECS(ctr),
+               (unsigned int)CYCLE_TIMER_GET_CYCLES(ctr),
+               (unsigned int)CYCLE_TIMER_GET_OFFSET(ctr));
+    }
+}
+
+int
+main(int argc, char **argv)
+{
+    if(argc != 2) {
+        fprintf(stderr, "usage: %s <flight recorder dump>\n", argv[0]);
+        exit(-1);
+    }
+
+    FILE *f = fopen(argv[1], "r");
+    if(f == NULL) {
+        fprintf(stderr, "Could not open %s\n", argv[1]);
+        exit(-1);
+    }
+
+    struct FlightRecorderFileHeader hdr;
+    if(fread(&hdr, sizeof(hdr), 1, f) != 1
+       || hdr.magic != FLIGHTRECORDER_MAGIC
+       || hdr.version != FLIGHTRECORDER_VERSION
+       || hdr.record_size != sizeof(FlightRecord)) {
+        fprintf(stderr, "%s is not a (compatible) flight recorder dump\n", argv[1]);
+        fclose(f);
+        exit(-1);
+    }
+    hdr.name[sizeof(hdr.name)-1] = 0;
+    hdr.reason[sizeof(hdr.reason)-1] = 0;
+
+    printf("# %s: %u records, pid %u, reason '%s', taken at %llu.%06llu\n",
+           hdr.name, hdr.nb_records, hdr.pid, hdr.reason,
+           (unsigned long long)(hdr.time_usecs / 1000000ULL),
+           (unsigned long long)(hdr.time_usecs % 1000000ULL));
+    printf("#      seq type hdl  ch            now        pkt_ctr cycle drop skip  len state flags  fill  result\n");
+
+    FlightRecord r;
+    unsigned int n = 0;
+    while(n < hdr.nb_records && fread(&r, sizeof(r), 1, f) == 1) {
+        printf("%10u %s %s ", r.seq, recordTypeToString(r.type),
+               (r.handler & 0x80 ? "XMT" : "RCV"));
+        if(r.handler & 0x40) {
+            printf("  -");
+        } else {
+            printf("%3u", r.handler & 0x3F);
+        }
+        printCtr(r.now);
+        printCtr(r.pkt_ctr);
+        printf(" %5d %4u %4u %4u %5u %5s %5d %7u\n",
+               r.cycle, r.dropped, r.skipped, r.length, r.sp_state,
+               (r.flags & FlightRecorder::eRF_ClientXrun ? "X" : "-"),
+               r.buffer_fill, r.result);
+        n++;
+    }
+    fclose(f);
+
+    if(n != hdr.nb_records) {
+        fprintf(stderr, "Truncated dump: %u of %u records\n", n, hdr.nb_records);
+        exit(-1);
+    }
+    return 0;
+}
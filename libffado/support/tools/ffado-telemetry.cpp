@@ -0,0 +1,270 @@
+/*
+ * Copyright (C) 2005-2008 by Pieter Palmers
+ *
+ * This file is part of FFADO
+ * FFADO = Free Firewire (pro-)audio drivers for linux
+ *
+ * FFADO is based upon FreeBoB
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) version 3 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * Reads the streaming telemetry segment and prints percentiles.
+ * The segment is mapped read-only, the streaming threads are never
+ * touched.
+ */
+
+#include "config.h"
+
+#include "libutil/PosixSharedMemory.h"
+#include "libutil/StreamTelemetry.h"
+
+#include <argp.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+
+using namespace Util;
+
+DECLARE_GLOBAL_DEBUG_MODULE;
+
+int run;
+
+static void sighandler(int sig)
+{
+    run = 0;
+}
+
+////////////////////////////////////////////////
+// arg parsing
+////////////////////////////////////////////////
+const char *argp_program_version = "ffado-telemetry 0.1";
+const char *argp_program_bug_address = "<ffado-devel@lists.sf.net>";
+static char doc[] = "ffado-telemetry -- show the FFADO streaming telemetry.\n\n"
+                    "Prints the percentiles of the streaming histograms. When an "
+                    "interval is given, the statistics are computed over each "
+                    "interval, otherwise the totals since stream start are shown once.";
+static char args_doc[] = "";
+static struct argp_option options[] = {
+    {"verbose",   'v', "LEVEL",     0,  "Produce verbose output" },
+    {"name",      'n', "NAME",      0,  "Name of the telemetry segment" },
+    {"pid",       'p', "PID",       0,  "Process id of the telemetry segment owner" },
+    {"interval",  'i', "MSEC",      0,  "Refresh interval (0 = print once)" },
+   { 0 }
+};
+
+struct arguments
+{
+    arguments()
+        : verbose( 0 )
+        , name( NULL )
+        , pid( 0 )
+        , interval( 0 )
+        {}
+
+    long int verbose;
+    const char *name;
+    long int pid;
+    long int interval;
+} arguments;
+
+// Parse a single option.
+static error_t
+parse_opt( int key, char* arg, struct argp_state* state )
+{
+    struct arguments* arguments = ( struct arguments* ) state->input;
+
+    char* tail;
+    errno = 0;
+    switch (key) {
+    case 'v':
+        arguments->verbose = strtol( arg, &tail, 0 );
+        if ( errno ) {
+            fprintf( stderr,  "Could not parse 'verbose' argument\n" );
+            return ARGP_ERR_UNKNOWN;
+        }
+        break;
+    case 'n':
+        arguments->name = arg;
+        break;
+    case 'p':
+        arguments->pid = strtol( arg, &tail, 0 );
+        if ( errno || arguments->pid <= 0 ) {
+            fprintf( stderr,  "Could not parse 'pid' argument\n" );
+            return ARGP_ERR_UNKNOWN;
+        }
+        break;
+    case 'i':
+        arguments->interval = strtol( arg, &tail, 0 );
+        if ( errno || arguments->interval < 0 ) {
+            fprintf( stderr,  "Could not parse 'interval' argument\n" );
+            return ARGP_ERR_UNKNOWN;
+        }
+        break;
+    default:
+        return ARGP_ERR_UNKNOWN;
+    }
+    return 0;
+}
+
+static struct argp argp = { options, parse_opt, args_doc, doc };
+
+static void
+printHistogram(const char *name, const TelemetryHistogram *h, const char *unit)
+{
+    printf("   %-16s n=%-9u p50=%-7u p90=%-7u p99=%-7u p99.9=%-7u max=%-7u %s\n",
+           name, h->count,
+           StreamTelemetry::getPercentile(h, 50.0),
+           StreamTelemetry::getPercentile(h, 90.0),
+           StreamTelemetry::getPercentile(h, 99.0),
+           StreamTelemetry::getPercentile(h, 99.9),
+           h->max, unit);
+}
+
+static void
+printSegment(const TelemetrySegment *now, const TelemetrySegment *prev)
+{
+    TelemetryHistogram h;
+
+    printf("pid %u: periods: %u, xruns: %u\n", now->pid,
+           now->periods - prev->periods, now->xruns - prev->xruns);
+    StreamTelemetry::subtractHistogram(&h, &now->wake_latency, &prev->wake_latency);
+    printHistogram("wake latency", &h, "usec");
+
+    for(unsigned int i=0; i < STREAMTELEMETRY_SLOTS; i++) {
+        const TelemetryStreamSlot *s = &now->slots[i];
+        const TelemetryStreamSlot *p = &prev->slots[i];
+        if(!s->in_use) continue;
+
+        printf(" [%2u] %s, channel %d: xruns: %u, dropped: %u, skipped: %u\n",
+               i, s->name, s->channel,
+               s->xruns - p->xruns,
+               s->dropped_cycles - p->dropped_cycles,
+               s->skipped_cycles - p->skipped_cycles);
+        StreamTelemetry::subtractHistogram(&h, &s->packet_latency, &p->packet_latency);
+        printHistogram((s->type == 0 ? "packet latency" : "packet lead"), &h, "ticks");
+        StreamTelemetry::subtractHistogram(&h, &s->buffer_fill, &p->buffer_fill);
+        printHistogram("buffer fill", &h, "frames");
+        StreamTelemetry::subtractHistogram(&h, &s->dll_error, &p->dll_error);
+        printHistogram("DLL error", &h, "ticks");
+        StreamTelemetry::subtractHistogram(&h, &s->dropped, &p->dropped);
+        printHistogram("dropped", &h, "cycles/event");
+        StreamTelemetry::subtractHistogram(&h, &s->skipped, &p->skipped);
+        printHistogram("skipped", &h, "cycles/event");
+    }
+
+    for(unsigned int i=0; i < STREAMTELEMETRY_THREAD_SLOTS; i++) {
+        const TelemetryThreadSlot *s = &now->threads[i];
+        const TelemetryThreadSlot *p = &prev->threads[i];
+        if(!s->in_use) continue;
+
+        printf(" [T%u] %s: budget: %u usec, iterations: %u, overruns: %u, stalls: %u, max late: %u usec%s\n",
+               i, s->name, s->budget,
+               s->iterations - p->iterations,
+               s->overruns - p->overruns,
+               s->stalls - p->stalls,
+               s->max_lateness, (s->demoted ? ", DEMOTED" : ""));
+        StreamTelemetry::subtractHistogram(&h, &s->utilisation, &p->utilisation);
+        printHistogram("utilisation", &h, "% of budget");
+        StreamTelemetry::subtractHistogram(&h, &s->lateness, &p->lateness);
+        printHistogram("lateness", &h, "usec");
+    }
+    printf("\n");
+    fflush(stdout);
+}
+
+///////////////////////////
+// main
+//////////////////////////
+int
+main(int argc, char **argv)
+{
+    run = 1;
+    signal (SIGINT, sighandler);
+    signal (SIGPIPE, sighandler);
+
+    if ( argp_parse ( &argp, argc, argv, 0, 0, &arguments ) ) {
+        fprintf( stderr, "Could not parse command line\n" );
+        exit(-1);
+    }
+
+    setDebugLevel(arguments.verbose);
+
+    // every process has its own segment
+    std::string name;
+    if(arguments.name) {
+        name = arguments.name;
+    } else if(arguments.pid) {
+        name = PosixSharedMemory::getProcessName(STREAMTELEMETRY_SHM_NAME, arguments.pid);
+    } else {
+        std::vector<std::string> names = PosixSharedMemory::findSegments(STREAMTELEMETRY_SHM_NAME);
+        if(names.size() == 0) {
+            fprintf( stderr, "No telemetry segment found. Is streaming active?\n" );
+            exit(-1);
+        }
+        if(names.size() > 1) {
+            fprintf( stderr, "More than one telemetry segment, select one with --pid or --name:\n" );
+            for(unsigned int i=0; i < names.size(); i++) {
+                fprintf( stderr, "  %s\n", names.at(i).c_str() );
+            }
+            exit(-1);
+        }
+        name = names.at(0);
+    }
+
+    PosixSharedMemory shm(name, sizeof(TelemetrySegment));
+    shm.setVerboseLevel(arguments.verbose);
+    if(!shm.Open(PosixSharedMemory::eD_ReadOnly)) {
+        fprintf( stderr, "Could not open telemetry segment '%s'. Is streaming active?\n",
+                 name.c_str() );
+        exit(-1);
+    }
+    TelemetrySegment *seg = (TelemetrySegment *)shm.requestBlock(0, sizeof(TelemetrySegment));
+    if(seg == NULL) {
+        fprintf( stderr, "Could not map telemetry segment\n" );
+        exit(-1);
+    }
+    if(seg->magic != STREAMTELEMETRY_MAGIC || seg->version != STREAMTELEMETRY_VERSION
+       || seg->nb_slots != STREAMTELEMETRY_SLOTS || seg->nb_buckets != STREAMTELEMETRY_NB_BUCKETS
+       || seg->nb_thread_slots != STREAMTELEMETRY_THREAD_SLOTS) {
+        fprintf( stderr, "Telemetry segment '%s' has an incompatible layout\n",
+                 name.c_str() );
+        exit(-1);
+    }
+
+    // snapshots, such that the computations are done on stable data
+    TelemetrySegment *now = new TelemetrySegment;
+    TelemetrySegment *prev = new TelemetrySegment;
+    memset(prev, 0, sizeof(TelemetrySegment));
+
+    do {
+        memcpy(now, (const void *)seg, sizeof(TelemetrySegment));
+        printSegment(now, prev);
+        if(arguments.interval) {
+            TelemetrySegment *tmp = prev;
+            prev = now;
+            now = tmp;
+            usleep(arguments.interval * 1000);
+        }
+    } while(run && arguments.interval);
+
+    delete now;
+    delete prev;
+    return 0;
+}
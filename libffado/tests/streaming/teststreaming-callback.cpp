@@ -0,0 +1,379 @@
+/*
+ * Copyright (C) 2005-2008 by Pieter Palmers
+ *
+ * This file is part of FFADO
+ * FFADO = Free Firewire (pro-)audio drivers for linux
+ *
+ * FFADO is based upon FreeBoB.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) version 3 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+/**
+ * Test application for the library driven period loop,
+ * see ffado_streaming_set_process_callback()
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <signal.h>
+
+#include "libffado/ffado.h"
+
+#include "debugmodule/debugmodule.h"
+
+#include <math.h>
+#include <argp.h>
+
+volatile int run;
+
+DECLARE_GLOBAL_DEBUG_MODULE;
+
+// Program documentation.
+static char doc[] = "FFADO -- a driver for Firewire Audio devices (process callback test application)\n\n"
+                    ;
+
+// A description of the arguments we accept.
+static char args_doc[] = "";
+
+struct arguments
+{
+    long int verbose;
+    long int test_tone;
+    long int test_tone_freq;
+    long int period;
+    long int nb_buffers;
+    long int sample_rate;
+    long int rtprio;
+    long int nb_periods;
+    char* args[2];
+    
+};
+
+// The options we understand.
+static struct argp_option options[] = {
+    {"verbose",  'v', "level",    0,  "Verbose level" },
+    {"rtprio",  'P', "prio",  0,  "Realtime priority of the period thread (0 = no RT scheduling)" },
+    {"test-tone",  't', "bool",  0,  "Output test sine" },
+    {"test-tone-freq",  'f', "hz",  0,  "Test sine frequency" },
+    {"samplerate",  'r', "hz",  0,  "Sample rate" },
+    {"period",  'p', "frames",  0,  "Period (buffer) size" },
+    {"nb_buffers",  'n', "nb",  0,  "Nb buffers (periods)" },
+    {"countdown",  'c', "periods",  0,  "Stop after this many periods (0 = run until interrupted)" },
+    { 0 }
+};
+
+//-------------------------------------------------------------
+
+// Parse a single option.
+static error_t
+parse_opt( int key, char* arg, struct argp_state* state )
+{
+    // Get the input argument from `argp_parse', which we
+    // know is a pointer to our arguments structure.
+    struct arguments* arguments = ( struct arguments* ) state->input;
+    char* tail;
+
+    errno = 0;
+    switch (key) {
+    case 'v':
+        if (arg) {
+            arguments->verbose = strtol( arg, &tail, 0 );
+            if ( errno ) {
+                fprintf( stderr,  "Could not parse 'verbose' argument\n" );
+                return ARGP_ERR_UNKNOWN;
+            }
+        }
+        break;
+    case 'P':
+        if (arg) {
+            arguments->rtprio = strtol( arg, &tail, 0 );
+            if ( errno ) {
+                fprintf( stderr,  "Could not parse 'rtprio' argument\n" );
+                return ARGP_ERR_UNKNOWN;
+            }
+        }
+        break;
+    case 'p':
+        if (arg) {
+            arguments->period = strtol( arg, &tail, 0 );
+            if ( errno ) {
+                fprintf( stderr,  "Could not parse 'period' argument\n" );
+                return ARGP_ERR_UNKNOWN;
+            }
+        }
+        break;
+    case 'n':
+        if (arg) {
+            arguments->nb_buffers = strtol( arg, &tail, 0 );
+            if ( errno ) {
+                fprintf( stderr,  "Could not parse 'nb_buffers' argument\n" );
+                return ARGP_ERR_UNKNOWN;
+            }
+        }
+        break;
+    case 'r':
+        if (arg) {
+            arguments->sample_rate = strtol( arg, &tail, 0 );
+            if ( errno ) {
+                fprintf( stderr,  "Could not parse 'samplerate' argument\n" );
+                return ARGP_ERR_UNKNOWN;
+            }
+        }
+        break;
+    case 't':
+        if (arg) {
+            arguments->test_tone = strtol( arg, &tail, 0 );
+            if ( errno ) {
+                fprintf( stderr,  "Could not parse 'test-tone' argument\n" );
+                return ARGP_ERR_UNKNOWN;
+            }
+        }
+        break;
+    case 'f':
+        if (arg) {
+            arguments->test_tone_freq = strtol( arg, &tail, 0 );
+            if ( errno ) {
+                fprintf( stderr,  "Could not parse 'test-tone-freq' argument\n" );
+                return ARGP_ERR_UNKNOWN;
+            }
+        }
+        break;
+    case 'c':
+        if (arg) {
+            arguments->nb_periods = strtol( arg, &tail, 0 );
+            if ( errno ) {
+                fprintf( stderr,  "Could not parse 'countdown' argument\n" );
+                return ARGP_ERR_UNKNOWN;
+            }
+        }
+        break;
+    case ARGP_KEY_ARG:
+        break;
+    case ARGP_KEY_END:
+        break;
+    default:
+        return ARGP_ERR_UNKNOWN;
+    }
+    return 0;
+}
+
+// Our argp parser.
+static struct argp argp = { options, parse_opt, args_doc, doc };
+
+// the state shared with the process callback
+struct process_state
+{
+    int period;
+    int nb_in_channels;
+    int nb_out_channels;
+    float **audiobuffers_in;
+    float **audiobuffers_out;
+    int test_tone;
+    float sine_advance;
+    float frame_counter;
+    long int periods_left;
+    volatile int done;
+};
+
+static void sighandler (int sig)
+{
+    run = 0;
+}
+
+/*
+ * Called by the period thread of the library. The capture buffers are
+ * filled when it is called, the playback buffers are sent as soon as it
+ * returns. It must not block.
+ */
+static int process(ffado_device_t *dev, ffado_wait_response response, void *arg)
+{
+    struct process_state *state = (struct process_state *)arg;
+    int i, j;
+
+    if (response == ffado_wait_xrun) {
+        // the library has already recovered, the buffers are not transferred
+        return 0;
+    } else if (response != ffado_wait_ok) {
+        // shutdown or error, this is the last call
+        state->done = 1;
+        return -1;
+    }
+
+    if (state->test_tone) {
+        for (i=0; i < state->nb_out_channels; i++) {
+            if (ffado_streaming_get_playback_stream_type(dev,i) != ffado_stream_type_audio) continue;
+            for (j=0; j < state->period; j++) {
+                state->audiobuffers_out[i][j] = 0.97 * sin(state->sine_advance * (state->frame_counter + (float)j));
+            }
+        }
+        state->frame_counter += state->period;
+    } else {
+        // loop the captured audio back
+        for (i=0; i < state->nb_in_channels && i < state->nb_out_channels; i++) {
+            if (ffado_streaming_get_capture_stream_type(dev,i) == ffado_stream_type_audio
+                && ffado_streaming_get_playback_stream_type(dev,i) == ffado_stream_type_audio) {
+                memcpy(state->audiobuffers_out[i], state->audiobuffers_in[i], sizeof(float) * state->period);
+            }
+        }
+    }
+
+    if (state->periods_left > 0 && --state->periods_left == 0) {
+        // stop the period thread, the main thread stops the streaming
+        state->done = 1;
+        return 1;
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+
+    struct arguments arguments;
+
+    // Default values.
+    arguments.test_tone         = 0;
+    arguments.test_tone_freq    = 1000;
+    arguments.verbose           = 6;
+    arguments.period            = 1024;
+    arguments.nb_buffers        = 3;
+    arguments.sample_rate       = 44100;
+    arguments.rtprio            = 0;
+    arguments.nb_periods        = 0;
+    
+    // Parse our arguments; every option seen by `parse_opt' will
+    // be reflected in `arguments'.
+    if ( argp_parse ( &argp, argc, argv, 0, 0, &arguments ) ) {
+        debugError("Could not parse command line\n" );
+        return -1;
+    }
+
+    debugOutput(DEBUG_LEVEL_NORMAL, "verbose level = %d\n", (int)arguments.verbose);
+    setDebugLevel(arguments.verbose);
+
+    int i=0;
+    struct process_state state;
+    memset(&state, 0, sizeof(state));
+
+    run=1;
+
+    debugOutput(DEBUG_LEVEL_NORMAL, "FFADO process callback test application\n");
+
+    signal (SIGINT, sighandler);
+    signal (SIGPIPE, sighandler);
+
+    ffado_device_info_t device_info;
+    memset(&device_info,0,sizeof(ffado_device_info_t));
+
+    ffado_options_t dev_options;
+    memset(&dev_options,0,sizeof(ffado_options_t));
+
+    dev_options.sample_rate = arguments.sample_rate;
+    dev_options.period_size = arguments.period;
+
+    dev_options.nb_buffers = arguments.nb_buffers;
+
+    // the period thread runs at this priority
+    dev_options.realtime = (arguments.rtprio != 0);
+    dev_options.packetizer_priority = arguments.rtprio;
+    
+    dev_options.verbose = arguments.verbose;
+
+    ffado_device_t *dev=ffado_streaming_init(device_info, dev_options);
+
+    if (!dev) {
+        debugError("Could not init Ffado Streaming layer\n");
+        exit(-1);
+    }
+    ffado_streaming_set_audio_datatype(dev, ffado_audio_datatype_float);
+
+    state.period = arguments.period;
+    state.nb_in_channels = ffado_streaming_get_nb_capture_streams(dev);
+    state.nb_out_channels = ffado_streaming_get_nb_playback_streams(dev);
+    state.test_tone = arguments.test_tone;
+    state.sine_advance = 2.0*M_PI*arguments.test_tone_freq/((float)dev_options.sample_rate);
+    state.periods_left = arguments.nb_periods;
+
+    /* allocate the buffers, only the audio streams are used */
+    state.audiobuffers_in = (float **)calloc(state.nb_in_channels, sizeof(float *));
+    for (i=0; i < state.nb_in_channels; i++) {
+        state.audiobuffers_in[i] = (float *)calloc(arguments.period+1, sizeof(float));
+        if (ffado_streaming_get_capture_stream_type(dev,i) == ffado_stream_type_audio) {
+            ffado_streaming_set_capture_stream_buffer(dev, i, (char *)(state.audiobuffers_in[i]));
+            ffado_streaming_capture_stream_onoff(dev, i, 1);
+        }
+    }
+
+    state.audiobuffers_out = (float **)calloc(state.nb_out_channels, sizeof(float *));
+    for (i=0; i < state.nb_out_channels; i++) {
+        state.audiobuffers_out[i] = (float *)calloc(arguments.period+1, sizeof(float));
+        if (ffado_streaming_get_playback_stream_type(dev,i) == ffado_stream_type_audio) {
+            ffado_streaming_set_playback_stream_buffer(dev, i, (char *)(state.audiobuffers_out[i]));
+            ffado_streaming_playback_stream_onoff(dev, i, 1);
+        }
+    }
+
+    // has to be set before the streaming is started
+    if (ffado_streaming_set_process_callback(dev, process, &state)) {
+        debugFatal("Could not set the process callback\n");
+        ffado_streaming_finish(dev);
+        return -1;
+    }
+
+    if (ffado_streaming_prepare(dev)) {
+        debugFatal("Could not prepare streaming system\n");
+        ffado_streaming_finish(dev);
+        return -1;
+    }
+    if (ffado_streaming_start(dev)) {
+        debugFatal("Could not start streaming system\n");
+        ffado_streaming_finish(dev);
+        return -1;
+    }
+
+    // the library runs the period loop, this thread only waits for the end
+    debugOutput(DEBUG_LEVEL_NORMAL, "Streaming (IN: %d, OUT: %d)\n", state.nb_in_channels, state.nb_out_channels);
+    while(run && !state.done) {
+        usleep(100000);
+    }
+
+    ffado_process_stats_t stats;
+    if (ffado_streaming_get_process_stats(dev, &stats) == 0) {
+        debugOutput(DEBUG_LEVEL_NORMAL, "%d periods, %d xruns\n", stats.periods, stats.xruns);
+        debugOutput(DEBUG_LEVEL_NORMAL, " latency: min %d, avg %d, max %d usecs\n",
+                    stats.latency_min, stats.latency_avg, stats.latency_max);
+        debugOutput(DEBUG_LEVEL_NORMAL, " process: avg %d, max %d usecs\n",
+                    stats.process_avg, stats.process_max);
+    }
+
+    ffado_streaming_stop(dev);
+    ffado_streaming_finish(dev);
+
+    for (i=0;i<state.nb_in_channels;i++) {
+        free(state.audiobuffers_in[i]);
+    }
+    for (i=0;i<state.nb_out_channels;i++) {
+        free(state.audiobuffers_out[i]);
+    }
+    free(state.audiobuffers_in);
+    free(state.audiobuffers_out);
+
+  return EXIT_SUCCESS;
+}
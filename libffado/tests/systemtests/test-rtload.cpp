@@ -0,0 +1,733 @@
+/*
+ * Copyright (C) 2005-2008 by Pieter Palmers
+ *
+ * This file is part of FFADO
+ * FFADO = Free Firewire (pro-)audio drivers for linux
+ *
+ * FFADO is based upon FreeBoB
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) version 3 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * Realtime load characterization
+ *
+ * Runs the streaming threads while load threads keep the CPUs busy, for
+ * every combination of a list of load levels, period sizes and channel
+ * counts. Each configuration results in one CSV line on stdout with the
+ * wakeup latency percentiles of the period thread, the number of xruns
+ * and the headroom that is left in the period. The log goes to stderr.
+ *
+ * Backends:
+ *  - hardware: streams to the first device found through the library's
+ *    streaming API, i.e. the IsoTask, the CycleTimerHelper and the period
+ *    wait of the library are measured. The device clock is not the system
+ *    clock, so the latency is relative to a DLL estimate of the period
+ *    boundaries (as jackd does).
+ *  - simulated: no device needed. An iso thread wakes at every packet
+ *    interrupt and (de)multiplexes the packets, and signals the period
+ *    thread when a period is complete, the way the IsoTask signals the
+ *    period wait. The latency is relative to the exact period boundary.
+ */
+
+#include <stdio.h>
+#include <errno.h>
+#include <unistd.h>
+#include <signal.h>
+#include <semaphore.h>
+#include <math.h>
+
+#include <argp.h>
+
+#ifndef __STDC_FORMAT_MACROS
+#define __STDC_FORMAT_MACROS
+#endif
+#include <inttypes.h>
+
+#include "libffado/ffado.h"
+
+#include "debugmodule/debugmodule.h"
+#include "libutil/PosixThread.h"
+#include "libutil/SystemTimeSource.h"
+#include "libstreaming/util/SampleConversion.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <algorithm>
+
+DECLARE_GLOBAL_DEBUG_MODULE;
+
+#define MAX_EXTRA_ARGS 2
+// Program documentation.
+static char doc[] = "FFADO -- realtime load characterization\n\n"
+                    "Writes one CSV line per configuration to stdout.\n";
+
+// A description of the arguments we accept.
+static char args_doc[] = "";
+
+struct arguments
+{
+    long int verbose;
+    long int rtprio;
+    long int hardware;
+    long int sample_rate;
+    long int nb_buffers;
+    long int duration;
+    long int load_threads;
+    long int load_rtprio;
+    long int load_period;
+    long int irq_interval;
+    char* loads;
+    char* periods;
+    char* channels;
+    char* args[MAX_EXTRA_ARGS];
+};
+
+// The options we understand.
+static struct argp_option options[] = {
+    {"verbose",  'v', "level",    0,  "Verbose level" },
+    {"rtprio",  'P', "prio",  0,  "real time priority of the streaming threads" },
+    {"hardware",  'H', "bool",  0,  "use a real device instead of the simulated backend" },
+    {"samplerate",  'r', "hz",  0,  "sample rate" },
+    {"nb_buffers",  'n', "nb",  0,  "number of periods of buffering" },
+    {"duration",  'd', "secs",  0,  "run time per configuration" },
+    {"loads",  'l', "list",  0,  "CPU loads to sweep (in percent, comma separated)" },
+    {"periods",  'p', "list",  0,  "period sizes to sweep (in frames, comma separated)" },
+    {"channels",  'c', "list",  0,  "channel counts to sweep (comma separated)" },
+    {"load_threads",  't', "nb",  0,  "number of load threads (0 = one per CPU)" },
+    {"load_rtprio",  'L', "prio",  0,  "real time priority of the load threads (0 = no RT)" },
+    {"load_period",  'T', "usecs",  0,  "period of the load pulses" },
+    {"irq_interval",  'i', "packets",  0,  "packets per interrupt of the simulated iso thread" },
+    { 0 }
+};
+
+// Parse a single option.
+#define PARSE_ARG_LONG(XXletterXX, XXvarXX, XXdescXX) \
+    case XXletterXX: \
+        if (arg) { \
+            XXvarXX = strtol( arg, &tail, 0 ); \
+            if ( errno ) { \
+                fprintf( stderr,  "Could not parse '%s' argument\n", XXdescXX ); \
+                return ARGP_ERR_UNKNOWN; \
+            } \
+        } \
+        break;
+
+static error_t
+parse_opt( int key, char* arg, struct argp_state* state )
+{
+    // Get the input argument from `argp_parse', which we
+    // know is a pointer to our arguments structure.
+    struct arguments* arguments = ( struct arguments* ) state->input;
+    char* tail;
+
+    errno = 0;
+    switch (key) {
+    PARSE_ARG_LONG('v', arguments->verbose, "verbose");
+    PARSE_ARG_LONG('P', arguments->rtprio, "rtprio");
+    PARSE_ARG_LONG('H', arguments->hardware, "hardware");
+    PARSE_ARG_LONG('r', arguments->sample_rate, "samplerate");
+    PARSE_ARG_LONG('n', arguments->nb_buffers, "nb_buffers");
+    PARSE_ARG_LONG('d', arguments->duration, "duration");
+    PARSE_ARG_LONG('t', arguments->load_threads, "load_threads");
+    PARSE_ARG_LONG('L', arguments->load_rtprio, "load_rtprio");
+    PARSE_ARG_LONG('T', arguments->load_period, "load_period");
+    PARSE_ARG_LONG('i', arguments->irq_interval, "irq_interval");
+    case 'l':
+        arguments->loads = arg;
+        break;
+    case 'p':
+        arguments->periods = arg;
+        break;
+    case 'c':
+        arguments->channels = arg;
+        break;
+    case ARGP_KEY_ARG:
+        break;
+    case ARGP_KEY_END:
+        break;
+    default:
+        return ARGP_ERR_UNKNOWN;
+    }
+    return 0;
+}
+
+// Our argp parser.
+static struct argp argp = { options, parse_opt, args_doc, doc };
+
+// the global arguments struct
+struct arguments arguments;
+
+// signal handler
+int run;
+static void sighandler (int sig)
+{
+    run = 0;
+}
+
+static std::vector<long int>
+parse_list(const char *s)
+{
+    std::vector<long int> v;
+    const char *p = s;
+    while (p && *p) {
+        char *tail;
+        errno = 0;
+        long int x = strtol(p, &tail, 0);
+        if (errno || tail == p) {
+            fprintf(stderr, "Could not parse list '%s'\n", s);
+            v.clear();
+            return v;
+        }
+        v.push_back(x);
+        p = (*tail == ',' ? tail + 1 : tail);
+    }
+    return v;
+}
+
+// the load function
+static volatile float global;
+static void load_function() {
+    int cnt = 10;
+    while(cnt--) {
+        int global_int = (int)global;
+        global = global / 7.0;
+        global_int++;
+        global += (float)global_int;
+    }
+}
+
+/**
+ * Keeps a CPU busy for a percentage of every load period
+ */
+class LoadGenerator : public Util::RunnableInterface
+{
+public:
+    LoadGenerator(unsigned int period)
+        : m_period( period )
+        , m_pct( 0 )
+        , m_next( 0 )
+        {};
+
+    void setLoad(unsigned int pct) {m_pct = pct;};
+
+    bool Init() {
+        m_next = Util::SystemTimeSource::getCurrentTimeAsUsecs();
+        return true;
+    }
+    bool Execute() {
+        ffado_microsecs_t busy_until = m_next + m_period * m_pct / 100;
+        while(Util::SystemTimeSource::getCurrentTimeAsUsecs() < busy_until) {
+            load_function();
+        }
+        m_next += m_period;
+        ffado_microsecs_t now = Util::SystemTimeSource::getCurrentTimeAsUsecs();
+        if (m_next < now) {
+            // don't try to catch up
+            m_next = now;
+        } else {
+            Util::SystemTimeSource::SleepUsecAbsolute(m_next);
+        }
+        return true;
+    }
+
+private:
+    ffado_microsecs_t m_period;
+    volatile unsigned int m_pct;
+    ffado_microsecs_t m_next;
+};
+
+/**
+ * The measurements of one configuration
+ */
+struct Result
+{
+    Result() : proc_max( 0 ), periods( 0 ), xruns( 0 ) {};
+
+    void reserve(unsigned int n) {
+        latency.reserve(n);
+        busy.reserve(n);
+    }
+    void add(int64_t lat, int64_t proc) {
+        latency.push_back(lat);
+        busy.push_back((lat > 0 ? lat : 0) + proc);
+        if (proc > proc_max) proc_max = proc;
+        periods++;
+    }
+
+    std::vector<int64_t> latency;
+    std::vector<int64_t> busy;
+    int64_t proc_max;
+    unsigned int periods;
+    unsigned int xruns;
+};
+
+static int64_t
+percentile(std::vector<int64_t> &v, double pct)
+{
+    if (v.empty()) return 0;
+    size_t idx = (size_t)(pct / 100.0 * (v.size() - 1) + 0.5);
+    return v.at(idx);
+}
+
+static void
+print_header()
+{
+    printf("backend,load_pct,period,channels,sample_rate,periods,xruns,"
+           "lat_p50_us,lat_p90_us,lat_p99_us,lat_p999_us,lat_max_us,"
+           "proc_max_us,headroom_pct\n");
+    fflush(stdout);
+}
+
+static void
+print_result(const char *backend, long int load, long int period,
+             long int channels, Result &r)
+{
+    double period_usecs = 1e6 * period / arguments.sample_rate;
+
+    std::sort(r.latency.begin(), r.latency.end());
+    std::sort(r.busy.begin(), r.busy.end());
+    int64_t busy_max = (r.busy.empty() ? 0 : r.busy.back());
+    double headroom = 100.0 * (period_usecs - busy_max) / period_usecs;
+
+    printf("%s,%ld,%ld,%ld,%ld,%u,%u,"
+           "%" PRId64 ",%" PRId64 ",%" PRId64 ",%" PRId64 ",%" PRId64 ","
+           "%" PRId64 ",%.1f\n",
+           backend, load, period, channels, arguments.sample_rate,
+           r.periods, r.xruns,
+           percentile(r.latency, 50.0), percentile(r.latency, 90.0),
+           percentile(r.latency, 99.0), percentile(r.latency, 99.9),
+           (r.latency.empty() ? 0 : r.latency.back()),
+           r.proc_max, headroom);
+    fflush(stdout);
+}
+
+// -- the simulated backend
+
+/**
+ * The shared state of the simulated iso and period threads
+ */
+class Simulation
+{
+public:
+    Simulation(unsigned int period, unsigned int channels)
+        : m_period( period )
+        , m_channels( channels )
+        , m_start( 0 )
+        , m_periods_signalled( 0 )
+        , m_stop( false )
+    {
+        sem_init(&m_period_sem, 0, 0);
+        m_period_usecs = 1e6 * period / arguments.sample_rate;
+        m_irq_usecs = 125 * arguments.irq_interval;
+        m_frames_per_irq = (double)arguments.sample_rate * m_irq_usecs / 1e6;
+        m_packet_frames = (unsigned int)ceil(m_frames_per_irq / arguments.irq_interval);
+
+        m_packet = new uint32_t[m_packet_frames * channels];
+        m_decoded = new float[m_packet_frames * channels];
+        m_client = new float[period * channels];
+        m_encoded = new uint32_t[period * channels];
+        memset(m_packet, 0, m_packet_frames * channels * sizeof(uint32_t));
+        memset(m_decoded, 0, m_packet_frames * channels * sizeof(float));
+        memset(m_client, 0, period * channels * sizeof(float));
+        memset(m_encoded, 0, period * channels * sizeof(uint32_t));
+    }
+    ~Simulation()
+    {
+        sem_destroy(&m_period_sem);
+        delete[] m_packet;
+        delete[] m_decoded;
+        delete[] m_client;
+        delete[] m_encoded;
+    }
+
+    unsigned int        m_period;
+    unsigned int        m_channels;
+    double              m_period_usecs;
+    ffado_microsecs_t   m_irq_usecs;
+    double              m_frames_per_irq;
+    unsigned int        m_packet_frames;
+
+    ffado_microsecs_t   m_start;
+    volatile unsigned int m_periods_signalled;
+    volatile bool       m_stop;
+    sem_t               m_period_sem;
+
+    // the sample buffers the work is done on
+    uint32_t*           m_packet;
+    float*              m_decoded;
+    float*              m_client;
+    uint32_t*           m_encoded;
+
+    Result              m_result;
+};
+
+/**
+ * Emulates the IsoTask: wakes at every interrupt and handles the packets
+ * that arrived, signals the period thread at the period boundaries.
+ */
+class IsoEmulator : public Util::RunnableInterface
+{
+public:
+    IsoEmulator(Simulation &sim)
+        : m_sim( sim )
+        , m_irq( 0 )
+        {};
+
+    bool Execute() {
+        m_irq++;
+        Util::SystemTimeSource::SleepUsecAbsolute(m_sim.m_start + m_irq * m_sim.m_irq_usecs);
+        if (m_sim.m_stop) return false;
+
+        // demultiplex the packets of this interrupt
+        unsigned int nb_samples = m_sim.m_packet_frames * m_sim.m_channels;
+        for (int p = 0; p < arguments.irq_interval; p++) {
+            for (unsigned int i = 0; i < nb_samples; i++) {
+                m_sim.m_decoded[i] = Streaming::SampleFloat::fromInt24(
+                    ((int32_t)(m_sim.m_packet[i] << 8)) >> 8);
+            }
+        }
+
+        // signal the periods that are complete
+        unsigned int complete = (unsigned int)(m_irq * m_sim.m_frames_per_irq / m_sim.m_period);
+        while (m_sim.m_periods_signalled < complete) {
+            m_sim.m_periods_signalled++;
+            sem_post(&m_sim.m_period_sem);
+        }
+        return true;
+    }
+
+private:
+    Simulation &m_sim;
+    unsigned int m_irq;
+};
+
+/**
+ * Emulates the period wait loop: waits for a period to be signalled,
+ * then decodes and encodes the client buffers.
+ */
+class PeriodLoop : public Util::RunnableInterface
+{
+public:
+    PeriodLoop(Simulation &sim, unsigned int skip)
+        : m_sim( sim )
+        , m_n( 0 )
+        , m_skip( skip )
+        {};
+
+    bool Execute() {
+        sem_wait(&m_sim.m_period_sem);
+        if (m_sim.m_stop) return false;
+        ffado_microsecs_t wake = Util::SystemTimeSource::getCurrentTimeAsUsecs();
+        m_n++;
+
+        // the frames of the period are converted once in each direction
+        unsigned int nb_samples = m_sim.m_period * m_sim.m_channels;
+        for (unsigned int i = 0; i < nb_samples; i++) {
+            m_sim.m_client[i] = Streaming::SampleFloat::fromInt24(
+                ((int32_t)(m_sim.m_encoded[i] << 8)) >> 8);
+        }
+        for (unsigned int i = 0; i < nb_samples; i++) {
+            m_sim.m_encoded[i] = Streaming::SampleFloatClipped::toInt24(m_sim.m_client[i]);
+        }
+        ffado_microsecs_t done = Util::SystemTimeSource::getCurrentTimeAsUsecs();
+
+        if (m_n <= m_skip) return true;
+
+        double boundary = m_sim.m_start + m_n * m_sim.m_period_usecs;
+        double deadline = boundary + (arguments.nb_buffers - 1) * m_sim.m_period_usecs;
+        if (done > deadline) {
+            m_sim.m_result.xruns++;
+        }
+        m_sim.m_result.add((int64_t)(wake - boundary), (int64_t)(done - wake));
+        return true;
+    }
+
+private:
+    Simulation &m_sim;
+    unsigned int m_n;
+    unsigned int m_skip;
+};
+
+static bool
+run_simulated(long int period, long int channels, Result &result)
+{
+    Simulation sim(period, channels);
+    unsigned int nb_periods = arguments.duration * arguments.sample_rate / period;
+    unsigned int skip = arguments.sample_rate / period / 2; // settle for half a second
+    sim.m_result.reserve(nb_periods);
+
+    IsoEmulator iso(sim);
+    PeriodLoop loop(sim, skip);
+    // the iso thread runs above the period thread, as in the library
+    Util::PosixThread iso_thread(&iso, "ISO", arguments.rtprio > 0,
+                                 arguments.rtprio + 1, PTHREAD_CANCEL_DEFERRED);
+    Util::PosixThread loop_thread(&loop, "PERIOD", arguments.rtprio > 0,
+                                  arguments.rtprio, PTHREAD_CANCEL_DEFERRED);
+
+    sim.m_start = Util::SystemTimeSource::getCurrentTimeAsUsecs() + 10000;
+    if (loop_thread.Start() != 0 || iso_thread.Start() != 0) {
+        debugError("Could not start the streaming threads\n");
+        sim.m_stop = true;
+        sem_post(&sim.m_period_sem);
+        loop_thread.Stop();
+        iso_thread.Stop();
+        return false;
+    }
+
+    ffado_microsecs_t end = sim.m_start + arguments.duration * 1000000LL;
+    while (run && Util::SystemTimeSource::getCurrentTimeAsUsecs() < end) {
+        Util::SystemTimeSource::SleepUsecRelative(100000);
+    }
+
+    sim.m_stop = true;
+    iso_thread.Stop();
+    sem_post(&sim.m_period_sem);
+    loop_thread.Stop();
+
+    result = sim.m_result;
+    return true;
+}
+
+// -- the hardware backend
+
+static bool
+run_hardware(long int period, long int channels, Result &result)
+{
+    ffado_device_info_t device_info;
+    memset(&device_info, 0, sizeof(ffado_device_info_t));
+
+    ffado_options_t dev_options;
+    memset(&dev_options, 0, sizeof(ffado_options_t));
+    dev_options.sample_rate = arguments.sample_rate;
+    dev_options.period_size = period;
+    dev_options.nb_buffers = arguments.nb_buffers;
+    dev_options.realtime = (arguments.rtprio != 0);
+    dev_options.packetizer_priority = arguments.rtprio;
+    dev_options.verbose = arguments.verbose;
+
+    ffado_device_t *dev = ffado_streaming_init(device_info, dev_options);
+    if (!dev) {
+        debugError("Could not init the streaming layer\n");
+        return false;
+    }
+    ffado_streaming_set_audio_datatype(dev, ffado_audio_datatype_float);
+
+    // enable the first channels of each direction
+    std::vector<float> buffers(2 * channels * period);
+    int nb_in = ffado_streaming_get_nb_capture_streams(dev);
+    int nb_out = ffado_streaming_get_nb_playback_streams(dev);
+    int enabled = 0;
+    for (int i = 0; i < nb_in; i++) {
+        bool on = (enabled < channels
+                   && ffado_streaming_get_capture_stream_type(dev, i) == ffado_stream_type_audio);
+        if (on) {
+            ffado_streaming_set_capture_stream_buffer(dev, i, (char *)&buffers[enabled * period]);
+            enabled++;
+        }
+        ffado_streaming_capture_stream_onoff(dev, i, on);
+    }
+    enabled = 0;
+    for (int i = 0; i < nb_out; i++) {
+        bool on = (enabled < channels
+                   && ffado_streaming_get_playback_stream_type(dev, i) == ffado_stream_type_audio);
+        if (on) {
+            ffado_streaming_set_playback_stream_buffer(dev, i, (char *)&buffers[(channels + enabled) * period]);
+            enabled++;
+        }
+        ffado_streaming_playback_stream_onoff(dev, i, on);
+    }
+    if (enabled < channels) {
+        debugWarning("Device has only %d playback channels\n", enabled);
+    }
+
+    if (ffado_streaming_prepare(dev) || ffado_streaming_start(dev)) {
+        debugError("Could not start streaming\n");
+        ffado_streaming_finish(dev);
+        return false;
+    }
+
+    double period_usecs = 1e6 * period / arguments.sample_rate;
+    unsigned int nb_periods = arguments.duration * arguments.sample_rate / period;
+    unsigned int skip = arguments.sample_rate / period / 2;
+    result.reserve(nb_periods);
+
+    // second order DLL on the wakeup times, the estimated period
+    // boundaries are the reference for the latency
+    double omega = 2.0 * M_PI * 1.0 * period_usecs / 1e6;
+    double b = sqrt(2.0) * omega;
+    double c = omega * omega;
+    double next_boundary = 0, e2 = period_usecs;
+
+    unsigned int n = 0;
+    while (run && n < nb_periods + skip) {
+        ffado_wait_response response = ffado_streaming_wait(dev);
+        ffado_microsecs_t wake = Util::SystemTimeSource::getCurrentTimeAsUsecs();
+        if (response == ffado_wait_xrun) {
+            result.xruns++;
+            ffado_streaming_reset(dev);
+            next_boundary = 0;
+            continue;
+        } else if (response != ffado_wait_ok) {
+            debugError("Error while waiting for a period\n");
+            break;
+        }
+
+        ffado_streaming_transfer_capture_buffers(dev);
+        // loop the capture channels to the playback channels
+        memcpy(&buffers[channels * period], &buffers[0], channels * period * sizeof(float));
+        ffado_streaming_transfer_playback_buffers(dev);
+        ffado_microsecs_t done = Util::SystemTimeSource::getCurrentTimeAsUsecs();
+
+        double e = 0;
+        if (next_boundary == 0) {
+            next_boundary = wake + period_usecs;
+            e2 = period_usecs;
+        } else {
+            e = wake - next_boundary;
+            next_boundary += b * e + e2;
+            e2 += c * e;
+        }
+
+        if (++n > skip) {
+            result.add((int64_t)e, (int64_t)(done - wake));
+        }
+    }
+
+    ffado_streaming_stop(dev);
+    ffado_streaming_finish(dev);
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    // register signal handler
+    run = 1;
+    signal (SIGINT, sighandler);
+    signal (SIGPIPE, sighandler);
+
+    // Default values.
+    arguments.verbose = DEBUG_LEVEL_NORMAL;
+    arguments.rtprio = 60;
+    arguments.hardware = 0;
+    arguments.sample_rate = 48000;
+    arguments.nb_buffers = 2;
+    arguments.duration = 10;
+    arguments.load_threads = 0;
+    arguments.load_rtprio = 0;
+    arguments.load_period = 1000;
+    arguments.irq_interval = 8;
+    arguments.loads = (char *)"0,25,50,75,90";
+    arguments.periods = (char *)"64,128,256,512";
+    arguments.channels = (char *)"2,8,16";
+
+    // Parse our arguments; every option seen by `parse_opt' will
+    // be reflected in `arguments'.
+    if ( argp_parse ( &argp, argc, argv, 0, 0, &arguments ) ) {
+        debugError("Could not parse command line\n" );
+        return -1;
+    }
+    setDebugLevel(arguments.verbose);
+
+    std::vector<long int> loads = parse_list(arguments.loads);
+    std::vector<long int> periods = parse_list(arguments.periods);
+    std::vector<long int> channels = parse_list(arguments.channels);
+    if (loads.empty() || periods.empty() || channels.empty()
+        || arguments.sample_rate <= 0 || arguments.nb_buffers < 2
+        || arguments.irq_interval <= 0 || arguments.duration <= 0) {
+        debugError("Invalid arguments\n");
+        return -1;
+    }
+
+    long int nb_load_threads = arguments.load_threads;
+    if (nb_load_threads <= 0) {
+        nb_load_threads = sysconf(_SC_NPROCESSORS_ONLN);
+        if (nb_load_threads <= 0) nb_load_threads = 1;
+    }
+
+    debugOutput(DEBUG_LEVEL_INFO, "Realtime load characterization\n");
+    debugOutput(DEBUG_LEVEL_INFO, " Backend      : %s\n", arguments.hardware ? "hardware" : "simulated");
+    debugOutput(DEBUG_LEVEL_INFO, " RT priority  : %ld\n", arguments.rtprio);
+    debugOutput(DEBUG_LEVEL_INFO, " Sample rate  : %ld\n", arguments.sample_rate);
+    debugOutput(DEBUG_LEVEL_INFO, " Buffers      : %ld\n", arguments.nb_buffers);
+    debugOutput(DEBUG_LEVEL_INFO, " Duration     : %ld sec per configuration\n", arguments.duration);
+    debugOutput(DEBUG_LEVEL_INFO, " Load threads : %ld (prio %ld, period %ld usec)\n",
+                nb_load_threads, arguments.load_rtprio, arguments.load_period);
+    flushDebugOutput();
+
+    // start the load threads, idle until the first configuration
+    std::vector<LoadGenerator *> generators;
+    std::vector<Util::PosixThread *> load_threads;
+    for (long int i = 0; i < nb_load_threads; i++) {
+        LoadGenerator *g = new LoadGenerator(arguments.load_period);
+        Util::PosixThread *t = new Util::PosixThread(g, "LOAD", arguments.load_rtprio > 0,
+                                                     arguments.load_rtprio, PTHREAD_CANCEL_DEFERRED);
+        if (t->Start() != 0) {
+            debugError("Could not start load thread %ld\n", i);
+            delete t;
+            delete g;
+            break;
+        }
+        generators.push_back(g);
+        load_threads.push_back(t);
+    }
+
+    print_header();
+    const char *backend = (arguments.hardware ? "hardware" : "simulated");
+    int retval = 0;
+
+    for (unsigned int l = 0; run && l < loads.size(); l++) {
+        for (unsigned int i = 0; i < generators.size(); i++) {
+            generators.at(i)->setLoad(loads.at(l));
+        }
+        for (unsigned int p = 0; run && p < periods.size(); p++) {
+            for (unsigned int c = 0; run && c < channels.size(); c++) {
+                debugOutput(DEBUG_LEVEL_INFO, "load %ld%%, period %ld, %ld channels...\n",
+                            loads.at(l), periods.at(p), channels.at(c));
+                flushDebugOutput();
+
+                Result result;
+                bool ok;
+                if (arguments.hardware) {
+                    ok = run_hardware(periods.at(p), channels.at(c), result);
+                } else {
+                    ok = run_simulated(periods.at(p), channels.at(c), result);
+                }
+                if (!ok) {
+                    retval = -1;
+                    run = 0;
+                    break;
+                }
+                if (run) {
+                    print_result(backend, loads.at(l), periods.at(p), channels.at(c), result);
+                }
+            }
+        }
+    }
+
+    for (unsigned int i = 0; i < load_threads.size(); i++) {
+        load_threads.at(i)->Stop();
+        delete load_threads.at(i);
+        delete generators.at(i);
+    }
+
+    if(run) {
+        debugOutput(DEBUG_LEVEL_INFO, "Clean exit...\n");
+    } else {
+        debugOutput(DEBUG_LEVEL_INFO, "Forced exit...\n");
+    }
+    return retval;
+}
@@ -0,0 +1,244 @@
+/*
+ * Copyright (C) 2005-2008 by Pieter Palmers
+ *
+ * This file is part of FFADO
+ * FFADO = Free Firewire (pro-)audio drivers for linux
+ *
+ * FFADO is based upon FreeBoB.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) version 3 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * Streams with the bus reset fast path enabled and issues bus
+ * resets on the port, which should not cause an xrun as long as the
+ * devices keep their connections.
+ */
+
+#include "config.h"
+
+#include "debugmodule/debugmodule.h"
+#include "devicemanager.h"
+#include "libutil/Configuration.h"
+#include "libstreaming/StreamProcessorManager.h"
+
+#include <libraw1394/raw1394.h>
+
+#include <argp.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+DECLARE_GLOBAL_DEBUG_MODULE;
+
+int run;
+
+static void sighandler (int sig)
+{
+    run = 0;
+}
+
+// Program documentation.
+static char doc[] = "FFADO -- bus reset fast path test\n\n"
+                    "Streams from all devices and issues bus resets.\n"
+                    "Fails if a reset causes an xrun.\n";
+
+// A description of the arguments we accept.
+static char args_doc[] = "";
+
+struct arguments
+{
+    long int verbose;
+    long int port;
+    long int period;
+    long int sample_rate;
+    long int nb_resets;
+    long int interval;
+};
+
+// The options we understand.
+static struct argp_option options[] = {
+    {"verbose",  'v', "level",    0,  "Verbose level" },
+    {"port",     'p', "nr",       0,  "IEEE1394 port to reset" },
+    {"period",   'b', "frames",   0,  "Period (buffer) size" },
+    {"samplerate", 'r', "hz",     0,  "Sample rate" },
+    {"resets",   'n', "nb",       0,  "Number of bus resets" },
+    {"interval", 'i', "periods",  0,  "Periods between the bus resets" },
+    { 0 }
+};
+
+//-------------------------------------------------------------
+
+// Parse a single option.
+static error_t
+parse_opt( int key, char* arg, struct argp_state* state )
+{
+    // Get the input argument from `argp_parse', which we
+    // know is a pointer to our arguments structure.
+    struct arguments* arguments = ( struct arguments* ) state->input;
+    long int *value;
+
+    switch (key) {
+    case 'v': value = &arguments->verbose; break;
+    case 'p': value = &arguments->port; break;
+    case 'b': value = &arguments->period; break;
+    case 'r': value = &arguments->sample_rate; break;
+    case 'n': value = &arguments->nb_resets; break;
+    case 'i': value = &arguments->interval; break;
+    case ARGP_KEY_ARG:
+    case ARGP_KEY_END:
+        return 0;
+    default:
+        return ARGP_ERR_UNKNOWN;
+    }
+    if (arg) {
+        char* tail;
+        errno = 0;
+        *value = strtol( arg, &tail, 0 );
+        if ( errno ) {
+            fprintf( stderr,  "Could not parse '%c' argument\n", key );
+            return ARGP_ERR_UNKNOWN;
+        }
+    }
+    return 0;
+}
+
+// Our argp parser.
+static struct argp argp = { options, parse_opt, args_doc, doc };
+
+int
+main(int argc, char **argv)
+{
+    struct arguments arguments;
+
+    // Default values.
+    arguments.verbose       = DEBUG_LEVEL_NORMAL;
+    arguments.port          = 0;
+    arguments.period        = 512;
+    arguments.sample_rate   = 48000;
+    arguments.nb_resets     = 5;
+    arguments.interval      = 500;
+
+    // Parse our arguments; every option seen by `parse_opt' will
+    // be reflected in `arguments'.
+    if ( argp_parse ( &argp, argc, argv, 0, 0, &arguments ) ) {
+        fprintf( stderr, "Could not parse command line\n" );
+        return -1;
+    }
+    setDebugLevel(arguments.verbose);
+
+    run = 1;
+    signal (SIGINT, sighandler);
+
+    // enable the fast path, whatever the user and system configuration say
+    char config_name[] = "/tmp/ffado-test-busreset-XXXXXX";
+    int fd = mkstemp(config_name);
+    if (fd < 0) {
+        debugError("Could not create the configuration file\n");
+        return -1;
+    }
+    const char *config = "ieee1394 = {\n  busreset_fast_path = 1;\n};\n";
+    if (write(fd, config, strlen(config)) != (ssize_t)strlen(config)) {
+        debugError("Could not write the configuration file\n");
+        close(fd);
+        unlink(config_name);
+        return -1;
+    }
+    close(fd);
+
+    raw1394handle_t handle = raw1394_new_handle_on_port(arguments.port);
+    if (!handle) {
+        debugError("Could not get a handle on port %ld\n", arguments.port);
+        unlink(config_name);
+        return -1;
+    }
+
+    DeviceManager *m_deviceManager = new DeviceManager();
+    m_deviceManager->setVerboseLevel(arguments.verbose);
+    // files opened first take precedence
+    m_deviceManager->getConfiguration().openFile(config_name, Util::Configuration::eFM_ReadOnly);
+
+    int retval = -1;
+    if ( !m_deviceManager->setStreamingParams(arguments.period, arguments.sample_rate, 3) ) {
+        debugError("Could not set the streaming parameters\n");
+        goto out;
+    }
+    if ( !m_deviceManager->initialize() ) {
+        debugError("Could not initialize device manager\n");
+        goto out;
+    }
+    if ( !m_deviceManager->discover() ) {
+        debugError("Could not discover devices\n");
+        goto out;
+    }
+    if ( m_deviceManager->getAvDeviceCount() == 0 ) {
+        debugError("No devices found\n");
+        goto out;
+    }
+    if ( !m_deviceManager->initStreaming() || !m_deviceManager->prepareStreaming() ) {
+        debugError("Could not prepare streaming\n");
+        goto out;
+    }
+    if ( !m_deviceManager->startStreaming() ) {
+        debugError("Could not start streaming\n");
+        goto out;
+    }
+
+    {
+        long int periods = 0;
+        long int resets = 0;
+        long int xruns = 0;
+        Streaming::StreamProcessorManager &spm = m_deviceManager->getStreamProcessorManager();
+        while (run && resets <= arguments.nb_resets) {
+            enum DeviceManager::eWaitResult result = m_deviceManager->waitForPeriod();
+            if (result == DeviceManager::eWR_Xrun) {
+                printMessage("Xrun after %ld bus resets\n", resets);
+                xruns++;
+                continue;
+            } else if (result != DeviceManager::eWR_OK) {
+                debugError("Streaming stopped after %ld bus resets\n", resets);
+                xruns++;
+                break;
+            }
+            spm.transfer();
+            if (++periods % arguments.interval == 0) {
+                if (resets < arguments.nb_resets) {
+                    debugOutput(DEBUG_LEVEL_NORMAL, "Bus reset %ld\n", resets + 1);
+                    if (raw1394_reset_bus(handle)) {
+                        debugError("Could not reset the bus\n");
+                        break;
+                    }
+                }
+                resets++;
+            }
+        }
+        m_deviceManager->stopStreaming();
+        m_deviceManager->finishStreaming();
+
+        printMessage("%ld periods, %ld bus resets, %ld xruns\n", periods, resets, xruns);
+        if (run && resets > arguments.nb_resets) {
+            retval = (xruns == 0 ? 0 : 1);
+            printMessage("%s\n", (retval == 0 ? "PASS" : "FAIL"));
+        }
+    }
+
+out:
+    delete m_deviceManager;
+    raw1394_destroy_handle(handle);
+    unlink(config_name);
+    return retval;
+}
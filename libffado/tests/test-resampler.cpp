@@ -0,0 +1,158 @@
+/*
+ * Copyright (C) 2005-2008 by Pieter Palmers
+ *
+ * This file is part of FFADO
+ * FFADO = Free Firewire (pro-)audio drivers for linux
+ *
+ * FFADO is based upon FreeBoB
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) version 3 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "config.h"
+
+#include "debugmodule/debugmodule.h"
+
+DECLARE_GLOBAL_DEBUG_MODULE;
+
+#include "libstreaming/util/Resampler.h"
+#include "libstreaming/generic/PortManager.h"
+#include "libstreaming/generic/Port.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+using namespace Streaming;
+
+#define PERIOD          256
+#define NB_PERIODS      64
+// the input is decoded in chunks of at most a period, like the SP does
+#define MAX_CHUNK       (PERIOD & ~0x7)
+// a 1kHz sine at 48kHz, well inside the passband of the filter
+#define SINE_W          (2.0 * M_PI / 48.0)
+#define MIDI_INTERVAL   100
+// the filter needs its history before the output is meaningful
+#define SKIP_FRAMES     (2 * STREAMPROCESSOR_RESAMPLER_HALF_TAPS)
+#define MAX_ERROR       0.001
+
+/**
+ * Feeds a sine and regular MIDI events through a receive resampler running
+ * at a fixed ratio, the way StreamProcessor::getFramesResampled() does,
+ * and checks that the output follows the input at the new rate.
+ */
+static bool
+testReceive(double ratio)
+{
+    PortManager pm;
+    AudioPort *audio = new AudioPort(pm, "audio", Port::E_Capture);
+    MidiPort *midi = new MidiPort(pm, "midi", Port::E_Capture);
+    audio->enable();
+    midi->enable();
+
+    float client_audio[PERIOD];
+    uint32_t client_midi[PERIOD];
+    audio->setBufferAddress(client_audio);
+    midi->setBufferAddress(client_midi);
+
+    ClockDomain domain(ratio);
+    Resampler r(pm, true, domain);
+    if (!r.init(PERIOD, StreamProcessorManager::eADT_Float)) {
+        printMessage("Could not init resampler\n");
+        return false;
+    }
+
+    unsigned int nb_in = 0;
+    unsigned int nb_out = 0;
+    unsigned int nb_events_in = 0;
+    unsigned int nb_events_out = 0;
+    double max_error = 0.0;
+    double max_event_error = 0.0;
+    for (unsigned int period = 0; period < NB_PERIODS; period++) {
+        unsigned int needed = r.getFramesNeeded(PERIOD);
+        unsigned int done = 0;
+        while (done < needed) {
+            unsigned int chunk = needed - done;
+            if (chunk > MAX_CHUNK) chunk = MAX_CHUNK;
+            r.attachPorts(done);
+            // decode
+            float *a = (float *)audio->getBufferAddress();
+            uint32_t *m = (uint32_t *)midi->getBufferAddress();
+            for (unsigned int i = 0; i < chunk; i++) {
+                a[i] = sin(SINE_W * nb_in);
+                m[i] = (nb_in % MIDI_INTERVAL == 0 ? 0x01000000 | (nb_in / MIDI_INTERVAL) : 0);
+                if (m[i]) nb_events_in++;
+                nb_in++;
+            }
+            done += chunk;
+        }
+        r.detachPorts();
+        r.processRead(PERIOD, needed);
+
+        for (unsigned int i = 0; i < PERIOD; i++, nb_out++) {
+            // output frame n is input frame n * ratio
+            double expected_pos = nb_out * ratio;
+            if (nb_out >= SKIP_FRAMES) {
+                double err = fabs(client_audio[i] - sin(SINE_W * expected_pos));
+                if (err > max_error) max_error = err;
+            }
+            if (client_midi[i]) {
+                double in_pos = (double)((client_midi[i] & 0xFFFFFF) * MIDI_INTERVAL);
+                double err = fabs(in_pos - expected_pos);
+                if (err > max_event_error) max_event_error = err;
+                nb_events_out++;
+            }
+        }
+    }
+
+    printMessage("ratio %f: %u frames in, %u out, max error %f, "
+                 "%u/%u events, max event offset %f frames\n",
+                 ratio, nb_in, nb_out, max_error,
+                 nb_events_out, nb_events_in, max_event_error);
+
+    delete audio;
+    delete midi;
+
+    bool ok = true;
+    if (max_error > MAX_ERROR) {
+        printMessage(" FAIL: output does not follow the input\n");
+        ok = false;
+    }
+    // the events of the last period can still be in the history
+    if (nb_events_out + PERIOD / MIDI_INTERVAL + 1 < nb_events_in) {
+        printMessage(" FAIL: events lost\n");
+        ok = false;
+    }
+    // the nearest output frame, at the input rate
+    if (max_event_error > ratio) {
+        printMessage(" FAIL: events not aligned with the audio\n");
+        ok = false;
+    }
+    return ok;
+}
+
+int
+main(int argc, char **argv)
+{
+    setDebugLevel(DEBUG_LEVEL_NORMAL);
+
+    bool ok = true;
+    ok &= testReceive(1.0);
+    ok &= testReceive(1.0 + STREAMPROCESSOR_RESAMPLER_MAX_RATIO_DEVIATION / 2);
+    ok &= testReceive(1.0 - STREAMPROCESSOR_RESAMPLER_MAX_RATIO_DEVIATION / 2);
+
+    printMessage("%s\n", ok ? "PASS" : "FAIL");
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
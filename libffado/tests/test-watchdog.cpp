@@ -49,13 +49,15 @@ class HangTask : public Util::RunnableInterface
 public:
     HangTask(unsigned int time_usecs, unsigned int nb_hangs) 
         : m_time( time_usecs )
-        , m_nb_hangs(nb_hangs) {};
+        , m_nb_hangs(nb_hangs)
+        , m_deadline( NULL ) {};
     virtual ~HangTask() {};
 
     bool Init() {return true;};
     bool Execute() {
         debugOutput(DEBUG_LEVEL_VERBOSE, "execute\n");
         ffado_microsecs_t start = Util::SystemTimeSource::getCurrentTimeAsUsecs();
+        if (m_deadline) m_deadline->begin(start);
         ffado_microsecs_t stop_at = start + m_time;
         int cnt;
         int dummyvar = 0;
@@ -66,6 +68,7 @@ public:
 
         // ensure that dummyvar doesn't get optimized away
         bool always_true = (dummyvar + Util::SystemTimeSource::getCurrentTimeAsUsecs() != 0);
+        if (m_deadline) m_deadline->end();
 
         bool stop = (m_nb_hangs == 0);
         m_nb_hangs--;
@@ -78,7 +81,7 @@ public:
     };
     unsigned int m_time;
     unsigned int m_nb_hangs;
-
+    ThreadDeadline *m_deadline;
 };
 
 int run;
@@ -177,8 +180,9 @@ int main(int argc, char *argv[])
     PosixThread *thread2 = new Util::PosixThread(task2, true, 10, PTHREAD_CANCEL_DEFERRED);
     thread2->setVerboseLevel(arguments.verbose);
 
-    w->registerThread(thread1);
-    w->registerThread(thread2);
+    // both have a budget of 20ms
+    task1->m_deadline = w->registerThread("thread1", thread1, 1000*20, ThreadDeadline::eDP_OnStall);
+    task2->m_deadline = w->registerThread("thread2", thread2, 1000*20, ThreadDeadline::eDP_OnStall);
 
     // start the watchdog
     w->start();
@@ -194,12 +198,13 @@ int main(int argc, char *argv[])
     // wait for a while
     Util::SystemTimeSource::SleepUsecRelative(1000*1000*5);
 
+    w->show();
 
     thread1->Stop();
     thread2->Stop();
 
-    w->unregisterThread(thread1);
-    w->unregisterThread(thread2);
+    w->unregisterThread(task1->m_deadline);
+    w->unregisterThread(task2->m_deadline);
 
     delete thread1;
     delete thread2;